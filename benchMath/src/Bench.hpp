@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Math.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//
+// Small Google-Benchmark style harness: BENCHMARK(fn) registers a function
+// taking a BenchState, the state loop is repeated until the run takes long
+// enough to time, and results are reported as time per iteration and items
+// per second. CHECK(fn) registers a bool() correctness check that runs
+// before the benchmarks.
+//
+// Shared by two suites: benchMath (math, geometry, spatial queries and
+// animation) and benchRender (the CPU side of the renderer and of the
+// texture code, nothing that needs a GL context).
+//
+
+class BenchState
+{
+private:
+    u64 iterations;
+    u64 remaining;
+    u64 items;
+
+public:
+    explicit BenchState(u64 count) : iterations(count), remaining(count), items(0) {}
+
+    bool KeepRunning()
+    {
+        if (remaining == 0)
+            return false;
+        --remaining;
+        return true;
+    }
+
+    u64 Iterations() const { return iterations; }
+    void SetItemsProcessed(u64 count) { items = count; }
+    u64 ItemsProcessed() const { return items; }
+};
+
+typedef void (*BenchFunction)(BenchState &state);
+typedef bool (*CheckFunction)();
+
+struct BenchEntry
+{
+    const char *name;
+    BenchFunction function;
+};
+
+struct CheckEntry
+{
+    const char *name;
+    CheckFunction function;
+};
+
+std::vector<BenchEntry> &GetBenchmarks();
+std::vector<CheckEntry> &GetChecks();
+
+struct BenchRegister
+{
+    BenchRegister(const char *name, BenchFunction function) { GetBenchmarks().push_back({name, function}); }
+    BenchRegister(const char *name, CheckFunction function) { GetChecks().push_back({name, function}); }
+};
+
+#define BENCHMARK(fn) static BenchRegister bench_register_##fn(#fn, (BenchFunction)fn)
+#define CHECK(fn) static BenchRegister check_register_##fn(#fn, (CheckFunction)fn)
+
+template <typename T>
+inline void DoNotOptimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+inline void ClobberMemory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif
+}
+
+// test data of a file, built on first use and shared by its checks and
+// benchmarks (the untimed warm-up run of main builds it)
+template <typename T>
+inline T &Fixture()
+{
+    static T data;
+    return data;
+}
+
+inline float RandomFloat(float min, float max)
+{
+    return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+inline Mat4 RandomTransform()
+{
+    Vec3 axis(RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(0.1f, 1.0f));
+    Quat rotation(axis, RandomFloat(-3.0f, 3.0f));
+    Mat4 m = rotation.toMat4();
+    m = Mat4::Scale(m, Vec3(RandomFloat(0.5f, 2.0f), RandomFloat(0.5f, 2.0f), RandomFloat(0.5f, 2.0f)));
+    m.m[12] = RandomFloat(-100.0f, 100.0f);
+    m.m[13] = RandomFloat(-100.0f, 100.0f);
+    m.m[14] = RandomFloat(-100.0f, 100.0f);
+    return m;
+}
+
+inline bool NearlyEqual(float a, float b, float tolerance)
+{
+    return std::fabs(a - b) <= tolerance * (1.0f + std::fabs(a) + std::fabs(b));
+}
@@ -0,0 +1,237 @@
+#include "Bench.hpp"
+#include "Animation.hpp"
+
+//
+// Keyframe sampling and skinning: a 64 joint skeleton (8 chains of 8) with a
+// 4 second, 30 fps clip keyed on every joint and channel.
+//
+
+static const int ANIM_JOINTS = 64;
+static const int ANIM_CHAIN = 8;
+static const int ANIM_KEYS = 121;
+static const float ANIM_DURATION = 4.0f;
+static const int ANIM_CHARACTERS = 300;
+static const int ANIM_VERTICES = 10000;
+
+struct AnimationSet
+{
+    Skeleton skeleton;
+    AnimationClip clip;
+    CompressedClip compressed;
+    Pose pose;
+    AnimationCursor cursor;
+    std::vector<Mat4> model;
+    std::vector<Mat4> skin;
+    std::vector<Vec3> positions;
+    std::vector<Vec3> normals;
+    std::vector<Vec4> weights;
+    std::vector<Vec4> joints;
+    std::vector<Vec3> outPositions;
+    std::vector<Vec3> outNormals;
+
+    AnimationSet() : clip(ANIM_JOINTS, ANIM_DURATION), model(ANIM_JOINTS), skin(ANIM_JOINTS), positions(ANIM_VERTICES), normals(ANIM_VERTICES),
+                     weights(ANIM_VERTICES), joints(ANIM_VERTICES), outPositions(ANIM_VERTICES), outNormals(ANIM_VERTICES)
+    {
+        for (int j = 0; j < ANIM_JOINTS; ++j)
+        {
+            const int parent = j % ANIM_CHAIN == 0 ? -1 : j - 1;
+            const Vec3 offset = parent < 0 ? Vec3((float)(j / ANIM_CHAIN), 0.0f, 0.0f) : Vec3(0.0f, 0.5f, 0.0f);
+            skeleton.AddJoint("joint" + std::to_string(j), parent, offset, Quat(0.0f, 0.0f, 0.0f, 1.0f));
+        }
+        skeleton.ComputeInverseBindMatrices();
+
+        // smooth motion with a little noise, so the reducer keeps some keys
+        for (int j = 0; j < ANIM_JOINTS; ++j)
+        {
+            const float phase = j * 0.37f;
+            const Vec3 bind = skeleton.GetBindPose().translations[j];
+            for (int k = 0; k < ANIM_KEYS; ++k)
+            {
+                const float t = ANIM_DURATION * k / (ANIM_KEYS - 1);
+                const float wave = sinf(t * 2.0f + phase);
+                clip.AddTranslationKey(j, t, bind + Vec3(0.0f, 0.05f * wave, 0.0f));
+                const Vec3 axis = Vec3(sinf(phase), 1.0f, cosf(phase)).normal();
+                clip.AddRotationKey(j, t, Quat(axis, 0.8f * wave + RandomFloat(-0.0002f, 0.0002f)));
+                clip.AddScaleKey(j, t, Vec3(1.0f, 1.0f, 1.0f));
+            }
+        }
+        compressed.Build(clip);
+        pose = skeleton.GetBindPose();
+
+        for (int v = 0; v < ANIM_VERTICES; ++v)
+        {
+            positions[v] = Vec3(RandomFloat(-1, 8), RandomFloat(0, 4), RandomFloat(-1, 1));
+            normals[v] = Vec3(RandomFloat(-1, 1), RandomFloat(-1, 1), RandomFloat(0.1f, 1)).normal();
+            const int j = (int)RandomFloat(0, ANIM_JOINTS - 1);
+            const float w = RandomFloat(0.5f, 1.0f);
+            joints[v] = Vec4((float)j, (float)(j + 1), 0.0f, 0.0f);
+            weights[v] = Vec4(w, 1.0f - w, 0.0f, 0.0f);
+        }
+    }
+};
+
+static float rotationError(const Quat &a, const Quat &b)
+{
+    const float d = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+    return 2.0f * acosf(Min(d, 1.0f));
+}
+
+static bool CheckAnimationCompression()
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+    if (d.compressed.GetMemorySize() * 4 > d.clip.GetMemorySize())
+        return false;
+
+    // random times (cursor seeks backwards) and a forward sweep
+    Pose raw = d.skeleton.GetBindPose(), packed = raw;
+    AnimationCursor cursor;
+    for (int s = 0; s < 400; ++s)
+    {
+        const float time = s < 200 ? RandomFloat(0.0f, ANIM_DURATION) : ANIM_DURATION * (s - 200) / 199.0f;
+        d.clip.Sample(time, raw);
+        d.compressed.Sample(time, packed, cursor);
+        for (int j = 0; j < ANIM_JOINTS; ++j)
+        {
+            // budget plus quantization and the error of the quantized time
+            if (rotationError(raw.rotations[j], packed.rotations[j]) > 0.002f)
+                return false;
+            if ((raw.translations[j] - packed.translations[j]).length() > 0.002f || (raw.scales[j] - packed.scales[j]).length() > 0.002f)
+                return false;
+        }
+    }
+
+    // channels whose first key comes after the clip start hold it, and so
+    // do the ones past their last key
+    AnimationClip late(1, 2.0f);
+    late.AddTranslationKey(0, 0.5f, Vec3(1.0f, 0.0f, 0.0f));
+    late.AddTranslationKey(0, 1.5f, Vec3(3.0f, 2.0f, 0.0f));
+    late.AddRotationKey(0, 0.8f, Quat(Vec3(0.0f, 1.0f, 0.0f), 0.5f));
+    late.AddRotationKey(0, 1.2f, Quat(Vec3(0.0f, 1.0f, 0.0f), 1.5f));
+    late.AddScaleKey(0, 0.5f, Vec3(1.0f, 1.0f, 1.0f));
+    late.AddScaleKey(0, 1.0f, Vec3(2.0f, 2.0f, 2.0f));
+    CompressedClip lateCompressed;
+    lateCompressed.Build(late);
+    Pose lateRaw, latePacked;
+    lateRaw.Resize(1);
+    latePacked.Resize(1);
+    AnimationCursor lateCursor;
+    const float times[] = {0.0f, 0.3f, 0.7f, 1.0f, 1.4f, 1.9f, 2.0f};
+    for (float time : times)
+    {
+        late.Sample(time, lateRaw);
+        lateCompressed.Sample(time, latePacked, lateCursor);
+        if (rotationError(lateRaw.rotations[0], latePacked.rotations[0]) > 0.002f ||
+            (lateRaw.translations[0] - latePacked.translations[0]).length() > 0.002f || (lateRaw.scales[0] - latePacked.scales[0]).length() > 0.002f)
+            return false;
+    }
+    return true;
+}
+CHECK(CheckAnimationCompression);
+
+static bool CheckSkinning()
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+
+    // the bind pose skins to identity
+    d.skeleton.ComputeSkinMatrices(d.skeleton.GetBindPose(), d.model.data(), d.skin.data());
+    const Mat4 identity = Mat4::Identity();
+    for (int j = 0; j < ANIM_JOINTS; ++j)
+        for (int e = 0; e < 16; ++e)
+            if (!NearlyEqual(d.skin[j].m[e], identity.m[e], 1e-4f))
+                return false;
+
+    // animated pose against the weighted sum of transformed points
+    d.compressed.Sample(1.3f, d.pose, d.cursor);
+    d.skeleton.ComputeSkinMatrices(d.pose, d.model.data(), d.skin.data());
+    SkinVertices(d.skin.data(), d.positions.data(), d.normals.data(), d.weights.data(), d.joints.data(), 256, d.outPositions.data(), d.outNormals.data());
+    for (int v = 0; v < 256; ++v)
+    {
+        Vec3 expected(0.0f, 0.0f, 0.0f);
+        for (int k = 0; k < 2; ++k)
+        {
+            Vec3 p = d.positions[v];
+            d.skin[(int)(&d.joints[v].x)[k]].transformPoint(p);
+            expected += p * (&d.weights[v].x)[k];
+        }
+        if ((expected - d.outPositions[v]).length() > 1e-4f || !NearlyEqual(d.outNormals[v].length(), 1.0f, 1e-4f))
+            return false;
+    }
+
+    Skeleton broken;
+    return broken.AddJoint("orphan", 3, Vec3(0.0f, 0.0f, 0.0f), Quat(0.0f, 0.0f, 0.0f, 1.0f)) == -1;
+}
+CHECK(CheckSkinning);
+
+static void BM_AnimationSampleRaw(BenchState &state)
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+    float time = 0.0f;
+    while (state.KeepRunning())
+    {
+        d.clip.Sample(time, d.pose);
+        time = time + 1.0f / 60.0f > ANIM_DURATION ? 0.0f : time + 1.0f / 60.0f;
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANIM_JOINTS);
+}
+BENCHMARK(BM_AnimationSampleRaw);
+
+static void BM_AnimationSampleCompressed(BenchState &state)
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+    float time = 0.0f;
+    while (state.KeepRunning())
+    {
+        d.compressed.Sample(time, d.pose, d.cursor);
+        time = time + 1.0f / 60.0f > ANIM_DURATION ? 0.0f : time + 1.0f / 60.0f;
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANIM_JOINTS);
+}
+BENCHMARK(BM_AnimationSampleCompressed);
+
+static void BM_AnimationSkinMatrices(BenchState &state)
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+    while (state.KeepRunning())
+    {
+        d.skeleton.ComputeSkinMatrices(d.pose, d.model.data(), d.skin.data());
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANIM_JOINTS);
+}
+BENCHMARK(BM_AnimationSkinMatrices);
+
+// a crowd: every character at its own time with its own cursor
+static void BM_AnimationCrowd(BenchState &state)
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+    std::vector<AnimationCursor> cursors(ANIM_CHARACTERS);
+    std::vector<float> times(ANIM_CHARACTERS);
+    for (int c = 0; c < ANIM_CHARACTERS; ++c)
+        times[c] = RandomFloat(0.0f, ANIM_DURATION);
+    while (state.KeepRunning())
+    {
+        for (int c = 0; c < ANIM_CHARACTERS; ++c)
+        {
+            times[c] = times[c] + 1.0f / 60.0f > ANIM_DURATION ? 0.0f : times[c] + 1.0f / 60.0f;
+            d.compressed.Sample(times[c], d.pose, cursors[c]);
+            d.skeleton.ComputeSkinMatrices(d.pose, d.model.data(), d.skin.data());
+        }
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANIM_CHARACTERS);
+}
+BENCHMARK(BM_AnimationCrowd);
+
+static void BM_SkinVertices(BenchState &state)
+{
+    AnimationSet &d = Fixture<AnimationSet>();
+    while (state.KeepRunning())
+    {
+        SkinVertices(d.skin.data(), d.positions.data(), d.normals.data(), d.weights.data(), d.joints.data(), ANIM_VERTICES, d.outPositions.data(), d.outNormals.data());
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANIM_VERTICES);
+}
+BENCHMARK(BM_SkinVertices);
@@ -0,0 +1,246 @@
+#include "Bench.hpp"
+#include "Mesh.hpp"
+
+//
+// MeshBVH queries against brute force Ray::intersectTriangle over every triangle.
+//
+
+static const int GRID = 256;
+static const unsigned int RAY_COUNT = 4096;
+
+struct BVHSet
+{
+    std::vector<Vec3> vertices;
+    std::vector<u32> indices;
+    std::vector<Ray> rays;
+    std::vector<RayHit> hits;
+    MeshBVH bvh;
+
+    BVHSet() : hits(RAY_COUNT)
+    {
+        // rolling terrain like grid, GRID x GRID quads
+        for (int z = 0; z <= GRID; ++z)
+            for (int x = 0; x <= GRID; ++x)
+                vertices.push_back(Vec3((float)x, 8.0f * sinf(x * 0.05f) * cosf(z * 0.07f) + RandomFloat(0.0f, 0.5f), (float)z));
+        for (int z = 0; z < GRID; ++z)
+        {
+            for (int x = 0; x < GRID; ++x)
+            {
+                u32 i = z * (GRID + 1) + x;
+                indices.push_back(i);
+                indices.push_back(i + GRID + 1);
+                indices.push_back(i + 1);
+                indices.push_back(i + 1);
+                indices.push_back(i + GRID + 1);
+                indices.push_back(i + GRID + 2);
+            }
+        }
+
+        // a fan of rays from above, neighbours are coherent like picking / visibility rays
+        for (unsigned int i = 0; i < RAY_COUNT; ++i)
+        {
+            float fx = (float)(i % 64) / 63.0f, fz = (float)(i / 64) / 63.0f;
+            Vec3 origin(GRID * 0.5f, 40.0f, -20.0f);
+            Vec3 target(fx * GRID, 0.0f, fz * GRID);
+            rays.push_back(Ray(origin, target - origin));
+        }
+
+        bvh.Build(vertices.data(), indices.data(), indices.size() / 3);
+    }
+
+    bool bruteForce(const Ray &ray, float &best, u32 &triangle) const
+    {
+        bool found = false;
+        best = M_INFINITY;
+        for (u32 i = 0; i < indices.size(); i += 3)
+        {
+            float t;
+            Triangle tri(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+            if (ray.intersectTriangle(tri, t) && t > Epsilon && t < best)
+            {
+                best = t;
+                triangle = i / 3;
+                found = true;
+            }
+        }
+        return found;
+    }
+};
+
+static bool CheckBVHClosestHit()
+{
+    BVHSet &d = Fixture<BVHSet>();
+    for (unsigned int i = 0; i < RAY_COUNT; i += 37)
+    {
+        float t;
+        u32 triangle = 0;
+        bool expected = d.bruteForce(d.rays[i], t, triangle);
+        RayHit hit;
+        bool found = d.bvh.Intersect(d.rays[i], hit);
+        if (found != expected)
+            return false;
+        if (found && !NearlyEqual(hit.t, t, 1e-5f))
+            return false;
+        if (found && d.bvh.Occluded(d.rays[i], hit.t * 0.5f))
+            return false;
+        if (found != d.bvh.Occluded(d.rays[i]))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckBVHClosestHit);
+
+static bool CheckBVHPacket()
+{
+    BVHSet &d = Fixture<BVHSet>();
+    d.bvh.Intersect(d.rays.data(), d.hits.data(), RAY_COUNT - 3);
+    for (unsigned int i = 0; i < RAY_COUNT - 3; ++i)
+    {
+        RayHit hit;
+        bool found = d.bvh.Intersect(d.rays[i], hit, 1e6f);
+        // both overloads report a miss the same way
+        if (found != (d.hits[i].t != M_INFINITY) || found != (hit.t != M_INFINITY))
+            return false;
+        if (found && (d.hits[i].triangle != hit.triangle || !NearlyEqual(d.hits[i].t, hit.t, 1e-6f)))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckBVHPacket);
+
+static u32 treeDepth(const std::vector<BVHNode> &nodes, u32 index)
+{
+    const BVHNode &node = nodes[index];
+    if (node.count > 0)
+        return 0;
+    return 1 + Max(treeDepth(nodes, node.leftFirst), treeDepth(nodes, node.leftFirst + 1));
+}
+
+// a coplanar strip with exponentially growing spacing (SAH peels it a few
+// triangles per level) plus a stack of duplicates; also built with a tiny
+// depth cap, so queries run through leaves cut short by the cap
+static bool CheckBVHDegenerate()
+{
+    const u32 stripCount = 400;
+    const u32 duplicateCount = 200;
+    std::vector<Vec3> vertices;
+    std::vector<u32> indices;
+    std::vector<Ray> rays;
+    for (u32 i = 0; i < stripCount; ++i)
+    {
+        const float x = powf(1.15f, (float)i);
+        const float size = x * 0.01f;
+        vertices.push_back(Vec3(x, 0.0f, 0.0f));
+        vertices.push_back(Vec3(x, 0.0f, 1.0f));
+        vertices.push_back(Vec3(x + size, 0.0f, 0.0f));
+        rays.push_back(Ray(Vec3(x + size * 0.25f, 10.0f, 0.25f), Vec3(0.0f, -1.0f, 0.0f)));
+    }
+    vertices.push_back(Vec3(-2.0f, 1.0f, 0.0f));
+    vertices.push_back(Vec3(-2.0f, 1.0f, 1.0f));
+    vertices.push_back(Vec3(-1.0f, 1.0f, 0.0f));
+    for (u32 i = 0; i < stripCount * 3; ++i)
+        indices.push_back(i);
+    for (u32 i = 0; i < duplicateCount; ++i)
+    {
+        indices.push_back(stripCount * 3);
+        indices.push_back(stripCount * 3 + 1);
+        indices.push_back(stripCount * 3 + 2);
+    }
+    rays.push_back(Ray(Vec3(-1.75f, 10.0f, 0.25f), Vec3(0.0f, -1.0f, 0.0f)));
+    const u32 triangleCount = stripCount + duplicateCount;
+    const u32 rayCount = (u32)rays.size();
+
+    const u32 caps[2] = {BVH_MAX_DEPTH, 4};
+    for (u32 c = 0; c < 2; ++c)
+    {
+        MeshBVH bvh;
+        if (!bvh.Build(vertices.data(), indices.data(), triangleCount, caps[c]) || treeDepth(bvh.GetNodes(), 0) > caps[c])
+            return false;
+
+        std::vector<RayHit> hits(rayCount);
+        if (bvh.Intersect(rays.data(), hits.data(), rayCount) != rayCount)
+            return false;
+        for (u32 i = 0; i < rayCount; ++i)
+        {
+            // every strip ray hits its own triangle, the last one any of the duplicates
+            RayHit hit;
+            if (!bvh.Intersect(rays[i], hit) || !bvh.Occluded(rays[i]))
+                return false;
+            const float t = i < stripCount ? 10.0f : 9.0f;
+            if (!NearlyEqual(hit.t, t, 1e-5f) || !NearlyEqual(hits[i].t, t, 1e-5f))
+                return false;
+            if (i < stripCount && (hit.triangle != i || hits[i].triangle != i))
+                return false;
+            if (i == stripCount && (hit.triangle < stripCount || hits[i].triangle < stripCount))
+                return false;
+        }
+    }
+    return true;
+}
+CHECK(CheckBVHDegenerate);
+
+static void BM_BVHBuild(BenchState &state)
+{
+    BVHSet &d = Fixture<BVHSet>();
+    MeshBVH bvh;
+    while (state.KeepRunning())
+    {
+        bvh.Build(d.vertices.data(), d.indices.data(), d.indices.size() / 3);
+        DoNotOptimize(bvh);
+    }
+    state.SetItemsProcessed(state.Iterations() * (d.indices.size() / 3));
+}
+BENCHMARK(BM_BVHBuild);
+
+static void BM_BVHClosestHit(BenchState &state)
+{
+    BVHSet &d = Fixture<BVHSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < RAY_COUNT; ++i)
+            d.bvh.Intersect(d.rays[i], d.hits[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * RAY_COUNT);
+}
+BENCHMARK(BM_BVHClosestHit);
+
+static void BM_BVHPacket(BenchState &state)
+{
+    BVHSet &d = Fixture<BVHSet>();
+    while (state.KeepRunning())
+    {
+        d.bvh.Intersect(d.rays.data(), d.hits.data(), RAY_COUNT);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * RAY_COUNT);
+}
+BENCHMARK(BM_BVHPacket);
+
+static void BM_BVHOccluded(BenchState &state)
+{
+    BVHSet &d = Fixture<BVHSet>();
+    while (state.KeepRunning())
+    {
+        unsigned int blocked = 0;
+        for (unsigned int i = 0; i < RAY_COUNT; ++i)
+            blocked += d.bvh.Occluded(d.rays[i], 60.0f);
+        DoNotOptimize(blocked);
+    }
+    state.SetItemsProcessed(state.Iterations() * RAY_COUNT);
+}
+BENCHMARK(BM_BVHOccluded);
+
+static void BM_BruteForceClosestHit(BenchState &state)
+{
+    BVHSet &d = Fixture<BVHSet>();
+    while (state.KeepRunning())
+    {
+        float t;
+        u32 triangle;
+        bool found = d.bruteForce(d.rays[0], t, triangle);
+        DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+BENCHMARK(BM_BruteForceClosestHit);
@@ -0,0 +1,223 @@
+#include "Bench.hpp"
+
+//
+// Vec3Batch span functions against the per-vector Math API.
+//
+
+static const unsigned int POINT_COUNT = 100003; // odd on purpose, covers the scalar tail
+
+struct PointSet
+{
+    std::vector<Vec3> a, b, out, expected;
+    std::vector<float> dots;
+    Mat4 transform;
+
+    PointSet() : a(POINT_COUNT), b(POINT_COUNT), out(POINT_COUNT), expected(POINT_COUNT), dots(POINT_COUNT)
+    {
+        for (unsigned int i = 0; i < POINT_COUNT; ++i)
+        {
+            a[i] = Vec3(RandomFloat(-100, 100), RandomFloat(-100, 100), RandomFloat(-100, 100));
+            b[i] = Vec3(RandomFloat(-1, 1), RandomFloat(-1, 1), RandomFloat(-1, 1));
+        }
+        a[7] = Vec3(0.0f, 0.0f, 0.0f);
+        transform = RandomTransform();
+    }
+};
+
+static bool sameVec3(const std::vector<Vec3> &a, const std::vector<Vec3> &b, float tolerance)
+{
+    for (size_t i = 0; i < a.size(); ++i)
+        if (!NearlyEqual(a[i].x, b[i].x, tolerance) || !NearlyEqual(a[i].y, b[i].y, tolerance) || !NearlyEqual(a[i].z, b[i].z, tolerance))
+            return false;
+    return true;
+}
+
+static bool CheckBatchTransform()
+{
+    PointSet &d = Fixture<PointSet>();
+    for (unsigned int i = 0; i < POINT_COUNT; ++i)
+    {
+        d.expected[i] = d.a[i];
+        d.transform.transformPoint(d.expected[i]);
+    }
+    Vec3Batch::TransformPoints(d.transform, d.a.data(), d.out.data(), POINT_COUNT);
+    if (!sameVec3(d.out, d.expected, 1e-5f))
+        return false;
+
+    for (unsigned int i = 0; i < POINT_COUNT; ++i)
+    {
+        d.expected[i] = d.a[i];
+        d.transform.transformNormal(d.expected[i]);
+    }
+    d.out = d.a;
+    Vec3Batch::TransformNormals(d.transform, d.out.data(), d.out.data(), POINT_COUNT);
+    return sameVec3(d.out, d.expected, 1e-5f);
+}
+CHECK(CheckBatchTransform);
+
+static bool CheckBatchTranslateScale()
+{
+    PointSet &d = Fixture<PointSet>();
+    Vec3 offset(1.5f, -2.0f, 3.25f);
+    for (unsigned int i = 0; i < POINT_COUNT; ++i)
+        d.expected[i] = Vec3((d.a[i].x + offset.x) * 2.0f, (d.a[i].y + offset.y) * 0.5f, (d.a[i].z + offset.z) * -1.0f);
+    d.out = d.a;
+    Vec3Batch::Translate(d.out.data(), POINT_COUNT, offset);
+    Vec3Batch::Scale(d.out.data(), POINT_COUNT, Vec3(2.0f, 0.5f, -1.0f));
+    return sameVec3(d.out, d.expected, 0.0f);
+}
+CHECK(CheckBatchTranslateScale);
+
+static bool CheckBatchNormalize()
+{
+    PointSet &d = Fixture<PointSet>();
+    for (unsigned int i = 0; i < POINT_COUNT; ++i)
+    {
+        d.expected[i] = d.a[i];
+        d.expected[i].normalize();
+    }
+    Vec3Batch::Normalize(d.a.data(), d.out.data(), POINT_COUNT);
+    return sameVec3(d.out, d.expected, 1e-6f);
+}
+CHECK(CheckBatchNormalize);
+
+static bool CheckBatchDotCross()
+{
+    PointSet &d = Fixture<PointSet>();
+    Vec3Batch::Dot(d.a.data(), d.b.data(), d.dots.data(), POINT_COUNT);
+    for (unsigned int i = 0; i < POINT_COUNT; ++i)
+        if (!NearlyEqual(d.dots[i], d.a[i].dot(d.b[i]), 1e-5f))
+            return false;
+
+    for (unsigned int i = 0; i < POINT_COUNT; ++i)
+        d.expected[i] = d.a[i].cross(d.b[i]);
+    Vec3Batch::Cross(d.a.data(), d.b.data(), d.out.data(), POINT_COUNT);
+    return sameVec3(d.out, d.expected, 1e-5f);
+}
+CHECK(CheckBatchDotCross);
+
+static bool CheckBatchExpand()
+{
+    PointSet &d = Fixture<PointSet>();
+    BoundingBox expected(d.a[0], d.a[0]);
+    for (unsigned int i = 1; i < POINT_COUNT; ++i)
+        expected.expand(d.a[i]);
+    BoundingBox box(d.a[0], d.a[0]);
+    box.expand(d.a.data(), POINT_COUNT);
+    return box.min == expected.min && box.max == expected.max;
+}
+CHECK(CheckBatchExpand);
+
+static bool CheckVec3Pack()
+{
+    PointSet &d = Fixture<PointSet>();
+    Vec3x8 pack;
+    pack.load(d.a.data());
+    pack.transformPoints(d.transform);
+    Vec3 result[8];
+    pack.store(result);
+    for (int i = 0; i < 8; ++i)
+    {
+        Vec3 expected = d.a[i];
+        d.transform.transformPoint(expected);
+        if (!NearlyEqual(result[i].x, expected.x, 1e-5f) || !NearlyEqual(result[i].y, expected.y, 1e-5f) || !NearlyEqual(result[i].z, expected.z, 1e-5f))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckVec3Pack);
+
+static void BM_BatchTransformPoints(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        Vec3Batch::TransformPoints(d.transform, d.a.data(), d.out.data(), POINT_COUNT);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_BatchTransformPoints);
+
+static void BM_LoopTransformPoints(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < POINT_COUNT; ++i)
+        {
+            d.out[i] = d.a[i];
+            d.transform.transformPoint(d.out[i]);
+        }
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_LoopTransformPoints);
+
+static void BM_BatchNormalize(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        Vec3Batch::Normalize(d.a.data(), d.out.data(), POINT_COUNT);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_BatchNormalize);
+
+static void BM_LoopNormalize(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < POINT_COUNT; ++i)
+        {
+            d.out[i] = d.a[i];
+            d.out[i].normalize();
+        }
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_LoopNormalize);
+
+static void BM_BatchCross(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        Vec3Batch::Cross(d.a.data(), d.b.data(), d.out.data(), POINT_COUNT);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_BatchCross);
+
+static void BM_BatchExpand(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        BoundingBox box(d.a[0], d.a[0]);
+        box.expand(d.a.data(), POINT_COUNT);
+        DoNotOptimize(box);
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_BatchExpand);
+
+static void BM_LoopExpand(BenchState &state)
+{
+    PointSet &d = Fixture<PointSet>();
+    while (state.KeepRunning())
+    {
+        BoundingBox box(d.a[0], d.a[0]);
+        for (unsigned int i = 0; i < POINT_COUNT; ++i)
+            box.expand(d.a[i]);
+        DoNotOptimize(box);
+    }
+    state.SetItemsProcessed(state.Iterations() * POINT_COUNT);
+}
+BENCHMARK(BM_LoopExpand);
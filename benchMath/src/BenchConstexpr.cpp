@@ -0,0 +1,170 @@
+#include "Bench.hpp"
+#include <algorithm>
+
+//
+// Header inline / constexpr math. The static_asserts only compile if the
+// compiler folds these expressions, the benchmarks time the same expressions
+// at run time and the circle table against per-vertex trig.
+//
+
+static_assert(Vec3(1.0f, 2.0f, 3.0f).dot(Vec3(4.0f, 5.0f, 6.0f)) == 32.0f, "constexpr dot");
+static_assert(Vec3::Cross(Vec3(1.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f)).z == 1.0f, "constexpr cross");
+static_assert((Vec2(1.0f, 2.0f) * 2.0f + Vec2(0.5f, 0.5f)).y == 4.5f, "constexpr Vec2 ops");
+static_assert(Mat4::Translate(Vec3(1.0f, 2.0f, 3.0f)).m[12] == 1.0f, "constexpr translate");
+static_assert(Mat4::Scale(Vec3(2.0f, 3.0f, 4.0f)).m[10] == 4.0f, "constexpr scale");
+static_assert(Mat4::Identity().m[15] == 1.0f && Mat4::Identity().m[1] == 0.0f, "constexpr identity");
+static_assert(ConstCosRad(0.0) == 1.0 && ConstSinRad(M_PI) == 0.0, "constexpr sine / cosine");
+
+static const unsigned int EXPR_COUNT = 100000;
+static const int RING_SEGMENTS = 48;
+static const int RING_COUNT = 2000;
+
+struct ExprSet
+{
+    std::vector<Vec3> a, b, out;
+    std::vector<Vec2> ring;
+    int segments; // read back every ring so nothing is hoisted
+
+    ExprSet() : a(EXPR_COUNT), b(EXPR_COUNT), out(EXPR_COUNT), ring(RING_SEGMENTS + 1), segments(RING_SEGMENTS)
+    {
+        for (unsigned int i = 0; i < EXPR_COUNT; ++i)
+        {
+            a[i] = Vec3(RandomFloat(-1, 1), RandomFloat(-1, 1), RandomFloat(-1, 1));
+            b[i] = Vec3(RandomFloat(-1, 1), RandomFloat(-1, 1), RandomFloat(-1, 1));
+        }
+    }
+};
+
+static bool CheckCircleTable()
+{
+    double worst = 0.0;
+    for (int i = 0; i <= CIRCLE_TABLE_STEPS; ++i)
+    {
+        double a = 2.0 * M_PI * i / CIRCLE_TABLE_STEPS;
+        worst = std::max(worst, std::fabs(CircleTableData.sin[i] - std::sin(a)));
+        worst = std::max(worst, std::fabs(CircleTableData.cos[i] - std::cos(a)));
+    }
+    // float rounding of the exact value
+    if (worst > 6e-8)
+        return false;
+
+    // table entries or FastSinCosRad plus the float angle rounding, the seam
+    // closes exactly either way
+    const int counts[] = {3, 7, 12, 32, 48, 100, 2880};
+    for (int k = 0; k < 7; ++k)
+    {
+        for (int i = 0; i <= counts[k]; ++i)
+        {
+            float s, c;
+            CircleSinCos(i, counts[k], s, c);
+            double a = 2.0 * M_PI * i / counts[k];
+            if (std::fabs(s - std::sin(a)) > 2e-7 || std::fabs(c - std::cos(a)) > 2e-7)
+                return false;
+        }
+        float s0, c0, s1, c1;
+        CircleSinCos(0, counts[k], s0, c0);
+        CircleSinCos(counts[k], counts[k], s1, c1);
+        if (s0 != s1 || c0 != c1)
+            return false;
+    }
+    return true;
+}
+CHECK(CheckCircleTable);
+
+static bool CheckConstexprMath()
+{
+    Vec3 a(1.0f, -2.0f, 0.5f), b(0.25f, 3.0f, -1.0f);
+    Vec3 c = (a + b) * 0.5f - a.cross(b) * 0.1f;
+    if (!NearlyEqual(c.x, 0.575f, 1e-6f) || !NearlyEqual(c.y, 0.3875f, 1e-6f) || !NearlyEqual(c.z, -0.6f, 1e-6f))
+        return false;
+
+    Mat4 t = Mat4::Translate(Vec3(1.0f, 2.0f, 3.0f)) * Mat4::Scale(Vec3(2.0f, 2.0f, 2.0f));
+    Vec3 p(1.0f, 1.0f, 1.0f);
+    t.transformPoint(p);
+    return NearlyEqual(p.x, 4.0f, 1e-6f) && NearlyEqual(p.y, 6.0f, 1e-6f) && NearlyEqual(p.z, 8.0f, 1e-6f);
+}
+CHECK(CheckConstexprMath);
+
+static void BM_Vec3Expression(BenchState &state)
+{
+    ExprSet &d = Fixture<ExprSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < EXPR_COUNT; ++i)
+            d.out[i] = (d.a[i] + d.b[i]) * 0.5f - d.a[i].cross(d.b[i]) * 0.1f + Vec3(0.0f, 1.0f, 0.0f) * d.a[i].dot(d.b[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * EXPR_COUNT);
+}
+BENCHMARK(BM_Vec3Expression);
+
+static void BM_Mat4Compose(BenchState &state)
+{
+    ExprSet &d = Fixture<ExprSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < EXPR_COUNT; ++i)
+        {
+            Mat4 t = Mat4::Translate(d.a[i]);
+            Mat4 s = Mat4::Scale(d.b[i]);
+            d.out[i] = Vec3(t.m[12] * s.m[0], t.m[13] * s.m[5], t.m[14] * s.m[10]);
+        }
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * EXPR_COUNT);
+}
+BENCHMARK(BM_Mat4Compose);
+
+static void BM_RingLibm(BenchState &state)
+{
+    ExprSet &d = Fixture<ExprSet>();
+    while (state.KeepRunning())
+    {
+        for (int r = 0; r < RING_COUNT; ++r)
+        {
+            const int segments = d.segments;
+            for (int i = 0; i <= segments; ++i)
+                d.ring[i] = Vec2(SinRad(-TwoPi / segments * i), CosRad(-TwoPi / segments * i));
+            ClobberMemory();
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * RING_COUNT * (RING_SEGMENTS + 1));
+}
+BENCHMARK(BM_RingLibm);
+
+static void BM_RingFast(BenchState &state)
+{
+    ExprSet &d = Fixture<ExprSet>();
+    while (state.KeepRunning())
+    {
+        for (int r = 0; r < RING_COUNT; ++r)
+        {
+            const int segments = d.segments;
+            for (int i = 0; i <= segments; ++i)
+                d.ring[i] = Vec2(FastSinRad(-TwoPi / segments * i), FastCosRad(-TwoPi / segments * i));
+            ClobberMemory();
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * RING_COUNT * (RING_SEGMENTS + 1));
+}
+BENCHMARK(BM_RingFast);
+
+static void BM_RingTable(BenchState &state)
+{
+    ExprSet &d = Fixture<ExprSet>();
+    while (state.KeepRunning())
+    {
+        for (int r = 0; r < RING_COUNT; ++r)
+        {
+            const int segments = d.segments;
+            for (int i = 0; i <= segments; ++i)
+            {
+                CircleSinCos(i, segments, d.ring[i].x, d.ring[i].y);
+                d.ring[i].x = -d.ring[i].x;
+            }
+            ClobberMemory();
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * RING_COUNT * (RING_SEGMENTS + 1));
+}
+BENCHMARK(BM_RingTable);
@@ -0,0 +1,204 @@
+#include "Bench.hpp"
+#include <algorithm>
+
+//
+// Fast approximate trig / inverse sqrt against libm. The checks enforce the
+// error bounds documented in Math.hpp.
+//
+
+static const unsigned int ANGLE_COUNT = 100000;
+
+struct AngleSet
+{
+    std::vector<float> angles, sines, cosines;
+    std::vector<Vec3> vectors, out, expected;
+
+    AngleSet() : angles(ANGLE_COUNT), sines(ANGLE_COUNT), cosines(ANGLE_COUNT), vectors(ANGLE_COUNT), out(ANGLE_COUNT), expected(ANGLE_COUNT)
+    {
+        for (unsigned int i = 0; i < ANGLE_COUNT; ++i)
+        {
+            angles[i] = RandomFloat(-10.0f, 10.0f);
+            vectors[i] = Vec3(RandomFloat(-100, 100), RandomFloat(-100, 100), RandomFloat(-100, 100));
+        }
+        vectors[5] = Vec3(0.0f, 0.0f, 0.0f);
+    }
+};
+
+static bool CheckFastSinCos()
+{
+    // dense sweep over the documented range plus the octant boundaries
+    double worst = 0.0;
+    const int steps = 2000000;
+    for (int i = 0; i <= steps; ++i)
+    {
+        float a = -8192.0f + 16384.0f * (float)i / (float)steps;
+        float s, c;
+        FastSinCosRad(a, s, c);
+        worst = std::max(worst, std::fabs((double)s - std::sin((double)a)));
+        worst = std::max(worst, std::fabs((double)c - std::cos((double)a)));
+    }
+    for (int k = -64; k <= 64; ++k)
+    {
+        float a = (float)(k * M_PI / 4.0);
+        worst = std::max(worst, std::fabs((double)FastSinRad(a) - std::sin((double)a)));
+        worst = std::max(worst, std::fabs((double)FastCosRad(a) - std::cos((double)a)));
+    }
+    if (worst > 1.5e-7)
+        return false;
+
+    for (int i = -20000; i <= 20000; ++i)
+    {
+        float d = i < -720 || i > 720 ? i * 50.0013f : (float)i;
+        double r = std::fmod((double)d, 360.0) * M_PI / 180.0;
+        if (std::fabs(FastSin(d) - std::sin(r)) > 2e-7 || std::fabs(FastCos(d) - std::cos(r)) > 2e-7)
+            return false;
+    }
+
+    // the batch call matches the scalar one
+    AngleSet &set = Fixture<AngleSet>();
+    FastSinCosRad(set.angles.data(), set.sines.data(), set.cosines.data(), ANGLE_COUNT);
+    for (unsigned int i = 0; i < ANGLE_COUNT; ++i)
+    {
+        float s, c;
+        FastSinCosRad(set.angles[i], s, c);
+        if (!NearlyEqual(s, set.sines[i], 1e-7f) || !NearlyEqual(c, set.cosines[i], 1e-7f))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckFastSinCos);
+
+static bool CheckFastInvSqrt()
+{
+    for (int e = -30; e <= 30; ++e)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            double a = (1.0 + i / 1000.0) * std::pow(10.0, e);
+            double exact = 1.0 / std::sqrt(a);
+            if (std::fabs(FastInvSqrt((float)a) - exact) > 5e-7 * exact)
+                return false;
+        }
+    }
+
+    AngleSet &set = Fixture<AngleSet>();
+    Vec3Batch::Normalize(set.vectors.data(), set.expected.data(), ANGLE_COUNT);
+    Vec3Batch::NormalizeFast(set.vectors.data(), set.out.data(), ANGLE_COUNT);
+    for (unsigned int i = 0; i < ANGLE_COUNT; ++i)
+    {
+        if (!NearlyEqual(set.out[i].x, set.expected[i].x, 1e-6f) || !NearlyEqual(set.out[i].y, set.expected[i].y, 1e-6f) || !NearlyEqual(set.out[i].z, set.expected[i].z, 1e-6f))
+            return false;
+    }
+    Vec3 v(3.0f, 4.0f, 12.0f);
+    v.normalizeFast();
+    if (!NearlyEqual(v.length(), 1.0f, 1e-6f))
+        return false;
+
+    Quat a = Quat::FromYawPitchRoll(0.3f, 1.1f, -0.4f);
+    Quat b = Quat::FromYawPitchRoll(-1.2f, 0.2f, 2.0f);
+    for (int i = 0; i <= 10; ++i)
+    {
+        Quat exact = Quat::Slerp(a, b, i / 10.0f);
+        Quat fast = Quat::SlerpFast(a, b, i / 10.0f);
+        if (!NearlyEqual(exact.x, fast.x, 1e-5f) || !NearlyEqual(exact.y, fast.y, 1e-5f) || !NearlyEqual(exact.z, fast.z, 1e-5f) || !NearlyEqual(exact.w, fast.w, 1e-5f))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckFastInvSqrt);
+
+static void BM_LibmSinCos(BenchState &state)
+{
+    AngleSet &d = Fixture<AngleSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < ANGLE_COUNT; ++i)
+        {
+            d.sines[i] = sinf(d.angles[i]);
+            d.cosines[i] = cosf(d.angles[i]);
+        }
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANGLE_COUNT);
+}
+BENCHMARK(BM_LibmSinCos);
+
+static void BM_FastSinCos(BenchState &state)
+{
+    AngleSet &d = Fixture<AngleSet>();
+    while (state.KeepRunning())
+    {
+        FastSinCosRad(d.angles.data(), d.sines.data(), d.cosines.data(), ANGLE_COUNT);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANGLE_COUNT);
+}
+BENCHMARK(BM_FastSinCos);
+
+static void BM_LibmInvSqrt(BenchState &state)
+{
+    AngleSet &d = Fixture<AngleSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < ANGLE_COUNT; ++i)
+            d.sines[i] = 1.0f / sqrtf(d.angles[i] * d.angles[i] + 1.0f);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANGLE_COUNT);
+}
+BENCHMARK(BM_LibmInvSqrt);
+
+static void BM_FastInvSqrt(BenchState &state)
+{
+    AngleSet &d = Fixture<AngleSet>();
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < ANGLE_COUNT; ++i)
+            d.sines[i] = FastInvSqrt(d.angles[i] * d.angles[i] + 1.0f);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANGLE_COUNT);
+}
+BENCHMARK(BM_FastInvSqrt);
+
+static void BM_BatchNormalizeFast(BenchState &state)
+{
+    AngleSet &d = Fixture<AngleSet>();
+    while (state.KeepRunning())
+    {
+        Vec3Batch::NormalizeFast(d.vectors.data(), d.out.data(), ANGLE_COUNT);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * ANGLE_COUNT);
+}
+BENCHMARK(BM_BatchNormalizeFast);
+
+static void BM_SlerpFast(BenchState &state)
+{
+    Quat a = Quat::FromYawPitchRoll(0.3f, 1.1f, -0.4f);
+    Quat b = Quat::FromYawPitchRoll(-1.2f, 0.2f, 2.0f);
+    while (state.KeepRunning())
+    {
+        Quat sum(0.0f, 0.0f, 0.0f, 0.0f);
+        for (int i = 0; i < 1000; ++i)
+            sum = sum + Quat::SlerpFast(a, b, i * 0.001f);
+        DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.Iterations() * 1000);
+}
+BENCHMARK(BM_SlerpFast);
+
+static void BM_Slerp(BenchState &state)
+{
+    Quat a = Quat::FromYawPitchRoll(0.3f, 1.1f, -0.4f);
+    Quat b = Quat::FromYawPitchRoll(-1.2f, 0.2f, 2.0f);
+    while (state.KeepRunning())
+    {
+        Quat sum(0.0f, 0.0f, 0.0f, 0.0f);
+        for (int i = 0; i < 1000; ++i)
+            sum = sum + Quat::Slerp(a, b, i * 0.001f);
+        DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.Iterations() * 1000);
+}
+BENCHMARK(BM_Slerp);
@@ -0,0 +1,323 @@
+#include "Bench.hpp"
+
+//
+// Mat4 kernels against plain scalar reference versions of the same math.
+//
+
+static const int MATRIX_COUNT = 1024;
+
+static void scalarMultiply(const Mat4 &left, const Mat4 &right, Mat4 &result)
+{
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            result.m[i * 4 + j] = left.m[i * 4 + 0] * right.m[0 + j] + left.m[i * 4 + 1] * right.m[4 + j] +
+                                  left.m[i * 4 + 2] * right.m[8 + j] + left.m[i * 4 + 3] * right.m[12 + j];
+}
+
+static void scalarInverse(const Mat4 &mat, Mat4 &result)
+{
+    const float *a = mat.m;
+    float b00 = a[0] * a[5] - a[1] * a[4];
+    float b01 = a[0] * a[6] - a[2] * a[4];
+    float b02 = a[0] * a[7] - a[3] * a[4];
+    float b03 = a[1] * a[6] - a[2] * a[5];
+    float b04 = a[1] * a[7] - a[3] * a[5];
+    float b05 = a[2] * a[7] - a[3] * a[6];
+    float b06 = a[8] * a[13] - a[9] * a[12];
+    float b07 = a[8] * a[14] - a[10] * a[12];
+    float b08 = a[8] * a[15] - a[11] * a[12];
+    float b09 = a[9] * a[14] - a[10] * a[13];
+    float b10 = a[9] * a[15] - a[11] * a[13];
+    float b11 = a[10] * a[15] - a[11] * a[14];
+    float invDet = 1.0f / (b00 * b11 - b01 * b10 + b02 * b09 + b03 * b08 - b04 * b07 + b05 * b06);
+
+    result.m[0] = (a[5] * b11 - a[6] * b10 + a[7] * b09) * invDet;
+    result.m[1] = (-a[1] * b11 + a[2] * b10 - a[3] * b09) * invDet;
+    result.m[2] = (a[13] * b05 - a[14] * b04 + a[15] * b03) * invDet;
+    result.m[3] = (-a[9] * b05 + a[10] * b04 - a[11] * b03) * invDet;
+    result.m[4] = (-a[4] * b11 + a[6] * b08 - a[7] * b07) * invDet;
+    result.m[5] = (a[0] * b11 - a[2] * b08 + a[3] * b07) * invDet;
+    result.m[6] = (-a[12] * b05 + a[14] * b02 - a[15] * b01) * invDet;
+    result.m[7] = (a[8] * b05 - a[10] * b02 + a[11] * b01) * invDet;
+    result.m[8] = (a[4] * b10 - a[5] * b08 + a[7] * b06) * invDet;
+    result.m[9] = (-a[0] * b10 + a[1] * b08 - a[3] * b06) * invDet;
+    result.m[10] = (a[12] * b04 - a[13] * b02 + a[15] * b00) * invDet;
+    result.m[11] = (-a[8] * b04 + a[9] * b02 - a[11] * b00) * invDet;
+    result.m[12] = (-a[4] * b09 + a[5] * b07 - a[6] * b06) * invDet;
+    result.m[13] = (a[0] * b09 - a[1] * b07 + a[2] * b06) * invDet;
+    result.m[14] = (-a[12] * b03 + a[13] * b01 - a[14] * b00) * invDet;
+    result.m[15] = (a[8] * b03 - a[9] * b01 + a[10] * b00) * invDet;
+}
+
+static void scalarTransformPoint(const Mat4 &m, Vec3 &v)
+{
+    float x = v.x * m.m[0] + v.y * m.m[4] + v.z * m.m[8] + m.m[12];
+    float y = v.x * m.m[1] + v.y * m.m[5] + v.z * m.m[9] + m.m[13];
+    float z = v.x * m.m[2] + v.y * m.m[6] + v.z * m.m[10] + m.m[14];
+    v.set(x, y, z);
+}
+
+static void scalarTransformBox(const Mat4 &m, const BoundingBox &box, BoundingBox &out)
+{
+    Vec3 corners[8];
+    box.getCorners(corners);
+    scalarTransformPoint(m, corners[0]);
+    out.reset(corners[0]);
+    for (int i = 1; i < 8; ++i)
+    {
+        scalarTransformPoint(m, corners[i]);
+        out.expand(corners[i]);
+    }
+}
+
+struct MatrixSet
+{
+    std::vector<Mat4> a, b, out;
+    std::vector<Vec3> points;
+    std::vector<BoundingBox> boxes;
+
+    MatrixSet() : a(MATRIX_COUNT), b(MATRIX_COUNT), out(MATRIX_COUNT), points(MATRIX_COUNT), boxes(MATRIX_COUNT)
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+        {
+            a[i] = RandomTransform();
+            b[i] = RandomTransform();
+            points[i] = Vec3(RandomFloat(-50, 50), RandomFloat(-50, 50), RandomFloat(-50, 50));
+            Vec3 min(RandomFloat(-50, 50), RandomFloat(-50, 50), RandomFloat(-50, 50));
+            boxes[i] = BoundingBox(min, min + Vec3(RandomFloat(0, 10), RandomFloat(0, 10), RandomFloat(0, 10)));
+        }
+    }
+};
+
+static bool CheckMat4Multiply()
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    for (int i = 0; i < MATRIX_COUNT; ++i)
+    {
+        Mat4 expected;
+        scalarMultiply(d.a[i], d.b[i], expected);
+        Mat4 result = Mat4::Multiply(d.a[i], d.b[i]);
+        for (int k = 0; k < 16; ++k)
+            if (!NearlyEqual(result.m[k], expected.m[k], 1e-5f))
+                return false;
+    }
+    return true;
+}
+CHECK(CheckMat4Multiply);
+
+static bool CheckMat4Inverse()
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    for (int i = 0; i < MATRIX_COUNT; ++i)
+    {
+        Mat4 expected;
+        scalarInverse(d.a[i], expected);
+        Mat4 result = Mat4::Inverse(d.a[i]);
+        Mat4 member = d.a[i].inverse();
+        for (int k = 0; k < 16; ++k)
+            if (!NearlyEqual(result.m[k], expected.m[k], 1e-4f) || !NearlyEqual(member.m[k], expected.m[k], 1e-4f))
+                return false;
+    }
+    return true;
+}
+CHECK(CheckMat4Inverse);
+
+static bool CheckMat4MulVec4()
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    for (int i = 0; i < MATRIX_COUNT; ++i)
+    {
+        const Mat4 &m = d.a[i];
+        Vec4 v(d.points[i].x, d.points[i].y, d.points[i].z, 1.0f);
+        Vec4 r = m * v;
+        float e[4];
+        for (int row = 0; row < 4; ++row)
+            e[row] = m.m[row * 4 + 0] * v.x + m.m[row * 4 + 1] * v.y + m.m[row * 4 + 2] * v.z + m.m[row * 4 + 3] * v.w;
+        if (!NearlyEqual(r.x, e[0], 1e-5f) || !NearlyEqual(r.y, e[1], 1e-5f) || !NearlyEqual(r.z, e[2], 1e-5f) || !NearlyEqual(r.w, e[3], 1e-5f))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckMat4MulVec4);
+
+static bool CheckTransformPoint()
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    for (int i = 0; i < MATRIX_COUNT; ++i)
+    {
+        Vec3 a = d.points[i];
+        Vec3 b = d.points[i];
+        d.a[i].transformPoint(a);
+        scalarTransformPoint(d.a[i], b);
+        if (!NearlyEqual(a.x, b.x, 1e-5f) || !NearlyEqual(a.y, b.y, 1e-5f) || !NearlyEqual(a.z, b.z, 1e-5f))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckTransformPoint);
+
+static bool CheckBoundingBoxTransform()
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    for (int i = 0; i < MATRIX_COUNT; ++i)
+    {
+        BoundingBox expected;
+        scalarTransformBox(d.a[i], d.boxes[i], expected);
+        BoundingBox box = d.boxes[i];
+        box.transform(d.a[i]);
+        if (!NearlyEqual(box.min.x, expected.min.x, 1e-4f) || !NearlyEqual(box.min.y, expected.min.y, 1e-4f) ||
+            !NearlyEqual(box.min.z, expected.min.z, 1e-4f) || !NearlyEqual(box.max.x, expected.max.x, 1e-4f) ||
+            !NearlyEqual(box.max.y, expected.max.y, 1e-4f) || !NearlyEqual(box.max.z, expected.max.z, 1e-4f))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckBoundingBoxTransform);
+
+static void BM_Mat4Multiply(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+            d.out[i] = Mat4::Multiply(d.a[i], d.b[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_Mat4Multiply);
+
+static void BM_Mat4MultiplyScalar(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+            scalarMultiply(d.a[i], d.b[i], d.out[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_Mat4MultiplyScalar);
+
+static void BM_Mat4Inverse(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+            d.out[i] = Mat4::Inverse(d.a[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_Mat4Inverse);
+
+static void BM_Mat4InverseScalar(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+            scalarInverse(d.a[i], d.out[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_Mat4InverseScalar);
+
+static void BM_Mat4Decompose(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    Vec3 position, scale;
+    Quat rotation;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+        {
+            Mat4::Decompose(d.a[i], position, scale, rotation);
+            DoNotOptimize(rotation);
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_Mat4Decompose);
+
+static void BM_Mat4MulVec4(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    Vec4 sum(0.0f, 0.0f, 0.0f, 0.0f);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+        {
+            Vec4 r = d.a[i] * Vec4(d.points[i].x, d.points[i].y, d.points[i].z, 1.0f);
+            sum.x += r.x;
+        }
+        DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_Mat4MulVec4);
+
+static void BM_TransformPoint(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    std::vector<Vec3> points = d.points;
+    const Mat4 m = d.a[0];
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+            m.transformPoint(points[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_TransformPoint);
+
+static void BM_TransformPointScalar(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    std::vector<Vec3> points = d.points;
+    const Mat4 m = d.a[0];
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+            scalarTransformPoint(m, points[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_TransformPointScalar);
+
+static void BM_BoundingBoxTransform(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    BoundingBox out;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+        {
+            d.boxes[i].transform(out, d.a[i]);
+            DoNotOptimize(out);
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_BoundingBoxTransform);
+
+static void BM_BoundingBoxTransformScalar(BenchState &state)
+{
+    MatrixSet &d = Fixture<MatrixSet>();
+    BoundingBox out;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < MATRIX_COUNT; ++i)
+        {
+            scalarTransformBox(d.a[i], d.boxes[i], out);
+            DoNotOptimize(out);
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * MATRIX_COUNT);
+}
+BENCHMARK(BM_BoundingBoxTransformScalar);
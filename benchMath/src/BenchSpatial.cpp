@@ -0,0 +1,290 @@
+#include "Bench.hpp"
+#include "Scene.hpp"
+#include <algorithm>
+
+//
+// SpatialTree over 50k moving Node3D against linear scans of the same nodes.
+//
+
+static const unsigned int NODE_COUNT = 50000;
+
+struct SpatialSet
+{
+    std::vector<Node3D> nodes;
+    std::vector<Vec3> velocity;
+    std::vector<void*> results;
+    SpatialTree tree;
+    Frustum frustum;
+
+    SpatialSet() : nodes(NODE_COUNT), velocity(NODE_COUNT), tree(0.5f)
+    {
+        for (unsigned int i = 0; i < NODE_COUNT; ++i)
+        {
+            float size = RandomFloat(0.5f, 4.0f);
+            nodes[i].SetBoundingBox(BoundingBox(Vec3(-size, -size, -size), Vec3(size, size, size)));
+            nodes[i].SetPosition(Vec3(RandomFloat(-1000, 1000), RandomFloat(0, 50), RandomFloat(-1000, 1000)));
+            nodes[i].UpdateAbsolutePosition();
+            velocity[i] = Vec3(RandomFloat(-1, 1), 0.0f, RandomFloat(-1, 1)) * 0.1f;
+            tree.Insert(&nodes[i]);
+        }
+
+        Mat4 view = Mat4::LookAt(Vec3(0.0f, 50.0f, 0.0f), Vec3(300.0f, 0.0f, 400.0f), Vec3(0.0f, 1.0f, 0.0f));
+        Mat4 projection = Mat4::Perspective(60.0f, 16.0f / 9.0f, 0.1f, 800.0f);
+        frustum.update(view * projection);
+    }
+
+    void step()
+    {
+        for (unsigned int i = 0; i < NODE_COUNT; ++i)
+        {
+            nodes[i].SetPosition(nodes[i].GetPosition() + velocity[i]);
+            nodes[i].UpdateAbsolutePosition();
+            tree.Update(&nodes[i], velocity[i]);
+        }
+    }
+
+    // every proxy box must touch its node and every parent enclose its children
+    bool valid() const
+    {
+        const std::vector<SpatialNode> &n = tree.GetNodes();
+        int leaves = 0;
+        for (size_t i = 0; i < n.size(); ++i)
+        {
+            if (n[i].height < 0)
+                continue;
+            if (n[i].isLeaf())
+            {
+                const Node3D *node = static_cast<const Node3D *>(n[i].userData);
+                BoundingBox box = node->GetTransformedBoundingBox();
+                if (!n[i].box.intersects(box) || node->GetSpatialProxy() != (int)i)
+                    return false;
+                leaves++;
+                continue;
+            }
+            const SpatialNode &a = n[n[i].child1];
+            const SpatialNode &b = n[n[i].child2];
+            if (a.parent != (int)i || b.parent != (int)i || n[i].height != 1 + std::max(a.height, b.height))
+                return false;
+            BoundingBox merged = a.box;
+            merged.expand(b.box);
+            if (!(merged.min == n[i].box.min) || !(merged.max == n[i].box.max))
+                return false;
+        }
+        return leaves == tree.GetProxyCount();
+    }
+};
+
+static bool sameSet(std::vector<void*> &a, std::vector<void*> &b)
+{
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    return a == b;
+}
+
+static bool CheckSpatialTree()
+{
+    SpatialSet &d = Fixture<SpatialSet>();
+    for (int frame = 0; frame < 20; ++frame)
+        d.step();
+    if (!d.valid() || d.tree.GetHeight() > 40)
+        return false;
+
+    // fat boxes may report a few extra nodes, never miss one
+    std::vector<void*> found, expected;
+    d.tree.QueryFrustum(d.frustum, found);
+    for (unsigned int i = 0; i < NODE_COUNT; ++i)
+        if (d.frustum.intersectsBox(d.nodes[i].GetTransformedBoundingBox()))
+            expected.push_back(&d.nodes[i]);
+    std::sort(found.begin(), found.end());
+    for (size_t i = 0; i < expected.size(); ++i)
+        if (!std::binary_search(found.begin(), found.end(), expected[i]))
+            return false;
+    if (expected.empty() || found.size() > expected.size() * 2)
+        return false;
+
+    // box query against the stored fat boxes is exact
+    BoundingBox area(Vec3(-100, -10, -100), Vec3(150, 60, 50));
+    found.clear();
+    expected.clear();
+    d.tree.QueryBox(area, found);
+    for (unsigned int i = 0; i < NODE_COUNT; ++i)
+        if (d.tree.GetFatBox(d.nodes[i].GetSpatialProxy()).intersects(area))
+            expected.push_back(&d.nodes[i]);
+    if (expected.empty() || !sameSet(found, expected))
+        return false;
+
+    found.clear();
+    d.tree.QuerySphere(Vec3(0, 25, 0), 80.0f, found);
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        const Node3D *node = static_cast<const Node3D *>(found[i]);
+        if ((node->GetTransformedBoundingBox().center() - Vec3(0, 25, 0)).length() > 80.0f + 10.0f)
+            return false;
+    }
+
+    for (int r = 0; r < 32; ++r)
+    {
+        Ray ray(Vec3(RandomFloat(-500, 500), 25.0f, -1100.0f), Vec3(RandomFloat(-0.2f, 0.2f), 0.0f, 1.0f));
+        float best = M_INFINITY, t;
+        for (unsigned int i = 0; i < NODE_COUNT; ++i)
+            if (d.nodes[i].Intersect(ray, t) && t < best)
+                best = t;
+        Node3D *hit = d.tree.Raycast(ray, t);
+        if ((hit != nullptr) != (best != M_INFINITY) || (hit && !NearlyEqual(t, best, 1e-4f)))
+            return false;
+    }
+
+    // removing and reinserting keeps the tree consistent
+    for (unsigned int i = 0; i < NODE_COUNT; i += 3)
+        d.tree.Remove(&d.nodes[i]);
+    for (unsigned int i = 0; i < NODE_COUNT; i += 3)
+        d.tree.Insert(&d.nodes[i]);
+    return d.valid() && d.tree.GetProxyCount() == (int)NODE_COUNT;
+}
+CHECK(CheckSpatialTree);
+
+// deleted nodes leave their tree, a cleared or deleted tree unlinks its nodes
+static bool CheckSpatialNodeLifetime()
+{
+    SpatialTree tree;
+    Node3D kept;
+    Node3D *deleted = new Node3D(Vec3(1.0f, 0.0f, 0.0f));
+    tree.Insert(&kept);
+    tree.Insert(deleted);
+    delete deleted;
+
+    std::vector<void*> found;
+    tree.QueryBox(BoundingBox(Vec3(-5, -5, -5), Vec3(5, 5, 5)), found);
+    if (tree.GetProxyCount() != 1 || found.size() != 1 || found[0] != &kept)
+        return false;
+
+    // moving to another tree leaves the first one
+    SpatialTree *other = new SpatialTree();
+    other->Insert(&kept);
+    if (tree.GetProxyCount() != 0 || other->GetProxyCount() != 1 || kept.GetSpatialTree() != other)
+        return false;
+    delete other;
+    if (kept.GetSpatialTree() != nullptr || kept.GetSpatialProxy() != SPATIAL_NULL)
+        return false;
+
+    tree.Insert(&kept);
+    tree.Clear();
+    return kept.GetSpatialTree() == nullptr && kept.GetSpatialProxy() == SPATIAL_NULL;
+}
+CHECK(CheckSpatialNodeLifetime);
+
+// a node whose exact test queries the tree it is in, in the middle of Raycast
+class QueryingNode : public Node3D
+{
+public:
+    const SpatialTree *tree;
+    mutable size_t neighbours;
+
+    QueryingNode() : tree(nullptr), neighbours(0) {}
+
+    bool Intersect(const Ray &ray, float &t) const override
+    {
+        std::vector<void*> found;
+        neighbours = tree->QuerySphere(GetPosition(), 50.0f, found);
+        return Node3D::Intersect(ray, t);
+    }
+};
+
+static bool CheckSpatialReentrantQuery()
+{
+    SpatialTree tree;
+    std::vector<QueryingNode> nodes(65);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        nodes[i].tree = &tree;
+        nodes[i].SetBoundingBox(BoundingBox(Vec3(-1, -1, -1), Vec3(1, 1, 1)));
+        nodes[i].SetPosition(Vec3((float)(i % 8) * 10.0f, 0.0f, (float)(i / 8) * 10.0f));
+    }
+    nodes[64].SetPosition(Vec3(200.0f, 0.0f, 71.0f));
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        nodes[i].UpdateAbsolutePosition();
+        tree.Insert(&nodes[i]);
+    }
+
+    // grazes the fat boxes of the last row and misses the nodes, each miss
+    // runs a nested query before the walk goes on to the one it does hit
+    const Ray ray(Vec3(-20.0f, 0.0f, 71.05f), Vec3(1.0f, 0.0f, 0.0f));
+    float t;
+    Node3D *hit = tree.Raycast(ray, t);
+    return hit == &nodes[64] && NearlyEqual(t, 219.0f, 1e-4f) && nodes[56].neighbours > 0;
+}
+CHECK(CheckSpatialReentrantQuery);
+
+static void BM_SpatialMoveAll(BenchState &state)
+{
+    SpatialSet &d = Fixture<SpatialSet>();
+    while (state.KeepRunning())
+    {
+        d.step();
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * NODE_COUNT);
+}
+BENCHMARK(BM_SpatialMoveAll);
+
+static void BM_SpatialFrustum(BenchState &state)
+{
+    SpatialSet &d = Fixture<SpatialSet>();
+    while (state.KeepRunning())
+    {
+        d.results.clear();
+        u32 count = d.tree.QueryFrustum(d.frustum, d.results);
+        DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.Iterations() * NODE_COUNT);
+}
+BENCHMARK(BM_SpatialFrustum);
+
+static void BM_LinearFrustum(BenchState &state)
+{
+    SpatialSet &d = Fixture<SpatialSet>();
+    while (state.KeepRunning())
+    {
+        d.results.clear();
+        for (unsigned int i = 0; i < NODE_COUNT; ++i)
+            if (d.frustum.intersectsBox(d.nodes[i].GetTransformedBoundingBox()))
+                d.results.push_back(&d.nodes[i]);
+        DoNotOptimize(d.results.size());
+    }
+    state.SetItemsProcessed(state.Iterations() * NODE_COUNT);
+}
+BENCHMARK(BM_LinearFrustum);
+
+static void BM_SpatialSphere(BenchState &state)
+{
+    SpatialSet &d = Fixture<SpatialSet>();
+    while (state.KeepRunning())
+    {
+        d.results.clear();
+        u32 count = 0;
+        for (int i = 0; i < 64; ++i)
+            count += d.tree.QuerySphere(d.nodes[i].GetAbsolutePosition(), 30.0f, d.results);
+        DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.Iterations() * 64);
+}
+BENCHMARK(BM_SpatialSphere);
+
+static void BM_SpatialRaycast(BenchState &state)
+{
+    SpatialSet &d = Fixture<SpatialSet>();
+    while (state.KeepRunning())
+    {
+        int hits = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            float t;
+            Ray ray(Vec3(-1000.0f + i * 30.0f, 25.0f, -1100.0f), Vec3(0.05f, 0.0f, 1.0f));
+            hits += d.tree.Raycast(ray, t) != nullptr;
+        }
+        DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.Iterations() * 64);
+}
+BENCHMARK(BM_SpatialRaycast);
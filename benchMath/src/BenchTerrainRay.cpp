@@ -0,0 +1,137 @@
+#include "Bench.hpp"
+#include "Scene.hpp"
+
+//
+// HeightmapRaycaster against testing every cell of the heightmap.
+//
+
+static const int MAP_SIZE = 512;
+static const unsigned int TERRAIN_RAY_COUNT = 4096;
+
+struct TerrainRaySet
+{
+    Heightmap heightmap;
+    HeightmapRaycaster raycaster;
+    std::vector<Ray> rays;
+    std::vector<TerrainHit> hits;
+    Vec3 position, scale;
+
+    TerrainRaySet() : heightmap(200.0f), hits(TERRAIN_RAY_COUNT), position(-1000.0f, -50.0f, -1000.0f), scale(4.0f, 1.0f, 4.0f)
+    {
+        // 16 bit RAW written once to a temp file so the normal load path is used
+        std::vector<u16> samples(MAP_SIZE * MAP_SIZE);
+        for (int z = 0; z < MAP_SIZE; ++z)
+            for (int x = 0; x < MAP_SIZE; ++x)
+            {
+                float h = 0.5f + 0.25f * sinf(x * 0.031f) * cosf(z * 0.023f) + 0.2f * sinf((x + z) * 0.11f) * RandomFloat(0.8f, 1.0f);
+                samples[z * MAP_SIZE + x] = (u16)(Clamp(h, 0.0f, 1.0f) * 65535.0f);
+            }
+        const char *path = "benchMath_heightmap.raw";
+        FILE *file = fopen(path, "wb");
+        if (file)
+        {
+            fwrite(samples.data(), sizeof(u16), samples.size(), file);
+            fclose(file);
+        }
+        heightmap.Load(path, 16);
+        remove(path);
+        raycaster.Build(heightmap, position, scale);
+
+        // AI style visibility rays: agents a few metres above ground looking around
+        for (unsigned int i = 0; i < TERRAIN_RAY_COUNT; ++i)
+        {
+            Vec3 origin(RandomFloat(-900.0f, 900.0f), 200.0f, RandomFloat(-900.0f, 900.0f));
+            Vec3 direction(RandomFloat(-1.0f, 1.0f), RandomFloat(-0.6f, -0.05f), RandomFloat(-1.0f, 1.0f));
+            rays.push_back(Ray(origin, direction));
+        }
+    }
+
+    bool bruteForce(const Ray &ray, float &best)
+    {
+        best = M_INFINITY;
+        for (int z = 0; z < MAP_SIZE - 1; ++z)
+        {
+            for (int x = 0; x < MAP_SIZE - 1; ++x)
+            {
+                Vec3 p00 = position + Vec3(x * scale.x, heightmap.GetHeight(x, z) * scale.y, z * scale.z);
+                Vec3 p10 = position + Vec3((x + 1) * scale.x, heightmap.GetHeight(x + 1, z) * scale.y, z * scale.z);
+                Vec3 p01 = position + Vec3(x * scale.x, heightmap.GetHeight(x, z + 1) * scale.y, (z + 1) * scale.z);
+                Vec3 p11 = position + Vec3((x + 1) * scale.x, heightmap.GetHeight(x + 1, z + 1) * scale.y, (z + 1) * scale.z);
+                float t;
+                if (ray.intersectTriangle(Triangle(p00, p10, p01), t) && t > Epsilon && t < best)
+                    best = t;
+                if (ray.intersectTriangle(Triangle(p10, p11, p01), t) && t > Epsilon && t < best)
+                    best = t;
+            }
+        }
+        return best != M_INFINITY;
+    }
+};
+
+static bool CheckHeightmapRaycast()
+{
+    TerrainRaySet &d = Fixture<TerrainRaySet>();
+    if (d.heightmap.GetWidth() != MAP_SIZE)
+        return false;
+
+    for (unsigned int i = 0; i < TERRAIN_RAY_COUNT; i += 97)
+    {
+        float expected;
+        bool expectedHit = d.bruteForce(d.rays[i], expected);
+        TerrainHit hit;
+        bool found = d.raycaster.Raycast(d.rays[i], hit);
+        if (found != expectedHit)
+            return false;
+        if (!found)
+            continue;
+        if (!NearlyEqual(hit.t, expected, 1e-4f) || hit.normal.y <= 0.0f)
+            return false;
+
+        // halfway to the hit point is visible, a point below the surface is not
+        Vec3 halfway = d.rays[i].origin + d.rays[i].direction * (hit.t * 0.5f);
+        Vec3 below = hit.position - Vec3(0.0f, 5.0f, 0.0f);
+        if (!d.raycaster.LineOfSight(d.rays[i].origin, halfway) || d.raycaster.LineOfSight(d.rays[i].origin, below))
+            return false;
+    }
+    return true;
+}
+CHECK(CheckHeightmapRaycast);
+
+static void BM_HeightmapRaycast(BenchState &state)
+{
+    TerrainRaySet &d = Fixture<TerrainRaySet>();
+    while (state.KeepRunning())
+    {
+        int count = d.raycaster.Raycast(d.rays.data(), d.hits.data(), TERRAIN_RAY_COUNT);
+        DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.Iterations() * TERRAIN_RAY_COUNT);
+}
+BENCHMARK(BM_HeightmapRaycast);
+
+static void BM_HeightmapLineOfSight(BenchState &state)
+{
+    TerrainRaySet &d = Fixture<TerrainRaySet>();
+    while (state.KeepRunning())
+    {
+        int visible = 0;
+        for (unsigned int i = 0; i + 1 < TERRAIN_RAY_COUNT; ++i)
+            visible += d.raycaster.LineOfSight(d.rays[i].origin, d.rays[i + 1].origin - Vec3(0.0f, 190.0f, 0.0f));
+        DoNotOptimize(visible);
+    }
+    state.SetItemsProcessed(state.Iterations() * (TERRAIN_RAY_COUNT - 1));
+}
+BENCHMARK(BM_HeightmapLineOfSight);
+
+static void BM_HeightmapBruteForce(BenchState &state)
+{
+    TerrainRaySet &d = Fixture<TerrainRaySet>();
+    while (state.KeepRunning())
+    {
+        float t;
+        bool found = d.bruteForce(d.rays[0], t);
+        DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+BENCHMARK(BM_HeightmapBruteForce);
@@ -0,0 +1,207 @@
+#include "Bench.hpp"
+#include "Scene.hpp"
+#include <thread>
+
+//
+// TransformHierarchy against per node Node3D updates, 128k nodes in 1024
+// trees. Node3D is walked in creation order (parents first), its best case.
+//
+
+static const int HIERARCHY_COUNT = 131072;
+static const int HIERARCHY_ROOTS = 1024;
+
+struct HierarchySet
+{
+    TransformHierarchy hierarchy;
+    std::vector<int> handles;
+    std::vector<int> parents;
+    std::vector<Node3D *> nodes;
+    std::vector<Vec3> positions;
+    std::vector<Quat> rotations;
+    std::vector<Vec3> angles;
+
+    HierarchySet() : handles(HIERARCHY_COUNT), parents(HIERARCHY_COUNT), nodes(HIERARCHY_COUNT), positions(HIERARCHY_COUNT), rotations(HIERARCHY_COUNT), angles(HIERARCHY_COUNT)
+    {
+        for (int i = 0; i < HIERARCHY_COUNT; ++i)
+        {
+            // random earlier node, so siblings end up scattered until sorted
+            parents[i] = i < HIERARCHY_ROOTS ? TRANSFORM_NULL : (int)RandomFloat(Max(0, i - 8192), (float)i);
+            parents[i] = Min(parents[i], i - 1);
+            handles[i] = hierarchy.Create(parents[i] == TRANSFORM_NULL ? TRANSFORM_NULL : handles[parents[i]]);
+
+            positions[i] = Vec3(RandomFloat(-10, 10), RandomFloat(-10, 10), RandomFloat(-10, 10));
+            angles[i] = Vec3(RandomFloat(-180, 180), RandomFloat(-180, 180), RandomFloat(-180, 180));
+            rotations[i] = Quat::FromYawPitchRoll(angles[i].y * dtor, angles[i].x * dtor, angles[i].z * dtor);
+            hierarchy.SetLocal(handles[i], positions[i], rotations[i], Vec3(1.0f, 1.0f, 1.0f));
+
+            nodes[i] = new Node3D(positions[i], angles[i]);
+            if (parents[i] != TRANSFORM_NULL)
+                nodes[i]->SetParent(nodes[parents[i]]);
+        }
+        hierarchy.Update();
+    }
+
+    ~HierarchySet()
+    {
+        for (size_t i = 0; i < nodes.size(); ++i)
+            delete nodes[i];
+    }
+};
+
+// local point through every ancestor, straight from the TRS values
+static Vec3 referencePoint(const TransformHierarchy &h, int handle, Vec3 p)
+{
+    for (; handle != TRANSFORM_NULL; handle = h.GetParent(handle))
+    {
+        const Vec3 &s = h.GetScale(handle);
+        p = h.GetRotation(handle).rotate(Vec3(p.x * s.x, p.y * s.y, p.z * s.z)) + h.GetPosition(handle);
+    }
+    return p;
+}
+
+static bool matchesReference(const TransformHierarchy &h, int handle)
+{
+    Vec3 p(0.5f, -1.0f, 2.0f);
+    Vec3 expected = referencePoint(h, handle, p);
+    h.GetWorldMatrix(handle).transformPoint(p);
+    return NearlyEqual(p.x, expected.x, 1e-4f) && NearlyEqual(p.y, expected.y, 1e-4f) && NearlyEqual(p.z, expected.z, 1e-4f);
+}
+
+static bool CheckTransformHierarchy()
+{
+    HierarchySet &d = Fixture<HierarchySet>();
+    for (int i = 0; i < HIERARCHY_COUNT; i += 97)
+        if (!matchesReference(d.hierarchy, d.handles[i]))
+            return false;
+
+    // depth first: parents first and every subtree contiguous
+    for (int i = 0; i < HIERARCHY_COUNT; ++i)
+    {
+        const int parent = d.hierarchy.GetParent(d.handles[i]);
+        if (parent != TRANSFORM_NULL && d.hierarchy.GetIndex(parent) >= d.hierarchy.GetIndex(d.handles[i]))
+            return false;
+    }
+
+    // a dirty node recomputes its subtree and nothing else
+    TransformHierarchy h;
+    int root = h.Create();
+    int a = h.Create(root);
+    int b = h.Create(root);
+    int c = h.Create(a);
+    int e = h.Create(c);
+    h.SetScale(root, Vec3(2.0f, 2.0f, 2.0f));
+    h.SetRotation(a, Quat(Vec3(0.0f, 1.0f, 0.0f), 0.7f));
+    h.SetPosition(c, Vec3(1.0f, 2.0f, 3.0f));
+    h.SetPosition(e, Vec3(0.0f, 0.0f, 4.0f));
+    h.Update();
+    h.SetPosition(a, Vec3(5.0f, 0.0f, 0.0f));
+    h.Update();
+    if (h.HasChanged(root) || !h.HasChanged(a) || h.HasChanged(b) || !h.HasChanged(c) || !h.HasChanged(e) || !matchesReference(h, e))
+        return false;
+
+    // reparent out of order, cycles are refused
+    if (h.SetParent(a, e))
+        return false;
+    int f = h.Create();
+    h.SetPosition(f, Vec3(0.0f, -3.0f, 0.0f));
+    if (!h.SetParent(a, f))
+        return false;
+    h.Update();
+    if (h.GetParent(a) != f || !matchesReference(h, e) || h.GetIndex(f) >= h.GetIndex(a))
+        return false;
+
+    // destroy takes the subtree, freed handles are reused
+    h.Destroy(a);
+    if (h.GetCount() != 3)
+        return false;
+    int g = h.Create(b);
+    h.Update();
+    if (h.GetCount() != 4 || (g != a && g != c && g != e) || h.GetParent(g) != b || !matchesReference(h, g))
+        return false;
+
+    // the partition covers the array with whole root subtrees
+    std::vector<int> bounds;
+    d.hierarchy.Prepare();
+    int ranges = d.hierarchy.Partition(8, bounds);
+    if (ranges < 2 || bounds.front() != 0 || bounds.back() != d.hierarchy.GetCount())
+        return false;
+    for (int r = 1; r < ranges; ++r)
+    {
+        const int first = bounds[r];
+        for (int i = 0; i < HIERARCHY_COUNT; ++i)
+            if (d.hierarchy.GetIndex(d.handles[i]) == first && d.hierarchy.GetParent(d.handles[i]) != TRANSFORM_NULL)
+                return false;
+    }
+    return true;
+}
+CHECK(CheckTransformHierarchy);
+
+static void BM_Node3DUpdateAll(BenchState &state)
+{
+    HierarchySet &d = Fixture<HierarchySet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < HIERARCHY_COUNT; ++i)
+        {
+            d.nodes[i]->SetPosition(d.positions[i]);
+            d.nodes[i]->SetRotation(d.angles[i]);
+            d.nodes[i]->UpdateAbsolutePosition();
+        }
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * HIERARCHY_COUNT);
+}
+BENCHMARK(BM_Node3DUpdateAll);
+
+static void BM_HierarchyUpdateAll(BenchState &state)
+{
+    HierarchySet &d = Fixture<HierarchySet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < HIERARCHY_COUNT; ++i)
+            d.hierarchy.SetLocal(d.handles[i], d.positions[i], d.rotations[i], Vec3(1.0f, 1.0f, 1.0f));
+        d.hierarchy.Update();
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * HIERARCHY_COUNT);
+}
+BENCHMARK(BM_HierarchyUpdateAll);
+
+// 1% of the nodes move, their subtrees follow
+static void BM_HierarchyUpdateSparse(BenchState &state)
+{
+    HierarchySet &d = Fixture<HierarchySet>();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < HIERARCHY_COUNT; i += 100)
+            d.hierarchy.SetPosition(d.handles[i], d.positions[i]);
+        d.hierarchy.Update();
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * HIERARCHY_COUNT);
+}
+BENCHMARK(BM_HierarchyUpdateSparse);
+
+static void BM_HierarchyUpdateParallel(BenchState &state)
+{
+    HierarchySet &d = Fixture<HierarchySet>();
+    const int threads = Max(1, Min(8, (int)std::thread::hardware_concurrency()));
+    std::vector<int> bounds;
+    std::vector<std::thread> workers;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < HIERARCHY_COUNT; ++i)
+            d.hierarchy.SetLocal(d.handles[i], d.positions[i], d.rotations[i], Vec3(1.0f, 1.0f, 1.0f));
+        d.hierarchy.Prepare();
+        const int ranges = d.hierarchy.Partition(threads, bounds);
+        workers.clear();
+        for (int r = 1; r < ranges; ++r)
+            workers.push_back(std::thread(&TransformHierarchy::UpdateRange, &d.hierarchy, bounds[r], bounds[r + 1]));
+        d.hierarchy.UpdateRange(bounds[0], bounds[1]);
+        for (size_t w = 0; w < workers.size(); ++w)
+            workers[w].join();
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * HIERARCHY_COUNT);
+}
+BENCHMARK(BM_HierarchyUpdateParallel);
@@ -0,0 +1,72 @@
+#include "Bench.hpp"
+
+std::vector<BenchEntry> &GetBenchmarks()
+{
+    static std::vector<BenchEntry> benchmarks;
+    return benchmarks;
+}
+
+std::vector<CheckEntry> &GetChecks()
+{
+    static std::vector<CheckEntry> checks;
+    return checks;
+}
+
+static double runOnce(BenchFunction function, u64 iterations, u64 &items)
+{
+    BenchState state(iterations);
+    auto start = std::chrono::steady_clock::now();
+    function(state);
+    auto end = std::chrono::steady_clock::now();
+    items = state.ItemsProcessed();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// usage: benchMath|benchRender [filter]   runs the checks, then every benchmark whose name contains filter
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+    srand(1234);
+
+    int failed = 0;
+    for (const CheckEntry &check : GetChecks())
+    {
+        if (filter && !strstr(check.name, filter))
+            continue;
+        bool ok = check.function();
+        printf("%-40s %s\n", check.name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failed++;
+    }
+
+    printf("\n%-40s %14s %14s %16s\n", "Benchmark", "Time/iter", "Iterations", "Items/s");
+    printf("--------------------------------------------------------------------------------------\n");
+
+    for (const BenchEntry &bench : GetBenchmarks())
+    {
+        if (filter && !strstr(bench.name, filter))
+            continue;
+
+        // one untimed run first so lazily built test data is not measured
+        u64 iterations = 1;
+        u64 items = 0;
+        runOnce(bench.function, iterations, items);
+
+        // grow the iteration count until one run takes at least 0.2s
+        double seconds = runOnce(bench.function, iterations, items);
+        while (seconds < 0.2 && iterations < (1ull << 40))
+        {
+            double scale = seconds > 0.0 ? 0.3 / seconds : 100.0;
+            iterations = (u64)(iterations * Clamp((float)scale, 2.0f, 100.0f));
+            seconds = runOnce(bench.function, iterations, items);
+        }
+
+        double perIteration = seconds / iterations * 1e9;
+        if (items > 0)
+            printf("%-40s %11.2f ns %14llu %14.2fM\n", bench.name, perIteration, (unsigned long long)iterations, items / seconds / 1e6);
+        else
+            printf("%-40s %11.2f ns %14llu %16s\n", bench.name, perIteration, (unsigned long long)iterations, "-");
+    }
+
+    return failed == 0 ? 0 : 1;
+}
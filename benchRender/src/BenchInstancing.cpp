@@ -0,0 +1,95 @@
+#include "Bench.hpp"
+#include "Mesh.hpp"
+
+//
+// Per frame instance streaming on the CPU side: cull a field of grass clumps
+// and pack the visible ones, as matrices and as InstanceTRS.
+//
+
+static const u32 INSTANCE_COUNT = 14400;
+
+struct InstanceSet
+{
+    std::vector<InstanceTRS> field;
+    std::vector<InstanceTRS> visibleTRS;
+    std::vector<Mat4> visibleMatrices;
+    Frustum frustum;
+
+    InstanceSet() : field(INSTANCE_COUNT)
+    {
+        for (u32 i = 0; i < INSTANCE_COUNT; ++i)
+        {
+            InstanceTRS &instance = field[i];
+            instance.position = Vec3(RandomFloat(-60, 60), 0.0f, RandomFloat(-60, 60));
+            instance.rotation = Quat(Vec3(0.0f, 1.0f, 0.0f), RandomFloat(0.0f, 360.0f));
+            instance.scale = Vec3(1.0f, RandomFloat(0.45f, 1.15f), 1.0f);
+            instance.color = Color(255, 255, 255, 255);
+        }
+        visibleTRS.reserve(INSTANCE_COUNT);
+        visibleMatrices.reserve(INSTANCE_COUNT);
+
+        // a camera at the edge of the field looking across it
+        const Mat4 view = Mat4::LookAt(Vec3(0.0f, 2.0f, 60.0f), Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f));
+        const Mat4 projection = Mat4::Perspective(45.0f, 4.0f / 3.0f, 0.1f, 1000.0f);
+        frustum.update(view * projection);
+    }
+};
+
+// Quat::toMat4 is laid out for column vectors, transformPoint wants the transpose
+static Mat4 toMatrix(const InstanceTRS &instance)
+{
+    return Mat4::Scale(instance.scale) * instance.rotation.toMat4().transpose() * Mat4::Translate(instance.position);
+}
+
+// conservative box of a clump, the same test the sample runs
+static bool clumpVisible(const Frustum &frustum, const Vec3 &position)
+{
+    const Vec3 extent(1.0f, 1.75f, 1.0f);
+    return frustum.intersectsBox(position - extent, position + extent);
+}
+
+static bool CheckInstanceTRS()
+{
+    InstanceSet &d = Fixture<InstanceSet>();
+    for (u32 i = 0; i < 256; ++i)
+    {
+        const Vec3 point(RandomFloat(-1, 1), RandomFloat(0, 1.5f), RandomFloat(-1, 1));
+        Vec3 expected = point;
+        toMatrix(d.field[i]).transformPoint(expected);
+        const Vec3 packed = d.field[i].transformPoint(point);
+        if ((expected - packed).length() > 1e-4f)
+            return false;
+    }
+    return sizeof(InstanceTRS) < sizeof(Mat4);
+}
+CHECK(CheckInstanceTRS);
+
+static void BM_InstanceCullPackTRS(BenchState &state)
+{
+    InstanceSet &d = Fixture<InstanceSet>();
+    while (state.KeepRunning())
+    {
+        d.visibleTRS.clear();
+        for (u32 i = 0; i < INSTANCE_COUNT; ++i)
+            if (clumpVisible(d.frustum, d.field[i].position))
+                d.visibleTRS.push_back(d.field[i]);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * INSTANCE_COUNT);
+}
+BENCHMARK(BM_InstanceCullPackTRS);
+
+static void BM_InstanceCullPackMatrix(BenchState &state)
+{
+    InstanceSet &d = Fixture<InstanceSet>();
+    while (state.KeepRunning())
+    {
+        d.visibleMatrices.clear();
+        for (u32 i = 0; i < INSTANCE_COUNT; ++i)
+            if (clumpVisible(d.frustum, d.field[i].position))
+                d.visibleMatrices.push_back(toMatrix(d.field[i]));
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * INSTANCE_COUNT);
+}
+BENCHMARK(BM_InstanceCullPackMatrix);
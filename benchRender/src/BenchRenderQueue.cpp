@@ -0,0 +1,141 @@
+#include "Bench.hpp"
+#include "RenderQueue.hpp"
+#include <algorithm>
+
+//
+// Render queue keys and the per frame radix sort, against std::sort on the
+// same packets. A frame is a few thousand draws over a handful of shaders,
+// textures and meshes.
+//
+
+static const u32 QUEUE_PACKETS = 4096;
+
+struct PacketSet
+{
+    std::vector<RenderPacket> packets;
+    std::vector<RenderPacket> work;
+    std::vector<RenderPacket> scratch;
+
+    PacketSet() : packets(QUEUE_PACKETS), work(QUEUE_PACKETS), scratch(QUEUE_PACKETS)
+    {
+        for (u32 i = 0; i < QUEUE_PACKETS; ++i)
+        {
+            const bool transparent = i % 8 == 0;
+            const u32 pass = transparent ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+            const RenderSort sort = transparent ? SORT_BACK_TO_FRONT : SORT_STATE;
+            const float distance = RandomFloat(0.5f, 500.0f);
+            packets[i].key = RenderQueue::MakeKey(pass, sort, 1 + (u32)RandomFloat(0, 6), 10 + (u32)RandomFloat(0, 40), 3 + (u32)RandomFloat(0, 120), distance * distance);
+            packets[i].command = i;
+        }
+    }
+};
+
+static bool keyLess(const RenderPacket &a, const RenderPacket &b)
+{
+    return a.key < b.key;
+}
+
+static void noDraw(void *)
+{
+}
+
+static bool CheckRenderQueueSort()
+{
+    PacketSet &d = Fixture<PacketSet>();
+    std::vector<RenderPacket> expected = d.packets;
+    std::stable_sort(expected.begin(), expected.end(), keyLess);
+
+    // radix sort is stable too, so even equal keys keep their command order
+    d.work = d.packets;
+    RenderQueue::SortPackets(d.work.data(), d.scratch.data(), QUEUE_PACKETS);
+    for (u32 i = 0; i < QUEUE_PACKETS; ++i)
+        if (d.work[i].key != expected[i].key || d.work[i].command != expected[i].command)
+            return false;
+
+    // a single key value, every digit skipped
+    std::vector<RenderPacket> same(64);
+    for (u32 i = 0; i < same.size(); ++i)
+    {
+        same[i].key = 0x123456789ull;
+        same[i].command = i;
+    }
+    RenderQueue::SortPackets(same.data(), d.scratch.data(), (u32)same.size());
+    for (u32 i = 0; i < same.size(); ++i)
+        if (same[i].command != i)
+            return false;
+    return true;
+}
+CHECK(CheckRenderQueueSort);
+
+static bool CheckRenderQueuePolicies()
+{
+    RenderQueue queue;
+    queue.Begin(Vec3(0.0f, 0.0f, 0.0f));
+
+    // transparent far to near, opaque near to far, opaque before transparent
+    const float distances[4] = {3.0f, 40.0f, 0.75f, 12.0f};
+    for (int i = 0; i < 4; ++i)
+        queue.Submit(RENDER_PASS_TRANSPARENT, nullptr, noDraw, nullptr, distances[i]);
+    for (int i = 0; i < 4; ++i)
+        queue.Submit(RENDER_PASS_OPAQUE, nullptr, noDraw, nullptr, distances[i]);
+    queue.Sort();
+
+    const u32 order[8] = {6, 4, 7, 5, 1, 3, 0, 2};
+    const RenderPacket *packets = queue.GetPackets();
+    for (u32 i = 0; i < 8; ++i)
+        if (packets[i].command != order[i])
+            return false;
+
+    // state first: the shader decides before the depth, depth first: the reverse
+    const u64 nearState = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SORT_STATE, 2, 1, 1, 1.0f);
+    const u64 farState = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SORT_STATE, 1, 1, 1, 100.0f);
+    const u64 nearDepth = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SORT_FRONT_TO_BACK, 2, 1, 1, 1.0f);
+    const u64 farDepth = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SORT_FRONT_TO_BACK, 1, 1, 1, 100.0f);
+    return farState < nearState && nearDepth < farDepth;
+}
+CHECK(CheckRenderQueuePolicies);
+
+static void BM_RenderQueueRadixSort(BenchState &state)
+{
+    PacketSet &d = Fixture<PacketSet>();
+    while (state.KeepRunning())
+    {
+        d.work = d.packets;
+        RenderQueue::SortPackets(d.work.data(), d.scratch.data(), QUEUE_PACKETS);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * QUEUE_PACKETS);
+}
+BENCHMARK(BM_RenderQueueRadixSort);
+
+static void BM_RenderQueueStdSort(BenchState &state)
+{
+    PacketSet &d = Fixture<PacketSet>();
+    while (state.KeepRunning())
+    {
+        d.work = d.packets;
+        std::sort(d.work.begin(), d.work.end(), keyLess);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * QUEUE_PACKETS);
+}
+BENCHMARK(BM_RenderQueueStdSort);
+
+// full frame on the CPU side: submit every draw, then sort
+static void BM_RenderQueueSubmitSort(BenchState &state)
+{
+    RenderQueue queue;
+    std::vector<float> distances(QUEUE_PACKETS);
+    for (u32 i = 0; i < QUEUE_PACKETS; ++i)
+        distances[i] = RandomFloat(0.5f, 500.0f);
+    while (state.KeepRunning())
+    {
+        queue.Begin(Vec3(0.0f, 0.0f, 0.0f));
+        for (u32 i = 0; i < QUEUE_PACKETS; ++i)
+            queue.Submit(i % 8 == 0 ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE, nullptr, noDraw, nullptr, distances[i]);
+        queue.Sort();
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * QUEUE_PACKETS);
+}
+BENCHMARK(BM_RenderQueueSubmitSort);
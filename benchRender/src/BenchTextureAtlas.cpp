@@ -0,0 +1,164 @@
+#include "Bench.hpp"
+#include "TextureAtlas.hpp"
+#include <algorithm>
+
+//
+// MaxRects packing of sprite sized rectangles into 1024x1024 pages, and the
+// CPU side of adding images to an atlas (no GL: pages are only uploaded by
+// TextureAtlas::Upload).
+//
+
+static const int PAGE_SIZE = 1024;
+static const u32 SPRITE_COUNT = 600;
+
+struct SpriteSet
+{
+    std::vector<int> widths;
+    std::vector<int> heights;
+
+    SpriteSet() : widths(SPRITE_COUNT), heights(SPRITE_COUNT)
+    {
+        for (u32 i = 0; i < SPRITE_COUNT; ++i)
+        {
+            widths[i] = (int)RandomFloat(8.0f, 64.0f);
+            heights[i] = (int)RandomFloat(8.0f, 64.0f);
+        }
+    }
+};
+
+static bool overlaps(const Rectangle &a, const Rectangle &b)
+{
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static bool CheckRectPacker()
+{
+    SpriteSet &d = Fixture<SpriteSet>();
+
+    // largest first, the way TextureAtlas::Build feeds it
+    std::vector<u32> order(SPRITE_COUNT);
+    for (u32 i = 0; i < SPRITE_COUNT; ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&d](u32 a, u32 b) { return Max(d.widths[a], d.heights[a]) > Max(d.widths[b], d.heights[b]); });
+
+    RectPacker packer;
+    packer.Init(PAGE_SIZE, PAGE_SIZE);
+    std::vector<Rectangle> placed;
+    for (u32 i = 0; i < SPRITE_COUNT; ++i)
+    {
+        int x, y;
+        const int w = d.widths[order[i]];
+        const int h = d.heights[order[i]];
+        if (!packer.Insert(w, h, x, y))
+            return false;
+        if (x < 0 || y < 0 || x + w > PAGE_SIZE || y + h > PAGE_SIZE)
+            return false;
+        placed.push_back(Rectangle((float)x, (float)y, (float)w, (float)h));
+    }
+    for (size_t i = 0; i < placed.size(); ++i)
+        for (size_t j = i + 1; j < placed.size(); ++j)
+            if (overlaps(placed[i], placed[j]))
+                return false;
+
+    // fill the rest with 16x16 tiles: a packer that wastes space stops early
+    int x, y;
+    while (packer.Insert(16, 16, x, y))
+    {
+    }
+    return packer.GetOccupancy() > 0.9f;
+}
+CHECK(CheckRectPacker);
+
+static bool CheckTextureAtlas()
+{
+    TextureAtlas atlas;
+    atlas.Init(256, 256, 1);
+
+    Pixmap sprite(30, 30, 4);
+    sprite.Fill(255, 0, 0, 255);
+    const s32 first = atlas.Add("red", sprite);
+    if (first != 0 || atlas.Add("red", sprite) != first || atlas.Find("red") != first || atlas.Find("blue") != -1)
+        return false;
+
+    // names are single tokens of the index file
+    if (atlas.Add("two words", sprite) != -1 || atlas.Add("", sprite) != -1 || atlas.Add(std::string(256, 'a'), sprite) != -1 ||
+        atlas.Add(std::string(255, 'a'), sprite) < 0)
+        return false;
+    // the page texture has its size before the first Upload
+    if (atlas.GetPageTexture(0)->GetWidth() != 256 || atlas.GetPageTexture(0)->GetHeight() != 256)
+        return false;
+
+    // too large for a page with its padding
+    Pixmap large(255, 10, 4);
+    large.Fill(0);
+    if (atlas.Add("large", large) != -1)
+        return false;
+
+    // 64 sprites of 32x32 with padding need more than one 256x256 page
+    for (int i = 0; i < 64; ++i)
+        if (atlas.Add("sprite" + std::to_string(i), sprite) < 0)
+            return false;
+    if (atlas.GetPageCount() < 2 || atlas.GetRegionCount() != 66)
+        return false;
+
+    for (u32 i = 0; i < atlas.GetRegionCount(); ++i)
+    {
+        const AtlasRegion &a = atlas.GetRegion(i);
+        if (a.texture != atlas.GetPageTexture(a.page) || a.src.x < 1 || a.src.y < 1 || a.src.x + a.src.width > 255 || a.src.y + a.src.height > 255)
+            return false;
+        // padded rectangles never overlap
+        const Rectangle paddedA(a.src.x - 1, a.src.y - 1, a.src.width + 2, a.src.height + 2);
+        for (u32 j = i + 1; j < atlas.GetRegionCount(); ++j)
+        {
+            const AtlasRegion &b = atlas.GetRegion(j);
+            const Rectangle paddedB(b.src.x - 1, b.src.y - 1, b.src.width + 2, b.src.height + 2);
+            if (a.page == b.page && overlaps(paddedA, paddedB))
+                return false;
+        }
+    }
+    return true;
+}
+CHECK(CheckTextureAtlas);
+
+static void BM_RectPackerInsert(BenchState &state)
+{
+    SpriteSet &d = Fixture<SpriteSet>();
+    RectPacker packer;
+    while (state.KeepRunning())
+    {
+        packer.Init(PAGE_SIZE, PAGE_SIZE);
+        int x, y;
+        for (u32 i = 0; i < SPRITE_COUNT; ++i)
+            DoNotOptimize(packer.Insert(d.widths[i], d.heights[i], x, y));
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * SPRITE_COUNT);
+}
+BENCHMARK(BM_RectPackerInsert);
+
+static void BM_TextureAtlasAdd(BenchState &state)
+{
+    SpriteSet &d = Fixture<SpriteSet>();
+    std::vector<Pixmap *> sprites;
+    std::vector<std::string> names;
+    for (u32 i = 0; i < 64; ++i)
+    {
+        sprites.push_back(new Pixmap(d.widths[i], d.heights[i], 4));
+        sprites.back()->Fill(0xFF00FFFF);
+        names.push_back("sprite" + std::to_string(i));
+    }
+
+    TextureAtlas atlas;
+    while (state.KeepRunning())
+    {
+        atlas.Init(PAGE_SIZE, PAGE_SIZE, 1);
+        for (u32 i = 0; i < 64; ++i)
+            DoNotOptimize(atlas.Add(names[i], *sprites[i]));
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * 64);
+
+    for (size_t i = 0; i < sprites.size(); ++i)
+        delete sprites[i];
+}
+BENCHMARK(BM_TextureAtlasAdd);
@@ -0,0 +1,227 @@
+#include "Bench.hpp"
+#include "TextureFile.hpp"
+#include <cmath>
+#include <cstring>
+
+//
+// Block compression of a 256x256 terrain-like texture (smooth gradients plus
+// grain), and the CPU side of loading a cooked file against building the
+// mip chain at load time.
+//
+
+static const int IMAGE_SIZE = 256;
+
+struct TextureSet
+{
+    Pixmap image;
+
+    TextureSet() : image(IMAGE_SIZE, IMAGE_SIZE, 4)
+    {
+        for (int y = 0; y < IMAGE_SIZE; ++y)
+            for (int x = 0; x < IMAGE_SIZE; ++x)
+            {
+                const float grain = RandomFloat(-6.0f, 6.0f);
+                const int r = (int)(96 + 64 * sinf(x * 0.031f) + grain);
+                const int g = (int)(128 + 48 * cosf(y * 0.027f) + grain);
+                const int b = (int)(64 + (x + y) * 0.2f + grain);
+                image.SetPixel(x, y, (u8)Clamp(r, 0, 255), (u8)Clamp(g, 0, 255), (u8)Clamp(b, 0, 255), (u8)((x * 255) / IMAGE_SIZE));
+            }
+    }
+};
+
+// mode 6 only, what CompressBlockBC7 writes
+static void decodeBC7Mode6(const u8 *block, u8 *rgba)
+{
+    u32 position = 0;
+    auto read = [&](u32 count) {
+        u32 value = 0;
+        for (u32 i = 0; i < count; ++i, ++position)
+            value |= (u32)((block[position >> 3] >> (position & 7)) & 1) << i;
+        return value;
+    };
+    static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    read(7);
+    int endpoint[2][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoint[0][c] = (int)read(7);
+        endpoint[1][c] = (int)read(7);
+    }
+    const int p0 = (int)read(1);
+    const int p1 = (int)read(1);
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoint[0][c] = (endpoint[0][c] << 1) | p0;
+        endpoint[1][c] = (endpoint[1][c] << 1) | p1;
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        const int w = weights[read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; ++c)
+            rgba[i * 4 + c] = (u8)(((64 - w) * endpoint[0][c] + w * endpoint[1][c] + 32) >> 6);
+    }
+}
+
+// root mean square error of level 0 over the first `channels` channels
+static float blockError(TextureFileFormat format, int channels)
+{
+    const Pixmap &image = Fixture<TextureSet>().image;
+    std::vector<u8> blocks;
+    if (!CompressImage(format, image.pixels, image.width, image.height, 4, blocks))
+        return 1e9f;
+
+    const u32 blockBytes = format == TEXTURE_FILE_BC1 || format == TEXTURE_FILE_BC4 ? 8 : 16;
+    const u8 *block = blocks.data();
+    double sum = 0.0;
+    for (int by = 0; by < IMAGE_SIZE / 4; ++by)
+        for (int bx = 0; bx < IMAGE_SIZE / 4; ++bx, block += blockBytes)
+        {
+            u8 decoded[64];
+            switch (format)
+            {
+            case TEXTURE_FILE_BC1:
+                DecompressBlockBC1(block, decoded);
+                break;
+            case TEXTURE_FILE_BC3:
+                DecompressBlockBC3(block, decoded);
+                break;
+            case TEXTURE_FILE_BC4:
+            case TEXTURE_FILE_BC5:
+            {
+                u8 red[16];
+                u8 green[16];
+                DecompressBlockBC4(block, red);
+                DecompressBlockBC4(block + 8, green);
+                for (int i = 0; i < 16; ++i)
+                {
+                    decoded[i * 4] = red[i];
+                    decoded[i * 4 + 1] = green[i];
+                }
+                break;
+            }
+            default:
+                decodeBC7Mode6(block, decoded);
+                break;
+            }
+            for (int y = 0; y < 4; ++y)
+                for (int x = 0; x < 4; ++x)
+                {
+                    const u8 *source = image.pixels + ((by * 4 + y) * IMAGE_SIZE + bx * 4 + x) * 4;
+                    for (int c = 0; c < channels; ++c)
+                    {
+                        const int d = source[c] - decoded[(y * 4 + x) * 4 + c];
+                        sum += d * d;
+                    }
+                }
+        }
+    return (float)sqrt(sum / ((double)IMAGE_SIZE * IMAGE_SIZE * channels));
+}
+
+static bool CheckBlockCompression()
+{
+    // about 2 / 2 / 0.6 / 1 on this image, far above means broken endpoints or indices
+    const float bc1 = blockError(TEXTURE_FILE_BC1, 3);
+    const float bc3 = blockError(TEXTURE_FILE_BC3, 4);
+    const float bc4 = blockError(TEXTURE_FILE_BC4, 1);
+    const float bc7 = blockError(TEXTURE_FILE_BC7, 4);
+    return bc1 < 8.0f && bc3 < 8.0f && bc4 < 4.0f && bc7 < 5.0f && bc7 < bc3;
+}
+CHECK(CheckBlockCompression);
+
+static bool CheckTextureFile()
+{
+    const Pixmap &image = Fixture<TextureSet>().image;
+    std::vector<u8> file;
+    if (!CookTexture(image, TEXTURE_FILE_BC7, true, file))
+        return false;
+
+    TextureFileView view;
+    if (!ParseTextureFile(file.data(), file.size(), view))
+        return false;
+    if (view.format != TEXTURE_FILE_BC7 || view.width != IMAGE_SIZE || view.levels != 9)
+        return false;
+    for (u32 i = 0; i < view.levels; ++i)
+        if ((view.level[i].offset & 15) != 0 || view.level[i].size != TextureFormatLevelSize(TEXTURE_FILE_BC7, view.level[i].width, view.level[i].height))
+            return false;
+    if (view.level[8].width != 1 || view.level[8].size != 16)
+        return false;
+
+    // level 0 is exactly what CompressImage gives
+    std::vector<u8> level0;
+    CompressImage(TEXTURE_FILE_BC7, image.pixels, image.width, image.height, 4, level0);
+    if (memcmp(view.GetLevelData(0), level0.data(), level0.size()) != 0)
+        return false;
+
+    // truncated and corrupt files are refused
+    TextureFileView bad;
+    if (ParseTextureFile(file.data(), file.size() - 1, bad))
+        return false;
+    std::vector<u8> corrupt = file;
+    corrupt[4] = 9;
+    if (ParseTextureFile(corrupt.data(), corrupt.size(), bad))
+        return false;
+
+    // a 1x1 texture with a second 1x1 level is longer than a full chain
+    TextureFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    header.width = 1;
+    header.height = 1;
+    header.levels = 2;
+    TextureFileLevel level = {64, TextureFormatLevelSize(TEXTURE_FILE_BC7, 1, 1), 1, 1};
+    std::vector<u8> tooLong(64 + level.size, 0);
+    memcpy(tooLong.data(), &header, sizeof(header));
+    memcpy(tooLong.data() + sizeof(header), &level, sizeof(level));
+    memcpy(tooLong.data() + sizeof(header) + sizeof(level), &level, sizeof(level));
+    return !ParseTextureFile(tooLong.data(), tooLong.size(), bad);
+}
+CHECK(CheckTextureFile);
+
+static void encodeBench(BenchState &state, TextureFileFormat format)
+{
+    const Pixmap &image = Fixture<TextureSet>().image;
+    std::vector<u8> blocks;
+    while (state.KeepRunning())
+    {
+        CompressImage(format, image.pixels, image.width, image.height, 4, blocks);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations() * IMAGE_SIZE * IMAGE_SIZE);
+}
+
+static void BM_CompressBC1(BenchState &state) { encodeBench(state, TEXTURE_FILE_BC1); }
+BENCHMARK(BM_CompressBC1);
+
+static void BM_CompressBC3(BenchState &state) { encodeBench(state, TEXTURE_FILE_BC3); }
+BENCHMARK(BM_CompressBC3);
+
+static void BM_CompressBC7(BenchState &state) { encodeBench(state, TEXTURE_FILE_BC7); }
+BENCHMARK(BM_CompressBC7);
+
+// what the loader does on the CPU for a cooked file: validate, then point at the levels
+static void BM_TextureFileParse(BenchState &state)
+{
+    std::vector<u8> file;
+    CookTexture(Fixture<TextureSet>().image, TEXTURE_FILE_BC1, true, file);
+    TextureFileView view;
+    while (state.KeepRunning())
+    {
+        DoNotOptimize(ParseTextureFile(file.data(), file.size(), view));
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+BENCHMARK(BM_TextureFileParse);
+
+// the uncompressed path it replaces: mip chain built at load
+static void BM_TextureCookMips(BenchState &state)
+{
+    std::vector<u8> file;
+    while (state.KeepRunning())
+    {
+        CookTexture(Fixture<TextureSet>().image, TEXTURE_FILE_RGBA8, true, file);
+        ClobberMemory();
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+BENCHMARK(BM_TextureCookMips);
@@ -0,0 +1,153 @@
+#include "Bench.hpp"
+#include "TextureStreamer.hpp"
+#include <algorithm>
+
+//
+// The GL free half of the texture streamer: wanted levels, the budget fit
+// and the per frame upload plan, on a cooked 256x256 RGBA8 file (levels of
+// 256, 64, 16 KB ... with the tail from 64x64, level 2).
+//
+
+static const int IMAGE_SIZE = 256;
+static const u32 TAIL_LEVEL = 2;
+static const u32 TEXTURE_COUNT = 256;
+
+struct StreamSet
+{
+    std::vector<u8> file;
+    TextureFileView view;
+
+    StreamSet()
+    {
+        Pixmap image(IMAGE_SIZE, IMAGE_SIZE, 4);
+        for (int y = 0; y < IMAGE_SIZE; ++y)
+            for (int x = 0; x < IMAGE_SIZE; ++x)
+                image.SetPixel(x, y, (u8)x, (u8)y, 128, 255);
+        CookTexture(image, TEXTURE_FILE_RGBA8, true, file);
+        ParseTextureFile(file.data(), file.size(), view);
+    }
+};
+
+static std::vector<StreamedTexture> makeTextures(const TextureStreamPolicy &policy, u32 count)
+{
+    std::vector<StreamedTexture> textures(count);
+    for (u32 i = 0; i < count; ++i)
+        policy.Setup(textures[i], Fixture<StreamSet>().view);
+    return textures;
+}
+
+static bool CheckStreamTargets()
+{
+    TextureStreamPolicy policy;
+    policy.SetBudget(~0ull);
+    policy.SetGraceFrames(2);
+    std::vector<StreamedTexture> textures = makeTextures(policy, 5);
+    if (textures[0].tail != TAIL_LEVEL || textures[0].resident != TAIL_LEVEL)
+        return false;
+
+    // about one texel per pixel, never finer than 0 nor coarser than the tail
+    policy.Touch(textures[0], 512.0f);
+    policy.Touch(textures[1], 256.0f);
+    policy.Touch(textures[2], 128.0f);
+    policy.Touch(textures[3], 32.0f);
+    policy.Touch(textures[2], 64.0f);   // the largest report of a frame wins
+    policy.FitBudget(textures);
+    if (textures[0].target != 0 || textures[1].target != 0 || textures[2].target != 1 || textures[3].target != TAIL_LEVEL ||
+        textures[4].target != TAIL_LEVEL)
+        return false;
+
+    // kept for the grace frames, then back to the tail
+    policy.NextFrame();
+    policy.NextFrame();
+    if (policy.WantedLevel(textures[1]) != 0)
+        return false;
+    policy.NextFrame();
+    return policy.WantedLevel(textures[1]) == TAIL_LEVEL;
+}
+CHECK(CheckStreamTargets);
+
+static bool CheckStreamBudget()
+{
+    TextureStreamPolicy policy;
+    std::vector<StreamedTexture> textures = makeTextures(policy, 2);
+    policy.Touch(textures[0], 256.0f);     // one pixel per texel at level 0
+    policy.Touch(textures[1], 200.0f);     // wants level 0 too, but magnified less
+    const u64 full = TextureStreamPolicy::LevelBytes(textures[0], 0);
+    const u64 half = TextureStreamPolicy::LevelBytes(textures[0], 1);
+
+    // one byte short: the less magnified texture gives up its finest level
+    policy.SetBudget(2 * full - 1);
+    if (policy.FitBudget(textures) != 2 * full || textures[0].target != 0 || textures[1].target != 1)
+        return false;
+
+    // at level 1 the second one has more pixels per texel, so the first goes next
+    policy.SetBudget(full + half - 1);
+    policy.FitBudget(textures);
+    if (textures[0].target != 1 || textures[1].target != 1)
+        return false;
+
+    // the tails stay resident even when they alone are over the budget
+    policy.SetBudget(0);
+    policy.FitBudget(textures);
+    if (textures[0].target != TAIL_LEVEL || textures[1].target != TAIL_LEVEL || !policy.IsTailsOverBudget())
+        return false;
+    policy.SetBudget(~0ull);
+    policy.FitBudget(textures);
+    return !policy.IsTailsOverBudget();
+}
+CHECK(CheckStreamBudget);
+
+static bool CheckStreamUploads()
+{
+    TextureStreamPolicy policy;
+    policy.SetBudget(~0ull);
+    std::vector<StreamedTexture> textures = makeTextures(policy, 3);
+    policy.Touch(textures[0], 200.0f);
+    policy.Touch(textures[1], 256.0f);
+    policy.FitBudget(textures);
+
+    // largest on screen first, one level per texture and pass
+    std::vector<u32> uploads;
+    policy.PlanUploads(textures, uploads);
+    const u32 all[] = {1, 0, 1, 0};
+    if (uploads.size() != 4 || !std::equal(uploads.begin(), uploads.end(), all))
+        return false;
+
+    // the frame cap stops after the level that reaches it
+    const u64 level1 = TextureFileLevelBytes(textures[0].view, 1);
+    policy.SetUploadBudget((u32)level1 + 1);
+    policy.PlanUploads(textures, uploads);
+    if (uploads.size() != 2 || uploads[0] != 1 || uploads[1] != 0)
+        return false;
+    policy.SetUploadBudget(1);
+    policy.PlanUploads(textures, uploads);
+    if (uploads.size() != 1 || uploads[0] != 1)
+        return false;
+
+    // nothing planned once the targets are resident
+    textures[0].resident = textures[0].target;
+    textures[1].resident = textures[1].target;
+    policy.PlanUploads(textures, uploads);
+    return uploads.empty();
+}
+CHECK(CheckStreamUploads);
+
+static void BM_StreamFitBudget(BenchState &state)
+{
+    TextureStreamPolicy policy;
+    std::vector<StreamedTexture> textures = makeTextures(policy, TEXTURE_COUNT);
+    for (u32 i = 0; i < TEXTURE_COUNT; ++i)
+        policy.Touch(textures[i], RandomFloat(16.0f, 512.0f));
+    // about a quarter of the full chains fit
+    policy.SetBudget(TextureStreamPolicy::LevelBytes(textures[0], 0) * TEXTURE_COUNT / 4);
+
+    std::vector<u32> uploads;
+    while (state.KeepRunning())
+    {
+        DoNotOptimize(policy.FitBudget(textures));
+        policy.PlanUploads(textures, uploads);
+        DoNotOptimize(uploads.data());
+    }
+    state.SetItemsProcessed(state.Iterations() * TEXTURE_COUNT);
+}
+BENCHMARK(BM_StreamFitBudget);
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Math.hpp"
+#include "Mesh.hpp"
+
+// Local joint transforms of a skeleton, one entry per joint.
+struct Pose
+{
+    std::vector<Vec3> translations;
+    std::vector<Quat> rotations;
+    std::vector<Vec3> scales;
+
+    void Resize(int jointCount);
+    int GetJointCount() const { return (int)rotations.size(); }
+
+    // per joint lerp / nlerp from a to b, out may alias a or b
+    static void Blend(const Pose &a, const Pose &b, float weight, Pose &out);
+};
+
+//***************************************************************************************************************
+// Skeleton
+//***************************************************************************************************************
+
+// Joints are stored parents first, so model matrices are one linear pass.
+// Matrices use the row vector order of Mat4::transformPoint: a joint's model
+// matrix is local * parentModel and its skinning matrix inverseBind * model.
+class Skeleton
+{
+private:
+    std::vector<std::string> names;
+    std::vector<int> parents;
+    Pose bindPose;
+    std::vector<Mat4> inverseBind;
+
+public:
+    Skeleton();
+
+    // parent must be an existing joint or -1, returns the joint index or -1
+    int AddJoint(const std::string &name, int parent, const Vec3 &translation, const Quat &rotation, const Vec3 &scale = Vec3(1.0f, 1.0f, 1.0f));
+    void SetInverseBindMatrix(int joint, const Mat4 &matrix) { inverseBind[joint] = matrix; }
+    // inverse bind matrices from the bind pose, for skeletons built in code
+    void ComputeInverseBindMatrices();
+    void Clear();
+
+    int FindJoint(const std::string &name) const;
+    int GetJointCount() const { return (int)parents.size(); }
+    int GetParent(int joint) const { return parents[joint]; }
+    const std::string &GetName(int joint) const { return names[joint]; }
+    const Pose &GetBindPose() const { return bindPose; }
+    const Mat4 &GetInverseBindMatrix(int joint) const { return inverseBind[joint]; }
+
+    void ComputeModelMatrices(const Pose &pose, Mat4 *model) const;
+    // inverseBind * model for every joint: the palette for SkinVertices or a
+    // skinning shader; model is scratch of GetJointCount() matrices
+    void ComputeSkinMatrices(const Pose &pose, Mat4 *model, Mat4 *skin) const;
+};
+
+//***************************************************************************************************************
+// AnimationClip
+//***************************************************************************************************************
+
+// Uncompressed keyframes, the authoring / import format. Tracks without
+// keys leave the pose untouched, so sample on top of the bind pose.
+class AnimationClip
+{
+private:
+    struct Vec3Track
+    {
+        std::vector<float> times;
+        std::vector<Vec3> values;
+    };
+
+    struct QuatTrack
+    {
+        std::vector<float> times;
+        std::vector<Quat> values;
+    };
+
+    std::vector<Vec3Track> translations;
+    std::vector<QuatTrack> rotations;
+    std::vector<Vec3Track> scales;
+    float duration;
+
+    friend class CompressedClip;
+
+public:
+    AnimationClip(int jointCount = 0, float duration = 0.0f);
+
+    void Reset(int jointCount, float duration);
+    // keys may come in any order, they are kept sorted by time
+    void AddTranslationKey(int joint, float time, const Vec3 &value);
+    void AddRotationKey(int joint, float time, const Quat &value);
+    void AddScaleKey(int joint, float time, const Vec3 &value);
+
+    // reference sampler: binary search per track, lerp / nlerp
+    void Sample(float time, Pose &pose) const;
+
+    float GetDuration() const { return duration; }
+    int GetJointCount() const { return (int)rotations.size(); }
+    u32 GetKeyCount() const;
+    size_t GetMemorySize() const;
+};
+
+//***************************************************************************************************************
+// CompressedClip
+//***************************************************************************************************************
+
+// Error budget for CompressedClip::Build, per joint in local space (errors
+// add up along a chain). The defaults are below what 16 bit quantization
+// alone can reach on a few meters of motion.
+struct AnimationCompression
+{
+    float translationError;     // units
+    float rotationError;        // radians
+    float scaleError;
+
+    AnimationCompression() : translationError(0.0005f), rotationError(0.0005f), scaleError(0.0005f) {}
+};
+
+// Per instance playback state: the current key of every track, so forward
+// playback finds its keys in O(1), plus the scratch of the batch nlerp. One
+// per animated character, never shared between threads.
+struct AnimationCursor
+{
+    std::vector<u32> keys;
+    std::vector<float> scratch;
+};
+
+// Runtime clip. Every key is 8 bytes: a 16 bit time (fraction of the clip)
+// and three 16 bit values. Rotations use the smallest three encoding (the
+// largest component is dropped, the other three stored in 15 bits each),
+// translations and scales are quantized to the range of their track. Keys a
+// linear / nlerp interpolation reproduces within the error budget are
+// removed. Each track's keys are contiguous and tracks follow joint order,
+// so a pose sample streams through the clip front to back; rotations of all
+// joints are then interpolated 4 at a time with SIMD.
+class CompressedClip
+{
+private:
+    struct PackedKey
+    {
+        u16 time;
+        u16 value[3];
+    };
+
+    struct Track
+    {
+        u32 first;
+        u32 count;          // 0: no animation on this channel
+        Vec3 offset;        // dequantization of translation / scale keys
+        Vec3 range;
+    };
+
+    std::vector<Track> tracks;      // translation, rotation, scale for each joint
+    std::vector<PackedKey> keys;
+    float duration;
+    int jointCount;
+
+    u32 findKey(const Track &track, float time, u32 hint) const;
+    void sampleVec3(const Track &track, float time, u32 &hint, Vec3 &out) const;
+    void buildVec3Track(const std::vector<float> &times, const std::vector<Vec3> &values, float tolerance, Track &track);
+    void buildQuatTrack(const std::vector<float> &times, const std::vector<Quat> &values, float tolerance, Track &track);
+
+public:
+    CompressedClip();
+
+    bool Build(const AnimationClip &clip, const AnimationCompression &settings = AnimationCompression());
+    void Release();
+
+    // time is clamped to [0, duration], wrap it for looping clips
+    void Sample(float time, Pose &pose, AnimationCursor &cursor) const;
+
+    float GetDuration() const { return duration; }
+    int GetJointCount() const { return jointCount; }
+    u32 GetKeyCount() const { return (u32)keys.size(); }
+    size_t GetMemorySize() const { return tracks.size() * sizeof(Track) + keys.size() * sizeof(PackedKey); }
+};
+
+//***************************************************************************************************************
+// Skinning
+//***************************************************************************************************************
+
+// Linear blend skinning on the CPU. joints holds up to four palette indices
+// as floats (Mesh::joints), weights sum to one. normals / outNormals may be
+// null; outputs may alias the inputs.
+void SkinVertices(const Mat4 *skin, const Vec3 *positions, const Vec3 *normals, const Vec4 *weights, const Vec4 *joints, u32 count, Vec3 *outPositions, Vec3 *outNormals);
+// mesh->vertices / normals skinned into the output arrays (resized)
+bool SkinMesh(const Mesh *mesh, const Mat4 *skin, std::vector<Vec3> &outPositions, std::vector<Vec3> &outNormals);
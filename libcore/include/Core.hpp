@@ -120,6 +120,10 @@ typedef double f64;
 #include <vector>
 #include <functional>
 #include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "Math.hpp"
 
 enum WrapMode
@@ -149,6 +153,15 @@ enum PixelFormat
     R8G8B8A8,      // 32 bpp
 };
 
+enum TextureLoadState
+{
+    TEXTURE_LOAD_NONE,          // loaded synchronously or empty
+    TEXTURE_LOAD_PENDING,       // queued or decoding on a worker
+    TEXTURE_LOAD_UPLOADING,     // decoded, rows going up under the frame budget
+    TEXTURE_LOAD_READY,
+    TEXTURE_LOAD_FAILED,
+};
+
 enum class VertexType
 {
     POSITION = 1,
@@ -180,6 +193,8 @@ const int BLEND_SUBTRACT    = 3;
 const int BLEND_SCREEN      = 4;
 const int BLEND_COUNT       = 5;
 
+class SpatialTree;
+
 class Utils
 {
 public:
@@ -190,6 +205,10 @@ public:
     static unsigned char *LoadDataFile(const char *fileName, unsigned int *bytesRead);
     static char *LoadTextFile(const char *fileName);
     static bool FileExists(const char *fileName);
+    // last modification, seconds since the epoch; 0 when the file is missing
+    static long GetFileModTime(const char *fileName);
+    static void *MapFile(const char *fileName, size_t *size);
+    static void UnmapFile(void *data, size_t size);
     static bool DirectoryExists(const char *dirPath);
     static bool IsFileExtension(const char *fileName, const char *ext);
     static const char *TextFormat(const char *text, ...);
@@ -282,6 +301,105 @@ public:
     void Render(float x, float y, float width, float height);
 };
 
+// Binding points of the std140 blocks the Driver keeps up to date. Shaders
+// declare them with FRAME_BLOCK_GLSL / OBJECT_BLOCK_GLSL (GLSL 4.20 or later
+// for the binding qualifier). The numbers are macros so the GLSL strings are
+// built from the same values as the constants.
+#define FRAME_BLOCK_BINDING_INDEX  0
+#define OBJECT_BLOCK_BINDING_INDEX 1
+#define DRAW_BLOCK_BINDING_INDEX   2
+#define BLOCK_BINDING_STRING_(index) #index
+#define BLOCK_BINDING_STRING(index) BLOCK_BINDING_STRING_(index)
+
+const u32 FRAME_BLOCK_BINDING  = FRAME_BLOCK_BINDING_INDEX;
+const u32 OBJECT_BLOCK_BINDING = OBJECT_BLOCK_BINDING_INDEX;
+const u32 OBJECT_RING_SIZE     = 256 * 1024;    // per frame: 1024 draws at a 256 byte offset alignment
+// std430 storage block of MeshArena draws, indexed by gl_DrawID (GLSL 4.60)
+const u32 DRAW_BLOCK_BINDING   = DRAW_BLOCK_BINDING_INDEX;
+
+#define FRAME_BLOCK_GLSL                                                    \
+    "layout(std140, binding = " BLOCK_BINDING_STRING(FRAME_BLOCK_BINDING_INDEX) ") uniform FrameData\n" \
+    "{ mat4 view; mat4 projection; mat4 viewProjection;\n"                 \
+    "  vec4 cameraPosition; vec4 viewport; } frame;\n"
+#define OBJECT_BLOCK_GLSL                                                   \
+    "layout(std140, binding = " BLOCK_BINDING_STRING(OBJECT_BLOCK_BINDING_INDEX) ") uniform ObjectData\n" \
+    "{ mat4 model; vec4 color; } object;\n"
+#define DRAW_BLOCK_GLSL                                                     \
+    "struct DrawConstants { mat4 model; vec4 color; };\n"                   \
+    "layout(std430, binding = " BLOCK_BINDING_STRING(DRAW_BLOCK_BINDING_INDEX) ") readonly buffer DrawData\n" \
+    "{ DrawConstants draws[]; };\n"
+
+// FrameData block, written once per UpdateFrustum
+struct FrameConstants
+{
+    Mat4 view;
+    Mat4 projection;
+    Mat4 viewProjection;
+    Vec4 cameraPosition;    // eye position in world space, w = 1
+    Vec4 viewport;          // width, height, 1 / width, 1 / height
+};
+
+// ObjectData block, one ring slot per draw
+struct ObjectConstants
+{
+    Mat4 model;
+    Vec4 color;
+};
+
+// glMultiDrawElementsIndirect record, layout fixed by GL
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    s32 baseVertex;
+    u32 baseInstance;
+};
+
+class UniformBuffer
+{
+    u32 id;
+    u32 size;
+public:
+    UniformBuffer();
+
+    bool Create(u32 bytes, const void *data = nullptr);
+    void Update(const void *data, u32 bytes, u32 offset = 0);
+    void Bind(u32 binding) const;
+    void Release();
+
+    u32 GetID() const { return id; }
+    u32 GetSize() const { return size; }
+};
+
+// Persistently mapped uniform buffer split in one segment per frame in
+// flight. Push copies a block into the current segment and binds that range
+// (glBindBufferRange), NextFrame fences the segment and moves on, waiting
+// only if the GPU still reads the segment it reuses.
+class UniformRing
+{
+    static const u32 MAX_FRAMES = 4;
+
+    u32 id;
+    u8 *mapped;
+    u32 frameSize;
+    u32 frameCount;
+    u32 alignment;
+    u32 frame;
+    u32 head;
+    GLsync fences[MAX_FRAMES];
+public:
+    UniformRing();
+
+    bool Init(u32 bytesPerFrame, u32 frames = 3);
+    void Release();
+    void NextFrame();
+    // false when the segment of this frame is full, nothing is bound then
+    bool Push(u32 binding, const void *data, u32 bytes);
+
+    u32 GetUsed() const { return head; }
+    u32 GetCapacity() const { return frameSize; }
+};
 
 class Driver
 {
@@ -295,10 +413,42 @@ class Driver
         Vec3 cameraRotation;
         Frustum frustum;
         ScreenQuad screenQuad;
+        FrameConstants frameConstants;
+        UniformBuffer frameBlock;
+        UniformRing objectRing;
         unsigned  long triangles;
         unsigned  long vertices;
         unsigned  long drawCalls;
 
+        // shadow of the GL state, STATE_UNKNOWN until the first call sets it
+        static const u32 STATE_UNKNOWN = 0xFFFFFFFF;
+        static const int MAX_TEXTURE_UNITS = 32;
+        static const int BUFFER_TARGETS = 6;
+        struct StateCache
+        {
+            u32 program;
+            u32 vertexArray;
+            u32 buffers[BUFFER_TARGETS];
+            u32 activeTexture;
+            u32 textures[MAX_TEXTURE_UNITS];
+            u32 textureTargets[MAX_TEXTURE_UNITS];
+            u32 blend;
+            u32 depthTest;
+            u32 cullFace;
+            u32 depthWrite;
+            u32 colorMask;
+            u32 blendSrc;
+            u32 blendDst;
+            u32 cullMode;
+            u32 frontFace;
+            u32 depthFunc;
+            int viewport[4];
+        } state;
+        u32 stateChanges;
+        u32 stateElided;
+
+        bool setEnabled(u32 &cached, u32 capability, bool enable);
+
     public:
         static Driver *InstancePtr();
         static Driver& Instance();
@@ -316,6 +466,13 @@ class Driver
 
         const Vec3& GetCameraPosition() const { return cameraPosition; }
         const Vec3& GetCameraRotation() const { return cameraRotation; } 
+
+        const FrameConstants& GetFrameConstants() const { return frameConstants; }
+        // ObjectData for the next draw, false when this frame's ring is full
+        bool SetObjectConstants(const Mat4 &model, const Vec4 &color = Vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        bool SetObjectConstants(const ObjectConstants &constants);
+        // called by Device::Swap, recycles the per object ring
+        void EndFrame();
         
         void EnableBlend(bool enable);
         void EnableDepthTest(bool enable);
@@ -327,13 +484,65 @@ class Driver
         void SetClearColor(float r, float g, float b);
         void Clear(int mode);
  
+        // frustum and stats for a new frame, uploads the FrameData block
         void UpdateFrustum();
         bool IsInFrustum(const Vec3 &point);
         bool IsInFrustum(const Vec3 &min, const Vec3 &max);
         bool IsInFrustum(const BoundingBox &box);
+        u32 CullBoxes(const BoxList &boxes, u32 *visible, u8 *planeCache = nullptr);
+        // hierarchical cull, appends the user data of every visible proxy
+        u32 CullTree(const SpatialTree &tree, std::vector<void*> &visible);
+        const Frustum& GetFrustum() const { return frustum; }
+
+        // GL state cache: bindings and fixed function state go through the
+        // Driver, calls that would not change anything are dropped. Code that
+        // changes the same state with raw GL calls must call ResetState.
+        void UseProgram(u32 program);
+        void BindVertexArray(u32 vao);
+        void BindBuffer(u32 target, u32 buffer);
+        void BindBufferBase(u32 target, u32 index, u32 buffer);
+        void BindBufferRange(u32 target, u32 index, u32 buffer, u32 offset, u32 size);
+        void BindTexture(u32 unit, u32 texture, u32 target = GL_TEXTURE_2D);
+        // binds on unit 0 and makes it the active unit, for uploads and
+        // parameter changes that act on the active unit
+        void SelectTexture(u32 texture, u32 target = GL_TEXTURE_2D);
+        void SetCullFace(u32 face);
+        void SetFrontFace(u32 face);
+        void SetDepthFunc(u32 func);
+        void EnableDepthWrite(bool enable);
+        void ResetState();
+
+        // fixed function state a pass based renderer changes, entries the
+        // cache does not know yet are read back from GL on save
+        struct RenderState
+        {
+            bool blend;
+            bool depthTest;
+            bool cullFace;
+            bool depthWrite;
+            u32 blendSrc;
+            u32 blendDst;
+        };
+        RenderState SaveRenderState();
+        void RestoreRenderState(const RenderState &saved);
+
+        // GL reuses deleted names, so deletes go through the cache too
+        void DeleteProgram(u32 program);
+        void DeleteVertexArray(u32 vao);
+        void DeleteBuffer(u32 buffer);
+        void DeleteTexture(u32 texture);
+
+        // GL calls issued / dropped since the last UpdateFrustum
+        u32 GetStateChanges() const { return stateChanges; }
+        u32 GetStateChangesElided() const { return stateElided; }
 
         void DrawArrays(int mode, int first,int vertexCount);
         void DrawElements(int mode, int indexCount, int indexType, const void *indices);
+        void DrawArraysInstanced(int mode, int first, int vertexCount, int instanceCount);
+        void DrawElementsInstanced(int mode, int indexCount, int indexType, const void *indices, int instanceCount, int baseInstance = 0);
+        // commands already in the bound GL_DRAW_INDIRECT_BUFFER at indirect, the
+        // CPU copy feeds the counters; every record counts as one draw call
+        void MultiDrawElementsIndirect(int mode, int indexType, const void *indirect, const DrawElementsIndirectCommand *commands, int drawCount);
 
         unsigned long GetTotalTriangles() const { return triangles; }
         unsigned long GetTotalVertices() const { return vertices; }
@@ -522,6 +731,29 @@ public:
     int height;
 };
 
+// FNV-1a of a uniform name. constexpr, so a name known at compile time
+// costs nothing: shader->GetUniformHandle(HashUniformName("model")).
+constexpr u32 HashUniformName(const char *name, u32 hash = 2166136261u)
+{
+    return *name ? HashUniformName(name + 1, (hash ^ (u8)*name) * 16777619u) : hash;
+}
+
+// Pre resolved uniform: an index in the uniform table of the shader it came
+// from. Resolve once after loading, then set without any name lookup.
+struct UniformHandle
+{
+    int index;
+
+    UniformHandle() : index(-1) {}
+    explicit UniformHandle(int i) : index(i) {}
+    bool IsValid() const { return index >= 0; }
+};
+
+// Uniform locations are cached in a flat table when the program links, the
+// string setters hash the name and search it instead of calling
+// glGetUniformLocation. Each entry keeps the last value written, setting the
+// same value again skips the GL call. Values go through glProgramUniform*,
+// so they land in this program whether it is bound or not.
 class Shader
 {
 public:
@@ -549,6 +781,24 @@ public:
     void SetFloat(const std::string &name, float x, float y, float z);
     void SetFloat(const std::string &name, float x, float y, float z, float w);
 
+    // -1 handle when the program has no such uniform (error logged by name);
+    // by hash it is -1 too when two uniforms of the program share the hash
+    UniformHandle GetUniformHandle(const std::string &name);
+    UniformHandle GetUniformHandle(u32 nameHash) const;
+
+    void SetInt(UniformHandle uniform, int value);
+    void SetMatrix4(UniformHandle uniform, const float *value);
+    void SetMatrix3(UniformHandle uniform, const float *value);
+    void SetFloat(UniformHandle uniform, float v);
+    void SetFloat(UniformHandle uniform, float x, float y);
+    void SetFloat(UniformHandle uniform, float x, float y, float z);
+    void SetFloat(UniformHandle uniform, float x, float y, float z, float w);
+
+    // forget the cached values, after writing uniforms with raw GL calls
+    void InvalidateUniformCache();
+    u32 GetUniformUploads() const { return m_uniformUploads; }
+    u32 GetUniformSkips() const { return m_uniformSkips; }
+
     void Release();
 
     void print();
@@ -574,8 +824,36 @@ private:
     int m_numUniforms;
     int success;
 
+    struct UniformSlot
+    {
+        int location;       // -1: looked up and missing, the error was logged
+        u32 offset;         // cached value in m_uniformValues
+        u32 words;          // 0 until the first write sizes the cache
+        bool cached;
+    };
+
+    // names that hash alike get one entry each, the name tells them apart
+    struct UniformName
+    {
+        u32 hash;
+        int slot;
+        std::string name;
+    };
+
+    std::vector<UniformSlot> m_uniforms;                  // handle order
+    std::vector<UniformName> m_uniformLookup;             // sorted by hash
+    std::vector<u32> m_uniformValues;
+    u32 m_uniformUploads;
+    u32 m_uniformSkips;
+
 private:
     void checkCompileErrors(unsigned int shader, const std::string &type);
+    void cacheUniforms();
+    int addUniformSlot(const char *name, int location);
+    void addUniformLookup(const char *name, int slot);
+    // name null: only a hash shared by no other name resolves
+    int findUniformSlot(u32 hash, const char *name) const;
+    bool uniformChanged(UniformHandle uniform, const void *value, u32 words);
 
     Shader &operator=(const Shader &other) = delete;
     Shader(const Shader &other) = delete;
@@ -603,6 +881,7 @@ public:
     void SetWrapT(WrapMode mode);
     void SetAnisotropicFiltering(float level = -1.0f);
 
+    // binds the default texture while an async load is not ready
     void Bind(u32 unit = 0);
     void Update(const Pixmap &pixmap);
     void Update(const unsigned char *buffer, u16 components, int width, int height);
@@ -618,6 +897,7 @@ protected:
     float MaxAnisotropic;
     int width;
     int height;
+    TextureLoadState loadState;
 
     void createTexture();
 
@@ -637,10 +917,17 @@ public:
     Texture2D(const char *file_name);
 
     bool Load(const Pixmap &pixmap);
+    // .btex files go to LoadTextureFile, everything else through stb_image
     bool Load(const char *file_name);
+    // cooked container (TextureFile.hpp): mapped, every level uploaded as
+    // stored; BC1 / BC3 are decoded on the CPU when S3TC is missing
+    bool LoadTextureFile(const char *file_name);
     bool LoadFromMemory(const unsigned char *buffer, u16 components, int width, int height);
     u32 GetID() { return id; }
 
+    TextureLoadState GetLoadState() const { return loadState; }
+    bool IsLoading() const { return loadState == TEXTURE_LOAD_PENDING || loadState == TEXTURE_LOAD_UPLOADING; }
+
     
 
     Texture2D(const Texture2D &) = delete;
@@ -650,6 +937,9 @@ public:
 
 private:
     friend class Texture;
+    friend class TextureLoader;
+    friend class TextureStreamer;
+    friend class TextureAtlas;
     s32 components{0};
     static Texture2D *defaultTexture;
 };
@@ -690,6 +980,62 @@ public:
     u32 GetHeight() { return height; }
 };
 
+// Loads textures off the main thread: workers read and decode the files,
+// the GL thread uploads the decoded rows in Update() without going over a
+// byte budget per frame (through an orphaned pixel unpack buffer when
+// enabled), then builds the mip chain. The texture binds the default
+// texture until its state is TEXTURE_LOAD_READY.
+class TextureLoader
+{
+private:
+    struct Request
+    {
+        Texture2D *texture;
+        std::string fileName;
+        bool flip;
+        unsigned char *pixels;
+        int width;
+        int height;
+        int components;
+        int rowsUploaded;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Request *> pending;      // waiting for a worker
+    std::deque<Request *> decoded;      // waiting for the GL thread
+    std::vector<Request *> uploads;     // GL thread only
+    u32 busy;                           // requests on a worker right now
+    bool stopping;
+    u32 uploadBudget;
+    u32 pixelBuffer;
+
+    void workerLoop();
+    bool beginUpload(Request *request);
+    u32 uploadRows(Request *request, u32 budget);
+    void finish(Request *request, TextureLoadState state);
+
+public:
+    TextureLoader();
+    ~TextureLoader();
+
+    // workers 0 picks hardware threads - 1; the budget is in bytes per frame
+    bool Init(u32 workerCount = 0, u32 bytesPerFrame = 8 * 1024 * 1024, bool usePixelBuffer = true);
+    // stops the workers, unfinished textures are left FAILED
+    void Release();
+    bool IsRunning() const { return !workers.empty(); }
+
+    void Load(Texture2D *texture, const std::string &fileName, bool flip);
+    // GL thread, once per frame (Device::Swap does it); returns the bytes uploaded
+    u32 Update();
+
+    void SetUploadBudget(u32 bytesPerFrame) { uploadBudget = bytesPerFrame; }
+    u32 GetUploadBudget() const { return uploadBudget; }
+    // textures not READY or FAILED yet
+    u32 GetPendingCount();
+};
+
 class Assets
 {
 private:
@@ -697,6 +1043,8 @@ private:
     std::unordered_map<std::string, Texture2D *> textures;
     std::unordered_map<std::string, Shader *> shaders;
     Texture2D *defaultTexture= nullptr;
+    TextureLoader loader;
+    bool flipTexture = false;
     
 public:
         static Assets *InstancePtr();
@@ -714,7 +1062,12 @@ public:
         Shader* GetShader(const std::string &name);
 
         Texture2D* LoadTexture(const std::string &file_name);
+        // returns at once, poll GetLoadState() / IsLoading() on the texture
+        Texture2D* LoadTextureAsync(const std::string &file_name);
         Texture2D* GetTexture(const std::string &name); 
+        TextureLoader &GetTextureLoader() { return loader; }
+        // pumps the async uploads, called by Device::Swap
+        void Update();
 
         void Init();
         void Release();
@@ -2,6 +2,7 @@
 #pragma once
 #include <cmath>
 #include <cstring>
+#include <vector>
 
 const unsigned int MaxUInt32 = 0xFFFFFFFF;
 const int MinInt32 = 0x80000000;
@@ -145,6 +146,187 @@ inline float RadToDeg(float f)
 	return f * 57.29577951f;
 }
 
+//***************************************************************************************************************
+//  FAST MATH
+//***************************************************************************************************************
+
+// Opt-in approximations for hot loops, the exact functions above stay the
+// default. Bounds against libm, enforced by benchMath (CheckFastSinCos, CheckFastInvSqrt):
+//   FastSinRad / FastCosRad / FastSinCosRad   absolute error <= 1.5e-7 for |a| <= 8192
+//   FastSin / FastCos / FastSinCos (degrees)   absolute error <= 2e-7 for |a| <= 1e6
+//   FastInvSqrt / Vec3::normalizeFast          relative error <= 5e-7 (exact without SSE)
+// Past 8192 radians the range reduction loses bits; results stay finite.
+#if !defined(MATH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+#include <xmmintrin.h>
+#define MATH_FAST_RSQRT
+#endif
+
+// Cephes style: reduce to [-pi/4, pi/4] by octant, then a degree 7 sine and
+// a degree 8 cosine polynomial. Branch free so loops over it vectorize.
+inline void FastSinCosRad(float a, float &s, float &c)
+{
+	const float x = a < 0.0f ? -a : a;
+	int j = (int)(x * 1.27323954473516f); // 4 / pi
+	j = (j + 1) & ~1;
+	const float y = (float)j;
+	const float r = ((x - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+	const float z = r * r;
+	const float ps = r + r * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+	const float pc = 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+
+	// octant 2 and 6 swap the polynomials, the sign follows the quadrant
+	const int q = j & 7;
+	const float sv = (q & 2) ? pc : ps;
+	const float cv = (q & 2) ? ps : pc;
+	s = (((q & 4) != 0) != (a < 0.0f)) ? -sv : sv;
+	c = ((q + 2) & 4) ? -cv : cv;
+}
+
+inline float FastSinRad(float a)
+{
+	float s, c;
+	FastSinCosRad(a, s, c);
+	return s;
+}
+
+inline float FastCosRad(float a)
+{
+	float s, c;
+	FastSinCosRad(a, s, c);
+	return c;
+}
+
+// degrees are wrapped to [-180, 180] first, exactly, so the conversion does
+// not scale the rounding error of large angles
+inline float FastWrapDegrees(float degrees)
+{
+	const float turns = degrees * (1.0f / 360.0f);
+	return degrees - 360.0f * (float)(int)(turns + (turns < 0.0f ? -0.5f : 0.5f));
+}
+
+inline void FastSinCos(float degrees, float &s, float &c) { FastSinCosRad(FastWrapDegrees(degrees) * 0.017453293f, s, c); }
+inline float FastSin(float degrees) { return FastSinRad(FastWrapDegrees(degrees) * 0.017453293f); }
+inline float FastCos(float degrees) { return FastCosRad(FastWrapDegrees(degrees) * 0.017453293f); }
+
+// many angles at once (radians), vectorized
+void FastSinCosRad(const float *angles, float *sines, float *cosines, unsigned int count);
+
+// 1 / sqrt(a) for a > 0: hardware estimate plus one Newton step
+inline float FastInvSqrt(float a)
+{
+#if defined(MATH_FAST_RSQRT)
+	const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(a)));
+	return y * (1.5f - 0.5f * a * y * y);
+#else
+	return 1.0f / sqrtf(a);
+#endif
+}
+
+//***************************************************************************************************************
+//  CIRCLE TABLE
+//***************************************************************************************************************
+
+// Compile time sine / cosine, for constants and tables only (slow at run
+// time). Fold into [-pi/2, pi/2] and sum the Taylor series, ~1e-16 error.
+constexpr double ConstSinRad(double a)
+{
+	const double pi = 3.14159265358979323846;
+	a -= 2.0 * pi * (double)(long long)(a / (2.0 * pi));
+	if (a > pi) a -= 2.0 * pi;
+	if (a < -pi) a += 2.0 * pi;
+	if (a > 0.5 * pi) a = pi - a;
+	if (a < -0.5 * pi) a = -pi - a;
+
+	double term = a, sum = a;
+	for (int n = 1; n < 12; ++n)
+	{
+		term *= -a * a / (double)((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double ConstCosRad(double a)
+{
+	const double pi = 3.14159265358979323846;
+	a -= 2.0 * pi * (double)(long long)(a / (2.0 * pi));
+	if (a < 0.0) a = -a;
+	if (a > pi) a = 2.0 * pi - a;
+	double sign = 1.0;
+	if (a > 0.5 * pi)
+	{
+		a = pi - a;
+		sign = -1.0;
+	}
+
+	double term = 1.0, sum = 1.0;
+	for (int n = 1; n < 12; ++n)
+	{
+		term *= -a * a / (double)((2 * n - 1) * (2 * n));
+		sum += term;
+	}
+	return sign * sum;
+}
+
+// sin/cos of step * 2pi / STEPS for every step of one turn, built by the
+// compiler. 2880 divides by 1-6, 8, 9, 10, 12, 16, 18, 20, 24, 32, 36, 40,
+// 45, 48, 60, 64, 72, 90, 96 ... so the usual tessellations land on entries.
+const int CIRCLE_TABLE_STEPS = 2880;
+
+template <int N>
+struct CircleTable
+{
+	float sin[N + 1];
+	float cos[N + 1];
+};
+
+// quadrant folding on the integer step keeps 0, +-1 exact and the four
+// quadrants bit-for-bit symmetric
+template <int N>
+constexpr float CircleTableSin(int step)
+{
+	step %= N;
+	const float sign = step >= N / 2 ? -1.0f : 1.0f;
+	if (step >= N / 2) step -= N / 2;
+	if (step > N / 4) step = N / 2 - step;
+	return sign * (float)ConstSinRad(6.28318530717958647692 * step / N);
+}
+
+template <int N>
+constexpr CircleTable<N> MakeCircleTable()
+{
+	static_assert(N % 4 == 0, "circle table size must be a multiple of 4");
+	CircleTable<N> table{};
+	for (int i = 0; i <= N; ++i)
+	{
+		table.sin[i] = CircleTableSin<N>(i);
+		table.cos[i] = CircleTableSin<N>(i + N / 4);
+	}
+	return table;
+}
+
+extern const CircleTable<CIRCLE_TABLE_STEPS> CircleTableData;
+
+// sin/cos of step * 2pi / segments (step >= 0, segments > 0). A table read when
+// segments divides CIRCLE_TABLE_STEPS, FastSinCosRad otherwise.
+inline void CircleSinCos(int step, int segments, float &s, float &c)
+{
+	// one division, hoisted out of loops over step
+	const int stride = CIRCLE_TABLE_STEPS / segments;
+	if (stride * segments == CIRCLE_TABLE_STEPS)
+	{
+		const int index = step * stride % CIRCLE_TABLE_STEPS;
+		s = CircleTableData.sin[index];
+		c = CircleTableData.cos[index];
+		return;
+	}
+	// fold to [-pi, pi] so the float angle keeps its precision
+	step %= segments;
+	if (2 * step > segments)
+		step -= segments;
+	FastSinCosRad((float)(6.28318530717958647692 * step / segments), s, c);
+}
+
 struct Vec2;
 struct Vec3;
 struct Vec4;
@@ -172,27 +354,27 @@ struct Vec2
 {
 	float x, y;
 
-	Vec2();
-	Vec2(float x, float y);
+	constexpr Vec2() : x(0.0f), y(0.0f) {}
+	constexpr Vec2(float x, float y) : x(x), y(y) {}
 
-	Vec2 operator+(const Vec2 &other) const;
-	Vec2 operator-(const Vec2 &other) const;
-	Vec2 operator*(float scalar) const;
-	Vec2 operator/(float scalar) const;
+	constexpr Vec2 operator+(const Vec2 &other) const { return Vec2(x + other.x, y + other.y); }
+	constexpr Vec2 operator-(const Vec2 &other) const { return Vec2(x - other.x, y - other.y); }
+	constexpr Vec2 operator*(float scalar) const { return Vec2(x * scalar, y * scalar); }
+	constexpr Vec2 operator/(float scalar) const { return Vec2(x / scalar, y / scalar); }
 
-	Vec2 &operator+=(const Vec2 &other);
-	Vec2 &operator-=(const Vec2 &other);
-	Vec2 &operator*=(float scalar);
-	Vec2 &operator/=(float scalar);
+	constexpr Vec2 &operator+=(const Vec2 &other) { x += other.x; y += other.y; return *this; }
+	constexpr Vec2 &operator-=(const Vec2 &other) { x -= other.x; y -= other.y; return *this; }
+	constexpr Vec2 &operator*=(float scalar) { x *= scalar; y *= scalar; return *this; }
+	constexpr Vec2 &operator/=(float scalar) { x /= scalar; y /= scalar; return *this; }
 
-	Vec2 operator-() const;
+	constexpr Vec2 operator-() const { return Vec2(-x, -y); }
 
 	float length() const;
-	float lengthSquared() const;
+	constexpr float lengthSquared() const { return x * x + y * y; }
 	Vec2 &normalize();
 	Vec2 normal() const;
 
-	float dot(const Vec2 &other) const;
+	constexpr float dot(const Vec2 &other) const { return x * other.x + y * other.y; }
 	float angle(const Vec2 &other) const;
 	Vec2 rotate(float radians) const;
 	Vec2 rotate(float radians, const Vec2 &center) const;
@@ -206,8 +388,8 @@ struct Vec2
 	const float &operator[](int index) const;
 
 	static float Distance(const Vec2 &a, const Vec2 &b);
-	static float DistanceSquared(const Vec2 &a, const Vec2 &b);
-	static Vec2 Lerp(const Vec2 &a, const Vec2 &b, float t);
+	static constexpr float DistanceSquared(const Vec2 &a, const Vec2 &b) { return (b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y); }
+	static constexpr Vec2 Lerp(const Vec2 &a, const Vec2 &b, float t) { return Vec2(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)); }
 	static Vec2 Normal(const Vec2 &a, const Vec2 &b);
 	static float Angle(const Vec2 &a, const Vec2 &b);
 };
@@ -220,35 +402,36 @@ struct Vec3
 {
 	float x, y, z;
 
-	Vec3();
-	Vec3(float x, float y, float z);
+	constexpr Vec3() : x(0.0f), y(0.0f), z(0.0f) {}
+	constexpr Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
 
-	Vec3 operator+(const Vec3 &other) const;
-	Vec3 operator-(const Vec3 &other) const;
-	Vec3 operator*(float scalar) const;
-	Vec3 operator/(float scalar) const;
+	constexpr Vec3 operator+(const Vec3 &other) const { return Vec3(x + other.x, y + other.y, z + other.z); }
+	constexpr Vec3 operator-(const Vec3 &other) const { return Vec3(x - other.x, y - other.y, z - other.z); }
+	constexpr Vec3 operator*(float scalar) const { return Vec3(x * scalar, y * scalar, z * scalar); }
+	constexpr Vec3 operator/(float scalar) const { return Vec3(x / scalar, y / scalar, z / scalar); }
 
-	Vec3 &operator+=(const Vec3 &other);
-	Vec3 &operator-=(const Vec3 &other);
-	Vec3 &operator*=(float scalar);
-	Vec3 &operator/=(float scalar);
+	constexpr Vec3 &operator+=(const Vec3 &other) { x += other.x; y += other.y; z += other.z; return *this; }
+	constexpr Vec3 &operator-=(const Vec3 &other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
+	constexpr Vec3 &operator*=(float scalar) { x *= scalar; y *= scalar; z *= scalar; return *this; }
+	constexpr Vec3 &operator/=(float scalar) { x /= scalar; y /= scalar; z /= scalar; return *this; }
 
-	Vec3 operator-() const;
+	constexpr Vec3 operator-() const { return Vec3(-x, -y, -z); }
 
 
-	void set(float x, float y, float z);
+	constexpr void set(float x, float y, float z) { this->x = x; this->y = y; this->z = z; }
 
 	float &operator[](int index);
 	const float &operator[](int index) const;
 
 	float length() const;
-	float lengthSquared() const;
+	constexpr float lengthSquared() const { return x * x + y * y + z * z; }
 
 	Vec3 &normalize();
+	Vec3 &normalizeFast();
 	Vec3 normal() const;
 
-	float dot(const Vec3 &other) const;
-	Vec3 cross(const Vec3 &other) const;
+	constexpr float dot(const Vec3 &other) const { return x * other.x + y * other.y + z * other.z; }
+	constexpr Vec3 cross(const Vec3 &other) const { return Vec3(y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x); }
 
 	Vec3 rotate(float angle, const Vec3 &axis) const;
 	Vec3 project(const Vec3 &other) const;
@@ -258,16 +441,16 @@ struct Vec3
 	bool operator!=(const Vec3 &other) const;
 
 	static float Distance(const Vec3 &a, const Vec3 &b);
-	static float DistanceSquared(const Vec3 &a, const Vec3 &b);
-	static Vec3 Lerp(const Vec3 &a, const Vec3 &b, float t);
+	static constexpr float DistanceSquared(const Vec3 &a, const Vec3 &b) { return (a - b).lengthSquared(); }
+	static constexpr Vec3 Lerp(const Vec3 &a, const Vec3 &b, float t) { return Vec3(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z)); }
 	static Vec3 Normal(const Vec3 &a, const Vec3 &b);
 	static Vec3 Normalize(const Vec3 &a);
-	static Vec3 Cross(const Vec3 &a, const Vec3 &b);
-	static float Dot(const Vec3 &a, const Vec3 &b);
+	static constexpr Vec3 Cross(const Vec3 &a, const Vec3 &b) { return a.cross(b); }
+	static constexpr float Dot(const Vec3 &a, const Vec3 &b) { return a.dot(b); }
 	
 };
 
-Vec3 operator*(float scalar, const Vec3& vec);
+constexpr Vec3 operator*(float scalar, const Vec3& vec) { return vec * scalar; }
 
 //***************************************************************************************************************
 // VECTOR 4D
@@ -277,18 +460,18 @@ struct Vec4
 {
 	float x, y, z, w;
 
-	Vec4();
-	Vec4(float x, float y, float z, float w = 1.0f);
+	constexpr Vec4() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+	constexpr Vec4(float x, float y, float z, float w = 1.0f) : x(x), y(y), z(z), w(w) {}
 
-	Vec4 operator+(const Vec4 &other) const;
-	Vec4 operator-(const Vec4 &other) const;
-	Vec4 operator*(float scalar) const;
-	Vec4 operator/(float scalar) const;
+	constexpr Vec4 operator+(const Vec4 &other) const { return Vec4(x + other.x, y + other.y, z + other.z, w + other.w); }
+	constexpr Vec4 operator-(const Vec4 &other) const { return Vec4(x - other.x, y - other.y, z - other.z, w - other.w); }
+	constexpr Vec4 operator*(float scalar) const { return Vec4(x * scalar, y * scalar, z * scalar, w * scalar); }
+	constexpr Vec4 operator/(float scalar) const { return Vec4(x / scalar, y / scalar, z / scalar, w / scalar); }
 
-	Vec4 &operator+=(const Vec4 &other);
-	Vec4 &operator-=(const Vec4 &other);
-	Vec4 &operator*=(float scalar);
-	Vec4 &operator/=(float scalar);
+	constexpr Vec4 &operator+=(const Vec4 &other) { x += other.x; y += other.y; z += other.z; w += other.w; return *this; }
+	constexpr Vec4 &operator-=(const Vec4 &other) { x -= other.x; y -= other.y; z -= other.z; w -= other.w; return *this; }
+	constexpr Vec4 &operator*=(float scalar) { x *= scalar; y *= scalar; z *= scalar; w *= scalar; return *this; }
+	constexpr Vec4 &operator/=(float scalar) { x /= scalar; y /= scalar; z /= scalar; w /= scalar; return *this; }
 
 	float &operator[](int index);
 	const float &operator[](int index) const;
@@ -355,8 +538,12 @@ struct Mat4
 {
 	float m[16];
 
-	Mat4();
-	Mat4(float diagonal);
+	constexpr Mat4() : m{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f} {}
+	constexpr Mat4(float diagonal) : m{diagonal, 0.0f, 0.0f, 0.0f, 0.0f, diagonal, 0.0f, 0.0f, 0.0f, 0.0f, diagonal, 0.0f, 0.0f, 0.0f, 0.0f, diagonal} {}
+	// elements in storage order (m[0] .. m[15])
+	constexpr Mat4(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7,
+				   float m8, float m9, float m10, float m11, float m12, float m13, float m14, float m15)
+		: m{m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15} {}
 	Mat4(const float *elements);
 
 	float &at(int row, int col);
@@ -402,14 +589,23 @@ struct Mat4
 
 	static Mat3 ToMat3(const Mat4 &mat) ;
 
-	static Mat4 Identity();
-	static Mat4 Translate(const Vec3 &translation);
-	static Mat4 Scale(const Vec3 &scale);
+	static constexpr Mat4 Identity() { return Mat4(1.0f); }
+	static constexpr Mat4 Translate(const Vec3 &translation)
+	{
+		return Mat4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, translation.x, translation.y, translation.z, 1.0f);
+	}
+	static constexpr Mat4 Scale(const Vec3 &scale)
+	{
+		return Mat4(scale.x, 0.0f, 0.0f, 0.0f, 0.0f, scale.y, 0.0f, 0.0f, 0.0f, 0.0f, scale.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+	}
 	static Mat4 Rotate(float radians, const Vec3 &axis);
 	static Mat4 Perspective(float fov, float aspect, float near, float far);
 	static Mat4 Orthographic(float left, float right, float bottom, float top, float near, float far);
 	static Mat4 LookAt(const Vec3 &eye, const Vec3 &center, const Vec3 &up);
 
+	// scale, then rotate like Quat::rotate, then translate, for row vectors
+	// (transformPoint); parent transforms go on the right
+	static Mat4 Compose(const Vec3 &translation, const Quat &rotation, const Vec3 &scale);
 	static bool Decompose(const Mat4 &mat, Vec3 &position, Vec3 &scale, Quat &rotation);
 	static bool Decompose(const Mat4 &mat, Vec3 &position, Mat3 &out);
 	static Mat4 Inverse(const Mat4 &mat);
@@ -496,6 +692,8 @@ public:
 	static Quat Roll(float angle);
 	static Quat FromYawPitchRoll(float yaw, float pitch, float roll);
 	static Quat Slerp(const Quat &start, const Quat &end, float t);
+	// Slerp with the fast sine / inverse sqrt, for per frame animation blending
+	static Quat SlerpFast(const Quat &start, const Quat &end, float t);
 	static Quat Lerp(const Quat &start, const Quat &end, float t);
 };
 
@@ -569,6 +767,7 @@ struct BoundingBox
 	void expand(float x, float y, float z);
 	void expand(const Vec3 &point);
 	void expand(const BoundingBox &other);
+	void expand(const Vec3 *points, unsigned int count);
 	void scale(float factor);
 	Vec3 center() const;
 	Vec3 size() const;
@@ -601,10 +800,37 @@ struct Ray
 	bool intersectBox(const BoundingBox &box, float &t) const;
 };
 
+//***************************************************************************************************************
+//  BOX LIST
+//***************************************************************************************************************
+
+// Boxes stored as centre / half extents, one array per component, for the
+// batch frustum test. Arrays are padded to a multiple of 8 so the culler can
+// always read whole groups.
+struct BoxList
+{
+	std::vector<float> cx, cy, cz;
+	std::vector<float> ex, ey, ez;
+	unsigned int count;
+
+	BoxList();
+
+	void clear();
+	void reserve(unsigned int n);
+	void resize(unsigned int n);
+	unsigned int add(const Vec3 &min, const Vec3 &max);
+	unsigned int add(const BoundingBox &box);
+	void set(unsigned int index, const Vec3 &min, const Vec3 &max);
+	void set(unsigned int index, const BoundingBox &box);
+	unsigned int size() const { return count; }
+};
+
 //***************************************************************************************************************
 //  FRUSTUM
 //***************************************************************************************************************
 
+const unsigned int FRUSTUM_CULL_GROUP = 8;
+
 struct Frustum
 {
 	Plane planes[6];
@@ -616,5 +842,181 @@ struct Frustum
 	bool containsPoint(const Vec3 &point) const;
 	bool intersectsBox(const Vec3 &min, const Vec3 &max) const;
 	bool intersectsBox(const BoundingBox &box) const;
+
+	// Tests every box of the list at once. Bit i of visible ((size + 31) / 32
+	// words) is set when box i is at least partly inside. planeCache is optional,
+	// one byte per group of FRUSTUM_CULL_GROUP boxes, and remembers the plane that
+	// rejected the group last call so it is tried first. Returns the visible count.
+	unsigned int cullBoxes(const BoxList &boxes, unsigned int *visible, unsigned char *planeCache = nullptr) const;
 	
-};
\ No newline at end of file
+};
+
+//***************************************************************************************************************
+//  SOA BATCH
+//***************************************************************************************************************
+
+// N wide Vec3 pack, one array per component so every operation runs across
+// all N lanes (the loops are fixed size and vectorize at -O3).
+template <int N>
+struct alignas(N * sizeof(float)) Vec3Pack
+{
+	float x[N], y[N], z[N];
+
+	void load(const Vec3 *src)
+	{
+		for (int i = 0; i < N; i++)
+		{
+			x[i] = src[i].x;
+			y[i] = src[i].y;
+			z[i] = src[i].z;
+		}
+	}
+
+	void store(Vec3 *dst) const
+	{
+		for (int i = 0; i < N; i++)
+			dst[i].set(x[i], y[i], z[i]);
+	}
+
+	void set(const Vec3 &v)
+	{
+		for (int i = 0; i < N; i++)
+		{
+			x[i] = v.x;
+			y[i] = v.y;
+			z[i] = v.z;
+		}
+	}
+
+	Vec3 get(int i) const { return Vec3(x[i], y[i], z[i]); }
+
+	Vec3Pack operator+(const Vec3Pack &other) const
+	{
+		Vec3Pack r;
+		for (int i = 0; i < N; i++)
+		{
+			r.x[i] = x[i] + other.x[i];
+			r.y[i] = y[i] + other.y[i];
+			r.z[i] = z[i] + other.z[i];
+		}
+		return r;
+	}
+
+	Vec3Pack operator-(const Vec3Pack &other) const
+	{
+		Vec3Pack r;
+		for (int i = 0; i < N; i++)
+		{
+			r.x[i] = x[i] - other.x[i];
+			r.y[i] = y[i] - other.y[i];
+			r.z[i] = z[i] - other.z[i];
+		}
+		return r;
+	}
+
+	Vec3Pack operator*(float scalar) const
+	{
+		Vec3Pack r;
+		for (int i = 0; i < N; i++)
+		{
+			r.x[i] = x[i] * scalar;
+			r.y[i] = y[i] * scalar;
+			r.z[i] = z[i] * scalar;
+		}
+		return r;
+	}
+
+	void dot(const Vec3Pack &other, float *out) const
+	{
+		for (int i = 0; i < N; i++)
+			out[i] = x[i] * other.x[i] + y[i] * other.y[i] + z[i] * other.z[i];
+	}
+
+	Vec3Pack cross(const Vec3Pack &other) const
+	{
+		Vec3Pack r;
+		for (int i = 0; i < N; i++)
+		{
+			r.x[i] = y[i] * other.z[i] - z[i] * other.y[i];
+			r.y[i] = z[i] * other.x[i] - x[i] * other.z[i];
+			r.z[i] = x[i] * other.y[i] - y[i] * other.x[i];
+		}
+		return r;
+	}
+
+	void normalize()
+	{
+		for (int i = 0; i < N; i++)
+		{
+			float len = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+			float inv = len > 0.0f ? 1.0f / len : 1.0f;
+			x[i] *= inv;
+			y[i] *= inv;
+			z[i] *= inv;
+		}
+	}
+
+	// same convention as Mat4::transformPoint / transformNormal
+	void transformPoints(const Mat4 &mat)
+	{
+		const float *m = mat.m;
+		for (int i = 0; i < N; i++)
+		{
+			float tx = x[i] * m[0] + y[i] * m[4] + z[i] * m[8] + m[12];
+			float ty = x[i] * m[1] + y[i] * m[5] + z[i] * m[9] + m[13];
+			float tz = x[i] * m[2] + y[i] * m[6] + z[i] * m[10] + m[14];
+			x[i] = tx;
+			y[i] = ty;
+			z[i] = tz;
+		}
+	}
+
+	void transformNormals(const Mat4 &mat)
+	{
+		const float *m = mat.m;
+		for (int i = 0; i < N; i++)
+		{
+			float tx = x[i] * m[0] + y[i] * m[4] + z[i] * m[8];
+			float ty = x[i] * m[1] + y[i] * m[5] + z[i] * m[9];
+			float tz = x[i] * m[2] + y[i] * m[6] + z[i] * m[10];
+			x[i] = tx;
+			y[i] = ty;
+			z[i] = tz;
+		}
+	}
+
+	// grows min/max to include every lane
+	void expand(Vec3 &min, Vec3 &max) const
+	{
+		for (int i = 0; i < N; i++)
+		{
+			min.x = x[i] < min.x ? x[i] : min.x;
+			min.y = y[i] < min.y ? y[i] : min.y;
+			min.z = z[i] < min.z ? z[i] : min.z;
+			max.x = x[i] > max.x ? x[i] : max.x;
+			max.y = y[i] > max.y ? y[i] : max.y;
+			max.z = z[i] > max.z ? z[i] : max.z;
+		}
+	}
+};
+
+typedef Vec3Pack<4> Vec3x4;
+typedef Vec3Pack<8> Vec3x8;
+
+// Span versions working straight on Vec3 arrays (Mesh::vertices, normals...).
+// The AoS <-> SoA transpose is done in registers, 4 or 8 vectors at a time
+// depending on the target, with a scalar tail. src and dst may be the same.
+struct Vec3Batch
+{
+	static void TransformPoints(const Mat4 &mat, const Vec3 *src, Vec3 *dst, unsigned int count);
+	static void TransformNormals(const Mat4 &mat, const Vec3 *src, Vec3 *dst, unsigned int count);
+	static void Translate(Vec3 *points, unsigned int count, const Vec3 &offset);
+	static void Scale(Vec3 *points, unsigned int count, const Vec3 &scale);
+	static void Normalize(const Vec3 *src, Vec3 *dst, unsigned int count);
+	// FastInvSqrt precision, zero length vectors are left untouched
+	static void NormalizeFast(const Vec3 *src, Vec3 *dst, unsigned int count);
+	static void Dot(const Vec3 *a, const Vec3 *b, float *dst, unsigned int count);
+	static void Cross(const Vec3 *a, const Vec3 *b, Vec3 *dst, unsigned int count);
+	// grows min/max to include all points
+	static void Expand(const Vec3 *points, unsigned int count, Vec3 &min, Vec3 &max);
+};
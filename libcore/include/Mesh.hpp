@@ -3,6 +3,80 @@
 #include "Core.hpp"
 #include "Math.hpp"
 
+// First vertex attribute of per instance data, Mesh uses 0 - 6
+const u32 INSTANCE_ATTRIBUTE = 8;
+
+enum InstanceFormat
+{
+    INSTANCE_MATRIX,    // Mat4, one mat4 input at location 8
+    INSTANCE_TRS,       // InstanceTRS, locations 8 - 11
+};
+
+// Packed instance: translation, rotation, non uniform scale and an RGBA8
+// colour in 44 bytes. The point transform is scale, then rotate, then
+// translate, the same as Mat4 Scale * rotation * Translate.
+struct InstanceTRS
+{
+    Vec3 position;
+    Quat rotation;
+    Vec3 scale;
+    Color color;
+
+    Vec3 transformPoint(const Vec3 &point) const { return position + rotation.rotate(Vec3(point.x * scale.x, point.y * scale.y, point.z * scale.z)); }
+};
+
+// Vertex shader inputs of each format. The TRS block adds instanceTransform()
+// and instanceRotate() for positions and normals.
+#define INSTANCE_MATRIX_GLSL                                                \
+    "layout(location = 8) in mat4 instanceModel;\n"
+#define INSTANCE_TRS_GLSL                                                   \
+    "layout(location = 8) in vec3 instancePosition;\n"                      \
+    "layout(location = 9) in vec4 instanceRotation;\n"                      \
+    "layout(location = 10) in vec3 instanceScale;\n"                        \
+    "layout(location = 11) in vec4 instanceColor;\n"                        \
+    "vec3 instanceRotate(vec3 v) { vec3 t = 2.0 * cross(instanceRotation.xyz, v);\n" \
+    "    return v + instanceRotation.w * t + cross(instanceRotation.xyz, t); }\n" \
+    "vec3 instanceTransform(vec3 p) { return instancePosition + instanceRotate(p * instanceScale); }\n"
+
+// Per instance vertex data streamed every frame. Update() orphans the
+// previous storage so the upload never waits for draws still in flight;
+// Map() does the same and hands out the memory for a direct write. Attach it
+// to a Mesh or MeshBuffer, which then draw it with glDrawElementsInstanced.
+class InstanceBuffer
+{
+private:
+    u32 vbo;
+    u32 capacity;
+    u32 count;
+    u32 mappedCount;
+    u32 stride;
+    InstanceFormat format;
+    bool mapped;
+
+public:
+    InstanceBuffer();
+
+    // creating again replaces the GL buffer: meshes it was attached to have
+    // to call SetInstances again
+    bool Create(InstanceFormat format, u32 maxInstances);
+    void Release();
+
+    void Update(const void *instances, u32 count);
+    // room for count instances of GetStride() bytes, null on failure;
+    // Unmap with the number actually written before drawing
+    void *Map(u32 count);
+    void Unmap(u32 written);
+
+    // enables the instance attributes (divisor 1) on the bound VAO
+    void BindAttributes() const;
+    // disables locations 8 - 11 on the bound VAO and resets their divisor
+    static void UnbindAttributes();
+
+    u32 GetCount() const { return count; }
+    u32 GetCapacity() const { return capacity; }
+    u32 GetStride() const { return stride; }
+    InstanceFormat GetFormat() const { return format; }
+};
 
 class MeshBuffer
 {
@@ -12,6 +86,7 @@ private:
     GLuint vao; 
     size_t vertexCount;
     size_t indexCount;
+    const InstanceBuffer *instances;
 
 public:
     MeshBuffer();
@@ -25,9 +100,17 @@ public:
 
     void SetVertexData(const float *vertices, u32 count, const std::vector<GLint> &attribSizes,bool dynamic = false);
     void UpdateVertexData(const float *vertices, u32 count);
+    void UpdateVertexData(const float *vertices, u32 offset, u32 count);
     void UpdateIndexData(const u32 *indices, u32 count);
     void SetIndexData(const u32 *indices, u32 count,bool dynamic = false);
     void Render(int mode = GL_TRIANGLES);
+
+    // instance attributes live in the VAO, attach once after the vertex data
+    void SetInstances(const InstanceBuffer *buffer);
+    void RenderInstanced(int mode, u32 instanceCount);
+    void RenderInstanced(int mode = GL_TRIANGLES);
+
+    u32 GetVertexArray() const { return vao; }
 };
 
 
@@ -46,6 +129,7 @@ class Mesh
         u32 EBO;
         u32 VAO;
         u32 VBO[7];
+        const InstanceBuffer *instances;
         u8 flags;
         bool isDynamic;
         bool isFacesDynamic;
@@ -72,6 +156,13 @@ class Mesh
         void Render(u32 mode, u32 count);
         void Render(u32 mode);
 
+        // draws the whole mesh once per instance of the attached buffer
+        void SetInstances(const InstanceBuffer *buffer);
+        void RenderInstanced(u32 mode, u32 instanceCount);
+        void RenderInstanced(u32 mode);
+
+        u32 GetVertexArray() const { return VAO; }
+
         u32 AddVertex(const Vec3 &pos);
         u32 AddVertex(float x, float y, float z);
         u32 Addface(u32 a, u32 b, u32 c);
@@ -85,6 +176,70 @@ class Mesh
 
 };
 
+// Interleaved vertex of MeshArena, attributes 0 / 1 / 2 as in Mesh
+struct ArenaVertex
+{
+    Vec3 position;
+    Vec2 texcoord;
+    Vec3 normal;
+};
+
+// Many small meshes of one vertex format packed into a single vertex / index
+// buffer pair behind one VAO. Each visible draw becomes a
+// DrawElementsIndirectCommand plus its ObjectConstants in a storage buffer,
+// and the whole list goes out as one glMultiDrawElementsIndirect. The vertex
+// shader declares DRAW_BLOCK_GLSL and reads draws[gl_DrawID]. Meshes are
+// copied in once and stay until Release.
+class MeshArena
+{
+private:
+    struct Range
+    {
+        u32 firstIndex;
+        u32 indexCount;
+        s32 baseVertex;
+        BoundingBox bounds;
+    };
+
+    u32 vao;
+    u32 vbo;
+    u32 ebo;
+    u32 indirectBuffer;
+    u32 drawBuffer;
+    u32 vertexCapacity;
+    u32 indexCapacity;
+    u32 drawCapacity;
+    u32 vertexCount;
+    u32 indexCount;
+    u32 culled;
+    std::vector<Range> ranges;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<ObjectConstants> draws;
+
+public:
+    MeshArena();
+
+    bool Create(u32 maxVertices, u32 maxIndices, u32 maxDraws);
+    void Release();
+
+    // copies the mesh in, returns its handle or -1 when the arena is full
+    int Add(const Mesh *mesh);
+
+    // starts a new draw list
+    void Begin();
+    // false when the draw was culled against the Driver frustum, the list is
+    // full or the handle is invalid
+    bool Draw(int handle, const Mat4 &model, const Vec4 &color = Vec4(1.0f, 1.0f, 1.0f, 1.0f), bool cull = true);
+    // uploads the list and issues it with one call; bind the shader first
+    void Render(u32 mode = GL_TRIANGLES);
+
+    u32 GetMeshCount() const { return (u32)ranges.size(); }
+    u32 GetDrawCount() const { return (u32)commands.size(); }
+    u32 GetCulledCount() const { return culled; }
+    u32 GetVertexCount() const { return vertexCount; }
+    u32 GetIndexCount() const { return indexCount; }
+};
+
 
 
 class MeshManager
@@ -124,4 +279,67 @@ class MeshManager
 
 
 
-};
\ No newline at end of file
+};
+
+struct RayHit
+{
+    float t;            // distance along the (normalized) ray direction
+    float u, v;         // barycentric coordinates of the hit inside the triangle
+    u32 triangle;       // index of the triangle in the source index list (indices[triangle * 3])
+    Vec3 position;
+    Vec3 normal;        // geometric normal of the hit triangle
+};
+
+// 32 byte node, children of an inner node are stored next to each other
+struct BVHNode
+{
+    Vec3 min;
+    u32 leftFirst;      // inner: left child index, leaf: first triangle
+    Vec3 max;
+    u32 count;          // 0 for inner nodes
+};
+
+const u32 BVH_PACKET_SIZE = 4;
+// deepest leaf a build makes, the traversal stacks are sized from it
+const u32 BVH_MAX_DEPTH = 62;
+
+// Bounding volume hierarchy over the indexed triangles of a mesh, built with
+// a binned SAH. Triangles are copied in leaf order so a leaf reads one
+// contiguous block; rebuild after the mesh vertices change.
+class MeshBVH
+{
+private:
+    std::vector<BVHNode> nodes;
+    std::vector<Vec3> triangles;    // 3 vertices per triangle, leaf order
+    std::vector<u32> triangleIds;   // source triangle for each entry
+    u32 nodesUsed;
+    u32 maxDepth;
+
+    void updateBounds(u32 index, const BoundingBox *bounds);
+    void subdivide(u32 index, u32 depth, BoundingBox *bounds, Vec3 *centroids);
+    float findSplit(const BVHNode &node, const BoundingBox *bounds, const Vec3 *centroids, int &axis, float &position) const;
+    bool intersectTriangle(const Ray &ray, u32 index, RayHit &hit) const;
+
+public:
+    MeshBVH();
+
+    // nodes at depth (at most BVH_MAX_DEPTH) become leaves whatever their size
+    bool Build(const Mesh *mesh, u32 depth = BVH_MAX_DEPTH);
+    bool Build(const Vec3 *vertices, const u32 *indices, u32 triangleCount, u32 depth = BVH_MAX_DEPTH);
+    void Release();
+
+    // closest hit closer than maxDistance; a miss gets t = M_INFINITY, whatever
+    // maxDistance was, in this and the packet overload
+    bool Intersect(const Ray &ray, RayHit &hit, float maxDistance = M_INFINITY) const;
+    // any hit closer than maxDistance, for line of sight / shadow style queries
+    bool Occluded(const Ray &ray, float maxDistance = M_INFINITY) const;
+    // many rays at once, traversed in packets of BVH_PACKET_SIZE that share the
+    // node visits; works best with coherent rays (screen tiles, fans). Misses
+    // get t = M_INFINITY. Returns the number of hits.
+    u32 Intersect(const Ray *rays, RayHit *hits, u32 count, float maxDistance = M_INFINITY) const;
+
+    BoundingBox GetBounds() const;
+    u32 GetNodeCount() const { return nodesUsed; }
+    u32 GetTriangleCount() const { return (u32)triangleIds.size(); }
+    const std::vector<BVHNode> &GetNodes() const { return nodes; }
+};
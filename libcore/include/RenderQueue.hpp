@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Math.hpp"
+#include "Mesh.hpp"
+
+const u32 RENDER_MAX_PASSES = 16;
+const u32 RENDER_MAX_TEXTURES = 4;
+
+// default pass slots, any index below RENDER_MAX_PASSES can be configured
+enum RenderPassSlot
+{
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_CUTOUT = 4,
+    RENDER_PASS_TRANSPARENT = 8,
+    RENDER_PASS_OVERLAY = 12,
+};
+
+// Order of the draws inside a pass:
+// SORT_STATE          shader, texture, VAO, then near to far (opaque default)
+// SORT_FRONT_TO_BACK  near to far first, state only breaks ties (max early z)
+// SORT_BACK_TO_FRONT  far to near first, for blending
+enum RenderSort
+{
+    SORT_STATE,
+    SORT_FRONT_TO_BACK,
+    SORT_BACK_TO_FRONT,
+};
+
+// Fixed function state applied when the queue enters a pass
+struct RenderPassState
+{
+    RenderSort sort;
+    bool depthTest;
+    bool depthWrite;
+    bool cullFace;
+    bool blend;
+    u32 blendSrc;
+    u32 blendDst;
+
+    RenderPassState(RenderSort sort = SORT_STATE) : sort(sort), depthTest(true), depthWrite(true), cullFace(true), blend(false),
+                                                    blendSrc(GL_SRC_ALPHA), blendDst(GL_ONE_MINUS_SRC_ALPHA) {}
+};
+
+typedef void (*RenderCallback)(void *user);
+
+// Draw data a packet points to. Exactly one of mesh, buffer or callback is
+// set; count 0 draws the whole mesh. textures[i] goes to unit i, 0 leaves
+// the unit alone. The model matrix is written to the ObjectData block, or
+// to modelUniform instead when the shader still uses a plain uniform.
+struct RenderCommand
+{
+    Shader *shader;
+    Mesh *mesh;
+    MeshBuffer *buffer;
+    RenderCallback callback;
+    void *user;
+    u32 textures[RENDER_MAX_TEXTURES];
+    u32 mode;
+    u32 start;
+    u32 count;
+    UniformHandle modelUniform;
+    ObjectConstants object;
+};
+
+struct RenderPacket
+{
+    u64 key;
+    u32 command;
+};
+
+// Draws are recorded as packets of a 64 bit key and the index of their
+// command, radix sorted once and executed in key order through the Driver
+// state cache, so draws sharing a shader / texture / VAO run back to back.
+//
+// Key layout, pass always in the top 4 bits:
+//   SORT_STATE        pass:4 shader:12 texture:12 vao:12 depth:24
+//   SORT_*_TO_*       pass:4 depth:24 shader:12 texture:12 vao:12
+// Names are truncated to 12 bits; a collision only costs an extra state
+// change, the command carries the real names. Depth is the top 24 bits of
+// the float squared distance to the eye, which keeps the float ordering.
+class RenderQueue
+{
+private:
+    std::vector<RenderCommand> commands;
+    std::vector<RenderPacket> packets;
+    std::vector<RenderPacket> scratch;
+    RenderPassState passes[RENDER_MAX_PASSES];
+    Vec3 eye;
+    bool sorted;
+
+    RenderCommand &push(u32 pass, Shader *shader, u32 texture, u32 vertexArray, float depth);
+    void applyPass(u32 pass);
+
+public:
+    RenderQueue();
+
+    // the sort policy applies to draws submitted afterwards
+    void SetPass(u32 pass, const RenderPassState &state);
+    const RenderPassState &GetPass(u32 pass) const { return passes[pass]; }
+
+    // clears the queue, the eye comes from the Driver frame constants
+    // (call after UpdateFrustum) or is given for custom views
+    void Begin();
+    void Begin(const Vec3 &eye);
+
+    // references stay valid until the next Submit
+    RenderCommand &Submit(u32 pass, Shader *shader, Mesh *mesh, const Mat4 &model, u32 texture = 0, u32 mode = GL_TRIANGLES);
+    RenderCommand &Submit(u32 pass, Shader *shader, MeshBuffer *buffer, const Mat4 &model, u32 texture = 0, u32 mode = GL_TRIANGLES);
+    // custom draw code (terrain, particles) ordered by a view space distance
+    RenderCommand &Submit(u32 pass, Shader *shader, RenderCallback callback, void *user, float distance);
+
+    void Sort();
+    // sorts if needed and issues every packet, the queue keeps its content
+    void Execute();
+    void Flush() { Execute(); Clear(); }
+    void Clear();
+
+    u32 GetPacketCount() const { return (u32)packets.size(); }
+    const RenderPacket *GetPackets() const { return packets.data(); }
+    const RenderCommand &GetCommand(u32 index) const { return commands[index]; }
+
+    static u64 MakeKey(u32 pass, RenderSort sort, u32 shader, u32 texture, u32 vertexArray, float distanceSquared);
+    // LSD radix sort on the key, 8 bit digits, digits equal in every key are skipped
+    static void SortPackets(RenderPacket *packets, RenderPacket *scratch, u32 count);
+};
@@ -13,8 +13,14 @@ class Heightmap
         float *heightData;
         float maxHeight;
 
+        u8 *nativeData;     // raw 8/16 bit samples, owned or file mapped
+        int nativeDepth;
+        size_t mappedSize;  // > 0 when nativeData points into a file mapping
+
         u32 readRawValue(const u8* buffer, int bitDepth) const;
         void writeRawValue(u8* buffer, int bitDepth, float value) const;
+        bool openRaw(const char *filename, int bitDepth, size_t fileSize);
+        void releaseData();
 
     public:
         Heightmap(float heightScale = 100.0f);
@@ -22,6 +28,8 @@ class Heightmap
         
         bool LoadImage(const char *filename);
         bool Load(const char *filename,int bitDepth);
+        bool Map(const char *filename, int bitDepth);
+        bool LoadNative(const char *filename, int bitDepth);
         bool Save(const char *filename, int bitDepth);
         
         Vec3 GetNormal(int x, int y) ;
@@ -29,9 +37,111 @@ class Heightmap
 
         float GetHeight(int x, int y);
          void SetHeight(int x, int z, float height); 
+        void SetHeightValue(int x, int z, float value);
         int GetWidth() { return width; }
         float GetMaxHeight() { return maxHeight; }
+        const float *GetData();
+        const u8 *GetNativeData() const { return nativeData; }
+        int GetBitDepth() const { return nativeData ? nativeDepth : 32; }
+        bool IsNative() const { return nativeData != nullptr && heightData == nullptr; }
+        void ConvertRegion(int x, int z, int w, int h, float *out) const;
         float GetInterpolatedHeight(float x, float z) ;
+        void GetInterpolatedHeights(const float *xs, const float *zs, float *out, int count);
+        void GetNormals(int x, int z, int w, int h, Vec3 *out) const;
+};
+
+const int HEIGHTMAP_TILE_SHIFT = 6;
+const int HEIGHTMAP_TILE_SIZE = 1 << HEIGHTMAP_TILE_SHIFT;
+
+// Heightmap stored as 64x64 tiles in Morton order with a mip pyramid and
+// per tile min/max, so region reads stay inside a few cache friendly blocks
+// and LOD code can query coarse data and conservative bounds directly.
+class TiledHeightmap
+{
+    private:
+        struct Level
+        {
+            int width, height;
+            int tilesX, tilesY;
+            std::vector<u32> slots;       // tile (ty * tilesX + tx) -> storage slot
+            std::vector<float> tileMin;   // per tile, bounds of the full resolution samples
+            std::vector<float> tileMax;
+            std::vector<float> data;      // slot * tileSize^2 + row * tileSize + column
+        };
+
+        std::vector<Level> levels;
+        float maxHeight;
+
+        void initLevel(Level &level, int width, int height);
+        void buildMip(int index);
+        void queryMinMax(int level, int x0, int z0, int x1, int z1, float &minHeight, float &maxHeight) const;
+
+    public:
+        TiledHeightmap();
+
+        bool Build(Heightmap &heightmap);
+        bool Save(const char *filename) const;
+        bool Load(const char *filename);
+        void Release();
+
+        int GetLevelCount() const { return (int)levels.size(); }
+        int GetWidth(int level = 0) const { return levels.empty() ? 0 : levels[level].width; }
+        int GetHeight(int level = 0) const { return levels.empty() ? 0 : levels[level].height; }
+        float GetMaxHeight() const { return maxHeight; }
+
+        float GetHeight(int x, int z, int level = 0) const;
+        float GetInterpolatedHeight(float x, float z, int level = 0) const;
+        const float *GetTile(int tx, int tz, int level = 0) const;
+        void ReadRegion(int x, int z, int w, int h, int level, float *out) const;
+        bool GetMinMax(int x, int z, int w, int h, float &minHeight, float &maxHeight) const;
+};
+
+struct TerrainHit
+{
+    float t;            // distance along the ray
+    Vec3 position;
+    Vec3 normal;        // world space normal of the hit triangle
+    int x, z;           // hit cell, spans samples x..x+1, z..z+1
+};
+
+// Ray queries against a heightmap without building a mesh. A min/max pyramid
+// over the grid cells (the maximum mipmap) lets a ray skip every node whose
+// height range it passes above or below; surviving level 0 cells get an exact
+// test against their two triangles, split along the (x+1,z)-(x,z+1) diagonal
+// like the terrain meshes. World space is position + (x, height, z) * scale.
+class HeightmapRaycaster
+{
+    private:
+        struct Level
+        {
+            int width, height;          // cells
+            std::vector<float> minHeight;
+            std::vector<float> maxHeight;
+        };
+
+        Heightmap *heightmap;
+        std::vector<Level> levels;
+        Vec3 position;
+        Vec3 scale;
+
+        void buildLevel(int index, int x0, int z0, int x1, int z1);
+        bool intersectCell(const Vec3 &origin, const Vec3 &direction, int x, int z, float maxT, float &t) const;
+        bool traverse(const Ray &ray, float maxDistance, bool anyHit, TerrainHit &hit) const;
+
+    public:
+        HeightmapRaycaster();
+
+        bool Build(Heightmap &heightmap, const Vec3 &position = Vec3(0.0f, 0.0f, 0.0f), const Vec3 &scale = Vec3(1.0f, 1.0f, 1.0f));
+        // refresh the pyramid after the samples in [x0, x1] x [z0, z1] were edited
+        void Update(int x0, int z0, int x1, int z1);
+        void Release();
+
+        bool Raycast(const Ray &ray, TerrainHit &hit, float maxDistance = M_INFINITY) const;
+        int Raycast(const Ray *rays, TerrainHit *hits, int count, float maxDistance = M_INFINITY) const;
+        // true when nothing blocks the segment between the two points
+        bool LineOfSight(const Vec3 &from, const Vec3 &to) const;
+
+        int GetLevelCount() const { return (int)levels.size(); }
 };
 
 class Transform
@@ -77,8 +187,97 @@ private:
     void MarkDirty();
 };
 
+//***************************************************************************************************************
+// TransformHierarchy
+//***************************************************************************************************************
+
+const int TRANSFORM_NULL = -1;
+
+// Flat transform system for large node counts. Local TRS and world
+// matrices live in parallel arrays with every parent before its children,
+// sorted depth first so each subtree is one contiguous range. Update() is a
+// single linear pass that recomputes the nodes whose local transform or any
+// ancestor changed; the parent's flag is read from the same pass, no
+// recursion and no pointer chasing. Create appends, reparenting and Destroy
+// only mark the order stale and the next Update rebuilds it in O(n).
+// Handles stay valid while nodes move around in the arrays.
+//
+// World = local * parentWorld, the row vector order of Mat4::transformPoint
+// (a child offset is rotated by its parent).
+class TransformHierarchy
+{
+private:
+    enum
+    {
+        TRANSFORM_DIRTY = 1,    // local TRS changed since the last update
+        TRANSFORM_CHANGED = 2,  // world matrix recomputed by the last update
+        TRANSFORM_REMOVED = 4   // destroyed, dropped by the next sort
+    };
+
+    std::vector<int> parent;        // index of the parent, TRANSFORM_NULL for roots
+    std::vector<int> subtreeSize;   // node plus descendants
+    std::vector<Vec3> position;
+    std::vector<Quat> rotation;
+    std::vector<Vec3> scale;
+    std::vector<Mat4> world;        // local matrices are composed on the fly, cheaper than their bandwidth
+    std::vector<u8> flags;
+    std::vector<int> handleOf;      // index -> handle
+    std::vector<int> indexOf;       // handle -> index, next free handle while free
+    int freeHandle;
+    int removedCount;
+    bool ordered;                   // depth first order and subtree sizes are valid
+    bool parentsFirst;              // every parent index is lower than its children's
+
+    void sort();
+
+public:
+    TransformHierarchy();
+
+    int Create(int parentHandle = TRANSFORM_NULL);
+    // destroys the node and its whole subtree
+    void Destroy(int handle);
+    // false when the new parent is the node itself or one of its descendants
+    bool SetParent(int handle, int parentHandle);
+    int GetParent(int handle) const;
+    void Clear();
+
+    void SetPosition(int handle, const Vec3 &value);
+    void SetRotation(int handle, const Quat &value);
+    void SetScale(int handle, const Vec3 &value);
+    void SetLocal(int handle, const Vec3 &position, const Quat &rotation, const Vec3 &scale);
+
+    const Vec3 &GetPosition(int handle) const { return position[indexOf[handle]]; }
+    const Quat &GetRotation(int handle) const { return rotation[indexOf[handle]]; }
+    const Vec3 &GetScale(int handle) const { return scale[indexOf[handle]]; }
+
+    Mat4 GetLocalMatrix(int handle) const;
+    // valid after Update
+    const Mat4 &GetWorldMatrix(int handle) const { return world[indexOf[handle]]; }
+    Vec3 GetWorldPosition(int handle) const { return world[indexOf[handle]].getTranslation(); }
+    // true when the last update recomputed the node's world matrix
+    bool HasChanged(int handle) const { return (flags[indexOf[handle]] & TRANSFORM_CHANGED) != 0; }
+
+    // sorts if needed and updates every dirty subtree
+    void Update();
+
+    // Parallel update: Prepare() once, then UpdateRange over the ranges of
+    // Partition, each on its own thread. Ranges hold whole root subtrees so
+    // no node reads a parent written by another thread.
+    void Prepare();
+    int Partition(int maxRanges, std::vector<int> &bounds) const;
+    void UpdateRange(int begin, int end);
+
+    int GetCount() const { return (int)parent.size() - removedCount; }
+    // array position of a handle, stable until the next structural edit
+    int GetIndex(int handle) const { return indexOf[handle]; }
+    const Mat4 *GetWorldMatrices() const { return world.data(); }
+};
+
+class SpatialTree;
+
 class Node3D
 {
+    friend class SpatialTree;
 
     protected:
         Node3D* Parent;
@@ -87,10 +286,18 @@ class Node3D
         Vec3 RelativeRotation;
         Vec3 RelativeScale;
         Mat4 AbsoluteTransformation;
+        BoundingBox Bounds;     // local space
+        int SpatialProxy;       // leaf in the SpatialTree the node was inserted in, -1 when none
+        SpatialTree *SpatialOwner;
     public:
         Node3D(const Vec3 &position = Vec3(0.0f, 0.0f, 0.0f), const Vec3 &rotation = Vec3(0.0f, 0.0f, 0.0f), const Vec3 &scale = Vec3(1.0f, 1.0f, 1.0f));
+        // leaves its SpatialTree, so queries never return a deleted node
         virtual ~Node3D();
 
+        // a copy would share the proxy of the original
+        Node3D(const Node3D &) = delete;
+        Node3D &operator=(const Node3D &) = delete;
+
         void SetParent(Node3D* parent);
         Node3D* GetParent() { return Parent; }
 
@@ -110,6 +317,17 @@ class Node3D
         void SetRotation(const Vec3& rotation) { RelativeRotation = rotation; }
         void SetPosition(const Vec3& position) { RelativeTranslation = position; }
 
+        void SetBoundingBox(const BoundingBox& box) { Bounds = box; }
+        const BoundingBox& GetBoundingBox() const { return Bounds; }
+        // local bounds moved by the absolute transformation
+        BoundingBox GetTransformedBoundingBox() const;
+        int GetSpatialProxy() const { return SpatialProxy; }
+        SpatialTree *GetSpatialTree() const { return SpatialOwner; }
+
+        // closest hit along the ray, t is the distance; the default tests the
+        // transformed bounding box, override for exact geometry
+        virtual bool Intersect(const Ray& ray, float& t) const;
+
         virtual void Render();
         virtual void Update(u32 time);
 };
@@ -160,4 +378,85 @@ class Camera : public Node3D
         float GetAspect() const { return Aspect; }
 
         void Render() override;
-};
\ No newline at end of file
+};
+
+//***************************************************************************************************************
+// SpatialTree
+//***************************************************************************************************************
+
+const int SPATIAL_NULL = -1;
+
+struct SpatialNode
+{
+    BoundingBox box;    // leaves store the fattened box
+    void *userData;
+    int parent;         // next free node while on the free list
+    int child1;
+    int child2;
+    int height;         // 0 for leaves, -1 while free
+    bool sceneNode;     // leaf added by Insert: userData is a Node3D linked back to it
+
+    bool isLeaf() const { return child1 == SPATIAL_NULL; }
+};
+
+// Incremental dynamic AABB tree for moving objects. Each proxy keeps a box
+// enlarged by a margin (plus the predicted displacement) so small moves do
+// not touch the tree at all; a move that leaves its fat box reinserts only
+// that leaf, picking the sibling by surface area cost and rebalancing with
+// rotations on the way up. Queries walk the tree with a stack of their own and
+// append user data to the result vector.
+class SpatialTree
+{
+private:
+    std::vector<SpatialNode> nodes;
+    int root;
+    int freeList;
+    int proxyCount;
+    float margin;
+
+    int allocateNode();
+    void freeNode(int index);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int index);
+    void collect(int index, std::vector<void*> &results) const;
+
+public:
+    SpatialTree(float margin = 0.1f);
+    // unlinks the nodes still inserted
+    ~SpatialTree();
+
+    SpatialTree(const SpatialTree &) = delete;
+    SpatialTree &operator=(const SpatialTree &) = delete;
+
+    int CreateProxy(const BoundingBox &box, void *userData);
+    void DestroyProxy(int proxy);
+    // returns true when the proxy had to be reinserted
+    bool MoveProxy(int proxy, const BoundingBox &box, const Vec3 &displacement = Vec3(0.0f, 0.0f, 0.0f));
+    void Clear();
+
+    void *GetUserData(int proxy) const { return nodes[proxy].userData; }
+    const BoundingBox &GetFatBox(int proxy) const { return nodes[proxy].box; }
+
+    // scene node helpers, user data is the node and the proxy is kept in the
+    // node; a node is in one tree at a time and removes itself when deleted
+    int Insert(Node3D *node);
+    void Remove(Node3D *node);
+    bool Update(Node3D *node, const Vec3 &displacement = Vec3(0.0f, 0.0f, 0.0f));
+
+    // results are appended, the return value is the number added
+    u32 QueryFrustum(const Frustum &frustum, std::vector<void*> &results) const;
+    u32 QuerySphere(const Vec3 &center, float radius, std::vector<void*> &results) const;
+    u32 QueryBox(const BoundingBox &box, std::vector<void*> &results) const;
+    // every proxy whose fat box the ray enters before maxDistance
+    u32 QueryRay(const Ray &ray, float maxDistance, std::vector<void*> &results) const;
+    // closest Node3D::Intersect hit, front to back with pruning; only for trees
+    // filled through Insert(Node3D*)
+    Node3D *Raycast(const Ray &ray, float &t, float maxDistance = M_INFINITY) const;
+
+    BoundingBox GetBounds() const;
+    int GetProxyCount() const { return proxyCount; }
+    int GetHeight() const { return root == SPATIAL_NULL ? 0 : nodes[root].height; }
+    const std::vector<SpatialNode> &GetNodes() const { return nodes; }
+    int GetRoot() const { return root; }
+};
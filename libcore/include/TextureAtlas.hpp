@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Core.hpp"
+
+// MaxRects bin packer (best short side fit): the free space is kept as the
+// list of maximal free rectangles, a new rectangle goes where it leaves the
+// smallest leftover on its short side.
+class RectPacker
+{
+public:
+    struct PackRect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+private:
+    std::vector<PackRect> freeRects;
+    std::vector<PackRect> split;
+    int width;
+    int height;
+    u64 usedArea;
+
+    bool splitFreeRect(const PackRect &free, const PackRect &used);
+    void prune();
+
+public:
+    RectPacker();
+
+    void Init(int width, int height);
+    bool Insert(int width, int height, int &x, int &y);
+    // marks an area as used, for layouts restored from a file
+    void Reserve(int x, int y, int width, int height);
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    u32 GetFreeRectCount() const { return (u32)freeRects.size(); }
+    float GetOccupancy() const { return width > 0 ? (float)usedArea / ((float)width * height) : 0.0f; }
+};
+
+// An image inside an atlas page: draw it with
+// batch.Quad(region.texture, region.src, x, y, w, h).
+struct AtlasRegion
+{
+    Texture2D *texture;
+    Rectangle src;
+    u32 page;
+};
+
+// Packs many small images into shared RGBA pages, so sprites from the same
+// page batch into one draw. Images are copied into the page with their
+// edge texels extruded into the padding, against bleeding under linear
+// filtering. Add only writes the CPU copy of a page; Upload sends the rows
+// that changed to the GPU (call it before drawing).
+//
+// Offline: Build packs a list of files largest first, Save writes every
+// page as an uncompressed .btex and a text index (region names must not
+// contain spaces); Load restores them and still accepts new images.
+class TextureAtlas
+{
+private:
+    struct Page
+    {
+        Pixmap *pixmap;
+        Texture2D *texture;
+        RectPacker packer;
+        int dirtyTop;       // rows [dirtyTop, dirtyBottom) changed since the last Upload
+        int dirtyBottom;
+    };
+
+    std::vector<Page *> pages;
+    std::vector<AtlasRegion> regions;
+    std::vector<std::string> regionNames;
+    std::unordered_map<std::string, u32> names;
+    int pageWidth;
+    int pageHeight;
+    int padding;
+
+    Page *addPage();
+    void blit(Page *page, const Pixmap &image, int x, int y);
+
+public:
+    TextureAtlas();
+    ~TextureAtlas();
+
+    bool Init(int pageWidth = 1024, int pageHeight = 1024, int padding = 1);
+    void Release();
+
+    // returns the region handle, -1 when the image does not fit a page or
+    // the name has whitespace or over 255 characters (the index format);
+    // a name already in the atlas returns its region
+    s32 Add(const std::string &name, const Pixmap &image);
+    // named after the file without its extension
+    s32 Add(const char *file_name);
+    s32 Find(const std::string &name) const;
+    const AtlasRegion &GetRegion(u32 handle) const { return regions[handle]; }
+
+    void Upload();
+
+    bool Build(const std::vector<std::string> &files);
+    bool Save(const char *file_name) const;
+    bool Load(const char *file_name);
+
+    u32 GetRegionCount() const { return (u32)regions.size(); }
+    u32 GetPageCount() const { return (u32)pages.size(); }
+    Texture2D *GetPageTexture(u32 page) const { return pages[page]->texture; }
+    float GetOccupancy(u32 page) const { return pages[page]->packer.GetOccupancy(); }
+};
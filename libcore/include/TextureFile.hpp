@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Core.hpp"
+
+// Cooked texture container (.btex): a header, a table of levels, then every
+// level of the mip chain already in its GPU layout, so loading is a map of
+// the file and one upload per level, no decoding.
+const u32 TEXTURE_FILE_MAGIC = 0x58455442; // "BTEX"
+const u32 TEXTURE_FILE_VERSION = 1;
+const u32 TEXTURE_FILE_MAX_LEVELS = 16;
+
+// BC1  RGB, 4 bits per texel, alpha dropped
+// BC3  RGBA, 8 bits per texel
+// BC4  one channel (masks, heights), 4 bits per texel
+// BC5  two channels (normal map XY), 8 bits per texel
+// BC7  RGBA, 8 bits per texel, best quality (mode 6 only from the encoder)
+enum TextureFileFormat
+{
+    TEXTURE_FILE_R8,
+    TEXTURE_FILE_RG8,
+    TEXTURE_FILE_RGB8,
+    TEXTURE_FILE_RGBA8,
+    TEXTURE_FILE_BC1,
+    TEXTURE_FILE_BC3,
+    TEXTURE_FILE_BC4,
+    TEXTURE_FILE_BC5,
+    TEXTURE_FILE_BC7,
+    TEXTURE_FILE_FORMAT_COUNT,
+};
+
+struct TextureFileHeader
+{
+    u32 magic;
+    u32 version;
+    u32 format;
+    u32 width;
+    u32 height;
+    u32 levels;
+};
+
+struct TextureFileLevel
+{
+    u32 offset;     // from the start of the file, 16 byte aligned
+    u32 size;
+    u32 width;
+    u32 height;
+};
+
+// A validated file in memory, level data points into it
+struct TextureFileView
+{
+    TextureFileFormat format;
+    u32 width;
+    u32 height;
+    u32 levels;
+    TextureFileLevel level[TEXTURE_FILE_MAX_LEVELS];
+    const u8 *data;
+
+    const u8 *GetLevelData(u32 index) const { return data + level[index].offset; }
+};
+
+bool TextureFormatIsCompressed(TextureFileFormat format);
+// texel components the format keeps (BC1 reports 3)
+int TextureFormatComponents(TextureFileFormat format);
+u32 TextureFormatLevelSize(TextureFileFormat format, u32 width, u32 height);
+const char *TextureFormatName(TextureFileFormat format);
+
+// Block encoders, rgba is a 4x4 block of RGBA8 texels in rows, values a 4x4
+// block of one channel. Endpoints come from the principal axis of the block,
+// indices are the nearest palette entry.
+void CompressBlockBC1(const u8 *rgba, u8 *block);
+void CompressBlockBC3(const u8 *rgba, u8 *block);
+void CompressBlockBC4(const u8 *values, u8 *block);
+void CompressBlockBC5(const u8 *red, const u8 *green, u8 *block);
+void CompressBlockBC7(const u8 *rgba, u8 *block);
+
+// Block decoders, for drivers without S3TC and for the encoder checks
+void DecompressBlockBC1(const u8 *block, u8 *rgba);
+void DecompressBlockBC3(const u8 *block, u8 *rgba);
+void DecompressBlockBC4(const u8 *block, u8 *values);
+
+// One level: pixels are width x height texels of components channels, out is
+// resized to TextureFormatLevelSize. BC4 takes the first channel, BC5 the
+// first two (as do R8 / RG8); the other formats expand gray / gray alpha.
+bool CompressImage(TextureFileFormat format, const u8 *pixels, int width, int height, int components, std::vector<u8> &out);
+
+// Box filtered mip chain (down to 1x1 when mipmaps) encoded in format,
+// written as a complete .btex file into out.
+bool CookTexture(const Pixmap &image, TextureFileFormat format, bool mipmaps, std::vector<u8> &out);
+bool SaveTextureFile(const char *file_name, const std::vector<u8> &file);
+bool ParseTextureFile(const void *data, size_t size, TextureFileView &view);
+
+// GL side, on the texture selected with Driver::SelectTexture. BC1 / BC3
+// levels are decoded to RGBA8 when S3TC is missing. allocate specifies the
+// level (mutable textures), otherwise it fills glTexStorage2D storage.
+u32 TextureFileInternalFormat(TextureFileFormat format);
+// bytes the level takes on the GPU
+u32 TextureFileLevelBytes(const TextureFileView &view, u32 level);
+void UploadTextureLevel(const TextureFileView &view, u32 level, bool allocate, std::vector<u8> &scratch);
+void ApplyTextureFileSwizzle(TextureFileFormat format);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Math.hpp"
+#include "TextureFile.hpp"
+
+struct TextureStreamerStats
+{
+    u64 residentBytes;      // every resident level of every texture
+    u64 wantedBytes;        // what the current targets add up to
+    u64 budgetBytes;
+    u32 textures;
+    u32 pendingLevels;      // levels wanted but not resident yet
+    u32 uploadedLevels;     // last Update
+    u32 evictedLevels;      // last Update
+};
+
+// Streaming state of one texture: which levels are resident and wanted.
+struct StreamedTexture
+{
+    TextureFileView view;
+    u32 tail;           // coarsest level that may be dropped + 1, always resident from here
+    u32 resident;       // finest resident level (GL_TEXTURE_BASE_LEVEL)
+    u32 target;         // finest level allowed this frame
+    float pixels;       // screen size, kept for the grace period
+    u32 lastTouched;
+};
+
+// The decisions of TextureStreamer without any GL: wanted levels from the
+// reported screen sizes, the budget fit, and which levels to upload in
+// which order this frame. The streamer applies them to the textures.
+class TextureStreamPolicy
+{
+private:
+    u64 budget;
+    u32 uploadBudget;
+    u32 tailSize;
+    u32 graceFrames;
+    float mipBias;
+    u32 frame;
+    bool tailsOverBudget;
+
+    bool isVisible(const StreamedTexture &texture) const;
+
+public:
+    TextureStreamPolicy();
+
+    // tail from tailSize, only the tail resident
+    void Setup(StreamedTexture &texture, const TextureFileView &view) const;
+    void Touch(StreamedTexture &texture, float pixels) const;
+
+    u32 WantedLevel(const StreamedTexture &texture) const;
+    static u64 LevelBytes(const StreamedTexture &texture, u32 first);
+    // sets every target, the least magnified textures give up levels until
+    // the targets fit the budget; returns the bytes the targets add up to
+    u64 FitBudget(std::vector<StreamedTexture> &textures);
+    // one texture index per level to upload this frame, in upload order;
+    // each entry is the level above the previous one of that texture
+    void PlanUploads(const std::vector<StreamedTexture> &textures, std::vector<u32> &uploads) const;
+    void NextFrame() { frame++; }
+
+    void SetBudget(u64 budgetBytes) { budget = budgetBytes; }
+    void SetUploadBudget(u32 bytesPerFrame) { uploadBudget = bytesPerFrame; }
+    void SetTailSize(u32 size) { tailSize = Max(size, 1u); }
+    void SetGraceFrames(u32 frames) { graceFrames = frames; }
+    void SetMipBias(float bias) { mipBias = bias; }
+
+    u64 GetBudget() const { return budget; }
+    bool IsTailsOverBudget() const { return tailsOverBudget; }
+};
+
+// Mip streaming of cooked (.btex) textures under one memory budget.
+//
+// Each texture keeps its file mapped and only a range of levels resident:
+// GL_TEXTURE_BASE_LEVEL is the finest resident level and the levels above
+// it are released. The small mips (the tail, max side <= tailSize) are
+// always resident, so a texture can be sampled from the first frame.
+//
+// Every frame the caller reports how many pixels across each texture
+// covers on screen (Touch); the wanted level is the one with about one
+// texel per pixel. Update then lowers the wanted levels of the least
+// magnified textures until the total fits the budget, drops the levels
+// above the targets at once, and uploads the missing ones a level at a
+// time, finest needs first, within the upload budget of the frame.
+class TextureStreamer
+{
+private:
+    struct Entry
+    {
+        Texture2D *texture;
+        std::string fileName;
+        void *mapping;
+        size_t mappedSize;
+    };
+
+    // same index in both, the policy only sees the streaming state
+    std::vector<Entry> entries;
+    std::vector<StreamedTexture> streamed;
+    std::unordered_map<Texture2D *, u32> lookup;
+    std::vector<u32> uploads;
+    std::vector<u8> scratch;
+    TextureStreamPolicy policy;
+    TextureStreamerStats stats;
+
+    void evict(u32 index);
+    void uploadLevel(u32 index);
+
+public:
+    TextureStreamer();
+    ~TextureStreamer();
+
+    // budget covers the resident levels of every streamed texture,
+    // uploadBytesPerFrame bounds the levels uploaded by one Update
+    bool Init(u64 budgetBytes, u32 uploadBytesPerFrame = 4 * 1024 * 1024, u32 tailSize = 64);
+    void Release();
+
+    // the texture is owned by the streamer, bind it like any Texture2D
+    Texture2D *Load(const char *file_name);
+    void Unload(Texture2D *texture);
+
+    // the texture covers about `pixels` pixels across on screen this frame,
+    // several reports keep the largest
+    void Touch(Texture2D *texture, float pixels);
+    // pixels across of a sphere under the current FrameConstants
+    static float ScreenSize(const Vec3 &center, float radius);
+
+    // once per frame, on the GL thread
+    void Update();
+
+    void SetBudget(u64 budgetBytes) { policy.SetBudget(budgetBytes); }
+    void SetUploadBudget(u32 bytesPerFrame) { policy.SetUploadBudget(bytesPerFrame); }
+    // frames a texture keeps its screen size once it is not touched anymore
+    void SetGraceFrames(u32 frames) { policy.SetGraceFrames(frames); }
+    // positive values stream coarser levels everywhere
+    void SetMipBias(float bias) { policy.SetMipBias(bias); }
+
+    u32 GetResidentLevel(Texture2D *texture) const;
+    const TextureStreamerStats &GetStats() const { return stats; }
+};
@@ -0,0 +1,648 @@
+#include "Animation.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if !defined(MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+static const float QUAT_RANGE = 0.707106781f;   // smallest three components lie in [-1/sqrt2, 1/sqrt2]
+static const u32 MAX_KEY_SPAN = 128;            // longest run of source keys a single segment may replace
+
+//***************************************************************************************************************
+// helpers
+//***************************************************************************************************************
+
+static Quat nlerp(const Quat &a, const Quat &b, float t)
+{
+    const float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    const float s = d < 0.0f ? -t : t;
+    const float r = 1.0f - t;
+    Quat q(a.x * r + b.x * s, a.y * r + b.y * s, a.z * r + b.z * s, a.w * r + b.w * s);
+    const float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    if (length > 0.0f)
+    {
+        const float inv = 1.0f / length;
+        q = Quat(q.x * inv, q.y * inv, q.z * inv, q.w * inv);
+    }
+    return q;
+}
+
+static Vec3 interpolateKey(const Vec3 &a, const Vec3 &b, float t) { return Vec3::Lerp(a, b, t); }
+static Quat interpolateKey(const Quat &a, const Quat &b, float t) { return nlerp(a, b, t); }
+
+static float keyError(const Vec3 &a, const Vec3 &b) { return (a - b).length(); }
+
+// angle between the two rotations
+static float keyError(const Quat &a, const Quat &b)
+{
+    const float d = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+    return 2.0f * acosf(Min(d, 1.0f));
+}
+
+static u16 quantizeUnit(float v, float steps)
+{
+    const float q = v * steps + 0.5f;
+    return (u16)(q <= 0.0f ? 0.0f : (q >= steps ? steps : q));
+}
+
+static void encodeQuat(const Quat &q, u16 *out)
+{
+    const float c[4] = {q.x, q.y, q.z, q.w};
+    int largest = 0;
+    for (int i = 1; i < 4; ++i)
+        if (fabsf(c[i]) > fabsf(c[largest]))
+            largest = i;
+
+    // q and -q are the same rotation, make the dropped component positive
+    const float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+    for (int i = 0, k = 0; i < 4; ++i)
+        if (i != largest)
+            out[k++] = quantizeUnit((c[i] * sign / QUAT_RANGE) * 0.5f + 0.5f, 32767.0f);
+    out[0] |= (u16)((largest & 1) << 15);
+    out[1] |= (u16)((largest >> 1) << 15);
+}
+
+static Quat decodeQuat(const u16 *in)
+{
+    const float scale = 2.0f * QUAT_RANGE / 32767.0f;
+    const float a = (in[0] & 0x7FFF) * scale - QUAT_RANGE;
+    const float b = (in[1] & 0x7FFF) * scale - QUAT_RANGE;
+    const float c = in[2] * scale - QUAT_RANGE;
+    const float d = sqrtf(Max(0.0f, 1.0f - a * a - b * b - c * c));
+    switch ((in[0] >> 15) | ((in[1] >> 15) << 1))
+    {
+    case 0: return Quat(d, a, b, c);
+    case 1: return Quat(a, d, b, c);
+    case 2: return Quat(a, b, d, c);
+    default: return Quat(a, b, c, d);
+    }
+}
+
+// Greedy keyframe reduction over the quantized keys: from each kept key the
+// segment grows while every skipped source key stays within tolerance of the
+// interpolation. Tracks that never leave tolerance of their first key keep
+// only that key.
+template <typename T>
+static void reduceKeys(const std::vector<u16> &times, const std::vector<T> &decoded, const std::vector<T> &source, float tolerance, std::vector<u32> &kept)
+{
+    const u32 count = (u32)times.size();
+    kept.clear();
+    kept.push_back(0);
+
+    bool constant = true;
+    for (u32 k = 1; k < count && constant; ++k)
+        constant = keyError(decoded[0], source[k]) <= tolerance;
+    if (constant)
+        return;
+
+    u32 a = 0;
+    while (a + 1 < count)
+    {
+        u32 best = a + 1;
+        for (u32 b = a + 2; b < count && b - a <= MAX_KEY_SPAN; ++b)
+        {
+            const float span = (float)Max(1, (int)times[b] - (int)times[a]);
+            bool fits = true;
+            for (u32 k = a + 1; k < b && fits; ++k)
+            {
+                const float t = ((int)times[k] - (int)times[a]) / span;
+                fits = keyError(interpolateKey(decoded[a], decoded[b], t), source[k]) <= tolerance;
+            }
+            if (!fits)
+                break;
+            best = b;
+        }
+        kept.push_back(best);
+        a = best;
+    }
+}
+
+// rotations of count joints from the SoA scratch (a xyzw, b xyzw, t, each
+// stride floats long), shortest path nlerp
+static void nlerpBatch(const float *scratch, int stride, int count, Quat *out)
+{
+    const float *ax = scratch, *ay = ax + stride, *az = ay + stride, *aw = az + stride;
+    const float *bx = aw + stride, *by = bx + stride, *bz = by + stride, *bw = bz + stride;
+    const float *t = bw + stride;
+
+    int i = 0;
+#if defined(ANIMATION_SSE)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 threeHalves = _mm_set1_ps(1.5f);
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 x0 = _mm_loadu_ps(ax + i), y0 = _mm_loadu_ps(ay + i), z0 = _mm_loadu_ps(az + i), w0 = _mm_loadu_ps(aw + i);
+        __m128 x1 = _mm_loadu_ps(bx + i), y1 = _mm_loadu_ps(by + i), z1 = _mm_loadu_ps(bz + i), w1 = _mm_loadu_ps(bw + i);
+        const __m128 s = _mm_loadu_ps(t + i);
+
+        // flip b into a's hemisphere
+        const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)), _mm_add_ps(_mm_mul_ps(z0, z1), _mm_mul_ps(w0, w1)));
+        const __m128 flip = _mm_and_ps(d, signMask);
+        x1 = _mm_xor_ps(x1, flip);
+        y1 = _mm_xor_ps(y1, flip);
+        z1 = _mm_xor_ps(z1, flip);
+        w1 = _mm_xor_ps(w1, flip);
+
+        __m128 x = _mm_add_ps(x0, _mm_mul_ps(_mm_sub_ps(x1, x0), s));
+        __m128 y = _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), s));
+        __m128 z = _mm_add_ps(z0, _mm_mul_ps(_mm_sub_ps(z1, z0), s));
+        __m128 w = _mm_add_ps(w0, _mm_mul_ps(_mm_sub_ps(w1, w0), s));
+
+        // rsqrt estimate plus one Newton step
+        const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+        __m128 inv = _mm_rsqrt_ps(length2);
+        inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, length2), _mm_mul_ps(inv, inv))));
+        x = _mm_mul_ps(x, inv);
+        y = _mm_mul_ps(y, inv);
+        z = _mm_mul_ps(z, inv);
+        w = _mm_mul_ps(w, inv);
+
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        float *dst = &out[i].x;
+        _mm_storeu_ps(dst, x);
+        _mm_storeu_ps(dst + 4, y);
+        _mm_storeu_ps(dst + 8, z);
+        _mm_storeu_ps(dst + 12, w);
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = nlerp(Quat(ax[i], ay[i], az[i], aw[i]), Quat(bx[i], by[i], bz[i], bw[i]), t[i]);
+}
+
+//***************************************************************************************************************
+// Pose
+//***************************************************************************************************************
+
+void Pose::Resize(int jointCount)
+{
+    translations.resize(jointCount, Vec3(0.0f, 0.0f, 0.0f));
+    rotations.resize(jointCount, Quat(0.0f, 0.0f, 0.0f, 1.0f));
+    scales.resize(jointCount, Vec3(1.0f, 1.0f, 1.0f));
+}
+
+void Pose::Blend(const Pose &a, const Pose &b, float weight, Pose &out)
+{
+    const int count = Min(a.GetJointCount(), b.GetJointCount());
+    out.Resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        out.translations[i] = Vec3::Lerp(a.translations[i], b.translations[i], weight);
+        out.rotations[i] = nlerp(a.rotations[i], b.rotations[i], weight);
+        out.scales[i] = Vec3::Lerp(a.scales[i], b.scales[i], weight);
+    }
+}
+
+//***************************************************************************************************************
+// Skeleton
+//***************************************************************************************************************
+
+Skeleton::Skeleton()
+{
+}
+
+int Skeleton::AddJoint(const std::string &name, int parent, const Vec3 &translation, const Quat &rotation, const Vec3 &scale)
+{
+    if (parent < -1 || parent >= (int)parents.size())
+    {
+        Utils::LogError("Skeleton: joint %s has an invalid parent %d", name.c_str(), parent);
+        return -1;
+    }
+
+    names.push_back(name);
+    parents.push_back(parent);
+    bindPose.translations.push_back(translation);
+    bindPose.rotations.push_back(rotation);
+    bindPose.scales.push_back(scale);
+    inverseBind.push_back(Mat4::Identity());
+    return (int)parents.size() - 1;
+}
+
+void Skeleton::ComputeInverseBindMatrices()
+{
+    std::vector<Mat4> model(parents.size());
+    ComputeModelMatrices(bindPose, model.data());
+    for (size_t i = 0; i < parents.size(); ++i)
+        inverseBind[i] = model[i].inverse();
+}
+
+void Skeleton::Clear()
+{
+    names.clear();
+    parents.clear();
+    bindPose.Resize(0);
+    inverseBind.clear();
+}
+
+int Skeleton::FindJoint(const std::string &name) const
+{
+    for (size_t i = 0; i < names.size(); ++i)
+        if (names[i] == name)
+            return (int)i;
+    return -1;
+}
+
+void Skeleton::ComputeModelMatrices(const Pose &pose, Mat4 *model) const
+{
+    const int count = Min(GetJointCount(), pose.GetJointCount());
+    for (int i = 0; i < count; ++i)
+    {
+        const Mat4 local = Mat4::Compose(pose.translations[i], pose.rotations[i], pose.scales[i]);
+        model[i] = parents[i] < 0 ? local : local * model[parents[i]];
+    }
+}
+
+void Skeleton::ComputeSkinMatrices(const Pose &pose, Mat4 *model, Mat4 *skin) const
+{
+    ComputeModelMatrices(pose, model);
+    const int count = Min(GetJointCount(), pose.GetJointCount());
+    for (int i = 0; i < count; ++i)
+        skin[i] = inverseBind[i] * model[i];
+}
+
+//***************************************************************************************************************
+// AnimationClip
+//***************************************************************************************************************
+
+template <typename T>
+static void insertKey(std::vector<float> &times, std::vector<T> &values, float time, const T &value)
+{
+    const size_t at = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    times.insert(times.begin() + at, time);
+    values.insert(values.begin() + at, value);
+}
+
+// last key at or before time (0 when time is before the first key)
+static size_t findSegment(const std::vector<float> &times, float time, float &t)
+{
+    const size_t upper = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    if (upper == 0 || upper == times.size())
+    {
+        t = 0.0f;
+        return upper == 0 ? 0 : upper - 1;
+    }
+    const size_t i = upper - 1;
+    t = (time - times[i]) / (times[i + 1] - times[i]);
+    return i;
+}
+
+AnimationClip::AnimationClip(int jointCount, float duration)
+{
+    Reset(jointCount, duration);
+}
+
+void AnimationClip::Reset(int jointCount, float clipDuration)
+{
+    translations.assign(jointCount, Vec3Track());
+    rotations.assign(jointCount, QuatTrack());
+    scales.assign(jointCount, Vec3Track());
+    duration = clipDuration;
+}
+
+void AnimationClip::AddTranslationKey(int joint, float time, const Vec3 &value)
+{
+    insertKey(translations[joint].times, translations[joint].values, time, value);
+}
+
+void AnimationClip::AddRotationKey(int joint, float time, const Quat &value)
+{
+    insertKey(rotations[joint].times, rotations[joint].values, time, value);
+}
+
+void AnimationClip::AddScaleKey(int joint, float time, const Vec3 &value)
+{
+    insertKey(scales[joint].times, scales[joint].values, time, value);
+}
+
+void AnimationClip::Sample(float time, Pose &pose) const
+{
+    const int count = Min(GetJointCount(), pose.GetJointCount());
+    float t;
+    for (int j = 0; j < count; ++j)
+    {
+        const Vec3Track &translation = translations[j];
+        if (!translation.times.empty())
+        {
+            const size_t i = findSegment(translation.times, time, t);
+            pose.translations[j] = t > 0.0f ? Vec3::Lerp(translation.values[i], translation.values[i + 1], t) : translation.values[i];
+        }
+
+        const QuatTrack &rotation = rotations[j];
+        if (!rotation.times.empty())
+        {
+            const size_t i = findSegment(rotation.times, time, t);
+            pose.rotations[j] = t > 0.0f ? nlerp(rotation.values[i], rotation.values[i + 1], t) : rotation.values[i];
+        }
+
+        const Vec3Track &scale = scales[j];
+        if (!scale.times.empty())
+        {
+            const size_t i = findSegment(scale.times, time, t);
+            pose.scales[j] = t > 0.0f ? Vec3::Lerp(scale.values[i], scale.values[i + 1], t) : scale.values[i];
+        }
+    }
+}
+
+u32 AnimationClip::GetKeyCount() const
+{
+    u32 count = 0;
+    for (size_t j = 0; j < rotations.size(); ++j)
+        count += (u32)(translations[j].times.size() + rotations[j].times.size() + scales[j].times.size());
+    return count;
+}
+
+size_t AnimationClip::GetMemorySize() const
+{
+    size_t size = 0;
+    for (size_t j = 0; j < rotations.size(); ++j)
+    {
+        size += translations[j].times.size() * (sizeof(float) + sizeof(Vec3));
+        size += rotations[j].times.size() * (sizeof(float) + sizeof(Quat));
+        size += scales[j].times.size() * (sizeof(float) + sizeof(Vec3));
+    }
+    return size;
+}
+
+//***************************************************************************************************************
+// CompressedClip
+//***************************************************************************************************************
+
+CompressedClip::CompressedClip() : duration(0.0f), jointCount(0)
+{
+}
+
+void CompressedClip::Release()
+{
+    tracks.clear();
+    keys.clear();
+    duration = 0.0f;
+    jointCount = 0;
+}
+
+bool CompressedClip::Build(const AnimationClip &clip, const AnimationCompression &settings)
+{
+    Release();
+    if (clip.GetJointCount() == 0 || clip.duration <= 0.0f)
+    {
+        Utils::LogError("CompressedClip: empty clip");
+        return false;
+    }
+
+    duration = clip.duration;
+    jointCount = clip.GetJointCount();
+    tracks.resize(jointCount * 3);
+    for (int j = 0; j < jointCount; ++j)
+    {
+        buildVec3Track(clip.translations[j].times, clip.translations[j].values, settings.translationError, tracks[j * 3 + 0]);
+        buildQuatTrack(clip.rotations[j].times, clip.rotations[j].values, settings.rotationError, tracks[j * 3 + 1]);
+        buildVec3Track(clip.scales[j].times, clip.scales[j].values, settings.scaleError, tracks[j * 3 + 2]);
+    }
+    return true;
+}
+
+void CompressedClip::buildVec3Track(const std::vector<float> &times, const std::vector<Vec3> &values, float tolerance, Track &track)
+{
+    track.first = (u32)keys.size();
+    track.count = 0;
+    track.offset = Vec3(0.0f, 0.0f, 0.0f);
+    track.range = Vec3(0.0f, 0.0f, 0.0f);
+    if (times.empty())
+        return;
+
+    Vec3 min = values[0], max = values[0];
+    for (size_t i = 1; i < values.size(); ++i)
+    {
+        min.set(Min(min.x, values[i].x), Min(min.y, values[i].y), Min(min.z, values[i].z));
+        max.set(Max(max.x, values[i].x), Max(max.y, values[i].y), Max(max.z, values[i].z));
+    }
+    track.offset = min;
+    track.range = max - min;
+
+    const size_t count = times.size();
+    std::vector<PackedKey> packed(count);
+    std::vector<u16> quantizedTimes(count);
+    std::vector<Vec3> decoded(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        PackedKey &key = packed[i];
+        key.time = quantizeUnit(Min(Max(times[i] / duration, 0.0f), 1.0f), 65535.0f);
+        for (int c = 0; c < 3; ++c)
+        {
+            const float range = (&track.range.x)[c];
+            const float v = range > 0.0f ? ((&values[i].x)[c] - (&track.offset.x)[c]) / range : 0.0f;
+            key.value[c] = quantizeUnit(v, 65535.0f);
+            (&decoded[i].x)[c] = (&track.offset.x)[c] + range * (key.value[c] * (1.0f / 65535.0f));
+        }
+        quantizedTimes[i] = key.time;
+    }
+
+    std::vector<u32> kept;
+    reduceKeys(quantizedTimes, decoded, values, tolerance, kept);
+    for (size_t i = 0; i < kept.size(); ++i)
+        keys.push_back(packed[kept[i]]);
+    track.count = (u32)kept.size();
+}
+
+void CompressedClip::buildQuatTrack(const std::vector<float> &times, const std::vector<Quat> &values, float tolerance, Track &track)
+{
+    track.first = (u32)keys.size();
+    track.count = 0;
+    track.offset = Vec3(0.0f, 0.0f, 0.0f);
+    track.range = Vec3(0.0f, 0.0f, 0.0f);
+    if (times.empty())
+        return;
+
+    const size_t count = times.size();
+    std::vector<PackedKey> packed(count);
+    std::vector<u16> quantizedTimes(count);
+    std::vector<Quat> source(count), decoded(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        source[i] = values[i].normal();
+        packed[i].time = quantizeUnit(Min(Max(times[i] / duration, 0.0f), 1.0f), 65535.0f);
+        encodeQuat(source[i], packed[i].value);
+        decoded[i] = decodeQuat(packed[i].value);
+        quantizedTimes[i] = packed[i].time;
+    }
+
+    std::vector<u32> kept;
+    reduceKeys(quantizedTimes, decoded, source, tolerance, kept);
+    for (size_t i = 0; i < kept.size(); ++i)
+        keys.push_back(packed[kept[i]]);
+    track.count = (u32)kept.size();
+}
+
+// key at or before time, starting from the key the cursor used last; long
+// jumps (seeks, loop wrap) fall back to a binary search
+u32 CompressedClip::findKey(const Track &track, float time, u32 hint) const
+{
+    const PackedKey *k = &keys[track.first];
+    u32 i = hint < track.count ? hint : 0;
+    if (k[i].time > time || (i + 8 < track.count && k[i + 8].time <= time))
+    {
+        u32 lo = 0, hi = track.count;
+        while (lo < hi)
+        {
+            const u32 mid = (lo + hi) / 2;
+            if (k[mid].time <= time)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo > 0 ? lo - 1 : 0;
+    }
+    while (i + 1 < track.count && k[i + 1].time <= time)
+        ++i;
+    return i;
+}
+
+// translation / scale channel, leaves out untouched without keys
+void CompressedClip::sampleVec3(const Track &track, float time, u32 &hint, Vec3 &out) const
+{
+    if (track.count == 0)
+        return;
+    const u32 i = findKey(track, time, hint);
+    hint = i;
+    const PackedKey &k0 = keys[track.first + i];
+    const PackedKey &k1 = keys[track.first + (i + 1 < track.count ? i + 1 : i)];
+    // clamped on both sides: before the first key holds it, like AnimationClip::Sample
+    const float t = k1.time > k0.time ? Clamp((time - k0.time) / (float)(k1.time - k0.time), 0.0f, 1.0f) : 0.0f;
+    const Vec3 scale = track.range * (1.0f / 65535.0f);
+    out.set(track.offset.x + scale.x * (k0.value[0] + (k1.value[0] - k0.value[0]) * t),
+            track.offset.y + scale.y * (k0.value[1] + (k1.value[1] - k0.value[1]) * t),
+            track.offset.z + scale.z * (k0.value[2] + (k1.value[2] - k0.value[2]) * t));
+}
+
+void CompressedClip::Sample(float time, Pose &pose, AnimationCursor &cursor) const
+{
+    const int count = Min(jointCount, pose.GetJointCount());
+    const int stride = (count + 3) & ~3;
+    if (cursor.keys.size() != tracks.size())
+        cursor.keys.assign(tracks.size(), 0);
+    cursor.scratch.resize(stride * 9);
+
+    float *scratch = cursor.scratch.data();
+    float *a = scratch;                 // x, y, z, w rows of the segment start
+    float *b = scratch + stride * 4;    // and end
+    float *weight = scratch + stride * 8;
+    u32 *hints = cursor.keys.data();
+
+    const float qt = Min(Max(duration > 0.0f ? time / duration : 0.0f, 0.0f), 1.0f) * 65535.0f;
+    for (int j = 0; j < count; ++j)
+    {
+        const Track *track = &tracks[j * 3];
+        sampleVec3(track[0], qt, hints[j * 3 + 0], pose.translations[j]);
+        sampleVec3(track[2], qt, hints[j * 3 + 2], pose.scales[j]);
+
+        // rotations only gather here, the batch below interpolates them
+        Quat q0 = pose.rotations[j], q1 = q0;
+        float t = 0.0f;
+        if (track[1].count > 0)
+        {
+            const u32 i = findKey(track[1], qt, hints[j * 3 + 1]);
+            hints[j * 3 + 1] = i;
+            const PackedKey &k0 = keys[track[1].first + i];
+            q0 = q1 = decodeQuat(k0.value);
+            if (i + 1 < track[1].count)
+            {
+                const PackedKey &k1 = keys[track[1].first + i + 1];
+                q1 = decodeQuat(k1.value);
+                t = Clamp((qt - k0.time) / (float)(k1.time - k0.time), 0.0f, 1.0f);
+            }
+        }
+        a[j] = q0.x;
+        a[j + stride] = q0.y;
+        a[j + stride * 2] = q0.z;
+        a[j + stride * 3] = q0.w;
+        b[j] = q1.x;
+        b[j + stride] = q1.y;
+        b[j + stride * 2] = q1.z;
+        b[j + stride * 3] = q1.w;
+        weight[j] = t;
+    }
+
+    nlerpBatch(scratch, stride, count, pose.rotations.data());
+}
+
+//***************************************************************************************************************
+// Skinning
+//***************************************************************************************************************
+
+void SkinVertices(const Mat4 *skin, const Vec3 *positions, const Vec3 *normals, const Vec4 *weights, const Vec4 *joints, u32 count, Vec3 *outPositions, Vec3 *outNormals)
+{
+    for (u32 v = 0; v < count; ++v)
+    {
+        const float w[4] = {weights[v].x, weights[v].y, weights[v].z, weights[v].w};
+        const int j[4] = {(int)joints[v].x, (int)joints[v].y, (int)joints[v].z, (int)joints[v].w};
+        const Vec3 p = positions[v];
+
+#if defined(ANIMATION_SSE)
+        // weighted sum of the four palette matrices, one row per register
+        __m128 r0 = _mm_setzero_ps(), r1 = _mm_setzero_ps(), r2 = _mm_setzero_ps(), r3 = _mm_setzero_ps();
+        for (int k = 0; k < 4; ++k)
+        {
+            if (w[k] == 0.0f)
+                continue;
+            const float *m = skin[j[k]].m;
+            const __m128 s = _mm_set1_ps(w[k]);
+            r0 = _mm_add_ps(r0, _mm_mul_ps(_mm_loadu_ps(m + 0), s));
+            r1 = _mm_add_ps(r1, _mm_mul_ps(_mm_loadu_ps(m + 4), s));
+            r2 = _mm_add_ps(r2, _mm_mul_ps(_mm_loadu_ps(m + 8), s));
+            r3 = _mm_add_ps(r3, _mm_mul_ps(_mm_loadu_ps(m + 12), s));
+        }
+
+        float out[4];
+        const __m128 linear = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), r0), _mm_mul_ps(_mm_set1_ps(p.y), r1)), _mm_mul_ps(_mm_set1_ps(p.z), r2));
+        _mm_storeu_ps(out, _mm_add_ps(linear, r3));
+        const Vec3 skinned(out[0], out[1], out[2]);
+        if (normals && outNormals)
+        {
+            const Vec3 n = normals[v];
+            _mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(n.x), r0), _mm_mul_ps(_mm_set1_ps(n.y), r1)), _mm_mul_ps(_mm_set1_ps(n.z), r2)));
+            outNormals[v] = Vec3(out[0], out[1], out[2]).normalize();
+        }
+        outPositions[v] = skinned;
+#else
+        float m[16] = {0.0f};
+        for (int k = 0; k < 4; ++k)
+        {
+            if (w[k] == 0.0f)
+                continue;
+            const float *src = skin[j[k]].m;
+            for (int e = 0; e < 16; ++e)
+                m[e] += src[e] * w[k];
+        }
+
+        const Vec3 skinned(p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+                           p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+                           p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]);
+        if (normals && outNormals)
+        {
+            const Vec3 n = normals[v];
+            outNormals[v] = Vec3(n.x * m[0] + n.y * m[4] + n.z * m[8],
+                                 n.x * m[1] + n.y * m[5] + n.z * m[9],
+                                 n.x * m[2] + n.y * m[6] + n.z * m[10]).normalize();
+        }
+        outPositions[v] = skinned;
+#endif
+    }
+}
+
+bool SkinMesh(const Mesh *mesh, const Mat4 *skin, std::vector<Vec3> &outPositions, std::vector<Vec3> &outNormals)
+{
+    const size_t count = mesh->vertices.size();
+    if (mesh->weights.size() != count || mesh->joints.size() != count)
+    {
+        Utils::LogError("SkinMesh: mesh has no weights / joints for its %u vertices", (u32)count);
+        return false;
+    }
+
+    const bool hasNormals = mesh->normals.size() == count;
+    outPositions.resize(count);
+    outNormals.resize(hasNormals ? count : 0);
+    SkinVertices(skin, mesh->vertices.data(), hasNormals ? mesh->normals.data() : nullptr, mesh->weights.data(), mesh->joints.data(), (u32)count,
+                 outPositions.data(), hasNormals ? outNormals.data() : nullptr);
+    return true;
+}
@@ -108,32 +108,32 @@ void RenderBatch::Init(int numBuffers, int bufferElements)
     for (int i = 0; i < numBuffers; i++)
     {
         glGenVertexArrays(1, &vertexBuffer[i]->vaoId);
-        glBindVertexArray(vertexBuffer[i]->vaoId);
+        Driver::Instance().BindVertexArray(vertexBuffer[i]->vaoId);
 
         glGenBuffers(1, &vertexBuffer[i]->vboId[0]);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[0]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[0]);
         glBufferData(GL_ARRAY_BUFFER, vertexBuffer[i]->vertices.size() * sizeof(float), vertexBuffer[i]->vertices.data(), GL_DYNAMIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, 0, 0, 0);
 
         glGenBuffers(1, &vertexBuffer[i]->vboId[1]);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[1]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[1]);
         glBufferData(GL_ARRAY_BUFFER, vertexBuffer[i]->texcoords.size() * sizeof(float), vertexBuffer[i]->texcoords.data(), GL_DYNAMIC_DRAW);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, 0, 0, 0);
 
         glGenBuffers(1, &vertexBuffer[i]->vboId[2]);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[2]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[2]);
         glBufferData(GL_ARRAY_BUFFER, vertexBuffer[i]->colors.size() * sizeof(unsigned char), vertexBuffer[i]->colors.data(), GL_DYNAMIC_DRAW);
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
 
         glGenBuffers(1, &vertexBuffer[i]->vboId[3]);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[i]->vboId[3]);
+        Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[i]->vboId[3]);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[i]->indices.size() * sizeof(unsigned int), vertexBuffer[i]->indices.data(), GL_STATIC_DRAW);
     }
 
-    glBindVertexArray(0);
+    Driver::Instance().BindVertexArray(0);
 
     for (int i = 0; i < BATCH_DRAWCALLS; i++)
     {
@@ -151,8 +151,8 @@ void RenderBatch::Init(int numBuffers, int bufferElements)
 
 void UnloadVertexArray(unsigned int vaoId)
 {
-    glBindVertexArray(0);
-    glDeleteVertexArrays(1, &vaoId);
+    Driver::Instance().BindVertexArray(0);
+    Driver::Instance().DeleteVertexArray(vaoId);
 }
 
 void RenderBatch::Release()
@@ -162,10 +162,10 @@ void RenderBatch::Release()
 
     for (int i = 0; i < (int)vertexBuffer.size(); i++)
     {
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[0]);
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[1]);
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[2]);
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[3]);
+        Driver::Instance().DeleteBuffer(vertexBuffer[i]->vboId[0]);
+        Driver::Instance().DeleteBuffer(vertexBuffer[i]->vboId[1]);
+        Driver::Instance().DeleteBuffer(vertexBuffer[i]->vboId[2]);
+        Driver::Instance().DeleteBuffer(vertexBuffer[i]->vboId[3]);
         UnloadVertexArray(vertexBuffer[i]->vaoId);
     }
     for (int i = 0; i < (int)draws.size(); i++)
@@ -198,30 +198,28 @@ void RenderBatch::Render()
 {
     if (vertexCounter > 0)
     {
-        glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
+        Driver::Instance().BindVertexArray(vertexBuffer[currentBuffer]->vaoId);
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[0]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[0]);
         glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * 3 * sizeof(float), vertexBuffer[currentBuffer]->vertices.data());
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[1]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[1]);
         glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * 2 * sizeof(float), vertexBuffer[currentBuffer]->texcoords.data());
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[2]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[2]);
         glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * 4 * sizeof(unsigned char), vertexBuffer[currentBuffer]->colors.data());
 
-        glBindVertexArray(0);
+        Driver::Instance().BindVertexArray(0);
     }
     if (vertexCounter > 0)
     {
 
-        glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[3]);
-        glActiveTexture(GL_TEXTURE0);
-
+        Driver::Instance().BindVertexArray(vertexBuffer[currentBuffer]->vaoId);
+        Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[3]);
         for (int i = 0, vertexOffset = 0; i < drawCounter; i++)
         {
 
-            glBindTexture(GL_TEXTURE_2D, draws[i]->textureId);
+            Driver::Instance().SelectTexture(draws[i]->textureId);
             int mode = GL_LINES;
             if (draws[i]->mode == LINES)
                 mode = GL_LINES;
@@ -241,12 +239,12 @@ void RenderBatch::Render()
 
             vertexOffset += (draws[i]->vertexCount + draws[i]->vertexAlignment);
         }
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+        Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        Driver::Instance().SelectTexture(0);
     }
 
-    glBindVertexArray(0); // Unbind VAO
+    Driver::Instance().BindVertexArray(0); // Unbind VAO
     vertexCounter = 0;
     currentDepth = -1.0f;
     for (int i = 0; i < BATCH_DRAWCALLS; i++)
@@ -726,21 +724,24 @@ void RenderBatch::Sphere(const Vec3 &position, float radius, int rings, int slic
 
         for (int i = 0; i < rings; ++i)
         {
-            float theta = (float)i * M_PI / rings;
+            float sinTheta, cosTheta;
+            CircleSinCos(i, 2 * rings, sinTheta, cosTheta);
             for (int j = 0; j < slices; ++j)
             {
-                float phi1 = (float)j * 2 * M_PI / slices;
-                float phi2 = (float)(j + 1) * 2 * M_PI / slices;
+                float sinPhi1, cosPhi1;
+                CircleSinCos(j, slices, sinPhi1, cosPhi1);
+                float sinPhi2, cosPhi2;
+                CircleSinCos(j + 1, slices, sinPhi2, cosPhi2);
 
                 Vec3 v1 = Vec3(
-                    x + radius * sin(theta) * cos(phi1),
-                    y + radius * sin(theta) * sin(phi1),
-                    z + radius * cos(theta));
+                    x + radius * sinTheta * cosPhi1,
+                    y + radius * sinTheta * sinPhi1,
+                    z + radius * cosTheta);
 
                 Vec3 v2 = Vec3(
-                    x + radius * sin(theta) * cos(phi2),
-                    y + radius * sin(theta) * sin(phi2),
-                    z + radius * cos(theta));
+                    x + radius * sinTheta * cosPhi2,
+                    y + radius * sinTheta * sinPhi2,
+                    z + radius * cosTheta);
 
                 Line3D(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
             }
@@ -749,21 +750,24 @@ void RenderBatch::Sphere(const Vec3 &position, float radius, int rings, int slic
         // Desenhar linhas verticais
         for (int j = 0; j < slices; ++j)
         {
-            float phi = (float)j * 2 * M_PI / slices;
+            float sinPhi, cosPhi;
+            CircleSinCos(j, slices, sinPhi, cosPhi);
             for (int i = (float)0; i < rings; ++i)
             {
-                float theta1 = i * M_PI / rings;
-                float theta2 = (i + 1) * M_PI / rings;
+                float sinTheta1, cosTheta1;
+                CircleSinCos(i, 2 * rings, sinTheta1, cosTheta1);
+                float sinTheta2, cosTheta2;
+                CircleSinCos(i + 1, 2 * rings, sinTheta2, cosTheta2);
 
                 Vec3 v1 = Vec3(
-                    x + radius * sin(theta1) * cos(phi),
-                    y + radius * sin(theta1) * sin(phi),
-                    z + radius * cos(theta1));
+                    x + radius * sinTheta1 * cosPhi,
+                    y + radius * sinTheta1 * sinPhi,
+                    z + radius * cosTheta1);
 
                 Vec3 v2 = Vec3(
-                    x + radius * sin(theta2) * cos(phi),
-                    y + radius * sin(theta2) * sin(phi),
-                    z + radius * cos(theta2));
+                    x + radius * sinTheta2 * cosPhi,
+                    y + radius * sinTheta2 * sinPhi,
+                    z + radius * cosTheta2);
 
                 Line3D(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
             }
@@ -778,30 +782,34 @@ void RenderBatch::Sphere(const Vec3 &position, float radius, int rings, int slic
             for (int j = 0; j < slices; ++j)
             {
                 // Calcular os v�rtices da esfera
-                float theta1 = i * M_PI / rings;
-                float theta2 = (i + 1) * M_PI / rings;
-                float phi1 = j * 2 * M_PI / slices;
-                float phi2 = (j + 1) * 2 * M_PI / slices;
+                float sinTheta1, cosTheta1;
+                CircleSinCos(i, 2 * rings, sinTheta1, cosTheta1);
+                float sinTheta2, cosTheta2;
+                CircleSinCos(i + 1, 2 * rings, sinTheta2, cosTheta2);
+                float sinPhi1, cosPhi1;
+                CircleSinCos(j, slices, sinPhi1, cosPhi1);
+                float sinPhi2, cosPhi2;
+                CircleSinCos(j + 1, slices, sinPhi2, cosPhi2);
 
                 Vec3 v1 = Vec3(
-                    x + radius * sin(theta1) * cos(phi1),
-                    y + radius * sin(theta1) * sin(phi1),
-                    z + radius * cos(theta1));
+                    x + radius * sinTheta1 * cosPhi1,
+                    y + radius * sinTheta1 * sinPhi1,
+                    z + radius * cosTheta1);
 
                 Vec3 v2 = Vec3(
-                    x + radius * sin(theta1) * cos(phi2),
-                    y + radius * sin(theta1) * sin(phi2),
-                    z + radius * cos(theta1));
+                    x + radius * sinTheta1 * cosPhi2,
+                    y + radius * sinTheta1 * sinPhi2,
+                    z + radius * cosTheta1);
 
                 Vec3 v3 = Vec3(
-                    x + radius * sin(theta2) * cos(phi1),
-                    y + radius * sin(theta2) * sin(phi1),
-                    z + radius * cos(theta2));
+                    x + radius * sinTheta2 * cosPhi1,
+                    y + radius * sinTheta2 * sinPhi1,
+                    z + radius * cosTheta2);
 
                 Vec3 v4 = Vec3(
-                    x + radius * sin(theta2) * cos(phi2),
-                    y + radius * sin(theta2) * sin(phi2),
-                    z + radius * cos(theta2));
+                    x + radius * sinTheta2 * cosPhi2,
+                    y + radius * sinTheta2 * sinPhi2,
+                    z + radius * cosTheta2);
 
                 // Desenhar os tri�ngulos da esfera
                 Vertex3f(v1.x, v1.y, v1.z);
@@ -829,18 +837,20 @@ void RenderBatch::Cone(const Vec3 &position, float radius, float height, int seg
         // Desenhar linhas que formam a base do cone
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 v1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 v2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             Line3D(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
         }
@@ -849,12 +859,13 @@ void RenderBatch::Cone(const Vec3 &position, float radius, float height, int seg
         Vec3 vertex = Vec3(x, y + height, z);
         for (int i = 0; i < segments; ++i)
         {
-            float theta = i * 2 * M_PI / segments;
+            float sinTheta, cosTheta;
+            CircleSinCos(i, segments, sinTheta, cosTheta);
 
             Vec3 base = Vec3(
-                x + radius * cos(theta),
+                x + radius * cosTheta,
                 y,
-                z + radius * sin(theta));
+                z + radius * sinTheta);
 
             Line3D(base.x, base.y, base.z, vertex.x, vertex.y, vertex.z);
         }
@@ -867,18 +878,20 @@ void RenderBatch::Cone(const Vec3 &position, float radius, float height, int seg
         // Desenhar tri�ngulos para formar as faces do cone
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 base1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 base2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             // Tri�ngulo formado pela base do cone e o v�rtice
             Vertex3f(base1.x, base1.y, base1.z);
@@ -898,18 +911,20 @@ void RenderBatch::Cylinder(const Vec3 &position, float radius, float height, int
     {
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 base1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 base2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             Line3D(base1.x, base1.y, base1.z, base2.x, base2.y, base2.z);
         }
@@ -917,18 +932,20 @@ void RenderBatch::Cylinder(const Vec3 &position, float radius, float height, int
         // Desenhar linhas que formam a base superior do cilindro
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 top1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y + height,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 top2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y + height,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             Line3D(top1.x, top1.y, top1.z, top2.x, top2.y, top2.z);
         }
@@ -936,17 +953,18 @@ void RenderBatch::Cylinder(const Vec3 &position, float radius, float height, int
         // Desenhar linhas que conectam a base inferior � superior
         for (int i = 0; i < segments; ++i)
         {
-            float theta = i * 2 * M_PI / segments;
+            float sinTheta, cosTheta;
+            CircleSinCos(i, segments, sinTheta, cosTheta);
 
             Vec3 base = Vec3(
-                x + radius * cos(theta),
+                x + radius * cosTheta,
                 y,
-                z + radius * sin(theta));
+                z + radius * sinTheta);
 
             Vec3 top = Vec3(
-                x + radius * cos(theta),
+                x + radius * cosTheta,
                 y + height,
-                z + radius * sin(theta));
+                z + radius * sinTheta);
 
             Line3D(base.x, base.y, base.z, top.x, top.y, top.z);
         }
@@ -958,18 +976,20 @@ void RenderBatch::Cylinder(const Vec3 &position, float radius, float height, int
         // Desenhar a base inferior do cilindro
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 base1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 base2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             Vertex3f(x, y, z); // Centro da base inferior
             Vertex3f(base1.x, base1.y, base1.z);
@@ -979,18 +999,20 @@ void RenderBatch::Cylinder(const Vec3 &position, float radius, float height, int
         // Desenhar a base superior do cilindro
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 top1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y + height,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 top2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y + height,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             Vertex3f(x, y + height, z); // Centro da base superior
             Vertex3f(top2.x, top2.y, top2.z);
@@ -1000,28 +1022,30 @@ void RenderBatch::Cylinder(const Vec3 &position, float radius, float height, int
         // Desenhar a superf�cie lateral do cilindro
         for (int i = 0; i < segments; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+            float sinTheta1, cosTheta1;
+            CircleSinCos(i, segments, sinTheta1, cosTheta1);
+            float sinTheta2, cosTheta2;
+            CircleSinCos(i + 1, segments, sinTheta2, cosTheta2);
 
             Vec3 base1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 base2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             Vec3 top1 = Vec3(
-                x + radius * cos(theta1),
+                x + radius * cosTheta1,
                 y + height,
-                z + radius * sin(theta1));
+                z + radius * sinTheta1);
 
             Vec3 top2 = Vec3(
-                x + radius * cos(theta2),
+                x + radius * cosTheta2,
                 y + height,
-                z + radius * sin(theta2));
+                z + radius * sinTheta2);
 
             // Tri�ngulo lateral inferior
             Vertex3f(base1.x, base1.y, base1.z);
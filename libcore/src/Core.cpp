@@ -1,8 +1,10 @@
 #include "Core.hpp"
 #include "Mesh.hpp"
+#include "Scene.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include <algorithm>
 
 #define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a) / sizeof(a[0]))
 
@@ -18,8 +20,16 @@
 #define GETCWD _getcwd // NOTE: MSDN recommends not to use getcwd(), chdir()
 #define CHDIR _chdir
 #include <io.h> // Required for: _access() [Used in FileExists()]
+#include <sys/stat.h> // Required for: stat() [Used in GetFileModTime()]
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#define NOUSER
+#include <windows.h> // Required for: CreateFileMapping(), MapViewOfFile() [Used in MapFile()]
 #else
 #include <unistd.h> // Required for: getch(), chdir() (POSIX), access()
+#include <fcntl.h>    // Required for: open()
+#include <sys/mman.h> // Required for: mmap(), munmap() [Used in MapFile()]
+#include <sys/stat.h> // Required for: fstat()
 #define GETCWD getcwd
 #define CHDIR chdir
 #endif
@@ -173,6 +183,82 @@ bool Utils::FileExists(const char *fileName)
     return result;
 }
 
+void *Utils::MapFile(const char *fileName, size_t *size)
+{
+    void *data = nullptr;
+    *size = 0;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        LogError("FILEIO: [%s] Failed to open file", fileName);
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        LogError("FILEIO: [%s] Failed to get file size", fileName);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+    {
+        LogError("FILEIO: [%s] Failed to map file", fileName);
+        return nullptr;
+    }
+    // copy-on-write view, writes never reach the file
+    data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL)
+    {
+        LogError("FILEIO: [%s] Failed to map file", fileName);
+        return nullptr;
+    }
+    *size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        LogError("FILEIO: [%s] Failed to open file", fileName);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        LogError("FILEIO: [%s] Failed to get file size", fileName);
+        return nullptr;
+    }
+    // copy-on-write mapping, writes never reach the file
+    data = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        LogError("FILEIO: [%s] Failed to map file", fileName);
+        return nullptr;
+    }
+    *size = (size_t)st.st_size;
+#endif
+
+    LogInfo("FILEIO: [%s] File mapped successfully (%u bytes)", fileName, (unsigned int)*size);
+    return data;
+}
+
+void Utils::UnmapFile(void *data, size_t size)
+{
+    if (!data)
+        return;
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
 bool Utils::IsFileExtension(const char *fileName, const char *ext)
 {
     bool result = false;
@@ -188,6 +274,14 @@ bool Utils::IsFileExtension(const char *fileName, const char *ext)
     return result;
 }
 
+long Utils::GetFileModTime(const char *fileName)
+{
+    struct stat result;
+    if (stat(fileName, &result) == 0)
+        return (long)result.st_mtime;
+    return 0;
+}
+
 bool Utils::DirectoryExists(const char *dirPath)
 {
     bool result = false;
@@ -546,9 +640,9 @@ void Device::Close()
   
     if (glContext)
     {
-        Driver::Instance().Release();
         Assets::Instance().Release();
         MeshManager::Instance().Release();
+        Driver::Instance().Release();
         SDL_GL_DeleteContext(glContext);
         glContext = nullptr;
     }
@@ -565,6 +659,8 @@ void Device::Close()
 
 void Device::Swap()
 {
+    Assets::Instance().Update();
+    Driver::Instance().EndFrame();
     SDL_GL_SwapWindow(window);
 
     m_current = GetTime();
@@ -669,57 +765,343 @@ void Driver::SetTransform(u8 mode, const Mat4 &m)
     matrix[mode] = m;
 }
 
-void Driver::EnableBlend(bool enable)
+static int bufferTargetIndex(u32 target)
 {
-    if (enable)
+    switch (target)
     {
-        glEnable(GL_BLEND);
+    case GL_ARRAY_BUFFER:
+        return 0;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        return 1;
+    case GL_UNIFORM_BUFFER:
+        return 2;
+    case GL_SHADER_STORAGE_BUFFER:
+        return 3;
+    case GL_DRAW_INDIRECT_BUFFER:
+        return 4;
+    case GL_PIXEL_UNPACK_BUFFER:
+        return 5;
     }
-    else
+    return -1;
+}
+
+bool Driver::setEnabled(u32 &cached, u32 capability, bool enable)
+{
+    if (cached == (u32)enable)
     {
-        glDisable(GL_BLEND);
+        stateElided++;
+        return false;
     }
+    cached = enable;
+    if (enable)
+        glEnable(capability);
+    else
+        glDisable(capability);
+    stateChanges++;
+    return true;
+}
+
+void Driver::EnableBlend(bool enable)
+{
+    setEnabled(state.blend, GL_BLEND, enable);
 }
 
 void Driver::EnableDepthTest(bool enable)
 {
+    setEnabled(state.depthTest, GL_DEPTH_TEST, enable);
+}
+
+void Driver::EnableCullFace(bool enable)
+{
+    setEnabled(state.cullFace, GL_CULL_FACE, enable);
+}
+
+void Driver::EnableColorMask(bool enable)
+{
+    if (state.colorMask == (u32)enable)
+    {
+        stateElided++;
+        return;
+    }
+    state.colorMask = enable;
     if (enable)
     {
-        glEnable(GL_DEPTH_TEST);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     }
     else
     {
-        glDisable(GL_DEPTH_TEST);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
     }
+    stateChanges++;
 }
 
-void Driver::EnableCullFace(bool enable)
+void Driver::EnableDepthWrite(bool enable)
 {
-    if (enable)
+    if (state.depthWrite == (u32)enable)
     {
-        glEnable(GL_CULL_FACE);
+        stateElided++;
+        return;
     }
-    else
+    state.depthWrite = enable;
+    glDepthMask(enable ? GL_TRUE : GL_FALSE);
+    stateChanges++;
+}
+
+void Driver::SetBlend(int src,int dst)
+{
+    if (state.blendSrc == (u32)src && state.blendDst == (u32)dst)
     {
-        glDisable(GL_CULL_FACE);
+        stateElided++;
+        return;
     }
+    state.blendSrc = src;
+    state.blendDst = dst;
+    glBlendFunc(src, dst);
+    stateChanges++;
 }
 
-void Driver::EnableColorMask(bool enable)
+Driver::RenderState Driver::SaveRenderState()
 {
-    if (enable)
+    if (state.blend == STATE_UNKNOWN)
+        state.blend = glIsEnabled(GL_BLEND) ? 1 : 0;
+    if (state.depthTest == STATE_UNKNOWN)
+        state.depthTest = glIsEnabled(GL_DEPTH_TEST) ? 1 : 0;
+    if (state.cullFace == STATE_UNKNOWN)
+        state.cullFace = glIsEnabled(GL_CULL_FACE) ? 1 : 0;
+    if (state.depthWrite == STATE_UNKNOWN)
     {
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        GLboolean mask = GL_TRUE;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &mask);
+        state.depthWrite = mask ? 1 : 0;
     }
-    else
+    if (state.blendSrc == STATE_UNKNOWN || state.blendDst == STATE_UNKNOWN)
     {
-        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        GLint src = GL_ONE;
+        GLint dst = GL_ZERO;
+        glGetIntegerv(GL_BLEND_SRC_RGB, &src);
+        glGetIntegerv(GL_BLEND_DST_RGB, &dst);
+        state.blendSrc = (u32)src;
+        state.blendDst = (u32)dst;
     }
+
+    RenderState saved;
+    saved.blend = state.blend != 0;
+    saved.depthTest = state.depthTest != 0;
+    saved.cullFace = state.cullFace != 0;
+    saved.depthWrite = state.depthWrite != 0;
+    saved.blendSrc = state.blendSrc;
+    saved.blendDst = state.blendDst;
+    return saved;
 }
 
-void Driver::SetBlend(int src,int dst)
+void Driver::RestoreRenderState(const RenderState &saved)
 {
-    glBlendFunc(src, dst);
+    SetBlend((int)saved.blendSrc, (int)saved.blendDst);
+    EnableBlend(saved.blend);
+    EnableDepthTest(saved.depthTest);
+    EnableCullFace(saved.cullFace);
+    EnableDepthWrite(saved.depthWrite);
+}
+
+void Driver::SetCullFace(u32 face)
+{
+    if (state.cullMode == face)
+    {
+        stateElided++;
+        return;
+    }
+    state.cullMode = face;
+    glCullFace(face);
+    stateChanges++;
+}
+
+void Driver::SetFrontFace(u32 face)
+{
+    if (state.frontFace == face)
+    {
+        stateElided++;
+        return;
+    }
+    state.frontFace = face;
+    glFrontFace(face);
+    stateChanges++;
+}
+
+void Driver::SetDepthFunc(u32 func)
+{
+    if (state.depthFunc == func)
+    {
+        stateElided++;
+        return;
+    }
+    state.depthFunc = func;
+    glDepthFunc(func);
+    stateChanges++;
+}
+
+void Driver::UseProgram(u32 program)
+{
+    if (state.program == program)
+    {
+        stateElided++;
+        return;
+    }
+    state.program = program;
+    glUseProgram(program);
+    stateChanges++;
+}
+
+void Driver::BindVertexArray(u32 vao)
+{
+    if (state.vertexArray == vao)
+    {
+        stateElided++;
+        return;
+    }
+    state.vertexArray = vao;
+    // the element buffer binding belongs to the VAO
+    state.buffers[1] = STATE_UNKNOWN;
+    glBindVertexArray(vao);
+    stateChanges++;
+}
+
+void Driver::BindBuffer(u32 target, u32 buffer)
+{
+    const int index = bufferTargetIndex(target);
+    if (index >= 0)
+    {
+        if (state.buffers[index] == buffer)
+        {
+            stateElided++;
+            return;
+        }
+        state.buffers[index] = buffer;
+    }
+    glBindBuffer(target, buffer);
+    stateChanges++;
+}
+
+void Driver::BindBufferBase(u32 target, u32 index, u32 buffer)
+{
+    // indexed binds also set the generic binding of the target
+    const int slot = bufferTargetIndex(target);
+    if (slot >= 0)
+        state.buffers[slot] = buffer;
+    glBindBufferBase(target, index, buffer);
+    stateChanges++;
+}
+
+void Driver::BindBufferRange(u32 target, u32 index, u32 buffer, u32 offset, u32 size)
+{
+    const int slot = bufferTargetIndex(target);
+    if (slot >= 0)
+        state.buffers[slot] = buffer;
+    glBindBufferRange(target, index, buffer, offset, size);
+    stateChanges++;
+}
+
+void Driver::BindTexture(u32 unit, u32 texture, u32 target)
+{
+    if (unit >= (u32)MAX_TEXTURE_UNITS)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        state.activeTexture = unit;
+        stateChanges += 2;
+        return;
+    }
+    if (state.textures[unit] == texture && state.textureTargets[unit] == target)
+    {
+        stateElided++;
+        return;
+    }
+    if (state.activeTexture != unit)
+    {
+        state.activeTexture = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        stateChanges++;
+    }
+    state.textures[unit] = texture;
+    state.textureTargets[unit] = target;
+    glBindTexture(target, texture);
+    stateChanges++;
+}
+
+void Driver::SelectTexture(u32 texture, u32 target)
+{
+    if (state.activeTexture != 0)
+    {
+        state.activeTexture = 0;
+        glActiveTexture(GL_TEXTURE0);
+        stateChanges++;
+    }
+    BindTexture(0, texture, target);
+}
+
+void Driver::ResetState()
+{
+    state.program = STATE_UNKNOWN;
+    state.vertexArray = STATE_UNKNOWN;
+    for (int i = 0; i < BUFFER_TARGETS; ++i)
+        state.buffers[i] = STATE_UNKNOWN;
+    state.activeTexture = STATE_UNKNOWN;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+    {
+        state.textures[i] = STATE_UNKNOWN;
+        state.textureTargets[i] = STATE_UNKNOWN;
+    }
+    state.blend = STATE_UNKNOWN;
+    state.depthTest = STATE_UNKNOWN;
+    state.cullFace = STATE_UNKNOWN;
+    state.depthWrite = STATE_UNKNOWN;
+    state.colorMask = STATE_UNKNOWN;
+    state.blendSrc = STATE_UNKNOWN;
+    state.blendDst = STATE_UNKNOWN;
+    state.cullMode = STATE_UNKNOWN;
+    state.frontFace = STATE_UNKNOWN;
+    state.depthFunc = STATE_UNKNOWN;
+    state.viewport[0] = state.viewport[1] = state.viewport[2] = state.viewport[3] = -1;
+}
+
+void Driver::DeleteProgram(u32 program)
+{
+    if (program == 0)
+        return;
+    if (state.program == program)
+        state.program = STATE_UNKNOWN;
+    glDeleteProgram(program);
+}
+
+void Driver::DeleteVertexArray(u32 vao)
+{
+    if (vao == 0)
+        return;
+    if (state.vertexArray == vao)
+    {
+        state.vertexArray = STATE_UNKNOWN;
+        state.buffers[1] = STATE_UNKNOWN;
+    }
+    glDeleteVertexArrays(1, &vao);
+}
+
+void Driver::DeleteBuffer(u32 buffer)
+{
+    if (buffer == 0)
+        return;
+    for (int i = 0; i < BUFFER_TARGETS; ++i)
+        if (state.buffers[i] == buffer)
+            state.buffers[i] = STATE_UNKNOWN;
+    glDeleteBuffers(1, &buffer);
+}
+
+void Driver::DeleteTexture(u32 texture)
+{
+    if (texture == 0)
+        return;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+        if (state.textures[i] == texture)
+            state.textures[i] = STATE_UNKNOWN;
+    glDeleteTextures(1, &texture);
 }
 
 void Driver::Init()
@@ -732,17 +1114,32 @@ void Driver::Init()
     triangles = 0;
     width = 0;
     height = 0;
+    drawCalls = 0;
+    stateChanges = 0;
+    stateElided = 0;
+    ResetState();
     screenQuad.Init();
+
+    frameConstants.view = Mat4::Identity();
+    frameConstants.projection = Mat4::Identity();
+    frameConstants.viewProjection = Mat4::Identity();
+    frameConstants.cameraPosition = Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    frameConstants.viewport = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    if (frameBlock.Create(sizeof(FrameConstants), &frameConstants))
+        frameBlock.Bind(FRAME_BLOCK_BINDING);
+    objectRing.Init(OBJECT_RING_SIZE);
 }
 
 void Driver::Release()
 {
+    screenQuad.Release();
+    frameBlock.Release();
+    objectRing.Release();
     if (instance != nullptr)
     {
         delete instance;
         instance = nullptr;
     }
-    screenQuad.Release();
 }
 
 void Driver::SetBlendMode(u8 mode)
@@ -770,7 +1167,15 @@ void Driver::SetBlendMode(u8 mode)
 
 void Driver::SetViewport(float x, float y, float width, float height)
 {
-    glViewport(x, y, width, height);
+    const int viewport[4] = {(int)x, (int)y, (int)width, (int)height};
+    if (memcmp(viewport, state.viewport, sizeof(viewport)) == 0)
+    {
+        stateElided++;
+        return;
+    }
+    memcpy(state.viewport, viewport, sizeof(viewport));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    stateChanges++;
 }
 
 void Driver::SetClearColor(float r, float g, float b)
@@ -790,9 +1195,37 @@ void Driver::UpdateFrustum()
     vertices = 0;
     triangles = 0;
     drawCalls = 0;
+    stateChanges = 0;
+    stateElided = 0;
     cameraPosition = matrix[0].getPosition();
     cameraRotation = matrix[0].getRotationInDegrees();
 
+    // one upload for every shader that reads the FrameData block
+    frameConstants.view = matrix[0];
+    frameConstants.projection = matrix[1];
+    frameConstants.viewProjection = viewProjection;
+    Vec3 eye = matrix[0].inverse().getPosition();
+    frameConstants.cameraPosition = Vec4(eye.x, eye.y, eye.z, 1.0f);
+    frameConstants.viewport = Vec4((float)width, (float)height, width > 0 ? 1.0f / width : 0.0f, height > 0 ? 1.0f / height : 0.0f);
+    frameBlock.Update(&frameConstants, sizeof(FrameConstants));
+}
+
+bool Driver::SetObjectConstants(const Mat4 &model, const Vec4 &color)
+{
+    ObjectConstants constants;
+    constants.model = model;
+    constants.color = color;
+    return objectRing.Push(OBJECT_BLOCK_BINDING, &constants, sizeof(ObjectConstants));
+}
+
+bool Driver::SetObjectConstants(const ObjectConstants &constants)
+{
+    return objectRing.Push(OBJECT_BLOCK_BINDING, &constants, sizeof(ObjectConstants));
+}
+
+void Driver::EndFrame()
+{
+    objectRing.NextFrame();
 }
 
 bool Driver::IsInFrustum(const Vec3 &point)
@@ -810,6 +1243,16 @@ bool Driver::IsInFrustum(const BoundingBox &box)
     return  frustum.intersectsBox(box);
 }
 
+u32 Driver::CullBoxes(const BoxList &boxes, u32 *visible, u8 *planeCache)
+{
+    return frustum.cullBoxes(boxes, visible, planeCache);
+}
+
+u32 Driver::CullTree(const SpatialTree &tree, std::vector<void*> &visible)
+{
+    return tree.QueryFrustum(frustum, visible);
+}
+
 static int calculatePrimitiveCount(int mode, int count)
 {
     if (mode == GL_TRIANGLES)
@@ -838,12 +1281,176 @@ void Driver::DrawElements(int mode, int indexCount, int indexType, const void *i
     drawCalls++;
 }
 
+void Driver::DrawArraysInstanced(int mode, int first, int vertexCount, int instanceCount)
+{
+    if (instanceCount <= 0)
+        return;
+    vertices += vertexCount * instanceCount;
+    triangles += calculatePrimitiveCount(mode, vertexCount) * instanceCount;
+    glDrawArraysInstanced(mode, first, vertexCount, instanceCount);
+    drawCalls++;
+}
+
+void Driver::DrawElementsInstanced(int mode, int indexCount, int indexType, const void *indices, int instanceCount, int baseInstance)
+{
+    if (instanceCount <= 0)
+        return;
+    vertices += indexCount * instanceCount;
+    triangles += calculatePrimitiveCount(mode, indexCount) * instanceCount;
+    if (baseInstance == 0)
+        glDrawElementsInstanced(mode, indexCount, indexType, indices, instanceCount);
+    else
+        glDrawElementsInstancedBaseInstance(mode, indexCount, indexType, indices, instanceCount, baseInstance);
+    drawCalls++;
+}
+
+void Driver::MultiDrawElementsIndirect(int mode, int indexType, const void *indirect, const DrawElementsIndirectCommand *commands, int drawCount)
+{
+    if (drawCount <= 0)
+        return;
+    for (int i = 0; i < drawCount; ++i)
+    {
+        vertices += commands[i].count * commands[i].instanceCount;
+        triangles += calculatePrimitiveCount(mode, commands[i].count) * commands[i].instanceCount;
+    }
+    glMultiDrawElementsIndirect(mode, indexType, indirect, drawCount, 0);
+    drawCalls += drawCount;
+}
+
 void Driver::Resize(u32 w, u32 h)
 {
     width = w;
     height = h;
 }
 
+UniformBuffer::UniformBuffer() : id(0), size(0)
+{
+}
+
+bool UniformBuffer::Create(u32 bytes, const void *data)
+{
+    Release();
+    glGenBuffers(1, &id);
+    if (id == 0)
+    {
+        Utils::LogError("UBO: Failed to create uniform buffer");
+        return false;
+    }
+    size = bytes;
+    Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferData(GL_UNIFORM_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+    Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, 0);
+    return true;
+}
+
+void UniformBuffer::Update(const void *data, u32 bytes, u32 offset)
+{
+    if (id == 0 || offset + bytes > size)
+        return;
+    Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, bytes, data);
+    Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::Bind(u32 binding) const
+{
+    Driver::Instance().BindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+}
+
+void UniformBuffer::Release()
+{
+    if (id != 0)
+        Driver::Instance().DeleteBuffer(id);
+    id = 0;
+    size = 0;
+}
+
+UniformRing::UniformRing() : id(0), mapped(nullptr), frameSize(0), frameCount(0), alignment(256), frame(0), head(0)
+{
+    for (u32 i = 0; i < MAX_FRAMES; ++i)
+        fences[i] = 0;
+}
+
+bool UniformRing::Init(u32 bytesPerFrame, u32 frames)
+{
+    Release();
+
+    GLint offsetAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    alignment = (u32)Max(offsetAlignment, 16);
+    frameCount = frames < 1 ? 1 : (frames > MAX_FRAMES ? MAX_FRAMES : frames);
+    frameSize = (bytesPerFrame + alignment - 1) / alignment * alignment;
+    frame = 0;
+    head = 0;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &id);
+    Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)frameSize * frameCount, nullptr, flags);
+    mapped = (u8 *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)frameSize * frameCount, flags);
+    Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, 0);
+    if (!mapped)
+    {
+        Utils::LogError("UBO: Failed to map uniform ring (%u bytes)", frameSize * frameCount);
+        Release();
+        return false;
+    }
+    return true;
+}
+
+void UniformRing::Release()
+{
+    for (u32 i = 0; i < MAX_FRAMES; ++i)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+        fences[i] = 0;
+    }
+    if (id != 0)
+    {
+        if (mapped)
+        {
+            Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, id);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            Driver::Instance().BindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        Driver::Instance().DeleteBuffer(id);
+    }
+    id = 0;
+    mapped = nullptr;
+    head = 0;
+}
+
+void UniformRing::NextFrame()
+{
+    if (!mapped)
+        return;
+    if (head > 0)
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % frameCount;
+    head = 0;
+
+    if (fences[frame])
+    {
+        GLbitfield waitFlags = 0;
+        while (glClientWaitSync(fences[frame], waitFlags, 1000000) == GL_TIMEOUT_EXPIRED)
+            waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        glDeleteSync(fences[frame]);
+        fences[frame] = 0;
+    }
+}
+
+bool UniformRing::Push(u32 binding, const void *data, u32 bytes)
+{
+    if (!mapped || head + bytes > frameSize)
+        return false;
+    const u32 offset = frame * frameSize + head;
+    memcpy(mapped + offset, data, bytes);
+    Driver::Instance().BindBufferRange(GL_UNIFORM_BUFFER, binding, id, offset, bytes);
+    head += (bytes + alignment - 1) / alignment * alignment;
+    return true;
+}
+
 std::unordered_map<SDL_Keycode, bool> Input::currentKeys;
 std::unordered_map<SDL_Keycode, bool> Input::previousKeys;
 std::unordered_map<uint8_t, bool> Input::currentMouseButtons;
@@ -1301,6 +1908,8 @@ Shader::Shader()
     m_program = 0;
     m_numAttributes = 0;
     m_numUniforms = 0;
+    m_uniformUploads = 0;
+    m_uniformSkips = 0;
 }
 
 Shader::~Shader()
@@ -1310,7 +1919,7 @@ Shader::~Shader()
 
 void Shader::Bind() const
 {
-    glUseProgram(m_program);
+    Driver::Instance().UseProgram(m_program);
 }
 
 void Shader::Release()
@@ -1318,9 +1927,12 @@ void Shader::Release()
     if (m_program > 0)
     {
         Utils::LogInfo("SHADER: [ID %i] Release shader program.", m_program);
-        glDeleteProgram(m_program);
+        Driver::Instance().DeleteProgram(m_program);
     }
     m_program = 0;
+    m_uniforms.clear();
+    m_uniformLookup.clear();
+    m_uniformValues.clear();
 }
 
 bool Shader::Create(const char *vShaderCode, const char *fShaderCode, const char *gShaderCode)
@@ -1353,6 +1965,8 @@ bool Shader::Create(const char *vShaderCode, const char *fShaderCode, const char
     glAttachShader(m_program, geometry);
     glLinkProgram(m_program);
     checkCompileErrors(m_program, "PROGRAM");
+    if (success)
+        cacheUniforms();
 
     if (m_program > 0)
         Utils::LogInfo("SHADER: [ID %i] Create shader program.", m_program);
@@ -1360,7 +1974,7 @@ bool Shader::Create(const char *vShaderCode, const char *fShaderCode, const char
     glDeleteShader(vertex);
     glDeleteShader(fragment);
     glDeleteShader(geometry);
-    glUseProgram(m_program);
+    Driver::Instance().UseProgram(m_program);
 
     return true;
 }
@@ -1388,6 +2002,8 @@ bool Shader::Create(const char *vShaderCode, const char *fShaderCode)
     glAttachShader(m_program, fragment);
     glLinkProgram(m_program);
     checkCompileErrors(m_program, "PROGRAM");
+    if (success)
+        cacheUniforms();
 
     if (m_program > 0)
     {
@@ -1396,7 +2012,7 @@ bool Shader::Create(const char *vShaderCode, const char *fShaderCode)
     }
     glDeleteShader(vertex);
     glDeleteShader(fragment);
-    glUseProgram(m_program);
+    Driver::Instance().UseProgram(m_program);
 
     return success;
 }
@@ -1467,6 +2083,9 @@ int Shader::getAttribute(const std::string &name)
 }
 int Shader::getUniformLocation(const std::string &uniformName) const
 {
+    int slot = findUniformSlot(HashUniformName(uniformName.c_str()), uniformName.c_str());
+    if (slot != -1 && m_uniforms[slot].location != -1)
+        return m_uniforms[slot].location;
     int location = glGetUniformLocation(m_program, uniformName.c_str());
     if (location == -1)
         Utils::LogError("SHADER: [ID %i] Failed to find shader uniform: %s", m_program, uniformName.c_str());
@@ -1505,50 +2124,228 @@ bool Shader::addAttribute(const std::string &name)
     return true;
 }
 
+bool Shader::findUniform(const std::string &name) const
+{
+    return ContainsUniform(name);
+}
+
+bool Shader::ContainsUniform(const std::string &name) const
+{
+    int slot = findUniformSlot(HashUniformName(name.c_str()), name.c_str());
+    if (slot != -1)
+        return m_uniforms[slot].location != -1;
+    return glGetUniformLocation(m_program, name.c_str()) != -1;
+}
+
+void Shader::cacheUniforms()
+{
+    m_uniforms.clear();
+    m_uniformLookup.clear();
+    m_uniformValues.clear();
+
+    int uniformCount = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    for (int i = 0; i < uniformCount; i++)
+    {
+        int namelen = 0;
+        int num = 0;
+        char name[256];
+        GLenum type = GL_ZERO;
+        glGetActiveUniform(m_program, i, sizeof(name) - 1, &namelen, &num, &type, name);
+        name[namelen] = 0;
+
+        // members of uniform blocks have no location
+        int location = glGetUniformLocation(m_program, name);
+        if (location == -1)
+            continue;
+        int slot = addUniformSlot(name, location);
+
+        // arrays are reported as "name[0]", the plain name is the same uniform
+        if (namelen > 3 && strcmp(name + namelen - 3, "[0]") == 0)
+        {
+            name[namelen - 3] = 0;
+            addUniformLookup(name, slot);
+        }
+    }
+}
+
+int Shader::addUniformSlot(const char *name, int location)
+{
+    UniformSlot slot;
+    slot.location = location;
+    slot.offset = 0;
+    slot.words = 0;
+    slot.cached = false;
+    m_uniforms.push_back(slot);
+    addUniformLookup(name, (int)m_uniforms.size() - 1);
+    return (int)m_uniforms.size() - 1;
+}
+
+void Shader::addUniformLookup(const char *name, int slot)
+{
+    UniformName entry;
+    entry.hash = HashUniformName(name);
+    entry.slot = slot;
+    entry.name = name;
+    std::vector<UniformName>::iterator it = std::lower_bound(m_uniformLookup.begin(), m_uniformLookup.end(), entry.hash,
+                                                             [](const UniformName &a, u32 hash) { return a.hash < hash; });
+    m_uniformLookup.insert(it, entry);
+}
+
+int Shader::findUniformSlot(u32 hash, const char *name) const
+{
+    std::vector<UniformName>::const_iterator it = std::lower_bound(m_uniformLookup.begin(), m_uniformLookup.end(), hash,
+                                                                   [](const UniformName &a, u32 key) { return a.hash < key; });
+    if (!name)
+    {
+        if (it == m_uniformLookup.end() || it->hash != hash)
+            return -1;
+        const bool shared = it + 1 != m_uniformLookup.end() && (it + 1)->hash == hash;
+        return shared ? -1 : it->slot;
+    }
+    for (; it != m_uniformLookup.end() && it->hash == hash; ++it)
+        if (it->name == name)
+            return it->slot;
+    return -1;
+}
+
+UniformHandle Shader::GetUniformHandle(u32 nameHash) const
+{
+    int slot = findUniformSlot(nameHash, nullptr);
+    if (slot == -1 || m_uniforms[slot].location == -1)
+        return UniformHandle();
+    return UniformHandle(slot);
+}
+
+UniformHandle Shader::GetUniformHandle(const std::string &name)
+{
+    int slot = findUniformSlot(HashUniformName(name.c_str()), name.c_str());
+    if (slot == -1)
+    {
+        // names the link time table does not list, like "lights[2]"; misses
+        // are kept too, so a missing uniform is reported once
+        int location = glGetUniformLocation(m_program, name.c_str());
+        if (location == -1)
+            Utils::LogError("SHADER: [ID %i] Failed to find shader uniform: %s", m_program, name.c_str());
+        slot = addUniformSlot(name.c_str(), location);
+    }
+    if (m_uniforms[slot].location == -1)
+        return UniformHandle();
+    return UniformHandle(slot);
+}
+
+void Shader::InvalidateUniformCache()
+{
+    for (size_t i = 0; i < m_uniforms.size(); ++i)
+        m_uniforms[i].cached = false;
+}
+
+bool Shader::uniformChanged(UniformHandle uniform, const void *value, u32 words)
+{
+    if ((u32)uniform.index >= m_uniforms.size())
+        return false;
+
+    // the cache is sized by the first write
+    UniformSlot &slot = m_uniforms[uniform.index];
+    if (slot.words == 0)
+    {
+        slot.offset = (u32)m_uniformValues.size();
+        slot.words = words;
+        m_uniformValues.resize(slot.offset + words);
+    }
+    else if (slot.words != words)
+    {
+        m_uniformUploads++;
+        return true;
+    }
+
+    u32 *cache = &m_uniformValues[slot.offset];
+    if (slot.cached && memcmp(cache, value, words * sizeof(u32)) == 0)
+    {
+        m_uniformSkips++;
+        return false;
+    }
+    memcpy(cache, value, words * sizeof(u32));
+    slot.cached = true;
+    m_uniformUploads++;
+    return true;
+}
+
+void Shader::SetInt(UniformHandle uniform, int value)
+{
+    if (uniformChanged(uniform, &value, 1))
+        glProgramUniform1i(m_program, m_uniforms[uniform.index].location, value);
+}
+
+void Shader::SetMatrix4(UniformHandle uniform, const float *value)
+{
+    if (uniformChanged(uniform, value, 16))
+        glProgramUniformMatrix4fv(m_program, m_uniforms[uniform.index].location, 1, GL_FALSE, value);
+}
+
+void Shader::SetMatrix3(UniformHandle uniform, const float *value)
+{
+    if (uniformChanged(uniform, value, 9))
+        glProgramUniformMatrix3fv(m_program, m_uniforms[uniform.index].location, 1, GL_FALSE, value);
+}
+
+void Shader::SetFloat(UniformHandle uniform, float v)
+{
+    if (uniformChanged(uniform, &v, 1))
+        glProgramUniform1f(m_program, m_uniforms[uniform.index].location, v);
+}
+
+void Shader::SetFloat(UniformHandle uniform, float x, float y)
+{
+    const float v[2] = {x, y};
+    if (uniformChanged(uniform, v, 2))
+        glProgramUniform2fv(m_program, m_uniforms[uniform.index].location, 1, v);
+}
+
+void Shader::SetFloat(UniformHandle uniform, float x, float y, float z)
+{
+    const float v[3] = {x, y, z};
+    if (uniformChanged(uniform, v, 3))
+        glProgramUniform3fv(m_program, m_uniforms[uniform.index].location, 1, v);
+}
+
+void Shader::SetFloat(UniformHandle uniform, float x, float y, float z, float w)
+{
+    const float v[4] = {x, y, z, w};
+    if (uniformChanged(uniform, v, 4))
+        glProgramUniform4fv(m_program, m_uniforms[uniform.index].location, 1, v);
+}
+
 void Shader::SetInt(const std::string &name, int value)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniform1i(id, value);
+    SetInt(GetUniformHandle(name), value);
 }
 
 void Shader::SetMatrix4(const std::string &name, const float *value)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniformMatrix4fv(id, 1, GL_FALSE, value);
+    SetMatrix4(GetUniformHandle(name), value);
 }
 
 void Shader::SetMatrix3(const std::string &name, const float *value)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniformMatrix3fv(id, 1, GL_FALSE, value);
+    SetMatrix3(GetUniformHandle(name), value);
 }
 
 void Shader::SetFloat(const std::string &name, float v)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniform1f(id, v);
+    SetFloat(GetUniformHandle(name), v);
 }
 void Shader::SetFloat(const std::string &name, float x, float y)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniform2f(id, x, y);
+    SetFloat(GetUniformHandle(name), x, y);
 }
 void Shader::SetFloat(const std::string &name, float x, float y, float z)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniform3f(id, x, y, z);
+    SetFloat(GetUniformHandle(name), x, y, z);
 }
 void Shader::SetFloat(const std::string &name, float x, float y, float z, float w)
 {
-    int id = getUniform(name);
-    if (id != -1)
-        glUniform4f(id, x, y, z, w);
+    SetFloat(GetUniformHandle(name), x, y, z, w);
 }
 
 void Shader::print()
@@ -1602,6 +2399,7 @@ Texture::Texture() : HorizontalWrap(WrapMode::Repeat),
     id = 0;
     width = 0;
     height = 0;
+    loadState = TEXTURE_LOAD_NONE;
 }
 
 Texture::~Texture()
@@ -1615,9 +2413,9 @@ void Texture::SetMinFilter(FilterMode filter)
     this->MinificationFilter = filter;
     if (id != 0)
     {
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, MinificationFilter);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 
@@ -1626,9 +2424,9 @@ void Texture::SetMagFilter(FilterMode filter)
     this->MagnificationFilter = filter;
     if (id != 0)
     {
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, MagnificationFilter);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 
@@ -1637,9 +2435,9 @@ void Texture::SetWrapS(WrapMode mode)
     this->HorizontalWrap = mode;
     if (id != 0)
     {
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, HorizontalWrap);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 
@@ -1648,9 +2446,9 @@ void Texture::SetWrapT(WrapMode mode)
     this->VerticalWrap = mode;
     if (id != 0)
     {
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, VerticalWrap);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 
@@ -1659,9 +2457,9 @@ void Texture::SetAnisotropicFiltering(float level)
     this->MaxAnisotropic = level;
     if (id != 0)
     {
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, MaxAnisotropic);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 
@@ -1669,7 +2467,7 @@ void Texture::Release()
 {
     if (id != 0)
     {
-        glDeleteTextures(1, &id);
+        Driver::Instance().DeleteTexture(id);
         Utils::LogInfo("Texture: [ID %i] Release", id);
         id = 0;
     }
@@ -1679,10 +2477,10 @@ void Texture::createTexture()
 {
     if (id != 0)
     {
-        glDeleteTextures(1, &id);
+        Driver::Instance().DeleteTexture(id);
     }
     glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
+    Driver::Instance().SelectTexture(id);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, HorizontalWrap);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, VerticalWrap);
@@ -1696,8 +2494,12 @@ void Texture::createTexture()
 
 void Texture::Bind(u32 unit)
 {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, id);
+    if (loadState != TEXTURE_LOAD_NONE && loadState != TEXTURE_LOAD_READY)
+    {
+        Driver::Instance().BindTexture(unit, Assets::Instance().GetDefaultTexture()->GetID());
+        return;
+    }
+    Driver::Instance().BindTexture(unit, id);
 }
 void Texture::Update(const Pixmap &pixmap)
 {
@@ -1739,10 +2541,10 @@ void Texture::Update(const Pixmap &pixmap)
         }
         }
 
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, glFormat, GL_UNSIGNED_BYTE, pixmap.pixels);
         glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 void Texture::Update(const unsigned char *buffer, u16 components, int width, int height)
@@ -1779,10 +2581,10 @@ void Texture::Update(const unsigned char *buffer, u16 components, int width, int
             break;
         }
         }
-        glBindTexture(GL_TEXTURE_2D, id);
+        Driver::Instance().SelectTexture(id);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, glFormat, GL_UNSIGNED_BYTE, buffer);
         glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().SelectTexture(0);
     }
 }
 
@@ -1906,13 +2708,15 @@ bool Texture2D::Load(const Pixmap &pixmap)
         }
     }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    Driver::Instance().SelectTexture(0);
     Utils::LogInfo("TEXTURE2D: [ID %i] Create Opengl Texture2D (%d,%d) bpp:%d", id, width, height, components);
     return true;
 }
 
 bool Texture2D::Load(const char *file_name)
 {
+    if (Utils::IsFileExtension(file_name, ".btex"))
+        return LoadTextureFile(file_name);
 
     unsigned int bytesRead;
     unsigned char *fileData = Utils::LoadDataFile(file_name, &bytesRead);
@@ -2032,6 +2836,272 @@ bool Texture2D::LoadFromMemory(const unsigned char *buffer, u16 components, int
 }
 
 
+TextureLoader::TextureLoader() : busy(0), stopping(false), uploadBudget(8 * 1024 * 1024), pixelBuffer(0)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+    Release();
+}
+
+bool TextureLoader::Init(u32 workerCount, u32 bytesPerFrame, bool usePixelBuffer)
+{
+    if (IsRunning())
+        return true;
+
+    if (workerCount == 0)
+    {
+        const u32 hardware = std::thread::hardware_concurrency();
+        workerCount = hardware > 1 ? hardware - 1 : 1;
+    }
+    uploadBudget = bytesPerFrame;
+    stopping = false;
+
+    if (usePixelBuffer)
+        glGenBuffers(1, &pixelBuffer);
+
+    for (u32 i = 0; i < workerCount; ++i)
+        workers.emplace_back(&TextureLoader::workerLoop, this);
+
+    Utils::LogInfo("TextureLoader: %u workers, %u bytes per frame%s", workerCount, uploadBudget, pixelBuffer ? ", pixel buffer" : "");
+    return true;
+}
+
+void TextureLoader::Release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+
+    // nothing else touches the queues now
+    for (size_t i = 0; i < pending.size(); ++i)
+        finish(pending[i], TEXTURE_LOAD_FAILED);
+    for (size_t i = 0; i < decoded.size(); ++i)
+        finish(decoded[i], TEXTURE_LOAD_FAILED);
+    for (size_t i = 0; i < uploads.size(); ++i)
+        finish(uploads[i], TEXTURE_LOAD_FAILED);
+    pending.clear();
+    decoded.clear();
+    uploads.clear();
+    busy = 0;
+
+    if (pixelBuffer != 0)
+    {
+        Driver::Instance().DeleteBuffer(pixelBuffer);
+        pixelBuffer = 0;
+    }
+}
+
+void TextureLoader::Load(Texture2D *texture, const std::string &fileName, bool flip)
+{
+    Request *request = new Request();
+    request->texture = texture;
+    request->fileName = fileName;
+    request->flip = flip;
+    request->pixels = nullptr;
+    request->width = 0;
+    request->height = 0;
+    request->components = 0;
+    request->rowsUploaded = 0;
+    texture->loadState = TEXTURE_LOAD_PENDING;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(request);
+    }
+    wake.notify_one();
+}
+
+u32 TextureLoader::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (u32)(pending.size() + decoded.size() + uploads.size()) + busy;
+}
+
+void TextureLoader::workerLoop()
+{
+    for (;;)
+    {
+        Request *request = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping)
+                return;
+            request = pending.front();
+            pending.pop_front();
+            busy++;
+        }
+
+        // file read and decode, no GL here
+        unsigned int bytesRead = 0;
+        unsigned char *fileData = Utils::LoadDataFile(request->fileName.c_str(), &bytesRead);
+        if (fileData)
+        {
+            stbi_set_flip_vertically_on_load_thread(request->flip);
+            request->pixels = stbi_load_from_memory(fileData, bytesRead, &request->width, &request->height, &request->components, 0);
+            free(fileData);
+            if (!request->pixels)
+                Utils::LogError("TextureLoader: Failed to decode image: %s", request->fileName.c_str());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(request);
+            busy--;
+        }
+    }
+}
+
+void TextureLoader::finish(Request *request, TextureLoadState state)
+{
+    request->texture->loadState = state;
+    if (request->pixels)
+        stbi_image_free(request->pixels);
+    delete request;
+}
+
+bool TextureLoader::beginUpload(Request *request)
+{
+    Texture2D *texture = request->texture;
+    GLenum format = GL_RGBA8;
+    switch (request->components)
+    {
+    case 1:
+        format = GL_R8;
+        break;
+    case 2:
+        format = GL_RG8;
+        break;
+    case 3:
+        format = GL_RGB8;
+        break;
+    case 4:
+        format = GL_RGBA8;
+        break;
+    default:
+        Utils::LogError("TextureLoader: %s has %d components", request->fileName.c_str(), request->components);
+        return false;
+    }
+
+    texture->width = request->width;
+    texture->height = request->height;
+    texture->components = request->components;
+
+    // immutable storage for the whole chain, rows are filled in later frames
+    int levels = 1;
+    for (int size = Max(request->width, request->height); size > 1; size >>= 1)
+        levels++;
+
+    texture->createTexture();
+    glTexStorage2D(GL_TEXTURE_2D, levels, format, request->width, request->height);
+    if (request->components == 1)
+    {
+        GLint swizzleMask[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
+    }
+    else if (request->components == 2)
+    {
+        GLint swizzleMask[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
+    }
+    texture->loadState = TEXTURE_LOAD_UPLOADING;
+    return true;
+}
+
+u32 TextureLoader::uploadRows(Request *request, u32 budget)
+{
+    static const GLenum formats[5] = {GL_RGBA, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    const u32 rowBytes = (u32)(request->width * request->components);
+    const u32 rowsLeft = (u32)(request->height - request->rowsUploaded);
+
+    // at least one row, so a texture wider than the budget still moves
+    u32 rows = Max(budget / rowBytes, 1u);
+    if (rows > rowsLeft)
+        rows = rowsLeft;
+    const u32 bytes = rows * rowBytes;
+    const unsigned char *source = request->pixels + (size_t)request->rowsUploaded * rowBytes;
+
+    Driver &driver = Driver::Instance();
+    driver.SelectTexture(request->texture->id);
+    const void *pixels = source;
+    if (pixelBuffer != 0)
+    {
+        // orphan, so the copy never waits on last frame's transfer
+        driver.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        void *target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (target)
+        {
+            memcpy(target, source, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            pixels = nullptr;
+        }
+        else
+        {
+            driver.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, request->rowsUploaded, request->width, rows, formats[request->components], GL_UNSIGNED_BYTE, pixels);
+
+    // other uploads (Texture2D::Update, fonts) expect client memory
+    if (pixelBuffer != 0)
+        driver.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    request->rowsUploaded += rows;
+    return bytes;
+}
+
+u32 TextureLoader::Update()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!decoded.empty())
+        {
+            uploads.push_back(decoded.front());
+            decoded.pop_front();
+        }
+    }
+    if (uploads.empty())
+        return 0;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // oldest first, a texture finishes before the next one starts
+    u32 uploaded = 0;
+    size_t done = 0;
+    for (; done < uploads.size() && uploaded < uploadBudget; ++done)
+    {
+        Request *request = uploads[done];
+        if (!request->pixels || (request->texture->loadState == TEXTURE_LOAD_PENDING && !beginUpload(request)))
+        {
+            finish(request, TEXTURE_LOAD_FAILED);
+            continue;
+        }
+
+        while (request->rowsUploaded < request->height && uploaded < uploadBudget)
+            uploaded += uploadRows(request, uploadBudget - uploaded);
+        if (request->rowsUploaded < request->height)
+            break;
+
+        glGenerateMipmap(GL_TEXTURE_2D);
+        Utils::LogInfo("TEXTURE2D: [ID %i] Async load %s (%d,%d) bpp:%d", request->texture->id, request->fileName.c_str(), request->width, request->height, request->components);
+        finish(request, TEXTURE_LOAD_READY);
+    }
+    uploads.erase(uploads.begin(), uploads.begin() + done);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    Driver::Instance().SelectTexture(0);
+    return uploaded;
+}
+
 Assets *Assets::instance = nullptr;
 
 Assets *Assets::InstancePtr()
@@ -2061,6 +3131,7 @@ Texture2D *Assets::GetDefaultTexture()
 
 void Assets::SetFlipTexture(bool flip)
 {
+    flipTexture = flip;
     stbi_set_flip_vertically_on_load(flip);
 }
 
@@ -2123,6 +3194,28 @@ Texture2D *Assets::LoadTexture( const std::string &file_name)
     return defaultTexture;
 }
 
+Texture2D *Assets::LoadTextureAsync(const std::string &file_name)
+{
+    const char* name = Utils::GetFileNameWithoutExt(file_name.c_str());
+    if (textures.find(name) != textures.end())
+        return textures[name];
+    // cooked files have nothing to decode, map and upload them now
+    if (Utils::IsFileExtension(file_name.c_str(), ".btex"))
+        return LoadTexture(file_name);
+    if (!loader.IsRunning())
+        loader.Init();
+    Texture2D *texture = new Texture2D();
+    textures[name] = texture;
+    loader.Load(texture, file_name, flipTexture);
+    return texture;
+}
+
+void Assets::Update()
+{
+    if (loader.IsRunning())
+        loader.Update();
+}
+
 Texture2D *Assets::GetTexture(const std::string &name)
 {
     if (textures.find(name) == textures.end())
@@ -2224,6 +3317,7 @@ void Assets::Init()
 
 void Assets::Release()
 {
+    loader.Release();
 
     for (auto texture : textures)
     {
@@ -2274,7 +3368,7 @@ void RenderTexture::addColorBuffer()
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     GLuint colorBuffer;
     glGenTextures(1, &colorBuffer);
-    glBindTexture(GL_TEXTURE_2D, colorBuffer);
+    Driver::Instance().SelectTexture(colorBuffer);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0,  GL_RGB, GL_UNSIGNED_BYTE, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -2305,7 +3399,7 @@ void RenderTexture::addDepthTexture()
         DEBUG_BREAK_IF(framebuffer == 0);
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
         glGenTextures(1, &depthTexture);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        Driver::Instance().SelectTexture(depthTexture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -2332,14 +3426,14 @@ bool RenderTexture::Process()
 void RenderTexture::Begin()
 {
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        glViewport(0, 0, width, height);
+        Driver::Instance().SetViewport(0, 0, width, height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void RenderTexture::End()
 {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, Driver::Instance().GetWidth(), Driver::Instance().GetHeight());
+        Driver::Instance().SetViewport(0, 0, Driver::Instance().GetWidth(), Driver::Instance().GetHeight());
 }
 
 
@@ -2347,7 +3441,7 @@ void RenderTexture::Release()
 {
         for (GLuint colorBuffer : colorBuffers) 
         {
-            glDeleteTextures(1, &colorBuffer);
+            Driver::Instance().DeleteTexture(colorBuffer);
         }
         colorBuffers.clear();
         if (depthBuffer) 
@@ -2356,7 +3450,7 @@ void RenderTexture::Release()
         }
         if (depthTexture) 
         {
-            glDeleteTextures(1, &depthTexture);
+            Driver::Instance().DeleteTexture(depthTexture);
         }
         if (framebuffer)
         {
@@ -2395,9 +3489,9 @@ void ScreenQuad::Init()
         glGenVertexArrays(1, &vao);
         glGenBuffers(1, &vbo);
 
-        glBindVertexArray(vao);
+        Driver::Instance().BindVertexArray(vao);
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
 
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
@@ -2406,8 +3500,8 @@ void ScreenQuad::Init()
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
         glEnableVertexAttribArray(1);
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+        Driver::Instance().BindVertexArray(0);
     
 
 }
@@ -2416,12 +3510,12 @@ void ScreenQuad::Release()
 {
     if (vao != 0)
     {
-        glDeleteVertexArrays(1, &vao);
+        Driver::Instance().DeleteVertexArray(vao);
         vao = 0;
     }
     if (vbo != 0)
     {
-        glDeleteBuffers(1, &vbo);
+        Driver::Instance().DeleteBuffer(vbo);
         vbo = 0;
     }
 }
@@ -2442,12 +3536,11 @@ void ScreenQuad::Render(float x, float y, float width, float height)
             right, top,    1.0f, 1.0f   // Top-right
         };
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(updatedVertices), updatedVertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
 
 
-        glBindVertexArray(vao);
+        Driver::Instance().BindVertexArray(vao);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
 }
@@ -2,108 +2,292 @@
 #include "Math.hpp"
 #include "Core.hpp"
 
-Vec3 operator*(float scalar, const Vec3 &vec)
+// SIMD kernels are picked at compile time from the target flags (release
+// builds use -march=native). Define MATH_NO_SIMD to force the scalar code.
+#if !defined(MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define MATH_SSE
+#include <emmintrin.h>
+#if defined(__AVX__) || defined(__FMA__)
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(MATH_SSE)
+
+#define MATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define MATH_SWIZZLE(a, x, y, z, w) _mm_shuffle_ps(a, a, _MM_SHUFFLE(w, z, y, x))
+
+static inline __m128 simdMadd(__m128 a, __m128 b, __m128 c)
 {
-    return Vec3(vec.x * scalar, vec.y * scalar, vec.z * scalar);
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
 }
 
-void Transform(const Mat4 &mat, const Vec3 &vec, Vec3 &out)
+// 2x2 row major helpers for the block inverse
+static inline __m128 simdMat2Mul(__m128 a, __m128 b)
 {
-    Vec4 temp(vec.x, vec.y, vec.z, 1.0f); // Adiciona w = 1.0 para calcular translação
-    Vec4 result = mat * temp;             // Mat4 * Vec4
-    out.x = result.x;
-    out.y = result.y;
-    out.z = result.z;
+    return _mm_add_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(MATH_SWIZZLE(a, 1, 0, 3, 2), MATH_SWIZZLE(b, 2, 1, 2, 1)));
 }
 
-void Transform(const Mat4 &mat, const Vec4 &vec, Vec4 &out)
+// adj(a) * b
+static inline __m128 simdMat2AdjMul(__m128 a, __m128 b)
 {
-    out = mat * vec;
+    return _mm_sub_ps(_mm_mul_ps(MATH_SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(MATH_SWIZZLE(a, 1, 1, 2, 2), MATH_SWIZZLE(b, 2, 3, 0, 1)));
 }
 
-void Transform(const Mat3 &mat, const Vec3 &vec, Vec3 &out)
+// a * adj(b)
+static inline __m128 simdMat2MulAdj(__m128 a, __m128 b)
 {
-    out.x = vec.x * mat.at(0, 0) + vec.y * mat.at(1, 0) + vec.z * mat.at(2, 0) + mat.at(3, 0);
-    out.y = vec.y * mat.at(0, 1) + vec.y * mat.at(1, 1) + vec.z * mat.at(2, 1) + mat.at(3, 1);
-    out.z = vec.z * mat.at(0, 2) + vec.z * mat.at(1, 2) + vec.z * mat.at(2, 2) + mat.at(3, 2);
+    return _mm_sub_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(MATH_SWIZZLE(a, 1, 0, 3, 2), MATH_SWIZZLE(b, 2, 1, 2, 1)));
 }
 
-void TransformNormal(const Mat4 &mat, const Vec3 &vec, Vec3 &out)
+static inline void simdMat4Inverse(const float *in, float *out)
 {
-    out.x = vec.x * mat.at(0, 0) + vec.y * mat.at(1, 0) + vec.z * mat.at(2, 0);
-    out.y = vec.x * mat.at(0, 1) + vec.y * mat.at(1, 1) + vec.z * mat.at(2, 1);
-    out.z = vec.x * mat.at(0, 2) + vec.y * mat.at(1, 2) + vec.z * mat.at(2, 2);
+    const __m128 r0 = _mm_loadu_ps(in + 0);
+    const __m128 r1 = _mm_loadu_ps(in + 4);
+    const __m128 r2 = _mm_loadu_ps(in + 8);
+    const __m128 r3 = _mm_loadu_ps(in + 12);
+
+    // 2x2 blocks | A B |
+    //            | C D |
+    const __m128 A = _mm_movelh_ps(r0, r1);
+    const __m128 B = _mm_movehl_ps(r1, r0);
+    const __m128 C = _mm_movelh_ps(r2, r3);
+    const __m128 D = _mm_movehl_ps(r3, r2);
+
+    // (|A| |B| |C| |D|)
+    const __m128 detSub = _mm_sub_ps(_mm_mul_ps(MATH_SHUFFLE(r0, r2, 0, 2, 0, 2), MATH_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                                     _mm_mul_ps(MATH_SHUFFLE(r0, r2, 1, 3, 1, 3), MATH_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+    const __m128 detA = MATH_SWIZZLE(detSub, 0, 0, 0, 0);
+    const __m128 detB = MATH_SWIZZLE(detSub, 1, 1, 1, 1);
+    const __m128 detC = MATH_SWIZZLE(detSub, 2, 2, 2, 2);
+    const __m128 detD = MATH_SWIZZLE(detSub, 3, 3, 3, 3);
+
+    const __m128 D_C = simdMat2AdjMul(D, C);
+    const __m128 A_B = simdMat2AdjMul(A, B);
+
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), simdMat2Mul(B, D_C));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), simdMat2Mul(C, A_B));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), simdMat2MulAdj(D, A_B));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), simdMat2MulAdj(A, D_C));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    __m128 tr = _mm_mul_ps(A_B, MATH_SWIZZLE(D_C, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 2, 3, 0, 1));
+    tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 1, 0, 3, 2));
+    const __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+    const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+    X = _mm_mul_ps(X, rDetM);
+    Y = _mm_mul_ps(Y, rDetM);
+    Z = _mm_mul_ps(Z, rDetM);
+    W = _mm_mul_ps(W, rDetM);
+
+    _mm_storeu_ps(out + 0, MATH_SHUFFLE(X, Y, 3, 1, 3, 1));
+    _mm_storeu_ps(out + 4, MATH_SHUFFLE(X, Y, 2, 0, 2, 0));
+    _mm_storeu_ps(out + 8, MATH_SHUFFLE(Z, W, 3, 1, 3, 1));
+    _mm_storeu_ps(out + 12, MATH_SHUFFLE(Z, W, 2, 0, 2, 0));
 }
 
-//***************************************************************************************************************
-// VECTOR 2D
-//***************************************************************************************************************
+// rows of a * b, b stored row major
+static inline void simdMat4Multiply(const float *a, const float *b, float *out)
+{
+#if defined(__AVX__)
+    // two result rows per iteration, b rows duplicated in both lanes
+    const __m256 b0 = _mm256_broadcast_ps((const __m128 *)(b + 0));
+    const __m256 b1 = _mm256_broadcast_ps((const __m128 *)(b + 4));
+    const __m256 b2 = _mm256_broadcast_ps((const __m128 *)(b + 8));
+    const __m256 b3 = _mm256_broadcast_ps((const __m128 *)(b + 12));
+    for (int i = 0; i < 16; i += 8)
+    {
+        const __m256 rows = _mm256_loadu_ps(a + i);
+        __m256 r = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), b0);
+#if defined(__FMA__)
+        r = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1, r);
+        r = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xAA), b2, r);
+        r = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xFF), b3, r);
+#else
+        r = _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1), r);
+        r = _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xAA), b2), r);
+        r = _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xFF), b3), r);
+#endif
+        _mm256_storeu_ps(out + i, r);
+    }
+#else
+    const __m128 b0 = _mm_loadu_ps(b + 0);
+    const __m128 b1 = _mm_loadu_ps(b + 4);
+    const __m128 b2 = _mm_loadu_ps(b + 8);
+    const __m128 b3 = _mm_loadu_ps(b + 12);
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(a[i + 0]), b0);
+        r = simdMadd(_mm_set1_ps(a[i + 1]), b1, r);
+        r = simdMadd(_mm_set1_ps(a[i + 2]), b2, r);
+        r = simdMadd(_mm_set1_ps(a[i + 3]), b3, r);
+        _mm_storeu_ps(out + i, r);
+    }
+#endif
+}
+
+// x * row0 + y * row1 + z * row2 + w * row3
+static inline __m128 simdMat4TransformRows(const float *m, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    __m128 r = _mm_mul_ps(x, _mm_loadu_ps(m + 0));
+    r = simdMadd(y, _mm_loadu_ps(m + 4), r);
+    r = simdMadd(z, _mm_loadu_ps(m + 8), r);
+    return simdMadd(w, _mm_loadu_ps(m + 12), r);
+}
+
+// one "pack" is 8 lanes with AVX (two groups of 4 Vec3, one per 128 bit lane)
+// or 4 lanes with SSE, the kernels below are written once against it
+#if defined(__AVX__)
 
-Vec2::Vec2() : x(0.0f), y(0.0f) {}
+typedef __m256 simdPack;
+static const unsigned int SIMD_WIDTH = 8;
 
-Vec2::Vec2(float x, float y) : x(x), y(y) {}
+#define PACK_SHUFFLE(a, b, x, y, z, w) _mm256_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
 
-Vec2 Vec2::operator+(const Vec2 &other) const
+static inline simdPack packSet(float v) { return _mm256_set1_ps(v); }
+static inline simdPack packAdd(simdPack a, simdPack b) { return _mm256_add_ps(a, b); }
+static inline simdPack packSub(simdPack a, simdPack b) { return _mm256_sub_ps(a, b); }
+static inline simdPack packMul(simdPack a, simdPack b) { return _mm256_mul_ps(a, b); }
+static inline simdPack packDiv(simdPack a, simdPack b) { return _mm256_div_ps(a, b); }
+static inline simdPack packSqrt(simdPack a) { return _mm256_sqrt_ps(a); }
+static inline simdPack packRsqrt(simdPack a) { return _mm256_rsqrt_ps(a); }
+static inline simdPack packGreater(simdPack a, simdPack b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline simdPack packSelect(simdPack mask, simdPack a, simdPack b) { return _mm256_blendv_ps(b, a, mask); }
+static inline simdPack packUnpackLow(simdPack a, simdPack b) { return _mm256_unpacklo_ps(a, b); }
+static inline simdPack packUnpackHigh(simdPack a, simdPack b) { return _mm256_unpackhi_ps(a, b); }
+static inline simdPack packMadd(simdPack a, simdPack b, simdPack c)
 {
-    return Vec2(x + other.x, y + other.y);
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
 }
 
-Vec2 Vec2::operator-(const Vec2 &other) const
+// p[0..3] in the low lane, p[12..15] in the high lane
+static inline simdPack packLoadSplit(const float *p)
 {
-    return Vec2(x - other.x, y - other.y);
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
 }
 
-Vec2 Vec2::operator*(float scalar) const
+static inline void packStoreSplit(float *p, simdPack v)
 {
-    return Vec2(x * scalar, y * scalar);
+    _mm_storeu_ps(p, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(p + 12, _mm256_extractf128_ps(v, 1));
 }
 
-Vec2 Vec2::operator/(float scalar) const
+static inline void packStore(float *p, simdPack v) { _mm256_storeu_ps(p, v); }
+static inline simdPack packLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline simdPack packOr(simdPack a, simdPack b) { return _mm256_or_ps(a, b); }
+static inline unsigned int packMask(simdPack v) { return (unsigned int)_mm256_movemask_ps(v); }
+
+#else
+
+typedef __m128 simdPack;
+static const unsigned int SIMD_WIDTH = 4;
+
+#define PACK_SHUFFLE(a, b, x, y, z, w) MATH_SHUFFLE(a, b, x, y, z, w)
+
+static inline simdPack packSet(float v) { return _mm_set1_ps(v); }
+static inline simdPack packAdd(simdPack a, simdPack b) { return _mm_add_ps(a, b); }
+static inline simdPack packSub(simdPack a, simdPack b) { return _mm_sub_ps(a, b); }
+static inline simdPack packMul(simdPack a, simdPack b) { return _mm_mul_ps(a, b); }
+static inline simdPack packDiv(simdPack a, simdPack b) { return _mm_div_ps(a, b); }
+static inline simdPack packSqrt(simdPack a) { return _mm_sqrt_ps(a); }
+static inline simdPack packRsqrt(simdPack a) { return _mm_rsqrt_ps(a); }
+static inline simdPack packGreater(simdPack a, simdPack b) { return _mm_cmpgt_ps(a, b); }
+static inline simdPack packSelect(simdPack mask, simdPack a, simdPack b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline simdPack packUnpackLow(simdPack a, simdPack b) { return _mm_unpacklo_ps(a, b); }
+static inline simdPack packUnpackHigh(simdPack a, simdPack b) { return _mm_unpackhi_ps(a, b); }
+static inline simdPack packMadd(simdPack a, simdPack b, simdPack c) { return simdMadd(a, b, c); }
+static inline simdPack packLoadSplit(const float *p) { return _mm_loadu_ps(p); }
+static inline void packStoreSplit(float *p, simdPack v) { _mm_storeu_ps(p, v); }
+static inline void packStore(float *p, simdPack v) { _mm_storeu_ps(p, v); }
+static inline simdPack packLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline simdPack packOr(simdPack a, simdPack b) { return _mm_or_ps(a, b); }
+static inline unsigned int packMask(simdPack v) { return (unsigned int)_mm_movemask_ps(v); }
+
+#endif
+
+// 4 packed Vec3 (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) per lane to x/y/z
+static inline void packLoadVec3(const Vec3 *src, simdPack &x, simdPack &y, simdPack &z)
 {
-    return Vec2(x / scalar, y / scalar);
+    const float *p = &src->x;
+    const simdPack a = packLoadSplit(p);
+    const simdPack b = packLoadSplit(p + 4);
+    const simdPack c = packLoadSplit(p + 8);
+
+    const simdPack xy = PACK_SHUFFLE(b, c, 2, 3, 1, 2); // x2 y2 x3 y3
+    const simdPack yz = PACK_SHUFFLE(a, b, 1, 2, 0, 1); // y0 z0 y1 z1
+    x = PACK_SHUFFLE(a, xy, 0, 3, 0, 2);
+    y = PACK_SHUFFLE(yz, xy, 0, 2, 1, 3);
+    z = PACK_SHUFFLE(yz, c, 1, 3, 0, 3);
 }
 
-Vec2 &Vec2::operator+=(const Vec2 &other)
+static inline void packStoreVec3(Vec3 *dst, simdPack x, simdPack y, simdPack z)
 {
-    x += other.x;
-    y += other.y;
-    return *this;
+    float *p = &dst->x;
+    const simdPack xy = packUnpackHigh(x, y); // x2 y2 x3 y3
+    const simdPack yz = packUnpackLow(y, z);  // y0 z0 y1 z1
+    const simdPack a = PACK_SHUFFLE(x, yz, 0, 1, 0, 1);
+    const simdPack c = PACK_SHUFFLE(xy, z, 2, 3, 2, 3);
+    packStoreSplit(p, PACK_SHUFFLE(a, a, 0, 2, 3, 1));
+    packStoreSplit(p + 4, PACK_SHUFFLE(yz, xy, 2, 3, 0, 1));
+    packStoreSplit(p + 8, PACK_SHUFFLE(c, c, 2, 0, 1, 3));
 }
 
-Vec2 &Vec2::operator-=(const Vec2 &other)
+// translate / scale don't need the transpose: the x y z pattern repeats every
+// 3 registers, so the offset is pre-rotated into the same 12 float layout
+static inline void packOffsetPattern(const Vec3 &v, __m128 &p0, __m128 &p1, __m128 &p2)
 {
-    x -= other.x;
-    y -= other.y;
-    return *this;
+    p0 = _mm_setr_ps(v.x, v.y, v.z, v.x);
+    p1 = _mm_setr_ps(v.y, v.z, v.x, v.y);
+    p2 = _mm_setr_ps(v.z, v.x, v.y, v.z);
 }
 
-Vec2 &Vec2::operator*=(float scalar)
+#endif
+
+void Transform(const Mat4 &mat, const Vec3 &vec, Vec3 &out)
 {
-    x *= scalar;
-    y *= scalar;
-    return *this;
+    Vec4 temp(vec.x, vec.y, vec.z, 1.0f); // Adiciona w = 1.0 para calcular translação
+    Vec4 result = mat * temp;             // Mat4 * Vec4
+    out.x = result.x;
+    out.y = result.y;
+    out.z = result.z;
 }
 
-Vec2 &Vec2::operator/=(float scalar)
+void Transform(const Mat4 &mat, const Vec4 &vec, Vec4 &out)
 {
-    x /= scalar;
-    y /= scalar;
-    return *this;
+    out = mat * vec;
 }
 
-Vec2 Vec2::operator-() const
+void Transform(const Mat3 &mat, const Vec3 &vec, Vec3 &out)
 {
-    return Vec2(-x, -y);
+    out.x = vec.x * mat.at(0, 0) + vec.y * mat.at(1, 0) + vec.z * mat.at(2, 0) + mat.at(3, 0);
+    out.y = vec.y * mat.at(0, 1) + vec.y * mat.at(1, 1) + vec.z * mat.at(2, 1) + mat.at(3, 1);
+    out.z = vec.z * mat.at(0, 2) + vec.z * mat.at(1, 2) + vec.z * mat.at(2, 2) + mat.at(3, 2);
 }
 
-float Vec2::length() const
+void TransformNormal(const Mat4 &mat, const Vec3 &vec, Vec3 &out)
 {
-    return Sqrt(x * x + y * y);
+    out.x = vec.x * mat.at(0, 0) + vec.y * mat.at(1, 0) + vec.z * mat.at(2, 0);
+    out.y = vec.x * mat.at(0, 1) + vec.y * mat.at(1, 1) + vec.z * mat.at(2, 1);
+    out.z = vec.x * mat.at(0, 2) + vec.y * mat.at(1, 2) + vec.z * mat.at(2, 2);
 }
 
-float Vec2::lengthSquared() const
+//***************************************************************************************************************
+// VECTOR 2D
+//***************************************************************************************************************
+
+float Vec2::length() const
 {
-    return x * x + y * y;
+    return Sqrt(x * x + y * y);
 }
 
 Vec2 &Vec2::normalize()
@@ -124,11 +308,6 @@ Vec2 Vec2::normal() const
     return (len > 0.0f) ? *this / len : *this;
 }
 
-float Vec2::dot(const Vec2 &other) const
-{
-    return x * other.x + y * other.y;
-}
-
 float Vec2::angle(const Vec2 &other) const
 {
     float dotProduct = this->dot(other);
@@ -186,20 +365,6 @@ float Vec2::Distance(const Vec2 &a, const Vec2 &b)
     return (a - b).length();
 }
 
-float Vec2::DistanceSquared(const Vec2 &a, const Vec2 &b)
-{
-    float dx = b.x - a.x;
-    float dy = b.y - a.y;
-    return dx * dx + dy * dy;
-}
-
-Vec2 Vec2::Lerp(const Vec2 &a, const Vec2 &b, float t)
-{
-    return Vec2(
-        a.x + t * (b.x - a.x),
-        a.y + t * (b.y - a.y));
-}
-
 Vec2 Vec2::Normal(const Vec2 &a, const Vec2 &b)
 {
     Vec2 diff = b - a;
@@ -216,74 +381,6 @@ float Vec2::Angle(const Vec2 &a, const Vec2 &b)
 //***************************************************************************************************************
 // VECTOR 3D
 //***************************************************************************************************************
-Vec3::Vec3() : x(0.0f), y(0.0f), z(0.0f) {}
-
-Vec3::Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
-
-Vec3 Vec3::operator+(const Vec3 &other) const
-{
-    return Vec3(x + other.x, y + other.y, z + other.z);
-}
-
-Vec3 Vec3::operator-(const Vec3 &other) const
-{
-    return Vec3(x - other.x, y - other.y, z - other.z);
-}
-
-Vec3 Vec3::operator*(float scalar) const
-{
-    return Vec3(x * scalar, y * scalar, z * scalar);
-}
-
-Vec3 Vec3::operator/(float scalar) const
-{
-    return Vec3(x / scalar, y / scalar, z / scalar);
-}
-
-Vec3 &Vec3::operator+=(const Vec3 &other)
-{
-    x += other.x;
-    y += other.y;
-    z += other.z;
-    return *this;
-}
-
-Vec3 &Vec3::operator-=(const Vec3 &other)
-{
-    x -= other.x;
-    y -= other.y;
-    z -= other.z;
-    return *this;
-}
-
-Vec3 &Vec3::operator*=(float scalar)
-{
-    x *= scalar;
-    y *= scalar;
-    z *= scalar;
-    return *this;
-}
-
-Vec3 &Vec3::operator/=(float scalar)
-{
-    x /= scalar;
-    y /= scalar;
-    z /= scalar;
-    return *this;
-}
-
-Vec3 Vec3::operator-() const
-{
-    return Vec3(-x, -y, -z);
-}
-
-void Vec3::set(float x, float y, float z)
-{
-    this->x = x;
-    this->y = y;
-    this->z = z;
-}
-
 float &Vec3::operator[](int index)
 {
     DEBUG_BREAK_IF(index < 0 || index > 2);
@@ -301,11 +398,6 @@ float Vec3::length() const
     return Sqrt(x * x + y * y + z * z);
 }
 
-float Vec3::lengthSquared() const
-{
-    return x * x + y * y + z * z;
-}
-
 Vec3 &Vec3::normalize()
 {
     float len = length();
@@ -318,23 +410,23 @@ Vec3 &Vec3::normalize()
     return *this;
 }
 
-Vec3 Vec3::normal() const
-{
-    float len = length();
-    return (len > 0.0f) ? *this / len : *this;
-}
-
-float Vec3::dot(const Vec3 &other) const
+Vec3 &Vec3::normalizeFast()
 {
-    return x * other.x + y * other.y + z * other.z;
+    const float lengthSq = x * x + y * y + z * z;
+    if (lengthSq > 0.0f)
+    {
+        const float inv = FastInvSqrt(lengthSq);
+        x *= inv;
+        y *= inv;
+        z *= inv;
+    }
+    return *this;
 }
 
-Vec3 Vec3::cross(const Vec3 &other) const
+Vec3 Vec3::normal() const
 {
-    return Vec3(
-        y * other.z - z * other.y,
-        z * other.x - x * other.z,
-        x * other.y - y * other.x);
+    float len = length();
+    return (len > 0.0f) ? *this / len : *this;
 }
 
 Vec3 Vec3::rotate(float angle, const Vec3 &axis) const
@@ -378,22 +470,6 @@ float Vec3::Distance(const Vec3 &a, const Vec3 &b)
     return Sqrt(dx * dx + dy * dy + dz * dz);
 }
 
-float Vec3::DistanceSquared(const Vec3 &a, const Vec3 &b)
-{
-    float dx = a.x - b.x;
-    float dy = a.y - b.y;
-    float dz = a.z - b.z;
-    return dx * dx + dy * dy + dz * dz;
-}
-
-Vec3 Vec3::Lerp(const Vec3 &a, const Vec3 &b, float t)
-{
-    return Vec3(
-        a.x + t * (b.x - a.x),
-        a.y + t * (b.y - a.y),
-        a.z + t * (b.z - a.z));
-}
-
 Vec3 Vec3::Normal(const Vec3 &a, const Vec3 &b)
 {
     Vec3 diff = b - a;
@@ -406,80 +482,10 @@ Vec3 Vec3::Normalize(const Vec3 &a)
     return Vec3(a.x / aLen, a.y / aLen, a.z / aLen);
 }
 
-Vec3 Vec3::Cross(const Vec3 &a, const Vec3 &b)
-{
-    return a.cross(b);
-}
-
-float Vec3::Dot(const Vec3 &a, const Vec3 &b)
-{
-    return a.dot(b);
-}
-
 //***************************************************************************************************************
 // VECTOR 4D
 //***************************************************************************************************************
 
-Vec4::Vec4() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
-
-Vec4::Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
-
-Vec4 Vec4::operator+(const Vec4 &other) const
-{
-    return Vec4(x + other.x, y + other.y, z + other.z, w + other.w);
-}
-
-Vec4 Vec4::operator-(const Vec4 &other) const
-{
-    return Vec4(x - other.x, y - other.y, z - other.z, w - other.w);
-}
-
-Vec4 Vec4::operator*(float scalar) const
-{
-    return Vec4(x * scalar, y * scalar, z * scalar, w * scalar);
-}
-
-Vec4 Vec4::operator/(float scalar) const
-{
-    return Vec4(x / scalar, y / scalar, z / scalar, w / scalar);
-}
-
-Vec4 &Vec4::operator+=(const Vec4 &other)
-{
-    x += other.x;
-    y += other.y;
-    z += other.z;
-    w += other.w;
-    return *this;
-}
-
-Vec4 &Vec4::operator-=(const Vec4 &other)
-{
-    x -= other.x;
-    y -= other.y;
-    z -= other.z;
-    w -= other.w;
-    return *this;
-}
-
-Vec4 &Vec4::operator*=(float scalar)
-{
-    x *= scalar;
-    y *= scalar;
-    z *= scalar;
-    w *= scalar;
-    return *this;
-}
-
-Vec4 &Vec4::operator/=(float scalar)
-{
-    x /= scalar;
-    y /= scalar;
-    z /= scalar;
-    w /= scalar;
-    return *this;
-}
-
 float &Vec4::operator[](int index)
 {
     switch (index)
@@ -802,34 +808,6 @@ Mat3 Mat3::Rotate(const Mat3 &mat, float radians, const Vec3 &axis)
 // MATRIX 4X4
 //***************************************************************************************************************
 
-Mat4::Mat4()
-{
-    m[0] = 1.0f;
-    m[1] = m[2] = m[3] = m[4] = 0.0f;
-
-    m[5] = 1.0f;
-    m[6] = m[7] = m[8] = m[9] = 0.0f;
-
-    m[10] = 1.0f;
-    m[11] = m[12] = m[13] = m[14] = 0.0f;
-
-    m[15] = 1.0f;
-}
-
-Mat4::Mat4(float diagonal)
-{
-    m[0] = diagonal;
-    m[1] = m[2] = m[3] = m[4] = 0.0f;
-
-    m[5] = diagonal;
-    m[6] = m[7] = m[8] = m[9] = 0.0f;
-
-    m[10] = diagonal;
-    m[11] = m[12] = m[13] = m[14] = 0.0f;
-
-    m[15] = diagonal;
-}
-
 Mat4::Mat4(const float *elements)
 {
     for (int i = 0; i < 16; ++i)
@@ -925,11 +903,23 @@ Mat4 Mat4::operator*(float scalar) const
 
 Vec4 Mat4::operator*(const Vec4 &vec) const
 {
+#if defined(MATH_SSE)
+    const __m128 v = _mm_setr_ps(vec.x, vec.y, vec.z, vec.w);
+    __m128 r0 = _mm_mul_ps(_mm_loadu_ps(m + 0), v);
+    __m128 r1 = _mm_mul_ps(_mm_loadu_ps(m + 4), v);
+    __m128 r2 = _mm_mul_ps(_mm_loadu_ps(m + 8), v);
+    __m128 r3 = _mm_mul_ps(_mm_loadu_ps(m + 12), v);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    float out[4];
+    _mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3)));
+    return Vec4(out[0], out[1], out[2], out[3]);
+#else
     return Vec4(
         at(0, 0) * vec.x + at(0, 1) * vec.y + at(0, 2) * vec.z + at(0, 3) * vec.w,
         at(1, 0) * vec.x + at(1, 1) * vec.y + at(1, 2) * vec.z + at(1, 3) * vec.w,
         at(2, 0) * vec.x + at(2, 1) * vec.y + at(2, 2) * vec.z + at(2, 3) * vec.w,
         at(3, 0) * vec.x + at(3, 1) * vec.y + at(3, 2) * vec.z + at(3, 3) * vec.w);
+#endif
 }
 
 Mat4 &Mat4::operator*=(const Mat4 &other)
@@ -1054,8 +1044,26 @@ Mat3 Mat4::ToMat3(const Mat4 &mat)
     return result;
 }
 
+Mat4 Mat4::transpose() const
+{
+    Mat4 result;
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int col = 0; col < 4; ++col)
+        {
+            result.at(row, col) = at(col, row);
+        }
+    }
+    return result;
+}
+
 Mat4 Mat4::inverse() const
 {
+#if defined(MATH_SSE)
+    Mat4 result;
+    simdMat4Inverse(m, result.m);
+    return result;
+#else
 
     float a00 = m[0], a01 = m[1], a02 = m[2], a03 = m[3];
     float a10 = m[4], a11 = m[5], a12 = m[6], a13 = m[7];
@@ -1096,6 +1104,7 @@ Mat4 Mat4::inverse() const
     result.m[15] = (a20 * b03 - a21 * b01 + a22 * b00) * invDet;
 
     return result;
+#endif
 }
 
 Vec3 Mat4::getRotationInDegrees() const
@@ -1150,23 +1159,6 @@ Vec3 Mat4::getRotation() const
     return rotation;
 }
 
-Mat4 Mat4::Identity()
-{
-    return Mat4(1.0f);
-}
-
-Mat4 Mat4::Translate(const Vec3 &translation)
-{
-    Mat4 result;
-    result.translate(translation.x, translation.y, translation.z);
-    return result;
-}
-Mat4 Mat4::Scale(const Vec3 &scale)
-{
-    Mat4 result;
-    result.scale(scale.x, scale.y, scale.z);
-    return result;
-}
 Mat4 Mat4::Rotate(float radians, const Vec3 &axis)
 {
     Mat4 result;
@@ -1387,12 +1379,20 @@ Mat4 Mat4::Scale(const Mat4 &mat, float x, float y, float z)
 
 void Mat4::transformPoint(Vec3 &v) const
 {
+#if defined(MATH_SSE)
+    float out[4];
+    _mm_storeu_ps(out, simdMat4TransformRows(m, _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z), _mm_set1_ps(1.0f)));
+    v.x = out[0];
+    v.y = out[1];
+    v.z = out[2];
+#else
     float x = v.x * m[0] + v.y * m[4] + v.z * m[8] + m[12];
     float y = v.x * m[1] + v.y * m[5] + v.z * m[9] + m[13];
     float z = v.x * m[2] + v.y * m[6] + v.z * m[10] + m[14];
     v.x = x;
     v.y = y;
     v.z = z;
+#endif
 }
 
 void Mat4::transformNormal(Vec3 &v) const
@@ -1404,6 +1404,20 @@ void Mat4::transformNormal(Vec3 &v) const
     v.y = y;
     v.z = z;
 }
+// the rows are the rotated axes times the scale, the translation is the
+// last row
+Mat4 Mat4::Compose(const Vec3 &t, const Quat &q, const Vec3 &s)
+{
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    return Mat4((1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x, 0.0f,
+                2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y, 0.0f,
+                2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f,
+                t.x, t.y, t.z, 1.0f);
+}
+
 bool Mat4::Decompose(const Mat4 &mat, Vec3 &position, Vec3 &scale, Quat &rotation)
 {
     position = Vec3(mat.at(0, 3), mat.at(1, 3), mat.at(2, 3));
@@ -1466,6 +1480,10 @@ bool Mat4::Decompose(const Mat4 &mat, Vec3 &position, Mat3 &out)
 Mat4 Mat4::Inverse(const Mat4 &mat)
 {
     Mat4 result;
+#if defined(MATH_SSE)
+    simdMat4Inverse(mat.m, result.m);
+    return result;
+#else
 
     // Cache the matrix values (speed optimization)
     float a00 = mat.m[0], a01 = mat.m[1], a02 = mat.m[2], a03 = mat.m[3];
@@ -1507,6 +1525,7 @@ Mat4 Mat4::Inverse(const Mat4 &mat)
     result.m[15] = (a20 * b03 - a21 * b01 + a22 * b00) * invDet;
 
     return result;
+#endif
 }
 
 Mat4 Mat4::Add(const Mat4 &left, const Mat4 &right)
@@ -1584,6 +1603,10 @@ Mat4 Mat4::Divide(const Mat4 &left, const Mat4 &right)
 Mat4 Mat4::Multiply(const Mat4 &left, const Mat4 &right)
 {
     Mat4 result;
+#if defined(MATH_SSE)
+    simdMat4Multiply(left.m, right.m, result.m);
+    return result;
+#else
 
     result.m[0] = left.m[0] * right.m[0] + left.m[1] * right.m[4] + left.m[2] * right.m[8] + left.m[3] * right.m[12];
     result.m[1] = left.m[0] * right.m[1] + left.m[1] * right.m[5] + left.m[2] * right.m[9] + left.m[3] * right.m[13];
@@ -1602,6 +1625,7 @@ Mat4 Mat4::Multiply(const Mat4 &left, const Mat4 &right)
     result.m[14] = left.m[12] * right.m[2] + left.m[13] * right.m[6] + left.m[14] * right.m[10] + left.m[15] * right.m[14];
     result.m[15] = left.m[12] * right.m[3] + left.m[13] * right.m[7] + left.m[14] * right.m[11] + left.m[15] * right.m[15];
     return result;
+#endif
 }
 
 Mat4 Mat4::Mirror(const Vec3 &n, float d)
@@ -1899,6 +1923,33 @@ Quat Quat::Slerp(const Quat &start, const Quat &end, float t)
     return start * weightStart + endCorrected * weightEnd;
 }
 
+Quat Quat::SlerpFast(const Quat &start, const Quat &end, float t)
+{
+    float dot = start.x * end.x + start.y * end.y + start.z * end.z + start.w * end.w;
+
+    Quat endCorrected = end;
+    if (dot < 0.0f)
+    {
+        dot = -dot;
+        endCorrected = Quat(-end.x, -end.y, -end.z, -end.w);
+    }
+
+    if (dot > 0.9995f)
+    {
+        Quat q = start + (endCorrected - start) * t;
+        const float inv = FastInvSqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        return q * inv;
+    }
+
+    const float theta = acosf(dot);
+    const float invSinTheta = FastInvSqrt(1.0f - dot * dot);
+
+    const float weightStart = FastSinRad((1.0f - t) * theta) * invSinTheta;
+    const float weightEnd = FastSinRad(t * theta) * invSinTheta;
+
+    return start * weightStart + endCorrected * weightEnd;
+}
+
 Quat Quat::Lerp(const Quat &start, const Quat &end, float t)
 {
 
@@ -2116,6 +2167,11 @@ void BoundingBox::expand(const BoundingBox &other)
     expand(other.min);
 }
 
+void BoundingBox::expand(const Vec3 *points, unsigned int count)
+{
+    Vec3Batch::Expand(points, count, min, max);
+}
+
 void BoundingBox::scale(float factor)
 {
     Vec3 centerPoint = center();
@@ -2201,6 +2257,30 @@ Vec3 BoundingBox::getCorner(unsigned char index) const
     return v;
 }
 
+#if defined(MATH_SSE)
+// Affine box transform from center and half extents (Arvo): same result as
+// transforming the 8 corners, at the cost of one point and one vector.
+static inline void simdTransformBox(const Mat4 &matrix, const Vec3 &min, const Vec3 &max, Vec3 &outMin, Vec3 &outMax)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 lo = _mm_setr_ps(min.x, min.y, min.z, 0.0f);
+    const __m128 hi = _mm_setr_ps(max.x, max.y, max.z, 0.0f);
+    const __m128 c = _mm_mul_ps(_mm_add_ps(lo, hi), half);
+    const __m128 e = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+
+    const __m128 center = simdMat4TransformRows(matrix.m, MATH_SWIZZLE(c, 0, 0, 0, 0), MATH_SWIZZLE(c, 1, 1, 1, 1), MATH_SWIZZLE(c, 2, 2, 2, 2), _mm_set1_ps(1.0f));
+    __m128 extent = _mm_mul_ps(MATH_SWIZZLE(e, 0, 0, 0, 0), _mm_andnot_ps(signMask, _mm_loadu_ps(matrix.m + 0)));
+    extent = simdMadd(MATH_SWIZZLE(e, 1, 1, 1, 1), _mm_andnot_ps(signMask, _mm_loadu_ps(matrix.m + 4)), extent);
+    extent = simdMadd(MATH_SWIZZLE(e, 2, 2, 2, 2), _mm_andnot_ps(signMask, _mm_loadu_ps(matrix.m + 8)), extent);
+
+    float a[4], b[4];
+    _mm_storeu_ps(a, _mm_sub_ps(center, extent));
+    _mm_storeu_ps(b, _mm_add_ps(center, extent));
+    outMin.set(a[0], a[1], a[2]);
+    outMax.set(b[0], b[1], b[2]);
+}
+#else
 static void updateMinMax(Vec3 *point, Vec3 *min, Vec3 *max)
 {
     if (point->x < min->x)
@@ -2216,8 +2296,13 @@ static void updateMinMax(Vec3 *point, Vec3 *min, Vec3 *max)
     if (point->z > max->z)
         max->z = point->z;
 }
+#endif
+
 void BoundingBox::transform(const Mat4 &matrix)
 {
+#if defined(MATH_SSE)
+    simdTransformBox(matrix, min, max, min, max);
+#else
     Vec3 corners[8];
     getCorners(corners);
     matrix.transformPoint(corners[0]);
@@ -2234,9 +2319,13 @@ void BoundingBox::transform(const Mat4 &matrix)
     this->max.x = newMax.x;
     this->max.y = newMax.y;
     this->max.z = newMax.z;
+#endif
 }
 void BoundingBox::transform(BoundingBox &box, const Mat4 &matrix)
 {
+#if defined(MATH_SSE)
+    simdTransformBox(matrix, min, max, box.min, box.max);
+#else
     Vec3 corners[8];
     getCorners(corners);
     matrix.transformPoint(corners[0]);
@@ -2253,6 +2342,7 @@ void BoundingBox::transform(BoundingBox &box, const Mat4 &matrix)
     box.max.x = newMax.x;
     box.max.y = newMax.y;
     box.max.z = newMax.z;
+#endif
 }
 //***************************************************************************************************************
 //                                               RAY
@@ -2333,6 +2423,71 @@ bool Ray::intersectBox(const BoundingBox &box, float &t) const
     return false;
 }
 
+//***************************************************************************************************************
+//                                              BOX LIST
+//***************************************************************************************************************
+
+BoxList::BoxList() : count(0) {}
+
+void BoxList::clear()
+{
+    count = 0;
+}
+
+void BoxList::reserve(unsigned int n)
+{
+    const unsigned int padded = (n + FRUSTUM_CULL_GROUP - 1) & ~(FRUSTUM_CULL_GROUP - 1);
+    cx.reserve(padded);
+    cy.reserve(padded);
+    cz.reserve(padded);
+    ex.reserve(padded);
+    ey.reserve(padded);
+    ez.reserve(padded);
+}
+
+void BoxList::resize(unsigned int n)
+{
+    const unsigned int padded = (n + FRUSTUM_CULL_GROUP - 1) & ~(FRUSTUM_CULL_GROUP - 1);
+    if (padded > cx.size())
+    {
+        cx.resize(padded, 0.0f);
+        cy.resize(padded, 0.0f);
+        cz.resize(padded, 0.0f);
+        ex.resize(padded, 0.0f);
+        ey.resize(padded, 0.0f);
+        ez.resize(padded, 0.0f);
+    }
+    count = n;
+}
+
+unsigned int BoxList::add(const Vec3 &min, const Vec3 &max)
+{
+    unsigned int index = count;
+    resize(count + 1);
+    set(index, min, max);
+    return index;
+}
+
+unsigned int BoxList::add(const BoundingBox &box)
+{
+    return add(box.min, box.max);
+}
+
+void BoxList::set(unsigned int index, const Vec3 &min, const Vec3 &max)
+{
+    cx[index] = (min.x + max.x) * 0.5f;
+    cy[index] = (min.y + max.y) * 0.5f;
+    cz[index] = (min.z + max.z) * 0.5f;
+    ex[index] = (max.x - min.x) * 0.5f;
+    ey[index] = (max.y - min.y) * 0.5f;
+    ez[index] = (max.z - min.z) * 0.5f;
+}
+
+void BoxList::set(unsigned int index, const BoundingBox &box)
+{
+    set(index, box.min, box.max);
+}
+
 //***************************************************************************************************************
 //                                              FRUSTUM
 //***************************************************************************************************************
@@ -2431,6 +2586,88 @@ bool Frustum::intersectsBox(const BoundingBox &box) const
     return true;
 }
 
+static inline unsigned int bitCount(unsigned int v)
+{
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+unsigned int Frustum::cullBoxes(const BoxList &boxes, unsigned int *visible, unsigned char *planeCache) const
+{
+    const unsigned int count = boxes.count;
+    memset(visible, 0, ((count + 31) / 32) * sizeof(unsigned int));
+    if (count == 0)
+        return 0;
+
+    // a box is outside a plane when centre distance + projected radius < 0,
+    // the same test as the p-vertex one in intersectsBox without the branches
+    float nx[6], ny[6], nz[6], ax[6], ay[6], az[6], nd[6];
+    for (int i = 0; i < 6; i++)
+    {
+        nx[i] = planes[i].normal.x;
+        ny[i] = planes[i].normal.y;
+        nz[i] = planes[i].normal.z;
+        ax[i] = fabsf(nx[i]);
+        ay[i] = fabsf(ny[i]);
+        az[i] = fabsf(nz[i]);
+        nd[i] = planes[i].distance;
+    }
+
+    const float *cx = boxes.cx.data(), *cy = boxes.cy.data(), *cz = boxes.cz.data();
+    const float *ex = boxes.ex.data(), *ey = boxes.ey.data(), *ez = boxes.ez.data();
+
+    unsigned int visibleCount = 0;
+    const unsigned int groups = (count + FRUSTUM_CULL_GROUP - 1) / FRUSTUM_CULL_GROUP;
+    for (unsigned int g = 0; g < groups; g++)
+    {
+        const unsigned int first = g * FRUSTUM_CULL_GROUP;
+        const unsigned int lanes = Min(count - first, FRUSTUM_CULL_GROUP);
+        const unsigned int all = (1u << lanes) - 1;
+
+        // plane coherency: start with the plane that rejected this group last time
+        unsigned int plane = planeCache && planeCache[g] < 6 ? planeCache[g] : 0;
+        unsigned int outside = 0;
+        for (int k = 0; k < 6; k++)
+        {
+#if defined(MATH_SSE)
+            const simdPack px = packSet(nx[plane]), py = packSet(ny[plane]), pz = packSet(nz[plane]);
+            const simdPack qx = packSet(ax[plane]), qy = packSet(ay[plane]), qz = packSet(az[plane]);
+            const simdPack pd = packSet(nd[plane]);
+            const simdPack zero = packSet(0.0f);
+            for (unsigned int lane = 0; lane < FRUSTUM_CULL_GROUP; lane += SIMD_WIDTH)
+            {
+                const unsigned int i = first + lane;
+                simdPack d = packMadd(packLoad(cz + i), pz, packMadd(packLoad(cy + i), py, packMadd(packLoad(cx + i), px, pd)));
+                d = packMadd(packLoad(ez + i), qz, packMadd(packLoad(ey + i), qy, packMadd(packLoad(ex + i), qx, d)));
+                outside |= packMask(packGreater(zero, d)) << lane;
+            }
+#else
+            for (unsigned int lane = 0; lane < lanes; lane++)
+            {
+                const unsigned int i = first + lane;
+                const float d = cx[i] * nx[plane] + cy[i] * ny[plane] + cz[i] * nz[plane] + nd[plane] +
+                                ex[i] * ax[plane] + ey[i] * ay[plane] + ez[i] * az[plane];
+                if (d < 0.0f)
+                    outside |= 1u << lane;
+            }
+#endif
+            if ((outside & all) == all)
+            {
+                if (planeCache)
+                    planeCache[g] = (unsigned char)plane;
+                break;
+            }
+            plane = plane == 5 ? 0 : plane + 1;
+        }
+
+        const unsigned int inside = ~outside & all;
+        visible[first >> 5] |= inside << (first & 31);
+        visibleCount += bitCount(inside);
+    }
+    return visibleCount;
+}
+
 Stack::Stack()
 {
     m_index = 0;
@@ -2485,3 +2722,227 @@ void Stack::rotate(float radians, const Vec3 &axis)
 {
     multiply(Mat4::Rotate(radians, axis));
 }
+
+//***************************************************************************************************************
+//  SOA BATCH
+//***************************************************************************************************************
+
+// Transforms stay a plain loop over locals on purpose: GCC and Clang vectorize
+// it with their own permutes, which measured faster than a hand written 4/8
+// lane transpose on both SSE2 and AVX2 targets (benchMath BM_BatchTransformPoints).
+static inline void transformSpan(const Mat4 &mat, float translate, const Vec3 *src, Vec3 *dst, unsigned int count)
+{
+    const float m0 = mat.m[0], m1 = mat.m[1], m2 = mat.m[2];
+    const float m4 = mat.m[4], m5 = mat.m[5], m6 = mat.m[6];
+    const float m8 = mat.m[8], m9 = mat.m[9], m10 = mat.m[10];
+    const float tx = mat.m[12] * translate, ty = mat.m[13] * translate, tz = mat.m[14] * translate;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const float x = src[i].x, y = src[i].y, z = src[i].z;
+        dst[i].x = x * m0 + y * m4 + z * m8 + tx;
+        dst[i].y = x * m1 + y * m5 + z * m9 + ty;
+        dst[i].z = x * m2 + y * m6 + z * m10 + tz;
+    }
+}
+
+void Vec3Batch::TransformPoints(const Mat4 &mat, const Vec3 *src, Vec3 *dst, unsigned int count)
+{
+    transformSpan(mat, 1.0f, src, dst, count);
+}
+
+void Vec3Batch::TransformNormals(const Mat4 &mat, const Vec3 *src, Vec3 *dst, unsigned int count)
+{
+    transformSpan(mat, 0.0f, src, dst, count);
+}
+
+void Vec3Batch::Translate(Vec3 *points, unsigned int count, const Vec3 &offset)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    __m128 o0, o1, o2;
+    packOffsetPattern(offset, o0, o1, o2);
+    for (; i + 4 <= count; i += 4)
+    {
+        float *p = &points[i].x;
+        _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), o0));
+        _mm_storeu_ps(p + 4, _mm_add_ps(_mm_loadu_ps(p + 4), o1));
+        _mm_storeu_ps(p + 8, _mm_add_ps(_mm_loadu_ps(p + 8), o2));
+    }
+#endif
+    for (; i < count; i++)
+        points[i] += offset;
+}
+
+void Vec3Batch::Scale(Vec3 *points, unsigned int count, const Vec3 &scale)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    __m128 s0, s1, s2;
+    packOffsetPattern(scale, s0, s1, s2);
+    for (; i + 4 <= count; i += 4)
+    {
+        float *p = &points[i].x;
+        _mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), s0));
+        _mm_storeu_ps(p + 4, _mm_mul_ps(_mm_loadu_ps(p + 4), s1));
+        _mm_storeu_ps(p + 8, _mm_mul_ps(_mm_loadu_ps(p + 8), s2));
+    }
+#endif
+    for (; i < count; i++)
+        points[i].set(points[i].x * scale.x, points[i].y * scale.y, points[i].z * scale.z);
+}
+
+void Vec3Batch::Normalize(const Vec3 *src, Vec3 *dst, unsigned int count)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    const simdPack zero = packSet(0.0f);
+    const simdPack one = packSet(1.0f);
+    for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH)
+    {
+        simdPack x, y, z;
+        packLoadVec3(src + i, x, y, z);
+        const simdPack lengthSq = packMadd(z, z, packMadd(y, y, packMul(x, x)));
+        // zero length vectors are left untouched, like Vec3::normalize
+        const simdPack inv = packSelect(packGreater(lengthSq, zero), packDiv(one, packSqrt(lengthSq)), one);
+        packStoreVec3(dst + i, packMul(x, inv), packMul(y, inv), packMul(z, inv));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        Vec3 v = src[i];
+        v.normalize();
+        dst[i] = v;
+    }
+}
+
+void Vec3Batch::NormalizeFast(const Vec3 *src, Vec3 *dst, unsigned int count)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    const simdPack zero = packSet(0.0f);
+    const simdPack half = packSet(0.5f);
+    const simdPack threeHalves = packSet(1.5f);
+    const simdPack one = packSet(1.0f);
+    for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH)
+    {
+        simdPack x, y, z;
+        packLoadVec3(src + i, x, y, z);
+        const simdPack lengthSq = packMadd(z, z, packMadd(y, y, packMul(x, x)));
+        // one Newton step on the estimate: y * (1.5 - 0.5 * a * y * y)
+        const simdPack estimate = packRsqrt(lengthSq);
+        const simdPack refined = packMul(estimate, packSub(threeHalves, packMul(packMul(half, lengthSq), packMul(estimate, estimate))));
+        const simdPack inv = packSelect(packGreater(lengthSq, zero), refined, one);
+        packStoreVec3(dst + i, packMul(x, inv), packMul(y, inv), packMul(z, inv));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        Vec3 v = src[i];
+        v.normalizeFast();
+        dst[i] = v;
+    }
+}
+
+void Vec3Batch::Dot(const Vec3 *a, const Vec3 *b, float *dst, unsigned int count)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH)
+    {
+        simdPack ax, ay, az, bx, by, bz;
+        packLoadVec3(a + i, ax, ay, az);
+        packLoadVec3(b + i, bx, by, bz);
+        packStore(dst + i, packMadd(az, bz, packMadd(ay, by, packMul(ax, bx))));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = a[i].x * b[i].x + a[i].y * b[i].y + a[i].z * b[i].z;
+}
+
+void Vec3Batch::Cross(const Vec3 *a, const Vec3 *b, Vec3 *dst, unsigned int count)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH)
+    {
+        simdPack ax, ay, az, bx, by, bz;
+        packLoadVec3(a + i, ax, ay, az);
+        packLoadVec3(b + i, bx, by, bz);
+        packStoreVec3(dst + i, packSub(packMul(ay, bz), packMul(az, by)),
+                      packSub(packMul(az, bx), packMul(ax, bz)),
+                      packSub(packMul(ax, by), packMul(ay, bx)));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = Vec3(a[i].y * b[i].z - a[i].z * b[i].y, a[i].z * b[i].x - a[i].x * b[i].z, a[i].x * b[i].y - a[i].y * b[i].x);
+}
+
+void Vec3Batch::Expand(const Vec3 *points, unsigned int count, Vec3 &min, Vec3 &max)
+{
+    unsigned int i = 0;
+#if defined(MATH_SSE)
+    if (count >= 4)
+    {
+        // running min/max in the interleaved layout, folded back to x y z at the end
+        __m128 lo0, lo1, lo2, hi0, hi1, hi2;
+        packOffsetPattern(min, lo0, lo1, lo2);
+        packOffsetPattern(max, hi0, hi1, hi2);
+        for (; i + 4 <= count; i += 4)
+        {
+            const float *p = &points[i].x;
+            const __m128 a = _mm_loadu_ps(p);
+            const __m128 b = _mm_loadu_ps(p + 4);
+            const __m128 c = _mm_loadu_ps(p + 8);
+            lo0 = _mm_min_ps(lo0, a);
+            lo1 = _mm_min_ps(lo1, b);
+            lo2 = _mm_min_ps(lo2, c);
+            hi0 = _mm_max_ps(hi0, a);
+            hi1 = _mm_max_ps(hi1, b);
+            hi2 = _mm_max_ps(hi2, c);
+        }
+
+        float lo[12], hi[12];
+        _mm_storeu_ps(lo, lo0);
+        _mm_storeu_ps(lo + 4, lo1);
+        _mm_storeu_ps(lo + 8, lo2);
+        _mm_storeu_ps(hi, hi0);
+        _mm_storeu_ps(hi + 4, hi1);
+        _mm_storeu_ps(hi + 8, hi2);
+        for (int k = 0; k < 12; k += 3)
+        {
+            min.set(Min(min.x, lo[k]), Min(min.y, lo[k + 1]), Min(min.z, lo[k + 2]));
+            max.set(Max(max.x, hi[k]), Max(max.y, hi[k + 1]), Max(max.z, hi[k + 2]));
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        const Vec3 &p = points[i];
+        min.set(Min(min.x, p.x), Min(min.y, p.y), Min(min.z, p.z));
+        max.set(Max(max.x, p.x), Max(max.y, p.y), Max(max.z, p.z));
+    }
+}
+
+//***************************************************************************************************************
+//                                              FAST MATH
+//***************************************************************************************************************
+
+// The inline scalar version is branch free, the compiler turns this loop into
+// SIMD (select / blend for the octant logic) at -O3.
+void FastSinCosRad(const float *angles, float *sines, float *cosines, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+        FastSinCosRad(angles[i], sines[i], cosines[i]);
+}
+
+//***************************************************************************************************************
+//                                              CIRCLE TABLE
+//***************************************************************************************************************
+
+// evaluated by the compiler, lands in .rodata
+constexpr CircleTable<CIRCLE_TABLE_STEPS> CircleTableData = MakeCircleTable<CIRCLE_TABLE_STEPS>();
+
+static_assert(CircleTableData.sin[0] == 0.0f && CircleTableData.cos[0] == 1.0f, "circle table origin");
+static_assert(CircleTableData.sin[CIRCLE_TABLE_STEPS / 4] == 1.0f && CircleTableData.cos[CIRCLE_TABLE_STEPS / 4] == 0.0f, "circle table quarter turn");
+static_assert(CircleTableData.sin[CIRCLE_TABLE_STEPS / 2] == 0.0f && CircleTableData.cos[CIRCLE_TABLE_STEPS / 2] == -1.0f, "circle table half turn");
+static_assert(CircleTableData.sin[CIRCLE_TABLE_STEPS / 12] == 0.5f, "circle table 30 degrees");
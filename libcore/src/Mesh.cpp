@@ -1,7 +1,127 @@
 #include "Mesh.hpp"
+#include <cstddef>
 
 
-MeshBuffer::MeshBuffer() : vbo(0), ebo(0), vao(0), vertexCount(0), indexCount(0)
+// the attribute offsets in BindAttributes follow this layout
+static_assert(sizeof(InstanceTRS) == 44, "InstanceTRS must stay tightly packed");
+
+InstanceBuffer::InstanceBuffer() : vbo(0), capacity(0), count(0), mappedCount(0), stride(0), format(INSTANCE_MATRIX), mapped(false)
+{
+}
+
+bool InstanceBuffer::Create(InstanceFormat format, u32 maxInstances)
+{
+    if (maxInstances == 0)
+    {
+        Utils::LogError("InstanceBuffer: empty capacity");
+        return false;
+    }
+    Release();
+
+    this->format = format;
+    stride = format == INSTANCE_MATRIX ? (u32)sizeof(Mat4) : (u32)sizeof(InstanceTRS);
+    capacity = maxInstances;
+    glGenBuffers(1, &vbo);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)capacity * stride, nullptr, GL_STREAM_DRAW);
+    return true;
+}
+
+void InstanceBuffer::Release()
+{
+    Driver::Instance().DeleteBuffer(vbo);
+    vbo = 0;
+    capacity = 0;
+    count = 0;
+    mappedCount = 0;
+    mapped = false;
+}
+
+void InstanceBuffer::Update(const void *instances, u32 count)
+{
+    if (vbo == 0)
+        return;
+    if (count > capacity)
+    {
+        Utils::LogWarning("InstanceBuffer: %u instances, capacity %u", count, capacity);
+        count = capacity;
+    }
+    this->count = count;
+
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)capacity * stride, nullptr, GL_STREAM_DRAW);
+    if (count > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)count * stride, instances);
+}
+
+void *InstanceBuffer::Map(u32 count)
+{
+    if (vbo == 0 || mapped || count == 0)
+        return nullptr;
+    if (count > capacity)
+    {
+        Utils::LogWarning("InstanceBuffer: %u instances, capacity %u", count, capacity);
+        count = capacity;
+    }
+
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    void *data = glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)count * stride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!data)
+        return nullptr;
+    mappedCount = count;
+    mapped = true;
+    return data;
+}
+
+void InstanceBuffer::Unmap(u32 written)
+{
+    if (!mapped)
+        return;
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    // the invalidated storage holds only what was written this time
+    count = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE ? Min(written, mappedCount) : 0;
+    mapped = false;
+}
+
+void InstanceBuffer::BindAttributes() const
+{
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (format == INSTANCE_MATRIX)
+    {
+        // rows of the row major Mat4 become the columns GLSL expects
+        for (u32 i = 0; i < 4; ++i)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + i);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, stride, (void *)(i * 4 * sizeof(float)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE + i, 1);
+        }
+    }
+    else
+    {
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(InstanceTRS, position));
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + 1);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE + 1, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(InstanceTRS, rotation));
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + 2);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE + 2, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(InstanceTRS, scale));
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + 3);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE + 3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(InstanceTRS, color));
+        for (u32 i = 0; i < 4; ++i)
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE + i, 1);
+    }
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::UnbindAttributes()
+{
+    for (u32 i = 0; i < 4; ++i)
+    {
+        glDisableVertexAttribArray(INSTANCE_ATTRIBUTE + i);
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE + i, 0);
+    }
+}
+
+MeshBuffer::MeshBuffer() : vbo(0), ebo(0), vao(0), vertexCount(0), indexCount(0), instances(nullptr)
 {
 }
 
@@ -12,23 +132,23 @@ void MeshBuffer::Init()
 
 void MeshBuffer::Release()
 {
-    glDeleteVertexArrays(1, &vao);
+    Driver::Instance().DeleteVertexArray(vao);
     if (vbo != 0)
-        glDeleteBuffers(1, &vbo);
+        Driver::Instance().DeleteBuffer(vbo);
     if (ebo != 0)
-        glDeleteBuffers(1, &ebo);
+        Driver::Instance().DeleteBuffer(ebo);
 }
 
 void MeshBuffer::Bind()
 {
     if (vao == 0)
         Init();
-    glBindVertexArray(vao);
+    Driver::Instance().BindVertexArray(vao);
 }
 
 void MeshBuffer::UnBind()
 {
-    glBindVertexArray(0);
+    Driver::Instance().BindVertexArray(0);
 }
 
 void MeshBuffer::SetVertexData(const float *vertices, u32 count, const std::vector<GLint> &attribSizes, bool dynamic)
@@ -38,7 +158,7 @@ void MeshBuffer::SetVertexData(const float *vertices, u32 count, const std::vect
     if (vbo == 0)
         glGenBuffers(1, &vbo);
     Bind();
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), vertices, dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
     size_t stride = 0;
     size_t offset = 0;
@@ -52,7 +172,7 @@ void MeshBuffer::SetVertexData(const float *vertices, u32 count, const std::vect
         glVertexAttribPointer(i, attribSizes[i], GL_FLOAT, GL_FALSE, stride, (void *)offset);
         offset += attribSizes[i] * sizeof(float);
     }
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void MeshBuffer::UpdateVertexData(const float *vertices, u32 count)
@@ -60,16 +180,27 @@ void MeshBuffer::UpdateVertexData(const float *vertices, u32 count)
     vertexCount = count;
     if (vbo == 0)
         glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float), vertices);
 }
 
+void MeshBuffer::UpdateVertexData(const float *vertices, u32 offset, u32 count)
+{
+    if (vbo == 0 || offset + count > vertexCount)
+        return;
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(float), count * sizeof(float), vertices + offset);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void MeshBuffer::UpdateIndexData(const u32 *indices, u32 count)
 {
     indexCount = count;
     if (ebo == 0)
         glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    // the element binding is VAO state, never touch another mesh's
+    Bind();
+    Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, count * sizeof(u32), indices);
 }
 
@@ -78,7 +209,8 @@ void MeshBuffer::SetIndexData(const u32 *indices, u32 count, bool dynamic)
     indexCount = count;
     if (ebo == 0)
         glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    Bind();
+    Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(u32), indices, dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
 }
 
@@ -89,7 +221,40 @@ void MeshBuffer::Render(int mode)
         Driver::Instance().DrawArrays(mode, 0, vertexCount);
     else
         Driver::Instance().DrawElements(mode, indexCount, GL_UNSIGNED_INT, 0);
-    UnBind();
+}
+
+void MeshBuffer::SetInstances(const InstanceBuffer *buffer)
+{
+    const bool attached = instances != nullptr;
+    instances = buffer;
+    if (!buffer)
+    {
+        if (attached)
+        {
+            Bind();
+            InstanceBuffer::UnbindAttributes();
+        }
+        return;
+    }
+    Bind();
+    buffer->BindAttributes();
+}
+
+void MeshBuffer::RenderInstanced(int mode, u32 instanceCount)
+{
+    if (instanceCount == 0)
+        return;
+    Bind();
+    if (indexCount == 0)
+        Driver::Instance().DrawArraysInstanced(mode, 0, vertexCount, instanceCount);
+    else
+        Driver::Instance().DrawElementsInstanced(mode, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+}
+
+void MeshBuffer::RenderInstanced(int mode)
+{
+    if (instances)
+        RenderInstanced(mode, instances->GetCount());
 }
 
 Mesh::Mesh(bool dynamic, bool facesDynamic) : isDynamic(dynamic), isFacesDynamic(facesDynamic), isInitialized(false)
@@ -101,6 +266,9 @@ Mesh::Mesh(bool dynamic, bool facesDynamic) : isDynamic(dynamic), isFacesDynamic
     VBO[2] = 0;
     VBO[3] = 0;
     VBO[4] = 0;
+    VBO[5] = 0;
+    VBO[6] = 0;
+    instances = nullptr;
     flags = 1 | 2 | 4 | 8 | 16 | 32;
     material = 0;
 }
@@ -123,23 +291,23 @@ void Mesh::Release()
 {
 
     if (VAO != 0)
-        glDeleteVertexArrays(1, &VAO);
+        Driver::Instance().DeleteVertexArray(VAO);
     if (VBO[0] != 0)
-        glDeleteBuffers(1, &VBO[0]);
+        Driver::Instance().DeleteBuffer(VBO[0]);
     if (VBO[1] != 0)
-        glDeleteBuffers(1, &VBO[1]);
+        Driver::Instance().DeleteBuffer(VBO[1]);
     if (VBO[2] != 0)
-        glDeleteBuffers(1, &VBO[2]);
+        Driver::Instance().DeleteBuffer(VBO[2]);
     if (VBO[3] != 0)
-        glDeleteBuffers(1, &VBO[3]);
+        Driver::Instance().DeleteBuffer(VBO[3]);
     if (VBO[4] != 0)
-        glDeleteBuffers(1, &VBO[4]);
+        Driver::Instance().DeleteBuffer(VBO[4]);
     if (VBO[5] != 0)
-        glDeleteBuffers(1, &VBO[5]);
+        Driver::Instance().DeleteBuffer(VBO[5]);
     if (VBO[6] != 0)
-        glDeleteBuffers(1, &VBO[6]);
+        Driver::Instance().DeleteBuffer(VBO[6]);
     if (EBO != 0)
-        glDeleteBuffers(1, &EBO);
+        Driver::Instance().DeleteBuffer(EBO);
 }
 
 void Mesh::Init()
@@ -178,16 +346,16 @@ void Mesh::Init()
     GLenum usage = isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
     GLenum indexUsage = isFacesDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
 
-    glBindVertexArray(VAO);
+    Driver::Instance().BindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[0]);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vec3), vertices.data(), usage);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(0);
 
     if (texcoords.size() > 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[1]);
         glBufferData(GL_ARRAY_BUFFER, texcoords.size() * sizeof(Vec2), texcoords.data(), usage);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(1);
@@ -195,7 +363,7 @@ void Mesh::Init()
 
     if (normals.size() > 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[2]);
         glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(Vec3), normals.data(), usage);
         glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(2);
@@ -203,7 +371,7 @@ void Mesh::Init()
 
     if (tangents.size() > 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[3]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[3]);
         glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(Vec3), tangents.data(), usage);
         glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(3);
@@ -211,7 +379,7 @@ void Mesh::Init()
 
     if (bitangents.size() > 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[4]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[4]);
         glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(Vec3), bitangents.data(), usage);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(4);
@@ -219,13 +387,13 @@ void Mesh::Init()
 
     if (indices.size() > 0)
     {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u32), indices.data(), indexUsage);
     }
 
     if (weights.size() > 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[5]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[5]);
         glBufferData(GL_ARRAY_BUFFER, weights.size() * sizeof(Vec4), weights.data(), usage);
         glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(5);
@@ -233,15 +401,15 @@ void Mesh::Init()
 
     if (joints.size() > 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[6]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[6]);
         glBufferData(GL_ARRAY_BUFFER, joints.size() * sizeof(Vec4), joints.data(), usage);
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(6);
     }
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    Driver::Instance().BindVertexArray(0);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+    Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 void Mesh::Update()
@@ -256,28 +424,28 @@ void Mesh::Update()
     {
         if (vertices.size() > 0 && (flags & 1))
         {
-            glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+            Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[0]);
             glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vec3), vertices.data());
             flags &= ~1;
         }
 
         if (texcoords.size() > 0 && (flags & 2))
         {
-            glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
+            Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[1]);
             glBufferSubData(GL_ARRAY_BUFFER, 0, texcoords.size() * sizeof(Vec2), texcoords.data());
             flags &= ~2;
         }
 
         if (normals.size() > 0 && (flags & 4))
         {
-            glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
+            Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[2]);
             glBufferSubData(GL_ARRAY_BUFFER, 0, normals.size() * sizeof(Vec3), normals.data());
             flags &= ~4;
         }
 
         if (tangents.size() > 0 && (flags & 8))
         {
-            glBindBuffer(GL_ARRAY_BUFFER, VBO[3]);
+            Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[3]);
             glBufferSubData(GL_ARRAY_BUFFER, 0, tangents.size() * sizeof(Vec3), tangents.data());
 
             flags &= ~8;
@@ -285,7 +453,7 @@ void Mesh::Update()
 
         if (bitangents.size() > 0 && (flags & 16))
         {
-            glBindBuffer(GL_ARRAY_BUFFER, VBO[4]);
+            Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[4]);
             glBufferSubData(GL_ARRAY_BUFFER, 0, bitangents.size() * sizeof(Vec3), bitangents.data());
 
             flags &= ~16;
@@ -294,7 +462,7 @@ void Mesh::Update()
 
     if (weights.size() > 0 && (flags & 64))
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[5]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[5]);
         glBufferSubData(GL_ARRAY_BUFFER, 0, weights.size() * sizeof(Vec4), weights.data());
 
         flags &= ~64;
@@ -302,7 +470,7 @@ void Mesh::Update()
 
     if (joints.size() > 0 && (flags & 128))
     {
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[6]);
+        Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO[6]);
         glBufferSubData(GL_ARRAY_BUFFER, 0, joints.size() * sizeof(Vec4), joints.data());
 
         flags &= ~128;
@@ -312,7 +480,8 @@ void Mesh::Update()
     {
         if (indices.size() > 0 && (flags & 32))
         {
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            Driver::Instance().BindVertexArray(VAO);
+            Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
             glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(u32), indices.data());
 
             flags &= ~32;
@@ -329,19 +498,63 @@ void Mesh::Render(u32 mode, u32 start, u32 count)
     {
         Update();
     }
-    glBindVertexArray(VAO);
+    Driver::Instance().BindVertexArray(VAO);
 
     if (indices.size() > 0)
     {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         Driver::Instance().DrawElements(mode, count, GL_UNSIGNED_INT, (void *)(start * sizeof(u32)));
     }
     else
     {
         Driver::Instance().DrawArrays(mode, start, count);
     }
+}
+
+void Mesh::SetInstances(const InstanceBuffer *buffer)
+{
+    const bool attached = instances != nullptr;
+    instances = buffer;
+    if (!buffer)
+    {
+        if (attached && isInitialized)
+        {
+            Driver::Instance().BindVertexArray(VAO);
+            InstanceBuffer::UnbindAttributes();
+        }
+        return;
+    }
+    if (!isInitialized)
+        Init();
+    Driver::Instance().BindVertexArray(VAO);
+    buffer->BindAttributes();
+}
+
+void Mesh::RenderInstanced(u32 mode, u32 instanceCount)
+{
+    if (instanceCount == 0)
+        return;
+    if (!isInitialized)
+        Init();
+    if (NeedsUpdate())
+        Update();
+    Driver::Instance().BindVertexArray(VAO);
+
+    if (indices.size() > 0)
+    {
+        Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        Driver::Instance().DrawElementsInstanced(mode, (int)indices.size(), GL_UNSIGNED_INT, (void *)0, instanceCount);
+    }
+    else
+    {
+        Driver::Instance().DrawArraysInstanced(mode, 0, (int)vertices.size(), instanceCount);
+    }
+}
 
-    glBindVertexArray(0);
+void Mesh::RenderInstanced(u32 mode)
+{
+    if (instances)
+        RenderInstanced(mode, instances->GetCount());
 }
 
 void Mesh::Render(u32 mode, u32 count)
@@ -385,36 +598,11 @@ void Mesh::AddMesh(Mesh *mesh)
 
     u8 flags = 0;
 
-    if (!mesh->vertices.empty())
-    {
-        for (u32 i = 0; i < mesh->vertices.size(); i++)
-        {
-            Vec3 vertex = mesh->vertices[i];
-            vertices.push_back(vertex);
-            if (!mesh->texcoords.empty())
-            {
-                Vec2 texcoord = mesh->texcoords[i];
-                texcoords.push_back(texcoord);
-            }
-            if (!mesh->normals.empty())
-            {
-                Vec3 normal = mesh->normals[i];
-                normals.push_back(normal);
-            }
-            if (!mesh->tangents.empty())
-            {
-                Vec3 tangent = mesh->tangents[i];
-                tangents.push_back(tangent);
-            }
-            if (!mesh->bitangents.empty())
-            {
-                Vec3 bitangent = mesh->bitangents[i];
-                bitangents.push_back(bitangent);
-            }
-           
-        }
-    
-    }
+    vertices.insert(vertices.end(), mesh->vertices.begin(), mesh->vertices.end());
+    texcoords.insert(texcoords.end(), mesh->texcoords.begin(), mesh->texcoords.end());
+    normals.insert(normals.end(), mesh->normals.begin(), mesh->normals.end());
+    tangents.insert(tangents.end(), mesh->tangents.begin(), mesh->tangents.end());
+    bitangents.insert(bitangents.end(), mesh->bitangents.begin(), mesh->bitangents.end());
 
     flags |= POSITION;
     if (!mesh->texcoords.empty())
@@ -428,6 +616,7 @@ void Mesh::AddMesh(Mesh *mesh)
 
     if (!mesh->indices.empty())
     {
+        indices.reserve(indices.size() + mesh->indices.size());
         for (u32 index : mesh->indices)
         {
             indices.push_back(index + offset);
@@ -438,6 +627,19 @@ void Mesh::AddMesh(Mesh *mesh)
     SetFlag(flags);
 } 
 
+// appends src to dst and runs the batch transform over the new range only
+static void appendTransformed(std::vector<Vec3> &dst, const std::vector<Vec3> &src, const Mat4 &transform, bool points)
+{
+    if (src.empty())
+        return;
+    size_t start = dst.size();
+    dst.resize(start + src.size());
+    if (points)
+        Vec3Batch::TransformPoints(transform, src.data(), dst.data() + start, src.size());
+    else
+        Vec3Batch::TransformNormals(transform, src.data(), dst.data() + start, src.size());
+}
+
 void Mesh::AddMesh(Mesh *mesh, const Mat4 &transform)
 {
 
@@ -448,40 +650,11 @@ void Mesh::AddMesh(Mesh *mesh, const Mat4 &transform)
 
     u8 flags = 0;
 
-    if (!mesh->vertices.empty())
-    {
-        for (u32 i = 0; i < mesh->vertices.size(); i++)
-        {
-            Vec3 vertex = mesh->vertices[i];
-            transform.transformPoint(vertex);
-            vertices.push_back(vertex);
-            if (!mesh->texcoords.empty())
-            {
-                Vec2 texcoord = mesh->texcoords[i];
-                texcoords.push_back(texcoord);
-            }
-            if (!mesh->normals.empty())
-            {
-                Vec3 normal = mesh->normals[i];
-                transform.transformNormal(normal);
-                normals.push_back(normal);
-            }
-            if (!mesh->tangents.empty())
-            {
-                Vec3 tangent = mesh->tangents[i];
-                transform.transformNormal(tangent);
-                tangents.push_back(tangent);
-            }
-            if (!mesh->bitangents.empty())
-            {
-                Vec3 bitangent = mesh->bitangents[i];
-                transform.transformNormal(bitangent);
-                bitangents.push_back(bitangent);
-            }
-           
-        }
-    
-    }
+    appendTransformed(vertices, mesh->vertices, transform, true);
+    texcoords.insert(texcoords.end(), mesh->texcoords.begin(), mesh->texcoords.end());
+    appendTransformed(normals, mesh->normals, transform, false);
+    appendTransformed(tangents, mesh->tangents, transform, false);
+    appendTransformed(bitangents, mesh->bitangents, transform, false);
 
     flags |= POSITION;
     if (!mesh->texcoords.empty())
@@ -495,6 +668,7 @@ void Mesh::AddMesh(Mesh *mesh, const Mat4 &transform)
 
     if (!mesh->indices.empty())
     {
+        indices.reserve(indices.size() + mesh->indices.size());
         for (u32 index : mesh->indices)
         {
             indices.push_back(index + offset);
@@ -505,6 +679,182 @@ void Mesh::AddMesh(Mesh *mesh, const Mat4 &transform)
     SetFlag(flags);
 }
 
+//***************************************************************************************************************
+//  MESH ARENA
+//***************************************************************************************************************
+
+MeshArena::MeshArena() : vao(0), vbo(0), ebo(0), indirectBuffer(0), drawBuffer(0), vertexCapacity(0), indexCapacity(0), drawCapacity(0),
+                         vertexCount(0), indexCount(0), culled(0)
+{
+}
+
+bool MeshArena::Create(u32 maxVertices, u32 maxIndices, u32 maxDraws)
+{
+    if (maxVertices == 0 || maxIndices == 0 || maxDraws == 0)
+    {
+        Utils::LogError("MeshArena: empty capacity");
+        return false;
+    }
+    Release();
+
+    vertexCapacity = maxVertices;
+    indexCapacity = maxIndices;
+    drawCapacity = maxDraws;
+    commands.reserve(maxDraws);
+    draws.reserve(maxDraws);
+
+    Driver &driver = Driver::Instance();
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    glGenBuffers(1, &indirectBuffer);
+    glGenBuffers(1, &drawBuffer);
+
+    driver.BindVertexArray(vao);
+    driver.BindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)maxVertices * sizeof(ArenaVertex), nullptr, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void *)offsetof(ArenaVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void *)offsetof(ArenaVertex, texcoord));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void *)offsetof(ArenaVertex, normal));
+    driver.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)maxIndices * sizeof(u32), nullptr, GL_STATIC_DRAW);
+
+    driver.BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)maxDraws * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+    driver.BindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)maxDraws * sizeof(ObjectConstants), nullptr, GL_STREAM_DRAW);
+    return true;
+}
+
+void MeshArena::Release()
+{
+    Driver &driver = Driver::Instance();
+    driver.DeleteVertexArray(vao);
+    driver.DeleteBuffer(vbo);
+    driver.DeleteBuffer(ebo);
+    driver.DeleteBuffer(indirectBuffer);
+    driver.DeleteBuffer(drawBuffer);
+    vao = vbo = ebo = indirectBuffer = drawBuffer = 0;
+    vertexCount = indexCount = 0;
+    ranges.clear();
+    commands.clear();
+    draws.clear();
+}
+
+int MeshArena::Add(const Mesh *mesh)
+{
+    if (vao == 0 || !mesh || mesh->vertices.empty())
+        return -1;
+
+    const u32 meshVertices = (u32)mesh->vertices.size();
+    const u32 meshIndices = mesh->indices.empty() ? meshVertices : (u32)mesh->indices.size();
+    if (vertexCount + meshVertices > vertexCapacity || indexCount + meshIndices > indexCapacity)
+    {
+        Utils::LogError("MeshArena: full (%u vertices, %u indices)", vertexCapacity, indexCapacity);
+        return -1;
+    }
+
+    std::vector<ArenaVertex> packed(meshVertices);
+    const bool hasTexcoords = mesh->texcoords.size() >= meshVertices;
+    const bool hasNormals = mesh->normals.size() >= meshVertices;
+    Range range;
+    range.bounds.reset(mesh->vertices[0]);
+    for (u32 i = 0; i < meshVertices; ++i)
+    {
+        packed[i].position = mesh->vertices[i];
+        packed[i].texcoord = hasTexcoords ? mesh->texcoords[i] : Vec2(0.0f, 0.0f);
+        packed[i].normal = hasNormals ? mesh->normals[i] : Vec3(0.0f, 1.0f, 0.0f);
+        range.bounds.expand(mesh->vertices[i]);
+    }
+
+    // indices stay mesh local, baseVertex offsets them at draw time
+    std::vector<u32> sequential;
+    const u32 *indices = mesh->indices.data();
+    if (mesh->indices.empty())
+    {
+        sequential.resize(meshVertices);
+        for (u32 i = 0; i < meshVertices; ++i)
+            sequential[i] = i;
+        indices = sequential.data();
+    }
+
+    Driver &driver = Driver::Instance();
+    driver.BindVertexArray(vao);
+    driver.BindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)vertexCount * sizeof(ArenaVertex), (GLsizeiptr)meshVertices * sizeof(ArenaVertex), packed.data());
+    driver.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)indexCount * sizeof(u32), (GLsizeiptr)meshIndices * sizeof(u32), indices);
+
+    range.firstIndex = indexCount;
+    range.indexCount = meshIndices;
+    range.baseVertex = (s32)vertexCount;
+    ranges.push_back(range);
+    vertexCount += meshVertices;
+    indexCount += meshIndices;
+    return (int)ranges.size() - 1;
+}
+
+void MeshArena::Begin()
+{
+    commands.clear();
+    draws.clear();
+    culled = 0;
+}
+
+bool MeshArena::Draw(int handle, const Mat4 &model, const Vec4 &color, bool cull)
+{
+    if (handle < 0 || handle >= (int)ranges.size() || commands.size() >= drawCapacity)
+        return false;
+
+    Range &range = ranges[handle];
+    if (cull)
+    {
+        BoundingBox world;
+        range.bounds.transform(world, model);
+        if (!Driver::Instance().IsInFrustum(world))
+        {
+            culled++;
+            return false;
+        }
+    }
+
+    DrawElementsIndirectCommand command;
+    command.count = range.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = 0;
+    commands.push_back(command);
+
+    ObjectConstants constants;
+    constants.model = model;
+    constants.color = color;
+    draws.push_back(constants);
+    return true;
+}
+
+void MeshArena::Render(u32 mode)
+{
+    if (commands.empty())
+        return;
+
+    // orphan last frame's lists so the upload does not wait on the GPU
+    Driver &driver = Driver::Instance();
+    driver.BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)drawCapacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, (GLsizeiptr)commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+    driver.BindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)drawCapacity * sizeof(ObjectConstants), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)draws.size() * sizeof(ObjectConstants), draws.data());
+    driver.BindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BLOCK_BINDING, drawBuffer);
+
+    driver.BindVertexArray(vao);
+    driver.MultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr, commands.data(), (int)commands.size());
+}
+
 MeshManager *MeshManager::instance = nullptr;
 
 MeshManager *MeshManager::InstancePtr()
@@ -576,10 +926,7 @@ void MeshManager::CalculateNormals(Mesh *mesh)
         mesh->normals[index2] += normal;
     }
 
-    for (Vec3 &normal : mesh->normals)
-    {
-        normal.normalize();
-    }
+    Vec3Batch::Normalize(mesh->normals.data(), mesh->normals.data(), mesh->normals.size());
     mesh->SetFlag(NORMAL);
 }
 
@@ -654,25 +1001,12 @@ void MeshManager::GetBoundingBox(Mesh *mesh, Vec3 &min, Vec3 &max)
     max.x = -1000000000;
     max.y = -1000000000;
     max.z = -1000000000;
-    for (Vec3 &vertex : mesh->vertices)
-    {
-        min.x = Min(min.x, vertex.x);
-        min.y = Min(min.y, vertex.y);
-        min.z = Min(min.z, vertex.z);
-        max.x = Max(max.x, vertex.x);
-        max.y = Max(max.y, vertex.y);
-        max.z = Max(max.z, vertex.z);
-    }
+    Vec3Batch::Expand(mesh->vertices.data(), mesh->vertices.size(), min, max);
 }
 
 void MeshManager::TranslateMesh(Mesh *mesh, float x, float y, float z)
 {
-    for (Vec3 &vertex : mesh->vertices)
-    {
-        vertex.x += x;
-        vertex.y += y;
-        vertex.z += z;
-    }
+    Vec3Batch::Translate(mesh->vertices.data(), mesh->vertices.size(), Vec3(x, y, z));
 
     mesh->SetFlag(POSITION);
 
@@ -680,12 +1014,7 @@ void MeshManager::TranslateMesh(Mesh *mesh, float x, float y, float z)
 
 void MeshManager::ScaleMesh(Mesh *mesh, float x, float y, float z)
 {
-    for (Vec3 &vertex : mesh->vertices)
-    {
-        vertex.x *= x;
-        vertex.y *= y;
-        vertex.z *= z;
-    }
+    Vec3Batch::Scale(mesh->vertices.data(), mesh->vertices.size(), Vec3(x, y, z));
 
     mesh->SetFlag(POSITION);    
 }
@@ -700,33 +1029,25 @@ void MeshManager::RotateMesh(Mesh *mesh, const Vec3 &axis,float angle)
 
     u8 flags = 0;
 
-    for (u32 i = 0; i < mesh->vertices.size(); i++)
+    if (!mesh->vertices.empty())
     {
-        Vec3 vertex = mesh->vertices[i];
+        Vec3Batch::TransformPoints(rotationMatrix, mesh->vertices.data(), mesh->vertices.data(), mesh->vertices.size());
         flags |= POSITION;
-        if (!mesh->normals.empty())
-        {
-            Vec3 normal = mesh->normals[i];
-            rotationMatrix.transformNormal(normal);
-            mesh->normals[i] = normal;
-            flags |= NORMAL;
-        }
-        if (!mesh->tangents.empty())
-        {
-            Vec3 tangent = mesh->tangents[i];
-            rotationMatrix.transformNormal(tangent);
-            mesh->tangents[i] = tangent;
-            flags |= TANGENT;
-        }
-        if (!mesh->bitangents.empty())
-        {
-            Vec3 bitangent = mesh->bitangents[i];
-            rotationMatrix.transformNormal(bitangent);
-            mesh->bitangents[i] = bitangent;
-            flags |= BITANGENT;
-        }
-        rotationMatrix.transformPoint(vertex);
-        mesh->vertices[i] = vertex;
+    }
+    if (!mesh->normals.empty())
+    {
+        Vec3Batch::TransformNormals(rotationMatrix, mesh->normals.data(), mesh->normals.data(), mesh->normals.size());
+        flags |= NORMAL;
+    }
+    if (!mesh->tangents.empty())
+    {
+        Vec3Batch::TransformNormals(rotationMatrix, mesh->tangents.data(), mesh->tangents.data(), mesh->tangents.size());
+        flags |= TANGENT;
+    }
+    if (!mesh->bitangents.empty())
+    {
+        Vec3Batch::TransformNormals(rotationMatrix, mesh->bitangents.data(), mesh->bitangents.data(), mesh->bitangents.size());
+        flags |= BITANGENT;
     }
 
     mesh->SetFlag(flags);
@@ -1011,18 +1332,16 @@ Mesh *MeshManager::CreateSphere(float diameter, int rows, int columns)
 
     float radius = diameter / 2.0f;
 
-    float fSegY = Pi / rows;       // Segmento de latitude
-    float fSegX = TwoPi / columns; // Segmento de longitude
-
     for (int j = 0; j <= rows; ++j)
     {
-        float fSY = SinRad(fSegY * j);
-        float fCY = CosRad(fSegY * j);
+        float fSY, fCY;
+        CircleSinCos(j, 2 * rows, fSY, fCY);
 
         for (int i = 0; i <= columns; ++i)
         {
-            float fSX = SinRad(-fSegX * i);
-            float fCX = CosRad(-fSegX * i);
+            float fSX, fCX;
+            CircleSinCos(i, columns, fSX, fCX);
+            fSX = -fSX;
 
             Vec3 vertex(
                 fSX * fSY * radius, // x
@@ -1032,7 +1351,7 @@ Mesh *MeshManager::CreateSphere(float diameter, int rows, int columns)
             mesh->vertices.push_back(vertex);
 
             Vec3 normal = vertex / radius;
-            normal.normalize();
+            normal.normalizeFast();
             mesh->normals.push_back(normal);
 
             float u = 1.0f - (float)i / columns;
@@ -1107,7 +1426,13 @@ Mesh *MeshManager::CreateCone(float height, float diameter, int segments)
     mesh->texcoords.reserve(vertexCount);
     mesh->indices.reserve(indexCount);
 
-    float segmentAngle = TwoPi / segments;
+    // rim directions, (sin, cos) of -2pi * i / segments
+    std::vector<Vec2> rim(segments);
+    for (int i = 0; i < segments; i++)
+    {
+        CircleSinCos(i, segments, rim[i].x, rim[i].y);
+        rim[i].x = -rim[i].x;
+    }
 
     for (int i = 0; i < segments; i++)
     {
@@ -1119,31 +1444,31 @@ Mesh *MeshManager::CreateCone(float height, float diameter, int segments)
         mesh->texcoords.push_back(Vec2(0.5f, 0.5f));
 
         mesh->vertices.push_back(Vec3(
-            SinRad(-segmentAngle * i) * radius,
+            rim[i].x * radius,
             -height / 2.0f,
-            CosRad(-segmentAngle * i) * radius));
+            rim[i].y * radius));
         mesh->normals.push_back(Vec3(
-                                    SinRad(-segmentAngle * i),
+                                    rim[i].x,
                                     radius / height,
-                                    CosRad(-segmentAngle * i))
+                                    rim[i].y)
                                     .normalize());
-        float u = SinRad(-segmentAngle * i) * 0.5f + 0.5f;
-        float v = CosRad(-segmentAngle * i) * 0.5f + 0.5f;
+        float u = rim[i].x * 0.5f + 0.5f;
+        float v = rim[i].y * 0.5f + 0.5f;
 
         mesh->texcoords.push_back(Vec2(u, v));
 
         mesh->vertices.push_back(Vec3(
-            SinRad(-segmentAngle * next) * radius,
+            rim[next].x * radius,
             -height / 2.0f,
-            CosRad(-segmentAngle * next) * radius));
+            rim[next].y * radius));
         mesh->normals.push_back(Vec3(
-                                    SinRad(-segmentAngle * next),
+                                    rim[next].x,
                                     radius / height,
-                                    CosRad(-segmentAngle * next))
+                                    rim[next].y)
                                     .normalize());
 
-        u = SinRad(-segmentAngle * next) * 0.5f + 0.5f;
-        v = CosRad(-segmentAngle * next) * 0.5f + 0.5f;
+        u = rim[next].x * 0.5f + 0.5f;
+        v = rim[next].y * 0.5f + 0.5f;
 
         mesh->texcoords.push_back(Vec2(u, v));
 
@@ -1158,13 +1483,13 @@ Mesh *MeshManager::CreateCone(float height, float diameter, int segments)
         int next = (i + 1) % segments;
 
         mesh->vertices.push_back(Vec3(
-            SinRad(-segmentAngle * i) * radius,
+            rim[i].x * radius,
             -height / 2.0f,
-            CosRad(-segmentAngle * i) * radius));
+            rim[i].y * radius));
         mesh->normals.push_back(Vec3(0.0f, -1.0f, 0.0f));
 
-        float u = SinRad(-segmentAngle * i) * 0.5f + 0.5f;
-        float v = CosRad(-segmentAngle * i) * 0.5f + 0.5f;
+        float u = rim[i].x * 0.5f + 0.5f;
+        float v = rim[i].y * 0.5f + 0.5f;
 
         mesh->texcoords.push_back(Vec2(v, u));
 
@@ -1173,13 +1498,13 @@ Mesh *MeshManager::CreateCone(float height, float diameter, int segments)
         mesh->texcoords.push_back(Vec2(0.5f, 0.5f));
 
         mesh->vertices.push_back(Vec3(
-            SinRad(-segmentAngle * next) * radius,
+            rim[next].x * radius,
             -height / 2.0f,
-            CosRad(-segmentAngle * next) * radius));
+            rim[next].y * radius));
         mesh->normals.push_back(Vec3(0.0f, -1.0f, 0.0f));
 
-        u = SinRad(-segmentAngle * next) * 0.5f + 0.5f;
-        v = CosRad(-segmentAngle * next) * 0.5f + 0.5f;
+        u = rim[next].x * 0.5f + 0.5f;
+        v = rim[next].y * 0.5f + 0.5f;
 
         mesh->texcoords.push_back(Vec2(v, u));
 
@@ -1212,7 +1537,13 @@ Mesh *MeshManager::CreateCylinder(float height, float diameter, int segments)
 
     Mesh *mesh = new Mesh();
 
-    float segmentAngle = TwoPi / segments;
+    // rim directions, (sin, cos) of -2pi * i / segments
+    std::vector<Vec2> rim(segments);
+    for (int i = 0; i < segments; i++)
+    {
+        CircleSinCos(i, segments, rim[i].x, rim[i].y);
+        rim[i].x = -rim[i].x;
+    }
     float segmentU = 1.0f / segments;
     float normY = (height > 0) ? 1.0f : -1.0f;
 
@@ -1231,13 +1562,13 @@ Mesh *MeshManager::CreateCylinder(float height, float diameter, int segments)
         mesh->texcoords.push_back(Vec2(0.5f, 0.5f));
 
         // Borda do topo
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * i) * radius, height / 2.0f, CosRad(-segmentAngle * i) * radius));
+        mesh->vertices.push_back(Vec3(rim[i].x * radius, height / 2.0f, rim[i].y * radius));
         mesh->normals.push_back(Vec3(0, normY, 0));
-        mesh->texcoords.push_back(Vec2(SinRad(-segmentAngle * i) / 2.0f + 0.5f, CosRad(-segmentAngle * i) / 2.0f + 0.5f));
+        mesh->texcoords.push_back(Vec2(rim[i].x / 2.0f + 0.5f, rim[i].y / 2.0f + 0.5f));
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * next) * radius, height / 2.0f, CosRad(-segmentAngle * next) * radius));
+        mesh->vertices.push_back(Vec3(rim[next].x * radius, height / 2.0f, rim[next].y * radius));
         mesh->normals.push_back(Vec3(0, normY, 0));
-        mesh->texcoords.push_back(Vec2(SinRad(-segmentAngle * next) / 2.0f + 0.5f, CosRad(-segmentAngle * next) / 2.0f + 0.5f));
+        mesh->texcoords.push_back(Vec2(rim[next].x / 2.0f + 0.5f, rim[next].y / 2.0f + 0.5f));
 
         u32 a = vertexIndex++;
         u32 b = vertexIndex++;
@@ -1254,16 +1585,16 @@ Mesh *MeshManager::CreateCylinder(float height, float diameter, int segments)
         if (next >= segments)
             next = 0;
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * i) * radius, height / 2.0f, CosRad(-segmentAngle * i) * radius));
-        mesh->normals.push_back(Vec3(SinRad(-segmentAngle * i), 0, CosRad(-segmentAngle * i)).normalize());
+        mesh->vertices.push_back(Vec3(rim[i].x * radius, height / 2.0f, rim[i].y * radius));
+        mesh->normals.push_back(Vec3(rim[i].x, 0, rim[i].y).normalize());
         mesh->texcoords.push_back(Vec2(segmentU * i, 0));
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * i) * radius, -height / 2.0f, CosRad(-segmentAngle * i) * radius));
-        mesh->normals.push_back(Vec3(SinRad(-segmentAngle * i), 0, CosRad(-segmentAngle * i)).normalize());
+        mesh->vertices.push_back(Vec3(rim[i].x * radius, -height / 2.0f, rim[i].y * radius));
+        mesh->normals.push_back(Vec3(rim[i].x, 0, rim[i].y).normalize());
         mesh->texcoords.push_back(Vec2(segmentU * i, 1));
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * next) * radius, -height / 2.0f, CosRad(-segmentAngle * next) * radius));
-        mesh->normals.push_back(Vec3(SinRad(-segmentAngle * next), 0, CosRad(-segmentAngle * next)).normalize());
+        mesh->vertices.push_back(Vec3(rim[next].x * radius, -height / 2.0f, rim[next].y * radius));
+        mesh->normals.push_back(Vec3(rim[next].x, 0, rim[next].y).normalize());
         mesh->texcoords.push_back(Vec2(segmentU * (i + 1), 1));
 
         u32 a = vertexIndex++;
@@ -1273,16 +1604,16 @@ Mesh *MeshManager::CreateCylinder(float height, float diameter, int segments)
         mesh->indices.push_back(b);
         mesh->indices.push_back(a);
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * i) * radius, height / 2.0f, CosRad(-segmentAngle * i) * radius));
-        mesh->normals.push_back(Vec3(SinRad(-segmentAngle * i), 0, CosRad(-segmentAngle * i)).normalize());
+        mesh->vertices.push_back(Vec3(rim[i].x * radius, height / 2.0f, rim[i].y * radius));
+        mesh->normals.push_back(Vec3(rim[i].x, 0, rim[i].y).normalize());
         mesh->texcoords.push_back(Vec2(segmentU * i, 0));
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * next) * radius, -height / 2.0f, CosRad(-segmentAngle * next) * radius));
-        mesh->normals.push_back(Vec3(SinRad(-segmentAngle * next), 0, CosRad(-segmentAngle * next)).normalize());
+        mesh->vertices.push_back(Vec3(rim[next].x * radius, -height / 2.0f, rim[next].y * radius));
+        mesh->normals.push_back(Vec3(rim[next].x, 0, rim[next].y).normalize());
         mesh->texcoords.push_back(Vec2(segmentU * (i + 1), 1));
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * next) * radius, height / 2.0f, CosRad(-segmentAngle * next) * radius));
-        mesh->normals.push_back(Vec3(SinRad(-segmentAngle * next), 0, CosRad(-segmentAngle * next)).normalize());
+        mesh->vertices.push_back(Vec3(rim[next].x * radius, height / 2.0f, rim[next].y * radius));
+        mesh->normals.push_back(Vec3(rim[next].x, 0, rim[next].y).normalize());
         mesh->texcoords.push_back(Vec2(segmentU * (i + 1), 0));
 
         a = vertexIndex++;
@@ -1299,18 +1630,18 @@ Mesh *MeshManager::CreateCylinder(float height, float diameter, int segments)
         int next = (i + 1) % segments;
 
         // Borda inferior
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * i) * radius, -height / 2.0f, CosRad(-segmentAngle * i) * radius));
+        mesh->vertices.push_back(Vec3(rim[i].x * radius, -height / 2.0f, rim[i].y * radius));
         mesh->normals.push_back(Vec3(0, -normY, 0));
-        mesh->texcoords.push_back(Vec2(SinRad(-segmentAngle * i) / 2.0f + 0.5f, CosRad(-segmentAngle * i) / 2.0f + 0.5f));
+        mesh->texcoords.push_back(Vec2(rim[i].x / 2.0f + 0.5f, rim[i].y / 2.0f + 0.5f));
 
         // Centro do fundo
         mesh->vertices.push_back(Vec3(0, -height / 2.0f, 0));
         mesh->normals.push_back(Vec3(0, -normY, 0));
         mesh->texcoords.push_back(Vec2(0.5f, 0.5f));
 
-        mesh->vertices.push_back(Vec3(SinRad(-segmentAngle * next) * radius, -height / 2.0f, CosRad(-segmentAngle * next) * radius));
+        mesh->vertices.push_back(Vec3(rim[next].x * radius, -height / 2.0f, rim[next].y * radius));
         mesh->normals.push_back(Vec3(0, -normY, 0));
-        mesh->texcoords.push_back(Vec2(SinRad(-segmentAngle * next) / 2.0f + 0.5f, CosRad(-segmentAngle * next) / 2.0f + 0.5f));
+        mesh->texcoords.push_back(Vec2(rim[next].x / 2.0f + 0.5f, rim[next].y / 2.0f + 0.5f));
 
         u32 a = vertexIndex++;
         u32 b = vertexIndex++;
@@ -1417,21 +1748,24 @@ Mesh *MeshManager::CreateTorus(int stacks, int slices, float innerRadius, float
     mesh->SetFlag(4);
     mesh->SetFlag(32);
 
-    const float pi = 3.14159265359f;
-    const float stackAngle = 2.0f * pi / static_cast<float>(stacks);
-    const float sliceAngle = 2.0f * pi / static_cast<float>(slices);
+    if (stacks < 3)
+        stacks = 3;
+    if (slices < 3)
+        slices = 3;
 
     for (int i = 0; i <= stacks; ++i)
     {
-        float u = static_cast<float>(i) * stackAngle;
+        float sinU, cosU;
+        CircleSinCos(i, stacks, sinU, cosU);
 
         for (int j = 0; j <= slices; ++j)
         {
-            float v = static_cast<float>(j) * sliceAngle;
+            float sinV, cosV;
+            CircleSinCos(j, slices, sinV, cosV);
 
-            float x = (outerRadius + innerRadius * cos(v)) * cos(u);
-            float y = (outerRadius + innerRadius * cos(v)) * sin(u);
-            float z = innerRadius * sin(v);
+            float x = (outerRadius + innerRadius * cosV) * cosU;
+            float y = (outerRadius + innerRadius * cosV) * sinU;
+            float z = innerRadius * sinV;
 
             float textureU = static_cast<float>(i) / stacks;
             float textureV = static_cast<float>(j) / slices;
@@ -1488,9 +1822,6 @@ Mesh *MeshManager::CreateCapsule(float diameter, int rows, int columns, float he
 
 	float radius = diameter / 2.0f;
 
-    float fSegY = Pi / rows;
-    float fSegX = 2 * Pi / columns;
-
     float fSegU = 1.0f / columns;
     float fSegV = 1.0f / rows;
 
@@ -1505,8 +1836,8 @@ Mesh *MeshManager::CreateCapsule(float diameter, int rows, int columns, float he
     u32 count = 0;
     for (int j = 0; j <= rows; j++)
     {
-        float fSY = SinRad(fSegY * j);
-        float fCY = CosRad(fSegY * j);
+        float fSY, fCY;
+        CircleSinCos(j, 2 * rows, fSY, fCY);
 
         for (int i = 0; i <= columns; i++)
         {
@@ -1514,12 +1845,14 @@ Mesh *MeshManager::CreateCapsule(float diameter, int rows, int columns, float he
             Vec3 point;
             Vec2 uv;
 
-            point.x = SinRad(-fSegX * i) * fSY * radius;
+            float fSX, fCX;
+            CircleSinCos(i, columns, fSX, fCX);
+            point.x = -fSX * fSY * radius;
             if (fCY * radius > 0)
                 point.y = fCY * radius + height;
             else
                 point.y = fCY * radius - height;
-            point.z = CosRad(-fSegX * i) * fSY * radius;
+            point.z = fCX * fSY * radius;
 
             if (j == 0 || j == rows)
                 uv.x = fSegU * i + fSegU / 2.0f;
@@ -1585,3 +1918,483 @@ Mesh *MeshManager::CreateCapsule(float diameter, int rows, int columns, float he
     return mesh;
 }
 
+
+//***************************************************************************************************************
+//  MESH BVH
+//***************************************************************************************************************
+
+static const int BVH_BINS = 12;
+// a far child per level on the way down, plus the two children of the last node
+static const int BVH_STACK = BVH_MAX_DEPTH + 2;
+
+static inline float halfArea(const Vec3 &min, const Vec3 &max)
+{
+    Vec3 e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static inline void growBox(BoundingBox &box, const BoundingBox &other)
+{
+    box.min.x = Min(box.min.x, other.min.x);
+    box.min.y = Min(box.min.y, other.min.y);
+    box.min.z = Min(box.min.z, other.min.z);
+    box.max.x = Max(box.max.x, other.max.x);
+    box.max.y = Max(box.max.y, other.max.y);
+    box.max.z = Max(box.max.z, other.max.z);
+}
+
+// slab test, returns the entry distance or M_INFINITY when the box is missed or further than maxDistance
+static inline float intersectNode(const BVHNode &node, const Vec3 &origin, const Vec3 &invDir, float maxDistance)
+{
+    float tx1 = (node.min.x - origin.x) * invDir.x, tx2 = (node.max.x - origin.x) * invDir.x;
+    float tmin = Min(tx1, tx2), tmax = Max(tx1, tx2);
+    float ty1 = (node.min.y - origin.y) * invDir.y, ty2 = (node.max.y - origin.y) * invDir.y;
+    tmin = Max(tmin, Min(ty1, ty2));
+    tmax = Min(tmax, Max(ty1, ty2));
+    float tz1 = (node.min.z - origin.z) * invDir.z, tz2 = (node.max.z - origin.z) * invDir.z;
+    tmin = Max(tmin, Min(tz1, tz2));
+    tmax = Min(tmax, Max(tz1, tz2));
+    if (tmax >= tmin && tmin < maxDistance && tmax > 0.0f)
+        return tmin;
+    return M_INFINITY;
+}
+
+MeshBVH::MeshBVH() : nodesUsed(0), maxDepth(BVH_MAX_DEPTH)
+{
+}
+
+void MeshBVH::Release()
+{
+    nodes.clear();
+    triangles.clear();
+    triangleIds.clear();
+    nodesUsed = 0;
+}
+
+bool MeshBVH::Build(const Mesh *mesh, u32 depth)
+{
+    if (!mesh || mesh->vertices.empty())
+    {
+        Utils::LogError("MeshBVH: empty mesh");
+        return false;
+    }
+
+    if (!mesh->indices.empty())
+        return Build(mesh->vertices.data(), mesh->indices.data(), mesh->indices.size() / 3, depth);
+
+    std::vector<u32> indices(mesh->vertices.size() - mesh->vertices.size() % 3);
+    for (u32 i = 0; i < indices.size(); i++)
+        indices[i] = i;
+    return Build(mesh->vertices.data(), indices.data(), indices.size() / 3, depth);
+}
+
+bool MeshBVH::Build(const Vec3 *vertices, const u32 *indices, u32 triangleCount, u32 depth)
+{
+    Release();
+    if (!vertices || !indices || triangleCount == 0)
+    {
+        Utils::LogError("MeshBVH: no triangles to build from");
+        return false;
+    }
+
+    triangles.resize(triangleCount * 3);
+    triangleIds.resize(triangleCount);
+    std::vector<Vec3> centroids(triangleCount);
+    std::vector<BoundingBox> bounds(triangleCount);
+    for (u32 i = 0; i < triangleCount; i++)
+    {
+        triangles[i * 3 + 0] = vertices[indices[i * 3 + 0]];
+        triangles[i * 3 + 1] = vertices[indices[i * 3 + 1]];
+        triangles[i * 3 + 2] = vertices[indices[i * 3 + 2]];
+        triangleIds[i] = i;
+        bounds[i].reset(triangles[i * 3 + 0]);
+        bounds[i].expand(triangles[i * 3 + 1]);
+        bounds[i].expand(triangles[i * 3 + 2]);
+        centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+    }
+
+    nodes.resize(triangleCount * 2);
+    nodesUsed = 1;
+    maxDepth = Min(depth, BVH_MAX_DEPTH);
+    BVHNode &root = nodes[0];
+    root.leftFirst = 0;
+    root.count = triangleCount;
+    updateBounds(0, bounds.data());
+    subdivide(0, 0, bounds.data(), centroids.data());
+
+    nodes.resize(nodesUsed);
+    nodes.shrink_to_fit();
+    return true;
+}
+
+void MeshBVH::updateBounds(u32 index, const BoundingBox *bounds)
+{
+    BVHNode &node = nodes[index];
+    BoundingBox box;
+    for (u32 i = 0; i < node.count; i++)
+        growBox(box, bounds[node.leftFirst + i]);
+    node.min = box.min;
+    node.max = box.max;
+}
+
+float MeshBVH::findSplit(const BVHNode &node, const BoundingBox *bounds, const Vec3 *centroids, int &axis, float &position) const
+{
+    float bestCost = M_INFINITY;
+    for (int a = 0; a < 3; a++)
+    {
+        float boundsMin = M_INFINITY, boundsMax = -M_INFINITY;
+        for (u32 i = 0; i < node.count; i++)
+        {
+            const float c = centroids[node.leftFirst + i][a];
+            boundsMin = Min(boundsMin, c);
+            boundsMax = Max(boundsMax, c);
+        }
+        if (boundsMin == boundsMax)
+            continue;
+
+        BoundingBox bins[BVH_BINS];
+        u32 counts[BVH_BINS] = {};
+        const float scale = BVH_BINS / (boundsMax - boundsMin);
+        for (u32 i = 0; i < node.count; i++)
+        {
+            const u32 t = node.leftFirst + i;
+            const int bin = Min(BVH_BINS - 1, (int)((centroids[t][a] - boundsMin) * scale));
+            counts[bin]++;
+            growBox(bins[bin], bounds[t]);
+        }
+
+        // sweep from both sides to get the area / count of every split plane
+        float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+        u32 leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+        BoundingBox leftBox, rightBox;
+        u32 leftSum = 0, rightSum = 0;
+        for (int i = 0; i < BVH_BINS - 1; i++)
+        {
+            leftSum += counts[i];
+            leftCount[i] = leftSum;
+            if (counts[i])
+                growBox(leftBox, bins[i]);
+            leftArea[i] = leftSum ? halfArea(leftBox.min, leftBox.max) : 0.0f;
+
+            const int j = BVH_BINS - 1 - i;
+            rightSum += counts[j];
+            rightCount[j - 1] = rightSum;
+            if (counts[j])
+                growBox(rightBox, bins[j]);
+            rightArea[j - 1] = rightSum ? halfArea(rightBox.min, rightBox.max) : 0.0f;
+        }
+
+        const float step = (boundsMax - boundsMin) / BVH_BINS;
+        for (int i = 0; i < BVH_BINS - 1; i++)
+        {
+            const float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                axis = a;
+                position = boundsMin + step * (i + 1);
+            }
+        }
+    }
+    return bestCost;
+}
+
+void MeshBVH::subdivide(u32 index, u32 depth, BoundingBox *bounds, Vec3 *centroids)
+{
+    BVHNode &node = nodes[index];
+    // degenerate input (long SAH chains) stops at the depth the traversal stacks hold
+    if (node.count <= 2 || depth >= maxDepth)
+        return;
+
+    int axis = 0;
+    float position = 0.0f;
+    const float splitCost = findSplit(node, bounds, centroids, axis, position);
+    const float leafCost = node.count * halfArea(node.min, node.max);
+    if (splitCost >= leafCost)
+        return;
+
+    // partition the triangle range in place around the split plane
+    u32 i = node.leftFirst;
+    u32 j = i + node.count - 1;
+    while (i <= j)
+    {
+        if (centroids[i][axis] < position)
+        {
+            i++;
+        }
+        else
+        {
+            std::swap(centroids[i], centroids[j]);
+            std::swap(bounds[i], bounds[j]);
+            std::swap(triangleIds[i], triangleIds[j]);
+            std::swap(triangles[i * 3 + 0], triangles[j * 3 + 0]);
+            std::swap(triangles[i * 3 + 1], triangles[j * 3 + 1]);
+            std::swap(triangles[i * 3 + 2], triangles[j * 3 + 2]);
+            if (j == 0)
+                break;
+            j--;
+        }
+    }
+
+    const u32 leftCount = i - node.leftFirst;
+    if (leftCount == 0 || leftCount == node.count)
+        return;
+
+    const u32 left = nodesUsed++;
+    const u32 right = nodesUsed++;
+    nodes[left].leftFirst = node.leftFirst;
+    nodes[left].count = leftCount;
+    nodes[right].leftFirst = i;
+    nodes[right].count = node.count - leftCount;
+    node.leftFirst = left;
+    node.count = 0;
+
+    updateBounds(left, bounds);
+    updateBounds(right, bounds);
+    subdivide(left, depth + 1, bounds, centroids);
+    subdivide(right, depth + 1, bounds, centroids);
+}
+
+bool MeshBVH::intersectTriangle(const Ray &ray, u32 index, RayHit &hit) const
+{
+    // Möller–Trumbore, same as Ray::intersectTriangle but keeping u / v
+    const Vec3 &v0 = triangles[index * 3 + 0];
+    const Vec3 edge1 = triangles[index * 3 + 1] - v0;
+    const Vec3 edge2 = triangles[index * 3 + 2] - v0;
+    const Vec3 h = ray.direction.cross(edge2);
+    const float a = edge1.dot(h);
+    if (fabs(a) < Epsilon)
+        return false;
+
+    const float f = 1.0f / a;
+    const Vec3 s = ray.origin - v0;
+    const float u = f * s.dot(h);
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    const Vec3 q = s.cross(edge1);
+    const float v = f * ray.direction.dot(q);
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    const float t = f * edge2.dot(q);
+    if (t <= Epsilon || t >= hit.t)
+        return false;
+
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    hit.triangle = index;
+    return true;
+}
+
+// fills the world data of a hit found by the traversal (triangle holds the leaf order index)
+static void finishHit(const std::vector<Vec3> &triangles, const std::vector<u32> &ids, const Ray &ray, RayHit &hit)
+{
+    const u32 index = hit.triangle;
+    hit.position = ray.pointAt(hit.t);
+    hit.normal = Vec3::Normalize(Vec3::Cross(triangles[index * 3 + 1] - triangles[index * 3], triangles[index * 3 + 2] - triangles[index * 3]));
+    hit.triangle = ids[index];
+}
+
+bool MeshBVH::Intersect(const Ray &ray, RayHit &hit, float maxDistance) const
+{
+    // hit.t is the search limit while walking, a miss reports M_INFINITY
+    hit.t = maxDistance;
+    if (nodesUsed == 0)
+    {
+        hit.t = M_INFINITY;
+        return false;
+    }
+
+    const Vec3 invDir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    if (intersectNode(nodes[0], ray.origin, invDir, hit.t) == M_INFINITY)
+    {
+        hit.t = M_INFINITY;
+        return false;
+    }
+
+    bool found = false;
+    u32 stack[BVH_STACK];
+    int sp = 0;
+    u32 index = 0;
+    for (;;)
+    {
+        const BVHNode &node = nodes[index];
+        if (node.count > 0)
+        {
+            for (u32 i = 0; i < node.count; i++)
+                found |= intersectTriangle(ray, node.leftFirst + i, hit);
+            if (sp == 0)
+                break;
+            index = stack[--sp];
+            continue;
+        }
+
+        // nearest child first, the far one is only visited if still in front of the best hit
+        u32 near = node.leftFirst, far = node.leftFirst + 1;
+        float dNear = intersectNode(nodes[near], ray.origin, invDir, hit.t);
+        float dFar = intersectNode(nodes[far], ray.origin, invDir, hit.t);
+        if (dNear > dFar)
+        {
+            std::swap(near, far);
+            std::swap(dNear, dFar);
+        }
+        if (dNear == M_INFINITY)
+        {
+            if (sp == 0)
+                break;
+            index = stack[--sp];
+            continue;
+        }
+        index = near;
+        if (dFar != M_INFINITY)
+            stack[sp++] = far;
+    }
+
+    if (found)
+        finishHit(triangles, triangleIds, ray, hit);
+    else
+        hit.t = M_INFINITY;
+    return found;
+}
+
+bool MeshBVH::Occluded(const Ray &ray, float maxDistance) const
+{
+    if (nodesUsed == 0)
+        return false;
+
+    const Vec3 invDir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    RayHit hit;
+    hit.t = maxDistance;
+
+    u32 stack[BVH_STACK];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0)
+    {
+        const BVHNode &node = nodes[stack[--sp]];
+        if (intersectNode(node, ray.origin, invDir, maxDistance) == M_INFINITY)
+            continue;
+        if (node.count > 0)
+        {
+            for (u32 i = 0; i < node.count; i++)
+                if (intersectTriangle(ray, node.leftFirst + i, hit))
+                    return true;
+        }
+        else
+        {
+            stack[sp++] = node.leftFirst + 1;
+            stack[sp++] = node.leftFirst;
+        }
+    }
+    return false;
+}
+
+u32 MeshBVH::Intersect(const Ray *rays, RayHit *hits, u32 count, float maxDistance) const
+{
+    if (nodesUsed == 0)
+    {
+        for (u32 i = 0; i < count; i++)
+            hits[i].t = M_INFINITY;
+        return 0;
+    }
+
+    u32 hitCount = 0;
+    for (u32 first = 0; first < count; first += BVH_PACKET_SIZE)
+    {
+        const u32 lanes = Min(count - first, BVH_PACKET_SIZE);
+
+        // SoA ray data, the box test below runs over all lanes at once
+        float ox[BVH_PACKET_SIZE], oy[BVH_PACKET_SIZE], oz[BVH_PACKET_SIZE];
+        float ix[BVH_PACKET_SIZE], iy[BVH_PACKET_SIZE], iz[BVH_PACKET_SIZE];
+        float best[BVH_PACKET_SIZE];
+        RayHit packet[BVH_PACKET_SIZE];
+        bool found[BVH_PACKET_SIZE];
+        for (u32 k = 0; k < BVH_PACKET_SIZE; k++)
+        {
+            const Ray &ray = rays[first + Min(k, lanes - 1)];
+            ox[k] = ray.origin.x;
+            oy[k] = ray.origin.y;
+            oz[k] = ray.origin.z;
+            ix[k] = 1.0f / ray.direction.x;
+            iy[k] = 1.0f / ray.direction.y;
+            iz[k] = 1.0f / ray.direction.z;
+            best[k] = maxDistance;
+            packet[k].t = maxDistance;
+            found[k] = false;
+        }
+        const Vec3 direction = rays[first].direction;
+
+        u32 stack[BVH_STACK];
+        int sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0)
+        {
+            const BVHNode &node = nodes[stack[--sp]];
+
+            u32 active = 0;
+            for (u32 k = 0; k < BVH_PACKET_SIZE; k++)
+            {
+                float tx1 = (node.min.x - ox[k]) * ix[k], tx2 = (node.max.x - ox[k]) * ix[k];
+                float ty1 = (node.min.y - oy[k]) * iy[k], ty2 = (node.max.y - oy[k]) * iy[k];
+                float tz1 = (node.min.z - oz[k]) * iz[k], tz2 = (node.max.z - oz[k]) * iz[k];
+                float tmin = Max(Max(Min(tx1, tx2), Min(ty1, ty2)), Min(tz1, tz2));
+                float tmax = Min(Min(Max(tx1, tx2), Max(ty1, ty2)), Max(tz1, tz2));
+                active |= (tmax >= tmin && tmin < best[k] && tmax > 0.0f) ? (1u << k) : 0u;
+            }
+            if (!active)
+                continue;
+
+            if (node.count > 0)
+            {
+                for (u32 k = 0; k < lanes; k++)
+                {
+                    if (!(active & (1u << k)))
+                        continue;
+                    for (u32 i = 0; i < node.count; i++)
+                        found[k] |= intersectTriangle(rays[first + k], node.leftFirst + i, packet[k]);
+                    best[k] = packet[k].t;
+                }
+                continue;
+            }
+
+            // front to back along the packet direction: left first when its centre comes first
+            const BVHNode &left = nodes[node.leftFirst];
+            const BVHNode &right = nodes[node.leftFirst + 1];
+            const Vec3 between = (right.min + right.max) - (left.min + left.max);
+            if (between.dot(direction) >= 0.0f)
+            {
+                stack[sp++] = node.leftFirst + 1;
+                stack[sp++] = node.leftFirst;
+            }
+            else
+            {
+                stack[sp++] = node.leftFirst;
+                stack[sp++] = node.leftFirst + 1;
+            }
+        }
+
+        for (u32 k = 0; k < lanes; k++)
+        {
+            if (found[k])
+            {
+                finishHit(triangles, triangleIds, rays[first + k], packet[k]);
+                hitCount++;
+            }
+            else
+            {
+                packet[k].t = M_INFINITY;
+            }
+            hits[first + k] = packet[k];
+        }
+    }
+    return hitCount;
+}
+
+BoundingBox MeshBVH::GetBounds() const
+{
+    if (nodesUsed == 0)
+        return BoundingBox();
+    return BoundingBox(nodes[0].min, nodes[0].max);
+}
@@ -0,0 +1,256 @@
+#include "RenderQueue.hpp"
+#include <cstring>
+
+static const u32 KEY_NAME_MASK = 0xFFF;
+
+// top 24 bits of a non negative float: exponent and 15 mantissa bits,
+// ordered like the float itself
+static u32 depthBits(float distanceSquared)
+{
+    if (!(distanceSquared > 0.0f))
+        return 0;
+    u32 bits;
+    memcpy(&bits, &distanceSquared, sizeof(bits));
+    return bits >> 8;
+}
+
+//***************************************************************************************************************
+// RenderQueue
+//***************************************************************************************************************
+
+RenderQueue::RenderQueue() : eye(0.0f, 0.0f, 0.0f), sorted(true)
+{
+    passes[RENDER_PASS_CUTOUT] = RenderPassState(SORT_STATE);
+
+    RenderPassState transparent(SORT_BACK_TO_FRONT);
+    transparent.depthWrite = false;
+    transparent.blend = true;
+    passes[RENDER_PASS_TRANSPARENT] = transparent;
+
+    RenderPassState overlay(SORT_BACK_TO_FRONT);
+    overlay.depthTest = false;
+    overlay.depthWrite = false;
+    overlay.cullFace = false;
+    overlay.blend = true;
+    passes[RENDER_PASS_OVERLAY] = overlay;
+}
+
+void RenderQueue::SetPass(u32 pass, const RenderPassState &state)
+{
+    if (pass >= RENDER_MAX_PASSES)
+    {
+        Utils::LogError("RenderQueue: pass %u out of range", pass);
+        return;
+    }
+    passes[pass] = state;
+}
+
+void RenderQueue::Begin()
+{
+    const Vec4 &position = Driver::Instance().GetFrameConstants().cameraPosition;
+    Begin(Vec3(position.x, position.y, position.z));
+}
+
+void RenderQueue::Begin(const Vec3 &eye)
+{
+    this->eye = eye;
+    Clear();
+}
+
+void RenderQueue::Clear()
+{
+    commands.clear();
+    packets.clear();
+    sorted = true;
+}
+
+u64 RenderQueue::MakeKey(u32 pass, RenderSort sort, u32 shader, u32 texture, u32 vertexArray, float distanceSquared)
+{
+    u64 depth = depthBits(distanceSquared);
+    const u64 state = ((u64)(shader & KEY_NAME_MASK) << 24) | ((u64)(texture & KEY_NAME_MASK) << 12) | (u64)(vertexArray & KEY_NAME_MASK);
+    const u64 key = (u64)(pass & 0xF) << 60;
+    if (sort == SORT_STATE)
+        return key | (state << 24) | depth;
+    if (sort == SORT_BACK_TO_FRONT)
+        depth = 0xFFFFFF - depth;
+    return key | (depth << 36) | state;
+}
+
+RenderCommand &RenderQueue::push(u32 pass, Shader *shader, u32 texture, u32 vertexArray, float depth)
+{
+    if (pass >= RENDER_MAX_PASSES)
+    {
+        Utils::LogWarning("RenderQueue: pass %u out of range, using the last one", pass);
+        pass = RENDER_MAX_PASSES - 1;
+    }
+
+    RenderPacket packet;
+    packet.key = MakeKey(pass, passes[pass].sort, shader ? shader->GetID() : 0, texture, vertexArray, depth);
+    packet.command = (u32)commands.size();
+    packets.push_back(packet);
+    sorted = false;
+
+    commands.emplace_back();
+    RenderCommand &command = commands.back();
+    command.shader = shader;
+    command.mesh = nullptr;
+    command.buffer = nullptr;
+    command.callback = nullptr;
+    command.user = nullptr;
+    command.textures[0] = texture;
+    for (u32 i = 1; i < RENDER_MAX_TEXTURES; ++i)
+        command.textures[i] = 0;
+    command.mode = GL_TRIANGLES;
+    command.start = 0;
+    command.count = 0;
+    command.object.model = Mat4::Identity();
+    command.object.color = Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    return command;
+}
+
+RenderCommand &RenderQueue::Submit(u32 pass, Shader *shader, Mesh *mesh, const Mat4 &model, u32 texture, u32 mode)
+{
+    const Vec3 offset = model.getPosition() - eye;
+    RenderCommand &command = push(pass, shader, texture, mesh->GetVertexArray(), offset.dot(offset));
+    command.mesh = mesh;
+    command.mode = mode;
+    command.object.model = model;
+    return command;
+}
+
+RenderCommand &RenderQueue::Submit(u32 pass, Shader *shader, MeshBuffer *buffer, const Mat4 &model, u32 texture, u32 mode)
+{
+    const Vec3 offset = model.getPosition() - eye;
+    RenderCommand &command = push(pass, shader, texture, buffer->GetVertexArray(), offset.dot(offset));
+    command.buffer = buffer;
+    command.mode = mode;
+    command.object.model = model;
+    return command;
+}
+
+RenderCommand &RenderQueue::Submit(u32 pass, Shader *shader, RenderCallback callback, void *user, float distance)
+{
+    RenderCommand &command = push(pass, shader, 0, 0, distance * distance);
+    command.callback = callback;
+    command.user = user;
+    return command;
+}
+
+void RenderQueue::SortPackets(RenderPacket *packets, RenderPacket *scratch, u32 count)
+{
+    if (count < 2)
+        return;
+
+    // all eight histograms in one read
+    u32 histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (u32 i = 0; i < count; ++i)
+    {
+        const u64 key = packets[i].key;
+        for (int d = 0; d < 8; ++d)
+            histograms[d][(key >> (d * 8)) & 0xFF]++;
+    }
+
+    RenderPacket *source = packets;
+    RenderPacket *target = scratch;
+    for (int d = 0; d < 8; ++d)
+    {
+        u32 *histogram = histograms[d];
+        const u32 first = (u32)((source[0].key >> (d * 8)) & 0xFF);
+        if (histogram[first] == count)
+            continue;
+
+        u32 offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            const u32 n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for (u32 i = 0; i < count; ++i)
+        {
+            const u32 digit = (u32)((source[i].key >> (d * 8)) & 0xFF);
+            target[histogram[digit]++] = source[i];
+        }
+        RenderPacket *swap = source;
+        source = target;
+        target = swap;
+    }
+
+    if (source != packets)
+        memcpy(packets, source, count * sizeof(RenderPacket));
+}
+
+void RenderQueue::Sort()
+{
+    if (sorted)
+        return;
+    if (scratch.size() < packets.size())
+        scratch.resize(packets.size());
+    SortPackets(packets.data(), scratch.data(), (u32)packets.size());
+    sorted = true;
+}
+
+void RenderQueue::applyPass(u32 pass)
+{
+    Driver &driver = Driver::Instance();
+    const RenderPassState &state = passes[pass];
+    driver.EnableDepthTest(state.depthTest);
+    driver.EnableDepthWrite(state.depthWrite);
+    driver.EnableCullFace(state.cullFace);
+    driver.EnableBlend(state.blend);
+    if (state.blend)
+        driver.SetBlend(state.blendSrc, state.blendDst);
+}
+
+void RenderQueue::Execute()
+{
+    Sort();
+
+    Driver &driver = Driver::Instance();
+    const Driver::RenderState entry = driver.SaveRenderState();
+    u32 currentPass = RENDER_MAX_PASSES;
+    for (size_t i = 0; i < packets.size(); ++i)
+    {
+        const u32 pass = (u32)(packets[i].key >> 60);
+        if (pass != currentPass)
+        {
+            applyPass(pass);
+            currentPass = pass;
+        }
+
+        RenderCommand &command = commands[packets[i].command];
+        if (command.shader)
+            command.shader->Bind();
+        for (u32 unit = 0; unit < RENDER_MAX_TEXTURES; ++unit)
+            if (command.textures[unit] != 0)
+                driver.BindTexture(unit, command.textures[unit]);
+
+        if (command.callback)
+        {
+            command.callback(command.user);
+            continue;
+        }
+
+        if (command.shader && command.modelUniform.IsValid())
+            command.shader->SetMatrix4(command.modelUniform, command.object.model.m);
+        else
+            driver.SetObjectConstants(command.object);
+
+        if (command.mesh)
+        {
+            if (command.count == 0)
+                command.mesh->Render(command.mode);
+            else
+                command.mesh->Render(command.mode, command.start, command.count);
+        }
+        else if (command.buffer)
+        {
+            command.buffer->Render(command.mode);
+        }
+    }
+
+    // direct draws after the queue see the state they had before it
+    if (currentPass != RENDER_MAX_PASSES)
+        driver.RestoreRenderState(entry);
+}
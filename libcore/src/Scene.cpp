@@ -1,23 +1,93 @@
 #include "Scene.hpp"
 #include "Scene.hpp"
 #include <cmath>
+#include <algorithm>
+#include <cfloat>
 #include "stb_image.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HEIGHTMAP_SSE2
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Raw samples are little-endian, which is also the host order on every
+// platform we build for, so 8/16 bit data can be read in place.
+
+static void convertSamples8(const u8 *src, float *dst, int count, float scale)
+{
+    int i = 0;
+#if defined(HEIGHTMAP_SSE2)
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), s));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), s));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), s));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), s));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = src[i] * scale;
+}
+
+static void convertSamples16(const u16 *src, float *dst, int count, float scale)
+{
+    int i = 0;
+#if defined(HEIGHTMAP_SSE2)
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), s));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), s));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = src[i] * scale;
+}
+
 Heightmap::Heightmap(float heightScale)
 {
     maxHeight = heightScale;
     width = 0;
     height = 0;
     heightData = nullptr;
+    nativeData = nullptr;
+    nativeDepth = 0;
+    mappedSize = 0;
 }
 
 Heightmap::~Heightmap()
+{
+    releaseData();
+}
+
+void Heightmap::releaseData()
 {
     if (heightData)
     {
         delete[] heightData;
         heightData = nullptr;
     }
+    if (nativeData)
+    {
+        if (mappedSize > 0)
+            Utils::UnmapFile(nativeData, mappedSize);
+        else
+            delete[] nativeData;
+        nativeData = nullptr;
+    }
+    nativeDepth = 0;
+    mappedSize = 0;
 }
 
 u32 Heightmap::readRawValue(const u8 *buffer, int bitDepth) const
@@ -46,10 +116,7 @@ bool Heightmap::LoadImage(const char *filename)
 
     if (data)
     {
-        if (heightData)
-        {
-            delete[] heightData;
-        }
+        releaseData();
         heightData = new float[width * height];
         for (int i = 0; i < width * height; i++)
         {
@@ -82,7 +149,12 @@ float Heightmap::GetHeight(int x, int y)
     if (y >= height)
         y = height - 1;
 
-    return heightData[x + y * width];
+    if (heightData)
+        return heightData[x + y * width];
+
+    if (nativeDepth == 16)
+        return reinterpret_cast<const u16 *>(nativeData)[x + y * width] * (maxHeight / 65535.0f);
+    return nativeData[x + y * width] * (maxHeight / 255.0f);
 }
 
 void Heightmap::SetHeight(int x, int y, float value)
@@ -96,7 +168,68 @@ void Heightmap::SetHeight(int x, int y, float value)
     if (y >= height)
         y = height - 1;
 
-    heightData[x + y * width] = (value / 255.0f) * maxHeight;
+    if (heightData)
+        heightData[x + y * width] = (value / 255.0f) * maxHeight;
+
+    if (nativeData)
+    {
+        float normalized = Clamp(value / 255.0f, 0.0f, 1.0f);
+        if (nativeDepth == 16)
+            reinterpret_cast<u16 *>(nativeData)[x + y * width] = static_cast<u16>(normalized * 65535.0f + 0.5f);
+        else
+            nativeData[x + y * width] = static_cast<u8>(normalized * 255.0f + 0.5f);
+    }
+}
+
+// Same as SetHeight but takes the height in GetHeight() units.
+void Heightmap::SetHeightValue(int x, int z, float value)
+{
+    if (maxHeight <= 0.0f)
+        return;
+    SetHeight(x, z, value / maxHeight * 255.0f);
+}
+
+void Heightmap::ConvertRegion(int x, int z, int w, int h, float *out) const
+{
+    if (x < 0 || z < 0 || x + w > width || z + h > height || w <= 0 || h <= 0)
+    {
+        Utils::LogError("Heightmap region out of bounds: %d %d %d %d", x, z, w, h);
+        return;
+    }
+
+    if (heightData)
+    {
+        for (int row = 0; row < h; ++row)
+            memcpy(out + row * w, heightData + (z + row) * width + x, w * sizeof(float));
+        return;
+    }
+    if (!nativeData)
+        return;
+
+    if (nativeDepth == 16)
+    {
+        const u16 *src = reinterpret_cast<const u16 *>(nativeData);
+        const float scale = maxHeight / 65535.0f;
+        for (int row = 0; row < h; ++row)
+            convertSamples16(src + (z + row) * width + x, out + row * w, w, scale);
+    }
+    else
+    {
+        const float scale = maxHeight / 255.0f;
+        for (int row = 0; row < h; ++row)
+            convertSamples8(nativeData + (z + row) * width + x, out + row * w, w, scale);
+    }
+}
+
+const float *Heightmap::GetData()
+{
+    if (!heightData && nativeData)
+    {
+        float *data = new float[width * height];
+        ConvertRegion(0, 0, width, height, data);
+        heightData = data;
+    }
+    return heightData;
 }
 
 float Heightmap::GetInterpolatedHeight(float x, float z)
@@ -118,6 +251,140 @@ float Heightmap::GetInterpolatedHeight(float x, float z)
     return h0 * (1 - fz) + h1 * fz;
 }
 
+// Bilinear taps straight on the stored samples (float heights or raw 8/16
+// bit values times scale), so mapped maps are not converted as a whole.
+template <typename T>
+static void interpolateHeights(const T *data, float scale, int width, int height, const float *xs, const float *zs, float *out, int count)
+{
+    const float maxX = (float)(width - 1);
+    const float maxZ = (float)(height - 1);
+    for (int i = 0; i < count; ++i)
+    {
+        const float x = Clamp(xs[i], 0.0f, maxX);
+        const float z = Clamp(zs[i], 0.0f, maxZ);
+        const int x0 = (int)x;
+        const int z0 = (int)z;
+        const float fx = x - x0;
+        const float fz = z - z0;
+        const int dx = x0 < width - 1 ? 1 : 0;
+        const int dz = z0 < height - 1 ? width : 0;
+
+        const T *row = data + z0 * width + x0;
+        const float h0 = row[0] * (1 - fx) + row[dx] * fx;
+        const float h1 = row[dz] * (1 - fx) + row[dz + dx] * fx;
+        out[i] = (h0 * (1 - fz) + h1 * fz) * scale;
+    }
+}
+
+// Bilinear heights for a batch of points given in sample space. Coordinates
+// are clamped to the map once per point instead of once per tap, and with
+// AVX2 eight points of a float map are resolved per iteration using gathers.
+// Native and mapped maps are sampled in place, like GetHeight.
+void Heightmap::GetInterpolatedHeights(const float *xs, const float *zs, float *out, int count)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    if (!heightData)
+    {
+        if (!nativeData)
+            return;
+        if (nativeDepth == 16)
+            interpolateHeights(reinterpret_cast<const u16 *>(nativeData), maxHeight / 65535.0f, width, height, xs, zs, out, count);
+        else
+            interpolateHeights(nativeData, maxHeight / 255.0f, width, height, xs, zs, out, count);
+        return;
+    }
+
+    const float *data = heightData;
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 vmaxX = _mm256_set1_ps((float)(width - 1));
+    const __m256 vmaxZ = _mm256_set1_ps((float)(height - 1));
+    const __m256i lastX = _mm256_set1_epi32(width - 1);
+    const __m256i lastZ = _mm256_set1_epi32(height - 1);
+    const __m256i stride = _mm256_set1_epi32(width);
+    const __m256i ione = _mm256_set1_epi32(1);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(xs + i), zero), vmaxX);
+        __m256 z = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(zs + i), zero), vmaxZ);
+
+        __m256i x0 = _mm256_cvttps_epi32(x);
+        __m256i z0 = _mm256_cvttps_epi32(z);
+        __m256 fx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+        __m256 fz = _mm256_sub_ps(z, _mm256_cvtepi32_ps(z0));
+
+        __m256i dx = _mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(x0, ione), lastX), x0);
+        __m256i dz = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(z0, ione), lastZ), z0), stride);
+
+        __m256i i00 = _mm256_add_epi32(_mm256_mullo_epi32(z0, stride), x0);
+        __m256i i10 = _mm256_add_epi32(i00, dx);
+        __m256i i01 = _mm256_add_epi32(i00, dz);
+        __m256i i11 = _mm256_add_epi32(i01, dx);
+
+        __m256 h00 = _mm256_i32gather_ps(data, i00, 4);
+        __m256 h10 = _mm256_i32gather_ps(data, i10, 4);
+        __m256 h01 = _mm256_i32gather_ps(data, i01, 4);
+        __m256 h11 = _mm256_i32gather_ps(data, i11, 4);
+
+        __m256 ifx = _mm256_sub_ps(one, fx);
+        __m256 h0 = _mm256_add_ps(_mm256_mul_ps(h00, ifx), _mm256_mul_ps(h10, fx));
+        __m256 h1 = _mm256_add_ps(_mm256_mul_ps(h01, ifx), _mm256_mul_ps(h11, fx));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(h0, _mm256_sub_ps(one, fz)), _mm256_mul_ps(h1, fz)));
+    }
+#endif
+
+    interpolateHeights(data, 1.0f, width, height, xs + i, zs + i, out + i, count - i);
+}
+
+// Normals for a w x h block of samples, same central difference as
+// GetNormal. The block plus a one sample border is read once, so the inner
+// loop has no clamping and no per tap lookups.
+void Heightmap::GetNormals(int x, int z, int w, int h, Vec3 *out) const
+{
+    if (width <= 0 || height <= 0 || w <= 0 || h <= 0)
+        return;
+
+    const int pw = w + 2;
+    std::vector<float> padded((size_t)pw * (h + 2));
+
+    const int x0 = Clamp(x - 1, 0, width - 1);
+    const int x1 = Clamp(x + w, 0, width - 1);
+    const int span = x1 - x0 + 1;
+    const int lead = x0 - (x - 1);
+    std::vector<float> row(span);
+
+    for (int r = 0; r < h + 2; ++r)
+    {
+        ConvertRegion(x0, Clamp(z - 1 + r, 0, height - 1), span, 1, row.data());
+        float *dst = padded.data() + r * pw;
+        for (int c = 0; c < pw; ++c)
+            dst[c] = row[Clamp(c - lead, 0, span - 1)];
+    }
+
+    for (int r = 0; r < h; ++r)
+    {
+        const float *up = padded.data() + (r + 2) * pw + 1;
+        const float *mid = padded.data() + (r + 1) * pw + 1;
+        const float *down = padded.data() + r * pw + 1;
+        Vec3 *dst = out + r * w;
+        for (int c = 0; c < w; ++c)
+        {
+            const float nx = mid[c - 1] - mid[c + 1];
+            const float nz = down[c] - up[c];
+            const float inv = 1.0f / std::sqrt(nx * nx + 4.0f + nz * nz);
+            dst[c].x = nx * inv;
+            dst[c].y = 2.0f * inv;
+            dst[c].z = nz * inv;
+        }
+    }
+}
+
 Vec3 Heightmap::GetNormal(int x, int z)
 {
 
@@ -129,11 +396,60 @@ Vec3 Heightmap::GetNormal(int x, int z)
     normal.normalize();
     return normal;
 }
-bool Heightmap::Load(const char *filename, int bitDepth)
+bool Heightmap::openRaw(const char *filename, int bitDepth, size_t fileSize)
 {
-    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
+    size_t pixelSize = bitDepth / 8;
+    if (fileSize == 0 || fileSize % pixelSize != 0)
     {
-        Utils::LogError("Unsupported bit depth: %d", bitDepth);
+        Utils::LogError("Invalid file size: %s", filename);
+        return false;
+    }
+
+    size_t numPixels = fileSize / pixelSize;
+    int side = static_cast<int>(std::sqrt((double)numPixels));
+    if (static_cast<size_t>(side) * side != numPixels)
+    {
+        Utils::LogError("Invalid file size: %s", filename);
+        return false;
+    }
+    width = side;
+    height = side;
+    return true;
+}
+
+bool Heightmap::Map(const char *filename, int bitDepth)
+{
+    if (bitDepth != 8 && bitDepth != 16)
+    {
+        Utils::LogError("Unsupported bit depth for mapping: %d", bitDepth);
+        return false;
+    }
+
+    size_t fileSize = 0;
+    void *data = Utils::MapFile(filename, &fileSize);
+    if (!data)
+        return false;
+
+    if (!openRaw(filename, bitDepth, fileSize))
+    {
+        Utils::UnmapFile(data, fileSize);
+        return false;
+    }
+
+    releaseData();
+    nativeData = static_cast<u8 *>(data);
+    nativeDepth = bitDepth;
+    mappedSize = fileSize;
+
+    Utils::LogInfo("Heightmap mapped: %s [%dx%d, %d bits]", filename, width, height, bitDepth);
+    return true;
+}
+
+bool Heightmap::LoadNative(const char *filename, int bitDepth)
+{
+    if (bitDepth != 8 && bitDepth != 16)
+    {
+        Utils::LogError("Unsupported native bit depth: %d", bitDepth);
         return false;
     }
 
@@ -144,30 +460,67 @@ bool Heightmap::Load(const char *filename, int bitDepth)
         return false;
     }
     size_t fileSize = SDL_RWsize(file);
-    size_t pixelSize = bitDepth / 8;
-
-    if (fileSize % pixelSize != 0)
+    if (!openRaw(filename, bitDepth, fileSize))
     {
         SDL_RWclose(file);
-        Utils::LogError("Invalid file size: %s", filename);
         return false;
     }
 
-    size_t numPixels = fileSize / pixelSize;
-    width = static_cast<int>(std::sqrt(numPixels));
-    height = width;
+    releaseData();
+    nativeData = new u8[fileSize];
+    nativeDepth = bitDepth;
+    const bool read = SDL_RWread(file, nativeData, fileSize, 1) == 1;
+    SDL_RWclose(file);
+    if (!read)
+    {
+        releaseData();
+        Utils::LogError("Failed to read file: %s", filename);
+        return false;
+    }
+
+    Utils::LogInfo("Heightmap loaded: %s [%dx%d, %d bits native]", filename, width, height, bitDepth);
+    return true;
+}
 
-    if (width * height != static_cast<int>(numPixels))
+bool Heightmap::Load(const char *filename, int bitDepth)
+{
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
     {
-        SDL_RWclose(file);
-        Utils::LogError("Invalid file size: %s", filename);
+        Utils::LogError("Unsupported bit depth: %d", bitDepth);
         return false;
     }
 
-    if (heightData)
+    // 8/16 bit files are mapped and converted in place, no staging copy
+    if (bitDepth <= 16)
     {
-        delete[] heightData;
+        if (!Map(filename, bitDepth))
+            return false;
+        GetData();
+        if (mappedSize > 0)
+            Utils::UnmapFile(nativeData, mappedSize);
+        nativeData = nullptr;
+        nativeDepth = 0;
+        mappedSize = 0;
+        return true;
+    }
+
+    SDL_RWops *file = SDL_RWFromFile(filename, "rb");
+    if (!file)
+    {
+        Utils::LogError("Failed to open file: %s", filename);
+        return false;
+    }
+    size_t fileSize = SDL_RWsize(file);
+    size_t pixelSize = bitDepth / 8;
+
+    if (!openRaw(filename, bitDepth, fileSize))
+    {
+        SDL_RWclose(file);
+        return false;
     }
+    size_t numPixels = fileSize / pixelSize;
+
+    releaseData();
 
     std::vector<u8> buffer(fileSize);
     SDL_RWread(file, buffer.data(), fileSize, 1);
@@ -204,7 +557,8 @@ bool Heightmap::Save(const char *filename, int bitDepth)
 
     for (size_t i = 0; i < (size_t)(width * height); ++i)
     {
-        writeRawValue(buffer.data() + i * (bitDepth / 8), bitDepth, heightData[i]);
+        float value = heightData ? heightData[i] : GetHeight(i % width, i / width);
+        writeRawValue(buffer.data() + i * (bitDepth / 8), bitDepth, value);
     }
 
     SDL_RWwrite(file, buffer.data(), buffer.size(), 1);
@@ -212,111 +566,844 @@ bool Heightmap::Save(const char *filename, int bitDepth)
     return true;
 }
 
-Transform::Transform()
-    : position(0.0f, 0.0f, 0.0f),
-      rotation(Quat(0.0f, 0.0f, 0.0f, 1.0f)),
-      scale(1.0f, 1.0f, 1.0f),
-      localMatrix(Mat4::Identity()),
-      worldMatrix(Mat4::Identity()),
-      parent(nullptr),
-      isDirty(true) {}
+//***************************************************************************************************************
+// TiledHeightmap
+//***************************************************************************************************************
 
-void Transform::SetPosition(const Vec3 &pos, bool global)
+static const u32 TILED_HEIGHTMAP_MAGIC = 0x544D4842; // "BHMT"
+static const u32 TILED_HEIGHTMAP_VERSION = 1;
+static const s32 TILED_HEIGHTMAP_MAX_SIZE = 1 << 16;
+
+struct TiledHeightmapHeader
 {
-    if (global && parent)
-    {
-        Vec3 parentWorldPos;
-        parent->GetWorldMatrix().transformPoint(parentWorldPos);
-        position = pos - parentWorldPos; // Calcula posição relativa
-    }
-    else
-    {
-        position = pos;
-    }
-    MarkDirty();
+    u32 magic;
+    u32 version;
+    s32 width;
+    s32 height;
+    s32 tileSize;
+    s32 levels;
+    float maxHeight;
+};
+
+static u32 mortonCode(u32 x, u32 y)
+{
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    y = (y | (y << 8)) & 0x00FF00FF;
+    y = (y | (y << 4)) & 0x0F0F0F0F;
+    y = (y | (y << 2)) & 0x33333333;
+    y = (y | (y << 1)) & 0x55555555;
+    return x | (y << 1);
 }
 
-void Transform::SetRotation(const Quat &rot, bool global)
+static inline float tiledSample(const std::vector<float> &data, const std::vector<u32> &slots, int tilesX, int x, int z)
 {
-    if (global && parent)
-    {
-        Quat parentRotation = parent->GetRotation(true);
-        rotation = parentRotation.inverse() * rot;
-    }
-    else
-    {
-        rotation = rot;
-    }
-    MarkDirty();
+    const u32 slot = slots[(z >> HEIGHTMAP_TILE_SHIFT) * tilesX + (x >> HEIGHTMAP_TILE_SHIFT)];
+    return data[(slot << (HEIGHTMAP_TILE_SHIFT * 2)) + ((z & (HEIGHTMAP_TILE_SIZE - 1)) << HEIGHTMAP_TILE_SHIFT) + (x & (HEIGHTMAP_TILE_SIZE - 1))];
 }
 
-void Transform::SetScale(const Vec3 &scl, bool global)
+TiledHeightmap::TiledHeightmap()
 {
-    if (global && parent)
-    {
-        Vec3 parentScale = parent->GetScale(true);
-        scale = Vec3(scl.x / parentScale.x, scl.y / parentScale.y, scl.z / parentScale.z);
-    }
-    else
-    {
-        scale = scl;
-    }
-    MarkDirty();
+    maxHeight = 0.0f;
 }
 
-Vec3 Transform::GetPosition(bool global) const
+void TiledHeightmap::Release()
 {
-    if (global && parent)
-    {
-        Vec3 worldPosition = position;
-        parent->GetWorldMatrix().transformPoint(worldPosition);
-        return worldPosition;
-    }
-    return position;
+    levels.clear();
 }
 
-Quat Transform::GetRotation(bool global) const
+void TiledHeightmap::initLevel(Level &level, int width, int height)
 {
-    if (global && parent)
-    {
-        return parent->GetRotation(true) * rotation;
-    }
-    return rotation;
+    level.width = width;
+    level.height = height;
+    level.tilesX = (width + HEIGHTMAP_TILE_SIZE - 1) / HEIGHTMAP_TILE_SIZE;
+    level.tilesY = (height + HEIGHTMAP_TILE_SIZE - 1) / HEIGHTMAP_TILE_SIZE;
+
+    const int count = level.tilesX * level.tilesY;
+
+    // tiles are stored along a Z curve so 2x2 tile neighbourhoods stay close
+    std::vector<std::pair<u32, u32>> order(count);
+    for (int ty = 0; ty < level.tilesY; ++ty)
+        for (int tx = 0; tx < level.tilesX; ++tx)
+            order[ty * level.tilesX + tx] = std::make_pair(mortonCode(tx, ty), (u32)(ty * level.tilesX + tx));
+    std::sort(order.begin(), order.end());
+
+    level.slots.resize(count);
+    for (int i = 0; i < count; ++i)
+        level.slots[order[i].second] = i;
+
+    level.tileMin.assign(count, 0.0f);
+    level.tileMax.assign(count, 0.0f);
+    level.data.resize((size_t)count * HEIGHTMAP_TILE_SIZE * HEIGHTMAP_TILE_SIZE);
 }
 
-Vec3 Transform::GetScale(bool global) const
+void TiledHeightmap::buildMip(int index)
 {
-    if (global && parent)
+    const Level &src = levels[index - 1];
+    Level &dst = levels[index];
+
+    for (int ty = 0; ty < dst.tilesY; ++ty)
     {
-        Vec3 parentScale = parent->GetScale(true);
-        return Vec3(scale.x * parentScale.x, scale.y * parentScale.y, scale.z * parentScale.z);
+        for (int tx = 0; tx < dst.tilesX; ++tx)
+        {
+            const int tile = ty * dst.tilesX + tx;
+            float *out = dst.data.data() + ((size_t)dst.slots[tile] << (HEIGHTMAP_TILE_SHIFT * 2));
+            for (int r = 0; r < HEIGHTMAP_TILE_SIZE; ++r)
+            {
+                const int z = Min(ty * HEIGHTMAP_TILE_SIZE + r, dst.height - 1);
+                const int z0 = Min(z * 2, src.height - 1);
+                const int z1 = Min(z * 2 + 1, src.height - 1);
+                for (int c = 0; c < HEIGHTMAP_TILE_SIZE; ++c)
+                {
+                    const int x = Min(tx * HEIGHTMAP_TILE_SIZE + c, dst.width - 1);
+                    const int x0 = Min(x * 2, src.width - 1);
+                    const int x1 = Min(x * 2 + 1, src.width - 1);
+                    out[r * HEIGHTMAP_TILE_SIZE + c] = 0.25f * (tiledSample(src.data, src.slots, src.tilesX, x0, z0) +
+                                                                tiledSample(src.data, src.slots, src.tilesX, x1, z0) +
+                                                                tiledSample(src.data, src.slots, src.tilesX, x0, z1) +
+                                                                tiledSample(src.data, src.slots, src.tilesX, x1, z1));
+                }
+            }
+
+            // bounds are merged from the finer tiles so they stay exact for the full resolution data
+            bool first = true;
+            for (int j = 0; j < 2; ++j)
+            {
+                for (int i = 0; i < 2; ++i)
+                {
+                    const int cx = tx * 2 + i;
+                    const int cy = ty * 2 + j;
+                    if (cx >= src.tilesX || cy >= src.tilesY)
+                        continue;
+                    const int child = cy * src.tilesX + cx;
+                    if (first)
+                    {
+                        dst.tileMin[tile] = src.tileMin[child];
+                        dst.tileMax[tile] = src.tileMax[child];
+                        first = false;
+                    }
+                    else
+                    {
+                        dst.tileMin[tile] = Min(dst.tileMin[tile], src.tileMin[child]);
+                        dst.tileMax[tile] = Max(dst.tileMax[tile], src.tileMax[child]);
+                    }
+                }
+            }
+        }
     }
-    return scale;
 }
 
-void Transform::Move(const Vec3 &delta, bool global)
+bool TiledHeightmap::Build(Heightmap &heightmap)
 {
-    if (global)
+    const int width = heightmap.GetWidth();
+    const int height = heightmap.GetHeight();
+    if (width <= 0 || height <= 0)
     {
-        SetPosition(GetPosition(true) + delta, true);
+        Utils::LogError("TiledHeightmap: empty source heightmap");
+        return false;
     }
-    else
+
+    u32 startTimer = SDL_GetTicks();
+    levels.clear();
+    maxHeight = heightmap.GetMaxHeight();
+
+    levels.push_back(Level());
+    Level &base = levels[0];
+    initLevel(base, width, height);
+
+    for (int ty = 0; ty < base.tilesY; ++ty)
     {
-        SetPosition(position + delta, false);
+        for (int tx = 0; tx < base.tilesX; ++tx)
+        {
+            const int tile = ty * base.tilesX + tx;
+            float *out = base.data.data() + ((size_t)base.slots[tile] << (HEIGHTMAP_TILE_SHIFT * 2));
+            const int x = tx * HEIGHTMAP_TILE_SIZE;
+            const int w = Min(HEIGHTMAP_TILE_SIZE, width - x);
+
+            // samples past the map edge repeat the last row / column
+            for (int r = 0; r < HEIGHTMAP_TILE_SIZE; ++r)
+            {
+                float *row = out + r * HEIGHTMAP_TILE_SIZE;
+                heightmap.ConvertRegion(x, Min(ty * HEIGHTMAP_TILE_SIZE + r, height - 1), w, 1, row);
+                for (int c = w; c < HEIGHTMAP_TILE_SIZE; ++c)
+                    row[c] = row[w - 1];
+            }
+
+            float minHeight = out[0];
+            float maxValue = out[0];
+            for (int i = 1; i < HEIGHTMAP_TILE_SIZE * HEIGHTMAP_TILE_SIZE; ++i)
+            {
+                minHeight = Min(minHeight, out[i]);
+                maxValue = Max(maxValue, out[i]);
+            }
+            base.tileMin[tile] = minHeight;
+            base.tileMax[tile] = maxValue;
+        }
+    }
+
+    while (levels.back().width > HEIGHTMAP_TILE_SIZE || levels.back().height > HEIGHTMAP_TILE_SIZE)
+    {
+        const Level &prev = levels.back();
+        Level level;
+        initLevel(level, Max(1, (prev.width + 1) / 2), Max(1, (prev.height + 1) / 2));
+        levels.push_back(level);
+        buildMip((int)levels.size() - 1);
     }
+
+    Utils::LogInfo("TiledHeightmap: [%dx%d] %d levels built in %d ms", width, height, (int)levels.size(), SDL_GetTicks() - startTimer);
+    return true;
 }
 
-void Transform::Turn(const Quat &deltaRotation, bool global)
+bool TiledHeightmap::Save(const char *filename) const
 {
-    if (global)
+    if (levels.empty())
+        return false;
+
+    SDL_RWops *file = SDL_RWFromFile(filename, "wb");
+    if (!file)
     {
-        SetRotation(deltaRotation * GetRotation(true), true);
+        Utils::LogError("Failed to save file: %s", filename);
+        return false;
     }
-    else
+
+    TiledHeightmapHeader header;
+    header.magic = TILED_HEIGHTMAP_MAGIC;
+    header.version = TILED_HEIGHTMAP_VERSION;
+    header.width = levels[0].width;
+    header.height = levels[0].height;
+    header.tileSize = HEIGHTMAP_TILE_SIZE;
+    header.levels = (s32)levels.size();
+    header.maxHeight = maxHeight;
+    bool written = SDL_RWwrite(file, &header, sizeof(header), 1) == 1;
+
+    for (size_t i = 0; i < levels.size() && written; ++i)
     {
-        SetRotation(rotation * deltaRotation, false);
+        const Level &level = levels[i];
+        written = SDL_RWwrite(file, level.tileMin.data(), sizeof(float), level.tileMin.size()) == level.tileMin.size() &&
+                  SDL_RWwrite(file, level.tileMax.data(), sizeof(float), level.tileMax.size()) == level.tileMax.size() &&
+                  SDL_RWwrite(file, level.data.data(), sizeof(float), level.data.size()) == level.data.size();
     }
-}
+
+    SDL_RWclose(file);
+    if (!written)
+    {
+        Utils::LogError("Failed to write file: %s", filename);
+        return false;
+    }
+    Utils::LogInfo("TiledHeightmap saved: %s [%dx%d, %d levels]", filename, header.width, header.height, header.levels);
+    return true;
+}
+
+bool TiledHeightmap::Load(const char *filename)
+{
+    SDL_RWops *file = SDL_RWFromFile(filename, "rb");
+    if (!file)
+    {
+        Utils::LogError("Failed to open file: %s", filename);
+        return false;
+    }
+
+    TiledHeightmapHeader header;
+    if (SDL_RWread(file, &header, sizeof(header), 1) != 1 ||
+        header.magic != TILED_HEIGHTMAP_MAGIC || header.version != TILED_HEIGHTMAP_VERSION ||
+        header.tileSize != HEIGHTMAP_TILE_SIZE || header.width <= 0 || header.height <= 0 ||
+        header.width > TILED_HEIGHTMAP_MAX_SIZE || header.height > TILED_HEIGHTMAP_MAX_SIZE)
+    {
+        SDL_RWclose(file);
+        Utils::LogError("Invalid tiled heightmap: %s", filename);
+        return false;
+    }
+
+    // the pyramid is fully defined by the base size: the level count must be
+    // the one Build makes, and every level table has to be in the file
+    // before anything is allocated
+    int expectedLevels = 1;
+    u64 expectedSize = sizeof(header);
+    for (int width = header.width, height = header.height;; ++expectedLevels)
+    {
+        const u64 tiles = (u64)((width + HEIGHTMAP_TILE_SIZE - 1) >> HEIGHTMAP_TILE_SHIFT) * ((height + HEIGHTMAP_TILE_SIZE - 1) >> HEIGHTMAP_TILE_SHIFT);
+        expectedSize += tiles * (2 + HEIGHTMAP_TILE_SIZE * HEIGHTMAP_TILE_SIZE) * sizeof(float);
+        if (width <= HEIGHTMAP_TILE_SIZE && height <= HEIGHTMAP_TILE_SIZE)
+            break;
+        width = Max(1, (width + 1) / 2);
+        height = Max(1, (height + 1) / 2);
+    }
+    const Sint64 fileSize = SDL_RWsize(file);
+    if (header.levels != expectedLevels || fileSize < 0 || (u64)fileSize < expectedSize)
+    {
+        SDL_RWclose(file);
+        Utils::LogError("Invalid tiled heightmap: %s (%d levels, %lld of %llu bytes)", filename, header.levels, (long long)fileSize, (unsigned long long)expectedSize);
+        return false;
+    }
+
+    levels.clear();
+    levels.resize(header.levels);
+    maxHeight = header.maxHeight;
+
+    int width = header.width;
+    int height = header.height;
+    for (int i = 0; i < header.levels; ++i)
+    {
+        Level &level = levels[i];
+        initLevel(level, width, height);
+
+        size_t read = SDL_RWread(file, level.tileMin.data(), sizeof(float), level.tileMin.size());
+        read += SDL_RWread(file, level.tileMax.data(), sizeof(float), level.tileMax.size());
+        read += SDL_RWread(file, level.data.data(), sizeof(float), level.data.size());
+        if (read != level.tileMin.size() * 2 + level.data.size())
+        {
+            SDL_RWclose(file);
+            levels.clear();
+            Utils::LogError("Truncated tiled heightmap: %s", filename);
+            return false;
+        }
+
+        width = Max(1, (width + 1) / 2);
+        height = Max(1, (height + 1) / 2);
+    }
+
+    SDL_RWclose(file);
+    Utils::LogInfo("TiledHeightmap loaded: %s [%dx%d, %d levels]", filename, header.width, header.height, header.levels);
+    return true;
+}
+
+float TiledHeightmap::GetHeight(int x, int z, int level) const
+{
+    const Level &l = levels[level];
+    x = Clamp(x, 0, l.width - 1);
+    z = Clamp(z, 0, l.height - 1);
+    return tiledSample(l.data, l.slots, l.tilesX, x, z);
+}
+
+float TiledHeightmap::GetInterpolatedHeight(float x, float z, int level) const
+{
+    int x0 = static_cast<int>(std::floor(x));
+    int z0 = static_cast<int>(std::floor(z));
+    float fx = x - x0;
+    float fz = z - z0;
+
+    float h00 = GetHeight(x0, z0, level);
+    float h10 = GetHeight(x0 + 1, z0, level);
+    float h01 = GetHeight(x0, z0 + 1, level);
+    float h11 = GetHeight(x0 + 1, z0 + 1, level);
+
+    float h0 = h00 * (1 - fx) + h10 * fx;
+    float h1 = h01 * (1 - fx) + h11 * fx;
+
+    return h0 * (1 - fz) + h1 * fz;
+}
+
+const float *TiledHeightmap::GetTile(int tx, int tz, int level) const
+{
+    const Level &l = levels[level];
+    if (tx < 0 || tz < 0 || tx >= l.tilesX || tz >= l.tilesY)
+        return nullptr;
+    return l.data.data() + ((size_t)l.slots[tz * l.tilesX + tx] << (HEIGHTMAP_TILE_SHIFT * 2));
+}
+
+void TiledHeightmap::ReadRegion(int x, int z, int w, int h, int level, float *out) const
+{
+    const Level &l = levels[level];
+    const bool inside = x >= 0 && z >= 0 && x + w <= l.width && z + h <= l.height;
+
+    for (int r = 0; r < h; ++r)
+    {
+        float *dst = out + r * w;
+        if (!inside)
+        {
+            for (int c = 0; c < w; ++c)
+                dst[c] = GetHeight(x + c, z + r, level);
+            continue;
+        }
+
+        // copy whole tile row spans
+        const int zz = z + r;
+        int c = 0;
+        while (c < w)
+        {
+            const int xx = x + c;
+            const int span = Min(w - c, HEIGHTMAP_TILE_SIZE - (xx & (HEIGHTMAP_TILE_SIZE - 1)));
+            const float *src = GetTile(xx >> HEIGHTMAP_TILE_SHIFT, zz >> HEIGHTMAP_TILE_SHIFT, level) +
+                               ((zz & (HEIGHTMAP_TILE_SIZE - 1)) << HEIGHTMAP_TILE_SHIFT) + (xx & (HEIGHTMAP_TILE_SIZE - 1));
+            memcpy(dst + c, src, span * sizeof(float));
+            c += span;
+        }
+    }
+}
+
+void TiledHeightmap::queryMinMax(int level, int x0, int z0, int x1, int z1, float &minHeight, float &maxValue) const
+{
+    const Level &l = levels[level];
+    const Level &base = levels[0];
+    const int footprint = HEIGHTMAP_TILE_SIZE << level;
+
+    for (int ty = z0 / footprint; ty <= (z1 - 1) / footprint; ++ty)
+    {
+        for (int tx = x0 / footprint; tx <= (x1 - 1) / footprint; ++tx)
+        {
+            // tile area in full resolution samples, clipped to the map
+            const int ax0 = tx * footprint;
+            const int az0 = ty * footprint;
+            const int ax1 = Min(ax0 + footprint, base.width);
+            const int az1 = Min(az0 + footprint, base.height);
+
+            const int ix0 = Max(ax0, x0);
+            const int iz0 = Max(az0, z0);
+            const int ix1 = Min(ax1, x1);
+            const int iz1 = Min(az1, z1);
+            if (ix0 >= ix1 || iz0 >= iz1)
+                continue;
+
+            if (ix0 == ax0 && iz0 == az0 && ix1 == ax1 && iz1 == az1)
+            {
+                const int tile = ty * l.tilesX + tx;
+                minHeight = Min(minHeight, l.tileMin[tile]);
+                maxValue = Max(maxValue, l.tileMax[tile]);
+            }
+            else if (level > 0)
+            {
+                queryMinMax(level - 1, ix0, iz0, ix1, iz1, minHeight, maxValue);
+            }
+            else
+            {
+                for (int z = iz0; z < iz1; ++z)
+                {
+                    for (int x = ix0; x < ix1; ++x)
+                    {
+                        const float v = tiledSample(base.data, base.slots, base.tilesX, x, z);
+                        minHeight = Min(minHeight, v);
+                        maxValue = Max(maxValue, v);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool TiledHeightmap::GetMinMax(int x, int z, int w, int h, float &minHeight, float &maxValue) const
+{
+    if (levels.empty())
+        return false;
+
+    const int x0 = Max(x, 0);
+    const int z0 = Max(z, 0);
+    const int x1 = Min(x + w, levels[0].width);
+    const int z1 = Min(z + h, levels[0].height);
+    if (x0 >= x1 || z0 >= z1)
+        return false;
+
+    minHeight = FLT_MAX;
+    maxValue = -FLT_MAX;
+    queryMinMax((int)levels.size() - 1, x0, z0, x1, z1, minHeight, maxValue);
+    return true;
+}
+
+//***************************************************************************************************************
+// HeightmapRaycaster
+//***************************************************************************************************************
+
+static const int RAYCAST_STACK = 128;
+
+HeightmapRaycaster::HeightmapRaycaster() : heightmap(nullptr), position(0.0f, 0.0f, 0.0f), scale(1.0f, 1.0f, 1.0f)
+{
+}
+
+void HeightmapRaycaster::Release()
+{
+    levels.clear();
+    heightmap = nullptr;
+}
+
+bool HeightmapRaycaster::Build(Heightmap &source, const Vec3 &position, const Vec3 &scale)
+{
+    Release();
+    if (source.GetWidth() < 2 || source.GetHeight() < 2)
+    {
+        Utils::LogError("HeightmapRaycaster: heightmap too small");
+        return false;
+    }
+
+    heightmap = &source;
+    this->position = position;
+    this->scale = scale;
+
+    int w = source.GetWidth() - 1;
+    int h = source.GetHeight() - 1;
+    for (;;)
+    {
+        Level level;
+        level.width = w;
+        level.height = h;
+        level.minHeight.resize(w * h);
+        level.maxHeight.resize(w * h);
+        levels.push_back(level);
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    for (int i = 0; i < (int)levels.size(); i++)
+        buildLevel(i, 0, 0, levels[i].width - 1, levels[i].height - 1);
+    return true;
+}
+
+void HeightmapRaycaster::buildLevel(int index, int x0, int z0, int x1, int z1)
+{
+    Level &level = levels[index];
+    for (int z = z0; z <= z1; z++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            float lo, hi;
+            if (index == 0)
+            {
+                const float h00 = heightmap->GetHeight(x, z);
+                const float h10 = heightmap->GetHeight(x + 1, z);
+                const float h01 = heightmap->GetHeight(x, z + 1);
+                const float h11 = heightmap->GetHeight(x + 1, z + 1);
+                lo = Min(Min(h00, h10), Min(h01, h11));
+                hi = Max(Max(h00, h10), Max(h01, h11));
+            }
+            else
+            {
+                const Level &child = levels[index - 1];
+                lo = FLT_MAX;
+                hi = -FLT_MAX;
+                for (int cz = z * 2; cz <= Min(z * 2 + 1, child.height - 1); cz++)
+                {
+                    for (int cx = x * 2; cx <= Min(x * 2 + 1, child.width - 1); cx++)
+                    {
+                        lo = Min(lo, child.minHeight[cz * child.width + cx]);
+                        hi = Max(hi, child.maxHeight[cz * child.width + cx]);
+                    }
+                }
+            }
+            level.minHeight[z * level.width + x] = lo;
+            level.maxHeight[z * level.width + x] = hi;
+        }
+    }
+}
+
+void HeightmapRaycaster::Update(int x0, int z0, int x1, int z1)
+{
+    if (levels.empty())
+        return;
+
+    // a sample touches the cells on both sides of it
+    x0 = Max(x0 - 1, 0);
+    z0 = Max(z0 - 1, 0);
+    x1 = Min(x1, levels[0].width - 1);
+    z1 = Min(z1, levels[0].height - 1);
+    if (x0 > x1 || z0 > z1)
+        return;
+
+    for (int i = 0; i < (int)levels.size(); i++)
+    {
+        buildLevel(i, x0, z0, x1, z1);
+        x0 >>= 1;
+        z0 >>= 1;
+        x1 >>= 1;
+        z1 >>= 1;
+    }
+}
+
+// Möller–Trumbore without culling, t in (Epsilon, maxT)
+static inline bool raycastTriangle(const Vec3 &origin, const Vec3 &direction, const Vec3 &v0, const Vec3 &v1, const Vec3 &v2, float maxT, float &t)
+{
+    const Vec3 edge1 = v1 - v0;
+    const Vec3 edge2 = v2 - v0;
+    const Vec3 p = direction.cross(edge2);
+    const float det = edge1.dot(p);
+    if (fabs(det) < 1e-12f)
+        return false;
+
+    const float inv = 1.0f / det;
+    const Vec3 s = origin - v0;
+    const float u = s.dot(p) * inv;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    const Vec3 q = s.cross(edge1);
+    const float v = direction.dot(q) * inv;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    const float d = edge2.dot(q) * inv;
+    if (d <= Epsilon || d >= maxT)
+        return false;
+    t = d;
+    return true;
+}
+
+bool HeightmapRaycaster::intersectCell(const Vec3 &origin, const Vec3 &direction, int x, int z, float maxT, float &t) const
+{
+    const Vec3 p00((float)x, heightmap->GetHeight(x, z), (float)z);
+    const Vec3 p10((float)(x + 1), heightmap->GetHeight(x + 1, z), (float)z);
+    const Vec3 p01((float)x, heightmap->GetHeight(x, z + 1), (float)(z + 1));
+    const Vec3 p11((float)(x + 1), heightmap->GetHeight(x + 1, z + 1), (float)(z + 1));
+
+    bool found = false;
+    if (raycastTriangle(origin, direction, p00, p10, p01, maxT, t))
+    {
+        found = true;
+        maxT = t;
+    }
+    if (raycastTriangle(origin, direction, p10, p11, p01, maxT, t))
+        found = true;
+    return found;
+}
+
+bool HeightmapRaycaster::traverse(const Ray &ray, float maxDistance, bool anyHit, TerrainHit &hit) const
+{
+    if (levels.empty())
+        return false;
+
+    // local (sample) space; the ray parameter is the same in both spaces
+    const Vec3 origin((ray.origin.x - position.x) / scale.x, (ray.origin.y - position.y) / scale.y, (ray.origin.z - position.z) / scale.z);
+    const Vec3 direction(ray.direction.x / scale.x, ray.direction.y / scale.y, ray.direction.z / scale.z);
+    const Vec3 inv(direction.x != 0.0f ? 1.0f / direction.x : 1e30f,
+                   direction.y != 0.0f ? 1.0f / direction.y : 1e30f,
+                   direction.z != 0.0f ? 1.0f / direction.z : 1e30f);
+
+    struct Entry
+    {
+        int level, x, z;
+        float t;
+    };
+    Entry stack[RAYCAST_STACK];
+    int sp = 0;
+    stack[sp++] = {(int)levels.size() - 1, 0, 0, 0.0f};
+
+    const int cellsX = levels[0].width;
+    const int cellsZ = levels[0].height;
+    float best = maxDistance;
+    int bestX = -1, bestZ = -1;
+
+    while (sp > 0)
+    {
+        const Entry node = stack[--sp];
+        if (node.t >= best)
+            continue;
+
+        if (node.level == 0)
+        {
+            float t;
+            if (intersectCell(origin, direction, node.x, node.z, best, t))
+            {
+                best = t;
+                bestX = node.x;
+                bestZ = node.z;
+                if (anyHit)
+                    break;
+            }
+            continue;
+        }
+
+        // children sorted so the nearest one is popped first
+        const int childLevel = node.level - 1;
+        const Level &child = levels[childLevel];
+        Entry children[4];
+        int count = 0;
+        for (int cz = node.z * 2; cz <= Min(node.z * 2 + 1, child.height - 1); cz++)
+        {
+            for (int cx = node.x * 2; cx <= Min(node.x * 2 + 1, child.width - 1); cx++)
+            {
+                const float x0 = (float)(cx << childLevel);
+                const float z0 = (float)(cz << childLevel);
+                const float x1 = (float)Min((cx + 1) << childLevel, cellsX);
+                const float z1 = (float)Min((cz + 1) << childLevel, cellsZ);
+                const float y0 = child.minHeight[cz * child.width + cx];
+                const float y1 = child.maxHeight[cz * child.width + cx];
+
+                float tx1 = (x0 - origin.x) * inv.x, tx2 = (x1 - origin.x) * inv.x;
+                float ty1 = (y0 - origin.y) * inv.y, ty2 = (y1 - origin.y) * inv.y;
+                float tz1 = (z0 - origin.z) * inv.z, tz2 = (z1 - origin.z) * inv.z;
+                float tmin = Max(Max(Min(tx1, tx2), Min(ty1, ty2)), Max(Min(tz1, tz2), 0.0f));
+                float tmax = Min(Min(Max(tx1, tx2), Max(ty1, ty2)), Max(tz1, tz2));
+                if (tmax < tmin || tmin >= best)
+                    continue;
+
+                Entry e = {childLevel, cx, cz, tmin};
+                int i = count++;
+                while (i > 0 && children[i - 1].t < e.t)
+                {
+                    children[i] = children[i - 1];
+                    i--;
+                }
+                children[i] = e;
+            }
+        }
+        for (int i = 0; i < count && sp < RAYCAST_STACK; i++)
+            stack[sp++] = children[i];
+    }
+
+    if (bestX < 0)
+        return false;
+
+    hit.t = best;
+    hit.x = bestX;
+    hit.z = bestZ;
+    hit.position = ray.pointAt(best);
+
+    // normal of the triangle that was hit, in world space
+    const Vec3 local = origin + direction * best;
+    const float fx = local.x - bestX, fz = local.z - bestZ;
+    const float h00 = heightmap->GetHeight(bestX, bestZ);
+    const float h10 = heightmap->GetHeight(bestX + 1, bestZ);
+    const float h01 = heightmap->GetHeight(bestX, bestZ + 1);
+    const float h11 = heightmap->GetHeight(bestX + 1, bestZ + 1);
+    float dx, dz;
+    if (fx + fz <= 1.0f)
+    {
+        dx = h10 - h00;
+        dz = h01 - h00;
+    }
+    else
+    {
+        dx = h11 - h01;
+        dz = h11 - h10;
+    }
+    hit.normal = Vec3::Normalize(Vec3(-dx * scale.y / scale.x, 1.0f, -dz * scale.y / scale.z));
+    return true;
+}
+
+bool HeightmapRaycaster::Raycast(const Ray &ray, TerrainHit &hit, float maxDistance) const
+{
+    return traverse(ray, maxDistance, false, hit);
+}
+
+int HeightmapRaycaster::Raycast(const Ray *rays, TerrainHit *hits, int count, float maxDistance) const
+{
+    int hitCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (traverse(rays[i], maxDistance, false, hits[i]))
+            hitCount++;
+        else
+            hits[i].t = M_INFINITY;
+    }
+    return hitCount;
+}
+
+bool HeightmapRaycaster::LineOfSight(const Vec3 &from, const Vec3 &to) const
+{
+    const Vec3 delta = to - from;
+    const float distance = delta.length();
+    if (distance <= Epsilon)
+        return true;
+
+    TerrainHit hit;
+    return !traverse(Ray(from, delta), distance, true, hit);
+}
+
+Transform::Transform()
+    : position(0.0f, 0.0f, 0.0f),
+      rotation(Quat(0.0f, 0.0f, 0.0f, 1.0f)),
+      scale(1.0f, 1.0f, 1.0f),
+      localMatrix(Mat4::Identity()),
+      worldMatrix(Mat4::Identity()),
+      parent(nullptr),
+      isDirty(true) {}
+
+void Transform::SetPosition(const Vec3 &pos, bool global)
+{
+    if (global && parent)
+    {
+        Vec3 parentWorldPos;
+        parent->GetWorldMatrix().transformPoint(parentWorldPos);
+        position = pos - parentWorldPos; // Calcula posição relativa
+    }
+    else
+    {
+        position = pos;
+    }
+    MarkDirty();
+}
+
+void Transform::SetRotation(const Quat &rot, bool global)
+{
+    if (global && parent)
+    {
+        Quat parentRotation = parent->GetRotation(true);
+        rotation = parentRotation.inverse() * rot;
+    }
+    else
+    {
+        rotation = rot;
+    }
+    MarkDirty();
+}
+
+void Transform::SetScale(const Vec3 &scl, bool global)
+{
+    if (global && parent)
+    {
+        Vec3 parentScale = parent->GetScale(true);
+        scale = Vec3(scl.x / parentScale.x, scl.y / parentScale.y, scl.z / parentScale.z);
+    }
+    else
+    {
+        scale = scl;
+    }
+    MarkDirty();
+}
+
+Vec3 Transform::GetPosition(bool global) const
+{
+    if (global && parent)
+    {
+        Vec3 worldPosition = position;
+        parent->GetWorldMatrix().transformPoint(worldPosition);
+        return worldPosition;
+    }
+    return position;
+}
+
+Quat Transform::GetRotation(bool global) const
+{
+    if (global && parent)
+    {
+        return parent->GetRotation(true) * rotation;
+    }
+    return rotation;
+}
+
+Vec3 Transform::GetScale(bool global) const
+{
+    if (global && parent)
+    {
+        Vec3 parentScale = parent->GetScale(true);
+        return Vec3(scale.x * parentScale.x, scale.y * parentScale.y, scale.z * parentScale.z);
+    }
+    return scale;
+}
+
+void Transform::Move(const Vec3 &delta, bool global)
+{
+    if (global)
+    {
+        SetPosition(GetPosition(true) + delta, true);
+    }
+    else
+    {
+        SetPosition(position + delta, false);
+    }
+}
+
+void Transform::Turn(const Quat &deltaRotation, bool global)
+{
+    if (global)
+    {
+        SetRotation(deltaRotation * GetRotation(true), true);
+    }
+    else
+    {
+        SetRotation(rotation * deltaRotation, false);
+    }
+}
 
 const Mat4 &Transform::GetLocalMatrix()
 {
@@ -331,38 +1418,316 @@ const Mat4 &Transform::GetLocalMatrix()
     return localMatrix;
 }
 
-const Mat4 &Transform::GetWorldMatrix()
+const Mat4 &Transform::GetWorldMatrix()
+{
+    if (isDirty || (parent && parent->isDirty))
+    {
+        if (parent)
+        {
+            worldMatrix = parent->GetWorldMatrix() * GetLocalMatrix();
+        }
+        else
+        {
+            worldMatrix = GetLocalMatrix();
+        }
+        isDirty = false;
+    }
+    return worldMatrix;
+}
+
+void Transform::SetParent(Transform *newParent)
+{
+    if (parent == newParent)
+        return;
+
+    parent = newParent;
+
+    MarkDirty();
+}
+
+void Transform::MarkDirty()
+{
+    isDirty = true;
+    if (parent)
+        parent->MarkDirty();
+}
+
+//***************************************************************************************************************
+// TransformHierarchy
+//***************************************************************************************************************
+
+template <typename T>
+static void permute(std::vector<T> &data, const std::vector<int> &order)
+{
+    std::vector<T> sorted(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        sorted[i] = data[order[i]];
+    data.swap(sorted);
+}
+
+TransformHierarchy::TransformHierarchy() : freeHandle(TRANSFORM_NULL), removedCount(0), ordered(true), parentsFirst(true)
+{
+}
+
+int TransformHierarchy::Create(int parentHandle)
+{
+    int handle;
+    if (freeHandle != TRANSFORM_NULL)
+    {
+        handle = freeHandle;
+        freeHandle = indexOf[handle];
+    }
+    else
+    {
+        handle = (int)indexOf.size();
+        indexOf.push_back(TRANSFORM_NULL);
+    }
+
+    const int index = (int)parent.size();
+    const int parentIndex = parentHandle != TRANSFORM_NULL ? indexOf[parentHandle] : TRANSFORM_NULL;
+    indexOf[handle] = index;
+
+    // appending keeps parents first; the subtree stays contiguous only when
+    // the parent's subtree already ends the array
+    if (parentIndex != TRANSFORM_NULL && parentIndex + subtreeSize[parentIndex] != index)
+        ordered = false;
+    for (int p = parentIndex; ordered && p != TRANSFORM_NULL; p = parent[p])
+        subtreeSize[p]++;
+
+    parent.push_back(parentIndex);
+    subtreeSize.push_back(1);
+    position.push_back(Vec3(0.0f, 0.0f, 0.0f));
+    rotation.push_back(Quat(0.0f, 0.0f, 0.0f, 1.0f));
+    scale.push_back(Vec3(1.0f, 1.0f, 1.0f));
+    world.push_back(Mat4::Identity());
+    flags.push_back(TRANSFORM_DIRTY);
+    handleOf.push_back(handle);
+    return handle;
+}
+
+void TransformHierarchy::Destroy(int handle)
+{
+    if (!ordered)
+        sort();
+
+    const int index = indexOf[handle];
+    const int end = index + subtreeSize[index];
+    for (int i = index; i < end; ++i)
+    {
+        if (flags[i] & TRANSFORM_REMOVED)
+            continue;
+        flags[i] = TRANSFORM_REMOVED;
+        indexOf[handleOf[i]] = freeHandle;
+        freeHandle = handleOf[i];
+        removedCount++;
+    }
+}
+
+bool TransformHierarchy::SetParent(int handle, int parentHandle)
+{
+    const int index = indexOf[handle];
+    const int parentIndex = parentHandle != TRANSFORM_NULL ? indexOf[parentHandle] : TRANSFORM_NULL;
+    if (parent[index] == parentIndex)
+        return true;
+
+    for (int p = parentIndex; p != TRANSFORM_NULL; p = parent[p])
+    {
+        if (p == index)
+        {
+            Utils::LogError("TransformHierarchy: node %d can not be parented to its own subtree", handle);
+            return false;
+        }
+    }
+
+    parent[index] = parentIndex;
+    flags[index] |= TRANSFORM_DIRTY;
+    ordered = false;
+    if (parentIndex > index)
+        parentsFirst = false;
+    return true;
+}
+
+int TransformHierarchy::GetParent(int handle) const
+{
+    const int p = parent[indexOf[handle]];
+    return p != TRANSFORM_NULL ? handleOf[p] : TRANSFORM_NULL;
+}
+
+void TransformHierarchy::Clear()
+{
+    parent.clear();
+    subtreeSize.clear();
+    position.clear();
+    rotation.clear();
+    scale.clear();
+    world.clear();
+    flags.clear();
+    handleOf.clear();
+    indexOf.clear();
+    freeHandle = TRANSFORM_NULL;
+    removedCount = 0;
+    ordered = true;
+    parentsFirst = true;
+}
+
+void TransformHierarchy::SetPosition(int handle, const Vec3 &value)
+{
+    const int index = indexOf[handle];
+    position[index] = value;
+    flags[index] |= TRANSFORM_DIRTY;
+}
+
+void TransformHierarchy::SetRotation(int handle, const Quat &value)
+{
+    const int index = indexOf[handle];
+    rotation[index] = value;
+    flags[index] |= TRANSFORM_DIRTY;
+}
+
+void TransformHierarchy::SetScale(int handle, const Vec3 &value)
+{
+    const int index = indexOf[handle];
+    scale[index] = value;
+    flags[index] |= TRANSFORM_DIRTY;
+}
+
+void TransformHierarchy::SetLocal(int handle, const Vec3 &t, const Quat &r, const Vec3 &s)
+{
+    const int index = indexOf[handle];
+    position[index] = t;
+    rotation[index] = r;
+    scale[index] = s;
+    flags[index] |= TRANSFORM_DIRTY;
+}
+
+// Rebuilds the depth first order, dropping destroyed nodes. Children keep
+// their relative order. O(n), only after structural edits.
+void TransformHierarchy::sort()
+{
+    const int count = (int)parent.size();
+    std::vector<int> firstChild(count, TRANSFORM_NULL);
+    std::vector<int> nextSibling(count, TRANSFORM_NULL);
+    std::vector<int> roots;
+    for (int i = count - 1; i >= 0; --i)
+    {
+        if (flags[i] & TRANSFORM_REMOVED)
+            continue;
+        if (parent[i] == TRANSFORM_NULL)
+        {
+            roots.push_back(i);
+            continue;
+        }
+        nextSibling[i] = firstChild[parent[i]];
+        firstChild[parent[i]] = i;
+    }
+
+    // roots were collected backwards, the stack pops them in order
+    std::vector<int> order;
+    order.reserve(count - removedCount);
+    std::vector<int> stack(roots);
+    while (!stack.empty())
+    {
+        const int node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+
+        const size_t top = stack.size();
+        for (int child = firstChild[node]; child != TRANSFORM_NULL; child = nextSibling[child])
+            stack.push_back(child);
+        std::reverse(stack.begin() + top, stack.end());
+    }
+
+    std::vector<int> newIndex(count, TRANSFORM_NULL);
+    for (size_t i = 0; i < order.size(); ++i)
+        newIndex[order[i]] = (int)i;
+
+    permute(parent, order);
+    permute(position, order);
+    permute(rotation, order);
+    permute(scale, order);
+    permute(world, order);
+    permute(flags, order);
+    permute(handleOf, order);
+
+    const int sorted = (int)order.size();
+    subtreeSize.assign(sorted, 1);
+    for (int i = 0; i < sorted; ++i)
+    {
+        if (parent[i] != TRANSFORM_NULL)
+            parent[i] = newIndex[parent[i]];
+        indexOf[handleOf[i]] = i;
+    }
+    for (int i = sorted - 1; i > 0; --i)
+        if (parent[i] != TRANSFORM_NULL)
+            subtreeSize[parent[i]] += subtreeSize[i];
+
+    removedCount = 0;
+    ordered = true;
+    parentsFirst = true;
+}
+
+Mat4 TransformHierarchy::GetLocalMatrix(int handle) const
+{
+    const int index = indexOf[handle];
+    return Mat4::Compose(position[index], rotation[index], scale[index]);
+}
+
+void TransformHierarchy::Prepare()
+{
+    if (!ordered || removedCount > 0)
+        sort();
+}
+
+int TransformHierarchy::Partition(int maxRanges, std::vector<int> &bounds) const
 {
-    if (isDirty || (parent && parent->isDirty))
+    const int count = (int)parent.size();
+    bounds.clear();
+    bounds.push_back(0);
+    if (count == 0)
+        return 0;
+
+    const int target = Max(1, count / Max(1, maxRanges));
+    int start = 0;
+    for (int i = 0; i < count; i += subtreeSize[i])
     {
-        if (parent)
-        {
-            worldMatrix = parent->GetWorldMatrix() * GetLocalMatrix();
-        }
-        else
+        if (i - start >= target)
         {
-            worldMatrix = GetLocalMatrix();
+            bounds.push_back(i);
+            start = i;
         }
-        isDirty = false;
     }
-    return worldMatrix;
+    bounds.push_back(count);
+    return (int)bounds.size() - 1;
 }
 
-void Transform::SetParent(Transform *newParent)
+void TransformHierarchy::UpdateRange(int begin, int end)
 {
-    if (parent == newParent)
-        return;
-
-    parent = newParent;
-
-    MarkDirty();
+    for (int i = begin; i < end; ++i)
+    {
+        const int p = parent[i];
+        const bool changed = (flags[i] & TRANSFORM_DIRTY) || (p != TRANSFORM_NULL && (flags[p] & TRANSFORM_CHANGED));
+        if (changed)
+        {
+            if (p == TRANSFORM_NULL)
+            {
+                world[i] = Mat4::Compose(position[i], rotation[i], scale[i]);
+            }
+            else
+            {
+                world[i] = Mat4::Compose(position[i], rotation[i], scale[i]) * world[p];
+            }
+        }
+        flags[i] = changed ? TRANSFORM_CHANGED : 0;
+    }
 }
 
-void Transform::MarkDirty()
+void TransformHierarchy::Update()
 {
-    isDirty = true;
-    if (parent)
-        parent->MarkDirty();
+    // the linear pass only needs parents first, nodes created since the last
+    // sort are fine where they were appended
+    if (!parentsFirst || removedCount > 0)
+        sort();
+    UpdateRange(0, (int)parent.size());
 }
 
 //***************************************************************************************************************
@@ -370,7 +1735,8 @@ void Transform::MarkDirty()
 //***************************************************************************************************************
 
 Node3D::Node3D(const Vec3 &position, const Vec3 &rotation, const Vec3 &scale)
-    : RelativeTranslation(position), RelativeRotation(rotation), RelativeScale(scale)
+    : Parent(nullptr), RelativeTranslation(position), RelativeRotation(rotation), RelativeScale(scale),
+      Bounds(Vec3(-0.5f, -0.5f, -0.5f), Vec3(0.5f, 0.5f, 0.5f)), SpatialProxy(SPATIAL_NULL), SpatialOwner(nullptr)
 {
     Name = "Node3D";
     UpdateAbsolutePosition();
@@ -379,6 +1745,8 @@ Node3D::Node3D(const Vec3 &position, const Vec3 &rotation, const Vec3 &scale)
 
 Node3D::~Node3D()
 {
+    if (SpatialOwner)
+        SpatialOwner->Remove(this);
 }
 
 void Node3D::SetParent(Node3D *parent)
@@ -418,6 +1786,18 @@ Vec3 Node3D::GetAbsolutePosition()
     return AbsoluteTransformation.getTranslation();
 }
 
+BoundingBox Node3D::GetTransformedBoundingBox() const
+{
+    BoundingBox box = Bounds;
+    box.transform(AbsoluteTransformation);
+    return box;
+}
+
+bool Node3D::Intersect(const Ray &ray, float &t) const
+{
+    return ray.intersectBox(GetTransformedBoundingBox(), t);
+}
+
 void Node3D::Render()
 {
 }
@@ -487,3 +1867,651 @@ void Camera::RecalculateProjectionMatrix()
 {
     Driver::Instance().SetTransform(PROJECTION_MATRIX, Mat4::Perspective(FOV, Aspect, ZNear, ZFar));
 }
+
+
+//***************************************************************************************************************
+// SpatialTree
+//***************************************************************************************************************
+
+static float boxArea(const BoundingBox &box)
+{
+    const Vec3 d = box.max - box.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static BoundingBox boxUnion(const BoundingBox &a, const BoundingBox &b)
+{
+    return BoundingBox(Vec3(Min(a.min.x, b.min.x), Min(a.min.y, b.min.y), Min(a.min.z, b.min.z)),
+                       Vec3(Max(a.max.x, b.max.x), Max(a.max.y, b.max.y), Max(a.max.z, b.max.z)));
+}
+
+static bool boxContains(const BoundingBox &outer, const BoundingBox &inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+// slab test limited to [0, maxT], entry is the distance where the ray enters
+static bool rayBox(const Vec3 &origin, const Vec3 &invDir, const BoundingBox &box, float maxT, float &entry)
+{
+    float tx1 = (box.min.x - origin.x) * invDir.x;
+    float tx2 = (box.max.x - origin.x) * invDir.x;
+    float tmin = Min(tx1, tx2);
+    float tmax = Max(tx1, tx2);
+
+    float ty1 = (box.min.y - origin.y) * invDir.y;
+    float ty2 = (box.max.y - origin.y) * invDir.y;
+    tmin = Max(tmin, Min(ty1, ty2));
+    tmax = Min(tmax, Max(ty1, ty2));
+
+    float tz1 = (box.min.z - origin.z) * invDir.z;
+    float tz2 = (box.max.z - origin.z) * invDir.z;
+    tmin = Max(tmin, Min(tz1, tz2));
+    tmax = Min(tmax, Max(tz1, tz2));
+
+    entry = Max(tmin, 0.0f);
+    return tmax >= entry && entry < maxT;
+}
+
+static Vec3 inverseDirection(const Vec3 &direction)
+{
+    return Vec3(Abs(direction.x) > 1e-30f ? 1.0f / direction.x : 1e30f,
+                Abs(direction.y) > 1e-30f ? 1.0f / direction.y : 1e30f,
+                Abs(direction.z) > 1e-30f ? 1.0f / direction.z : 1e30f);
+}
+
+// traversal stack owned by one query, so queries can run concurrently and
+// a Node3D::Intersect override may query the tree it is in; a depth first
+// walk holds at most height + 1 entries, deeper trees spill to the heap
+class SpatialStack
+{
+private:
+    static const size_t INLINE_SIZE = 128;
+    int local[INLINE_SIZE];
+    std::vector<int> heap;
+    int *data;
+    size_t count;
+    size_t capacity;
+
+public:
+    SpatialStack() : data(local), count(0), capacity(INLINE_SIZE) {}
+
+    bool empty() const { return count == 0; }
+    int pop() { return data[--count]; }
+    void push(int value)
+    {
+        if (count == capacity)
+        {
+            std::vector<int> grown(capacity * 2);
+            memcpy(grown.data(), data, count * sizeof(int));
+            heap.swap(grown);
+            data = heap.data();
+            capacity *= 2;
+        }
+        data[count++] = value;
+    }
+};
+
+SpatialTree::SpatialTree(float margin)
+    : root(SPATIAL_NULL), freeList(SPATIAL_NULL), proxyCount(0), margin(margin)
+{
+}
+
+SpatialTree::~SpatialTree()
+{
+    Clear();
+}
+
+int SpatialTree::allocateNode()
+{
+    int index;
+    if (freeList == SPATIAL_NULL)
+    {
+        nodes.push_back(SpatialNode());
+        index = (int)nodes.size() - 1;
+    }
+    else
+    {
+        index = freeList;
+        freeList = nodes[index].parent;
+    }
+
+    SpatialNode &node = nodes[index];
+    node.userData = nullptr;
+    node.sceneNode = false;
+    node.parent = SPATIAL_NULL;
+    node.child1 = SPATIAL_NULL;
+    node.child2 = SPATIAL_NULL;
+    node.height = 0;
+    return index;
+}
+
+void SpatialTree::freeNode(int index)
+{
+    nodes[index].parent = freeList;
+    nodes[index].height = -1;
+    freeList = index;
+}
+
+void SpatialTree::insertLeaf(int leaf)
+{
+    if (root == SPATIAL_NULL)
+    {
+        root = leaf;
+        nodes[root].parent = SPATIAL_NULL;
+        return;
+    }
+
+    // descend towards the sibling with the lowest surface area cost
+    const BoundingBox leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].isLeaf())
+    {
+        const SpatialNode &node = nodes[index];
+        const float area = boxArea(node.box);
+        const float combinedArea = boxArea(boxUnion(node.box, leafBox));
+
+        // cost of pairing with this node, and the minimum extra cost pushed down to the children
+        const float cost = 2.0f * combinedArea;
+        const float inheritance = 2.0f * (combinedArea - area);
+
+        float childCost[2];
+        const int children[2] = {node.child1, node.child2};
+        for (int i = 0; i < 2; i++)
+        {
+            const SpatialNode &child = nodes[children[i]];
+            const float grown = boxArea(boxUnion(leafBox, child.box));
+            childCost[i] = (child.isLeaf() ? grown : grown - boxArea(child.box)) + inheritance;
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    const int sibling = index;
+    const int oldParent = nodes[sibling].parent;
+    const int newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = boxUnion(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+
+    if (oldParent != SPATIAL_NULL)
+    {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    }
+    else
+    {
+        root = newParent;
+    }
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    // refit and rebalance up to the root
+    index = nodes[leaf].parent;
+    while (index != SPATIAL_NULL)
+    {
+        index = balance(index);
+        SpatialNode &node = nodes[index];
+        node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+        node.box = boxUnion(nodes[node.child1].box, nodes[node.child2].box);
+        index = node.parent;
+    }
+}
+
+void SpatialTree::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = SPATIAL_NULL;
+        return;
+    }
+
+    const int parent = nodes[leaf].parent;
+    const int grandParent = nodes[parent].parent;
+    const int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent == SPATIAL_NULL)
+    {
+        root = sibling;
+        nodes[sibling].parent = SPATIAL_NULL;
+        freeNode(parent);
+        return;
+    }
+
+    if (nodes[grandParent].child1 == parent)
+        nodes[grandParent].child1 = sibling;
+    else
+        nodes[grandParent].child2 = sibling;
+    nodes[sibling].parent = grandParent;
+    freeNode(parent);
+
+    int index = grandParent;
+    while (index != SPATIAL_NULL)
+    {
+        index = balance(index);
+        SpatialNode &node = nodes[index];
+        node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+        node.box = boxUnion(nodes[node.child1].box, nodes[node.child2].box);
+        index = node.parent;
+    }
+}
+
+// Rotates the taller grandchild up when the two subtrees of index differ in
+// height by more than one. Returns the node now at the position of index.
+int SpatialTree::balance(int index)
+{
+    SpatialNode *a = &nodes[index];
+    if (a->isLeaf() || a->height < 2)
+        return index;
+
+    const int ib = a->child1;
+    const int ic = a->child2;
+    SpatialNode *b = &nodes[ib];
+    SpatialNode *c = &nodes[ic];
+    const int difference = c->height - b->height;
+
+    if (difference > 1)
+    {
+        const int f = c->child1;
+        const int g = c->child2;
+
+        c->child1 = index;
+        c->parent = a->parent;
+        a->parent = ic;
+        if (c->parent != SPATIAL_NULL)
+        {
+            if (nodes[c->parent].child1 == index)
+                nodes[c->parent].child1 = ic;
+            else
+                nodes[c->parent].child2 = ic;
+        }
+        else
+        {
+            root = ic;
+        }
+
+        // the taller of f / g stays under c, the other moves under a
+        const int keep = nodes[f].height > nodes[g].height ? f : g;
+        const int move = keep == f ? g : f;
+        c->child2 = keep;
+        a->child2 = move;
+        nodes[move].parent = index;
+        a->box = boxUnion(b->box, nodes[move].box);
+        c->box = boxUnion(a->box, nodes[keep].box);
+        a->height = 1 + std::max(b->height, nodes[move].height);
+        c->height = 1 + std::max(a->height, nodes[keep].height);
+        return ic;
+    }
+
+    if (difference < -1)
+    {
+        const int d = b->child1;
+        const int e = b->child2;
+
+        b->child1 = index;
+        b->parent = a->parent;
+        a->parent = ib;
+        if (b->parent != SPATIAL_NULL)
+        {
+            if (nodes[b->parent].child1 == index)
+                nodes[b->parent].child1 = ib;
+            else
+                nodes[b->parent].child2 = ib;
+        }
+        else
+        {
+            root = ib;
+        }
+
+        const int keep = nodes[d].height > nodes[e].height ? d : e;
+        const int move = keep == d ? e : d;
+        b->child2 = keep;
+        a->child1 = move;
+        nodes[move].parent = index;
+        a->box = boxUnion(c->box, nodes[move].box);
+        b->box = boxUnion(a->box, nodes[keep].box);
+        a->height = 1 + std::max(c->height, nodes[move].height);
+        b->height = 1 + std::max(a->height, nodes[keep].height);
+        return ib;
+    }
+
+    return index;
+}
+
+int SpatialTree::CreateProxy(const BoundingBox &box, void *userData)
+{
+    const int proxy = allocateNode();
+    const Vec3 r(margin, margin, margin);
+    nodes[proxy].box = BoundingBox(box.min - r, box.max + r);
+    nodes[proxy].userData = userData;
+    insertLeaf(proxy);
+    proxyCount++;
+    return proxy;
+}
+
+void SpatialTree::DestroyProxy(int proxy)
+{
+    if (proxy < 0 || proxy >= (int)nodes.size() || !nodes[proxy].isLeaf() || nodes[proxy].height != 0)
+    {
+        Utils::LogError("SpatialTree: invalid proxy %d", proxy);
+        return;
+    }
+    if (nodes[proxy].sceneNode)
+    {
+        Node3D *node = static_cast<Node3D *>(nodes[proxy].userData);
+        node->SpatialProxy = SPATIAL_NULL;
+        node->SpatialOwner = nullptr;
+    }
+    removeLeaf(proxy);
+    freeNode(proxy);
+    proxyCount--;
+}
+
+bool SpatialTree::MoveProxy(int proxy, const BoundingBox &box, const Vec3 &displacement)
+{
+    const Vec3 r(margin, margin, margin);
+    BoundingBox fat(box.min - r, box.max + r);
+
+    // stretch towards the motion so steadily moving objects reinsert less often
+    const Vec3 d = displacement * 4.0f;
+    if (d.x < 0.0f) fat.min.x += d.x; else fat.max.x += d.x;
+    if (d.y < 0.0f) fat.min.y += d.y; else fat.max.y += d.y;
+    if (d.z < 0.0f) fat.min.z += d.z; else fat.max.z += d.z;
+
+    const BoundingBox &current = nodes[proxy].box;
+    if (boxContains(current, box))
+    {
+        // still inside, keep it unless the stored box has grown far too loose
+        const Vec3 huge(4.0f * margin, 4.0f * margin, 4.0f * margin);
+        if (boxContains(BoundingBox(fat.min - huge, fat.max + huge), current))
+            return false;
+    }
+
+    removeLeaf(proxy);
+    nodes[proxy].box = fat;
+    insertLeaf(proxy);
+    return true;
+}
+
+void SpatialTree::Clear()
+{
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].height == 0 && nodes[i].sceneNode)
+        {
+            Node3D *node = static_cast<Node3D *>(nodes[i].userData);
+            node->SpatialProxy = SPATIAL_NULL;
+            node->SpatialOwner = nullptr;
+        }
+    }
+    nodes.clear();
+    root = SPATIAL_NULL;
+    freeList = SPATIAL_NULL;
+    proxyCount = 0;
+}
+
+int SpatialTree::Insert(Node3D *node)
+{
+    if (node->SpatialOwner == this)
+    {
+        Update(node);
+        return node->SpatialProxy;
+    }
+    if (node->SpatialOwner)
+        node->SpatialOwner->Remove(node);
+    node->SpatialProxy = CreateProxy(node->GetTransformedBoundingBox(), node);
+    node->SpatialOwner = this;
+    nodes[node->SpatialProxy].sceneNode = true;
+    return node->SpatialProxy;
+}
+
+void SpatialTree::Remove(Node3D *node)
+{
+    if (node->SpatialOwner != this)
+        return;
+    // DestroyProxy unlinks the node
+    DestroyProxy(node->SpatialProxy);
+}
+
+bool SpatialTree::Update(Node3D *node, const Vec3 &displacement)
+{
+    if (node->SpatialOwner != this)
+        return false;
+    return MoveProxy(node->SpatialProxy, node->GetTransformedBoundingBox(), displacement);
+}
+
+void SpatialTree::collect(int index, std::vector<void*> &results) const
+{
+    SpatialStack stack;
+    stack.push(index);
+    while (!stack.empty())
+    {
+        const SpatialNode &node = nodes[stack.pop()];
+        if (node.isLeaf())
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            stack.push(node.child1);
+            stack.push(node.child2);
+        }
+    }
+}
+
+u32 SpatialTree::QueryFrustum(const Frustum &frustum, std::vector<void*> &results) const
+{
+    if (root == SPATIAL_NULL)
+        return 0;
+
+    const size_t start = results.size();
+    Vec3 normal[6], absNormal[6];
+    float distance[6];
+    for (int i = 0; i < 6; i++)
+    {
+        normal[i] = frustum.planes[i].normal;
+        absNormal[i] = Vec3(Abs(normal[i].x), Abs(normal[i].y), Abs(normal[i].z));
+        distance[i] = frustum.planes[i].distance;
+    }
+
+    // entries pack the node index with the mask of planes the parent was not
+    // yet fully inside of; a subtree inside every plane is taken without tests
+    SpatialStack stack;
+    stack.push(root << 6 | 0x3f);
+    while (!stack.empty())
+    {
+        const int entry = stack.pop();
+        const SpatialNode &node = nodes[entry >> 6];
+        int mask = entry & 0x3f;
+
+        const Vec3 center = (node.box.min + node.box.max) * 0.5f;
+        const Vec3 extent = (node.box.max - node.box.min) * 0.5f;
+        bool outside = false;
+        for (int i = 0; i < 6; i++)
+        {
+            if (!(mask & (1 << i)))
+                continue;
+            const float d = normal[i].x * center.x + normal[i].y * center.y + normal[i].z * center.z + distance[i];
+            const float r = absNormal[i].x * extent.x + absNormal[i].y * extent.y + absNormal[i].z * extent.z;
+            if (d + r < 0.0f)
+            {
+                outside = true;
+                break;
+            }
+            if (d - r >= 0.0f)
+                mask &= ~(1 << i);
+        }
+        if (outside)
+            continue;
+
+        if (node.isLeaf())
+            results.push_back(node.userData);
+        else if (mask == 0)
+            collect(entry >> 6, results);
+        else
+        {
+            stack.push(node.child1 << 6 | mask);
+            stack.push(node.child2 << 6 | mask);
+        }
+    }
+    return (u32)(results.size() - start);
+}
+
+u32 SpatialTree::QuerySphere(const Vec3 &center, float radius, std::vector<void*> &results) const
+{
+    if (root == SPATIAL_NULL)
+        return 0;
+
+    const size_t start = results.size();
+    const float radiusSq = radius * radius;
+    SpatialStack stack;
+    stack.push(root);
+    while (!stack.empty())
+    {
+        const SpatialNode &node = nodes[stack.pop()];
+
+        const float dx = Max(Max(node.box.min.x - center.x, 0.0f), center.x - node.box.max.x);
+        const float dy = Max(Max(node.box.min.y - center.y, 0.0f), center.y - node.box.max.y);
+        const float dz = Max(Max(node.box.min.z - center.z, 0.0f), center.z - node.box.max.z);
+        if (dx * dx + dy * dy + dz * dz > radiusSq)
+            continue;
+
+        if (node.isLeaf())
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            stack.push(node.child1);
+            stack.push(node.child2);
+        }
+    }
+    return (u32)(results.size() - start);
+}
+
+u32 SpatialTree::QueryBox(const BoundingBox &box, std::vector<void*> &results) const
+{
+    if (root == SPATIAL_NULL)
+        return 0;
+
+    const size_t start = results.size();
+    SpatialStack stack;
+    stack.push(root);
+    while (!stack.empty())
+    {
+        const SpatialNode &node = nodes[stack.pop()];
+        if (!node.box.intersects(box))
+            continue;
+
+        if (node.isLeaf())
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            stack.push(node.child1);
+            stack.push(node.child2);
+        }
+    }
+    return (u32)(results.size() - start);
+}
+
+u32 SpatialTree::QueryRay(const Ray &ray, float maxDistance, std::vector<void*> &results) const
+{
+    if (root == SPATIAL_NULL)
+        return 0;
+
+    const size_t start = results.size();
+    const Vec3 invDir = inverseDirection(ray.direction);
+    SpatialStack stack;
+    stack.push(root);
+    while (!stack.empty())
+    {
+        const SpatialNode &node = nodes[stack.pop()];
+        float entry;
+        if (!rayBox(ray.origin, invDir, node.box, maxDistance, entry))
+            continue;
+
+        if (node.isLeaf())
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            stack.push(node.child1);
+            stack.push(node.child2);
+        }
+    }
+    return (u32)(results.size() - start);
+}
+
+Node3D *SpatialTree::Raycast(const Ray &ray, float &t, float maxDistance) const
+{
+    if (root == SPATIAL_NULL)
+        return nullptr;
+
+    Node3D *closest = nullptr;
+    float best = maxDistance;
+    float entry;
+    const Vec3 invDir = inverseDirection(ray.direction);
+
+    SpatialStack stack;
+    if (rayBox(ray.origin, invDir, nodes[root].box, best, entry))
+        stack.push(root);
+    while (!stack.empty())
+    {
+        const SpatialNode &node = nodes[stack.pop()];
+
+        if (node.isLeaf())
+        {
+            // the node's own test can be exact, the fat box only bounds it
+            const Node3D *candidate = static_cast<const Node3D *>(node.userData);
+            float hit;
+            if (candidate->Intersect(ray, hit) && hit < best)
+            {
+                best = hit;
+                closest = const_cast<Node3D *>(candidate);
+            }
+            continue;
+        }
+
+        // push the far child first so the near one is visited next
+        float entry1, entry2;
+        const bool hit1 = rayBox(ray.origin, invDir, nodes[node.child1].box, best, entry1);
+        const bool hit2 = rayBox(ray.origin, invDir, nodes[node.child2].box, best, entry2);
+        if (hit1 && hit2)
+        {
+            if (entry1 <= entry2)
+            {
+                stack.push(node.child2);
+                stack.push(node.child1);
+            }
+            else
+            {
+                stack.push(node.child1);
+                stack.push(node.child2);
+            }
+        }
+        else if (hit1)
+            stack.push(node.child1);
+        else if (hit2)
+            stack.push(node.child2);
+    }
+
+    if (closest)
+        t = best;
+    return closest;
+}
+
+BoundingBox SpatialTree::GetBounds() const
+{
+    if (root == SPATIAL_NULL)
+        return BoundingBox();
+    return nodes[root].box;
+}
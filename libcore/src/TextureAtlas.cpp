@@ -0,0 +1,498 @@
+#include "TextureAtlas.hpp"
+#include "TextureFile.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+static const int ATLAS_FILE_VERSION = 1;
+static const size_t MAX_REGION_NAME = 255;
+
+// one token of the index, what Load reads back with %255s
+static bool validRegionName(const std::string &name)
+{
+    if (name.empty() || name.size() > MAX_REGION_NAME)
+        return false;
+    for (size_t i = 0; i < name.size(); ++i)
+        if (isspace((unsigned char)name[i]))
+            return false;
+    return true;
+}
+
+//***************************************************************************************************************
+// RectPacker
+//***************************************************************************************************************
+
+RectPacker::RectPacker() : width(0), height(0), usedArea(0)
+{
+}
+
+void RectPacker::Init(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    usedArea = 0;
+    freeRects.clear();
+    PackRect all = {0, 0, width, height};
+    freeRects.push_back(all);
+}
+
+bool RectPacker::Insert(int width, int height, int &x, int &y)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    int bestShort = 0x7FFFFFFF;
+    int bestLong = 0x7FFFFFFF;
+    int best = -1;
+    for (size_t i = 0; i < freeRects.size(); ++i)
+    {
+        const PackRect &free = freeRects[i];
+        if (free.width < width || free.height < height)
+            continue;
+        const int leftoverX = free.width - width;
+        const int leftoverY = free.height - height;
+        const int shortSide = Min(leftoverX, leftoverY);
+        const int longSide = Max(leftoverX, leftoverY);
+        if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+        {
+            bestShort = shortSide;
+            bestLong = longSide;
+            best = (int)i;
+        }
+    }
+    if (best < 0)
+        return false;
+
+    x = freeRects[best].x;
+    y = freeRects[best].y;
+    Reserve(x, y, width, height);
+    return true;
+}
+
+void RectPacker::Reserve(int x, int y, int width, int height)
+{
+    const PackRect used = {x, y, width, height};
+    split.clear();
+    for (size_t i = 0; i < freeRects.size();)
+    {
+        if (splitFreeRect(freeRects[i], used))
+        {
+            freeRects[i] = freeRects.back();
+            freeRects.pop_back();
+        }
+        else
+            ++i;
+    }
+    prune();
+    usedArea += (u64)width * height;
+}
+
+// the parts of free outside used, as up to four maximal rectangles
+bool RectPacker::splitFreeRect(const PackRect &free, const PackRect &used)
+{
+    if (used.x >= free.x + free.width || used.x + used.width <= free.x ||
+        used.y >= free.y + free.height || used.y + used.height <= free.y)
+        return false;
+
+    if (used.y > free.y)
+    {
+        PackRect above = free;
+        above.height = used.y - free.y;
+        split.push_back(above);
+    }
+    if (used.y + used.height < free.y + free.height)
+    {
+        PackRect below = free;
+        below.y = used.y + used.height;
+        below.height = free.y + free.height - below.y;
+        split.push_back(below);
+    }
+    if (used.x > free.x)
+    {
+        PackRect left = free;
+        left.width = used.x - free.x;
+        split.push_back(left);
+    }
+    if (used.x + used.width < free.x + free.width)
+    {
+        PackRect right = free;
+        right.x = used.x + used.width;
+        right.width = free.x + free.width - right.x;
+        split.push_back(right);
+    }
+    return true;
+}
+
+static bool contains(const RectPacker::PackRect &a, const RectPacker::PackRect &b)
+{
+    return b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height;
+}
+
+// adds the new pieces in split that no other free rectangle contains; the
+// old ones were maximal already and a piece of a split rectangle cannot
+// contain them, so only the pieces need testing
+void RectPacker::prune()
+{
+    const size_t kept = freeRects.size();
+    for (size_t i = 0; i < split.size(); ++i)
+    {
+        bool contained = false;
+        for (size_t j = 0; j < kept && !contained; ++j)
+            contained = contains(freeRects[j], split[i]);
+        // of two equal pieces only the first survives
+        for (size_t j = 0; j < split.size() && !contained; ++j)
+            contained = j != i && contains(split[j], split[i]) && (j < i || !contains(split[i], split[j]));
+        if (!contained)
+            freeRects.push_back(split[i]);
+    }
+}
+
+//***************************************************************************************************************
+// TextureAtlas
+//***************************************************************************************************************
+
+TextureAtlas::TextureAtlas() : pageWidth(1024), pageHeight(1024), padding(1)
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    Release();
+}
+
+bool TextureAtlas::Init(int pageWidth, int pageHeight, int padding)
+{
+    if (pageWidth <= 0 || pageHeight <= 0 || padding < 0)
+    {
+        Utils::LogError("TextureAtlas: invalid page %dx%d padding %d", pageWidth, pageHeight, padding);
+        return false;
+    }
+    Release();
+    this->pageWidth = pageWidth;
+    this->pageHeight = pageHeight;
+    this->padding = padding;
+    return true;
+}
+
+void TextureAtlas::Release()
+{
+    for (size_t i = 0; i < pages.size(); ++i)
+    {
+        pages[i]->texture->Release();
+        delete pages[i]->texture;
+        delete pages[i]->pixmap;
+        delete pages[i];
+    }
+    pages.clear();
+    regions.clear();
+    regionNames.clear();
+    names.clear();
+}
+
+TextureAtlas::Page *TextureAtlas::addPage()
+{
+    Page *page = new Page();
+    page->pixmap = new Pixmap(pageWidth, pageHeight, 4);
+    page->pixmap->Clear();
+    page->texture = new Texture2D();
+    // Quad and the region UVs divide by these before the first Upload
+    page->texture->width = pageWidth;
+    page->texture->height = pageHeight;
+    // sprites are drawn near their size, and mips would bleed across regions
+    page->texture->SetMinFilter(FilterMode::Linear);
+    page->texture->SetWrapS(WrapMode::ClampToEdge);
+    page->texture->SetWrapT(WrapMode::ClampToEdge);
+    page->packer.Init(pageWidth, pageHeight);
+    page->dirtyTop = 0;
+    page->dirtyBottom = pageHeight;
+    pages.push_back(page);
+    return page;
+}
+
+// image at (x, y) + padding, its border texels repeated over the padding
+void TextureAtlas::blit(Page *page, const Pixmap &image, int x, int y)
+{
+    u8 *target = page->pixmap->pixels;
+    const int components = image.components;
+    for (int row = -padding; row < image.height + padding; ++row)
+    {
+        const u8 *source = image.pixels + (size_t)Clamp(row, 0, image.height - 1) * image.width * components;
+        u8 *line = target + ((size_t)(y + padding + row) * pageWidth + x) * 4;
+        for (int column = -padding; column < image.width + padding; ++column)
+        {
+            const u8 *texel = source + Clamp(column, 0, image.width - 1) * components;
+            u8 *out = line + (column + padding) * 4;
+            switch (components)
+            {
+            case 1:
+                out[0] = out[1] = out[2] = texel[0];
+                out[3] = 255;
+                break;
+            case 2:
+                out[0] = out[1] = out[2] = texel[0];
+                out[3] = texel[1];
+                break;
+            case 3:
+                out[0] = texel[0];
+                out[1] = texel[1];
+                out[2] = texel[2];
+                out[3] = 255;
+                break;
+            default:
+                memcpy(out, texel, 4);
+                break;
+            }
+        }
+    }
+    page->dirtyTop = Min(page->dirtyTop, y);
+    page->dirtyBottom = Max(page->dirtyBottom, y + image.height + padding * 2);
+}
+
+s32 TextureAtlas::Add(const std::string &name, const Pixmap &image)
+{
+    auto it = names.find(name);
+    if (it != names.end())
+        return (s32)it->second;
+
+    if (!validRegionName(name))
+    {
+        Utils::LogError("TextureAtlas: invalid region name '%s'", name.c_str());
+        return -1;
+    }
+    if (!image.pixels || image.width <= 0 || image.height <= 0)
+    {
+        Utils::LogError("TextureAtlas: empty image %s", name.c_str());
+        return -1;
+    }
+    const int width = image.width + padding * 2;
+    const int height = image.height + padding * 2;
+    if (width > pageWidth || height > pageHeight)
+    {
+        Utils::LogError("TextureAtlas: %s (%dx%d) is larger than a page", name.c_str(), image.width, image.height);
+        return -1;
+    }
+
+    // first page with room, the newest ones are the emptiest
+    Page *page = nullptr;
+    int x = 0;
+    int y = 0;
+    for (size_t i = pages.size(); i-- > 0;)
+        if (pages[i]->packer.Insert(width, height, x, y))
+        {
+            page = pages[i];
+            break;
+        }
+    if (!page)
+    {
+        page = addPage();
+        page->packer.Insert(width, height, x, y);
+    }
+    blit(page, image, x, y);
+
+    AtlasRegion region;
+    region.texture = page->texture;
+    region.src = Rectangle((float)(x + padding), (float)(y + padding), (float)image.width, (float)image.height);
+    region.page = (u32)(std::find(pages.begin(), pages.end(), page) - pages.begin());
+
+    const u32 handle = (u32)regions.size();
+    regions.push_back(region);
+    regionNames.push_back(name);
+    names[name] = handle;
+    return (s32)handle;
+}
+
+s32 TextureAtlas::Add(const char *file_name)
+{
+    const std::string name = Utils::GetFileNameWithoutExt(file_name);
+    auto it = names.find(name);
+    if (it != names.end())
+        return (s32)it->second;
+
+    Pixmap image;
+    if (!image.Load(file_name))
+        return -1;
+    return Add(name, image);
+}
+
+s32 TextureAtlas::Find(const std::string &name) const
+{
+    auto it = names.find(name);
+    return it == names.end() ? -1 : (s32)it->second;
+}
+
+void TextureAtlas::Upload()
+{
+    bool uploaded = false;
+    for (size_t i = 0; i < pages.size(); ++i)
+    {
+        Page *page = pages[i];
+        if (page->dirtyTop >= page->dirtyBottom)
+            continue;
+
+        if (page->texture->GetID() == 0)
+            page->texture->Load(*page->pixmap);
+        else
+        {
+            // whole rows, so the page pitch needs no unpack state
+            Driver::Instance().SelectTexture(page->texture->GetID());
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, page->dirtyTop, pageWidth, page->dirtyBottom - page->dirtyTop, GL_RGBA, GL_UNSIGNED_BYTE,
+                            page->pixmap->pixels + (size_t)page->dirtyTop * pageWidth * 4);
+        }
+        page->dirtyTop = pageHeight;
+        page->dirtyBottom = 0;
+        uploaded = true;
+    }
+    if (uploaded)
+        Driver::Instance().SelectTexture(0);
+}
+
+bool TextureAtlas::Build(const std::vector<std::string> &files)
+{
+    std::vector<Pixmap *> images;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        Pixmap *image = new Pixmap();
+        if (!image->Load(files[i].c_str()))
+        {
+            delete image;
+            images.push_back(nullptr);
+            continue;
+        }
+        images.push_back(image);
+    }
+
+    // largest first packs much tighter than arrival order
+    std::vector<u32> order;
+    for (u32 i = 0; i < (u32)images.size(); ++i)
+        if (images[i])
+            order.push_back(i);
+    std::sort(order.begin(), order.end(), [&images](u32 a, u32 b) {
+        const int sideA = Max(images[a]->width, images[a]->height);
+        const int sideB = Max(images[b]->width, images[b]->height);
+        return sideA != sideB ? sideA > sideB : images[a]->width * images[a]->height > images[b]->width * images[b]->height;
+    });
+
+    bool result = order.size() == files.size();
+    for (size_t i = 0; i < order.size(); ++i)
+        if (Add(Utils::GetFileNameWithoutExt(files[order[i]].c_str()), *images[order[i]]) < 0)
+            result = false;
+
+    for (size_t i = 0; i < images.size(); ++i)
+        delete images[i];
+    return result;
+}
+
+bool TextureAtlas::Save(const char *file_name) const
+{
+    for (size_t i = 0; i < pages.size(); ++i)
+    {
+        std::vector<u8> file;
+        const std::string pageName = std::string(file_name) + "." + std::to_string(i) + ".btex";
+        if (!CookTexture(*pages[i]->pixmap, TEXTURE_FILE_RGBA8, false, file) || !SaveTextureFile(pageName.c_str(), file))
+            return false;
+    }
+
+    std::string index = "atlas " + std::to_string(ATLAS_FILE_VERSION) + " " + std::to_string(pageWidth) + " " + std::to_string(pageHeight) + " " +
+                        std::to_string(padding) + " " + std::to_string(pages.size()) + " " + std::to_string(regions.size()) + "\n";
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        const AtlasRegion &region = regions[i];
+        char line[512];
+        snprintf(line, sizeof(line), "%s %u %d %d %d %d\n", regionNames[i].c_str(), region.page, (int)region.src.x, (int)region.src.y, (int)region.src.width, (int)region.src.height);
+        index += line;
+    }
+
+    SDL_RWops *rw = SDL_RWFromFile(file_name, "wb");
+    if (!rw)
+    {
+        Utils::LogError("Failed to save file: %s", file_name);
+        return false;
+    }
+    const bool written = SDL_RWwrite(rw, index.data(), 1, index.size()) == index.size();
+    SDL_RWclose(rw);
+    if (!written)
+    {
+        Utils::LogError("Failed to write file: %s", file_name);
+        return false;
+    }
+    Utils::LogInfo("TextureAtlas saved: %s [%u pages, %u regions]", file_name, (u32)pages.size(), (u32)regions.size());
+    return true;
+}
+
+bool TextureAtlas::Load(const char *file_name)
+{
+    unsigned int bytesRead = 0;
+    unsigned char *data = Utils::LoadDataFile(file_name, &bytesRead);
+    if (!data)
+        return false;
+    const std::string index((const char *)data, bytesRead);
+    free(data);
+
+    int version = 0;
+    int width = 0;
+    int height = 0;
+    int pad = 0;
+    u32 pageCount = 0;
+    u32 regionCount = 0;
+    int consumed = 0;
+    if (sscanf(index.c_str(), "atlas %d %d %d %d %u %u%n", &version, &width, &height, &pad, &pageCount, &regionCount, &consumed) != 6 ||
+        version != ATLAS_FILE_VERSION || !Init(width, height, pad))
+    {
+        Utils::LogError("Invalid atlas: %s", file_name);
+        return false;
+    }
+
+    for (u32 i = 0; i < pageCount; ++i)
+    {
+        const std::string pageName = std::string(file_name) + "." + std::to_string(i) + ".btex";
+        size_t size = 0;
+        void *mapping = Utils::MapFile(pageName.c_str(), &size);
+        TextureFileView view;
+        const bool valid = mapping && ParseTextureFile(mapping, size, view) && view.format == TEXTURE_FILE_RGBA8 &&
+                           (int)view.width == pageWidth && (int)view.height == pageHeight;
+        if (valid)
+            memcpy(addPage()->pixmap->pixels, view.GetLevelData(0), view.level[0].size);
+        Utils::UnmapFile(mapping, size);
+        if (!valid)
+        {
+            Utils::LogError("Invalid atlas page: %s", pageName.c_str());
+            Release();
+            return false;
+        }
+    }
+
+    const char *cursor = index.c_str() + consumed;
+    for (u32 i = 0; i < regionCount; ++i)
+    {
+        char name[256];
+        AtlasRegion region;
+        int x, y, w, h;
+        int length = 0;
+        if (sscanf(cursor, " %255s %u %d %d %d %d%n", name, &region.page, &x, &y, &w, &h, &length) != 6 || region.page >= pages.size())
+        {
+            Utils::LogError("Invalid atlas region %u: %s", i, file_name);
+            Release();
+            return false;
+        }
+        cursor += length;
+
+        // the padded rectangle has to lie on the page, as Add placed it
+        if (w <= 0 || h <= 0 || x < padding || y < padding || x > pageWidth - padding - w || y > pageHeight - padding - h)
+        {
+            Utils::LogError("Invalid atlas region %s: %s", name, file_name);
+            Release();
+            return false;
+        }
+
+        Page *page = pages[region.page];
+        page->packer.Reserve(x - padding, y - padding, w + padding * 2, h + padding * 2);
+        region.texture = page->texture;
+        region.src = Rectangle((float)x, (float)y, (float)w, (float)h);
+        names[name] = (u32)regions.size();
+        regions.push_back(region);
+        regionNames.push_back(name);
+    }
+
+    Utils::LogInfo("TextureAtlas loaded: %s [%u pages, %u regions]", file_name, pageCount, regionCount);
+    return true;
+}
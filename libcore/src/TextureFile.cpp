@@ -0,0 +1,833 @@
+#include "TextureFile.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+static const u32 MAX_TEXTURE_SIZE = 16384;
+
+// BC7 4 bit index weights
+static const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+//***************************************************************************************************************
+// helpers
+//***************************************************************************************************************
+
+static inline int clampByte(int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+
+static inline u32 alignOffset(u32 offset) { return (offset + 15) & ~15u; }
+
+// floor(log2(max(width, height))) + 1, the length of a full mip chain
+static u32 fullChainLevels(u32 width, u32 height)
+{
+    u32 levels = 1;
+    for (u32 size = Max(width, height); size > 1; size >>= 1)
+        levels++;
+    return levels;
+}
+
+static u16 packColor565(const float *color)
+{
+    const int r = clampByte((int)(color[0] + 0.5f));
+    const int g = clampByte((int)(color[1] + 0.5f));
+    const int b = clampByte((int)(color[2] + 0.5f));
+    return (u16)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+}
+
+static void unpackColor565(u16 c, int *color)
+{
+    const int r = (c >> 11) & 31;
+    const int g = (c >> 5) & 63;
+    const int b = c & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Mean and principal axis of 16 points of `channels` components (power
+// iteration on the covariance). The projections on the axis give the
+// endpoints of the block.
+static void principalAxis(const u8 *texels, int stride, int channels, float *mean, float *axis)
+{
+    float covariance[4][4];
+    for (int c = 0; c < channels; ++c)
+    {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; ++i)
+            mean[c] += texels[i * stride + c];
+        mean[c] *= 1.0f / 16.0f;
+    }
+    for (int a = 0; a < channels; ++a)
+        for (int b = a; b < channels; ++b)
+        {
+            float sum = 0.0f;
+            for (int i = 0; i < 16; ++i)
+                sum += (texels[i * stride + a] - mean[a]) * (texels[i * stride + b] - mean[b]);
+            covariance[a][b] = sum;
+            covariance[b][a] = sum;
+        }
+
+    for (int c = 0; c < channels; ++c)
+        axis[c] = 1.0f;
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        float length = 0.0f;
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-8f)
+            break;
+        const float inv = 1.0f / sqrtf(length);
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] * inv;
+    }
+}
+
+// endpoints on the principal axis, low end first
+static void fitEndpoints(const u8 *texels, int stride, int channels, float *low, float *high)
+{
+    float mean[4];
+    float axis[4];
+    principalAxis(texels, stride, channels, mean, axis);
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            t += (texels[i * stride + c] - mean[c]) * axis[c];
+        minT = Min(minT, t);
+        maxT = Max(maxT, t);
+    }
+    for (int c = 0; c < channels; ++c)
+    {
+        low[c] = Clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+        high[c] = Clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+    }
+}
+
+static void writeBits(u8 *block, u32 &position, u32 value, u32 count)
+{
+    for (u32 i = 0; i < count; ++i, ++position)
+        if (value & (1u << i))
+            block[position >> 3] |= (u8)(1u << (position & 7));
+}
+
+// gray and gray alpha texels as RGBA
+static void expandTexel(const u8 *source, int components, u8 *rgba)
+{
+    switch (components)
+    {
+    case 1:
+        rgba[0] = rgba[1] = rgba[2] = source[0];
+        rgba[3] = 255;
+        break;
+    case 2:
+        rgba[0] = rgba[1] = rgba[2] = source[0];
+        rgba[3] = source[1];
+        break;
+    case 3:
+        rgba[0] = source[0];
+        rgba[1] = source[1];
+        rgba[2] = source[2];
+        rgba[3] = 255;
+        break;
+    default:
+        memcpy(rgba, source, 4);
+        break;
+    }
+}
+
+// the 4x4 block at (bx, by), edge texels repeated past the image
+static void fetchBlock(const u8 *pixels, int width, int height, int components, int bx, int by, u8 *rgba)
+{
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x)
+        {
+            const int px = Min(bx * 4 + x, width - 1);
+            const int py = Min(by * 4 + y, height - 1);
+            expandTexel(pixels + ((size_t)py * width + px) * components, components, rgba + (y * 4 + x) * 4);
+        }
+}
+
+static void fetchChannel(const u8 *pixels, int width, int height, int components, int channel, int bx, int by, u8 *values)
+{
+    channel = Min(channel, components - 1);
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x)
+        {
+            const int px = Min(bx * 4 + x, width - 1);
+            const int py = Min(by * 4 + y, height - 1);
+            values[y * 4 + x] = pixels[((size_t)py * width + px) * components + channel];
+        }
+}
+
+// next level of the chain, 2x2 box filter (the last row / column of odd
+// sizes is repeated)
+static void downsample(const u8 *source, int width, int height, int components, std::vector<u8> &out, int &outWidth, int &outHeight)
+{
+    outWidth = Max(1, width / 2);
+    outHeight = Max(1, height / 2);
+    out.resize((size_t)outWidth * outHeight * components);
+    for (int y = 0; y < outHeight; ++y)
+    {
+        const int y0 = Min(y * 2, height - 1);
+        const int y1 = Min(y * 2 + 1, height - 1);
+        for (int x = 0; x < outWidth; ++x)
+        {
+            const int x0 = Min(x * 2, width - 1);
+            const int x1 = Min(x * 2 + 1, width - 1);
+            for (int c = 0; c < components; ++c)
+            {
+                const int sum = source[((size_t)y0 * width + x0) * components + c] + source[((size_t)y0 * width + x1) * components + c] +
+                                source[((size_t)y1 * width + x0) * components + c] + source[((size_t)y1 * width + x1) * components + c];
+                out[((size_t)y * outWidth + x) * components + c] = (u8)((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+// Source texels in the layout of an uncompressed format: R8 / RG8 keep the
+// first channels as they are (like BC4 / BC5), RGB8 / RGBA8 expand gray and
+// gray alpha sources.
+static void convertTexels(const u8 *pixels, int width, int height, int components, int target, u8 *out)
+{
+    const size_t count = (size_t)width * height;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const u8 *source = pixels + i * components;
+        u8 *texel = out + i * target;
+        if (target <= 2)
+        {
+            texel[0] = source[0];
+            if (target == 2)
+                texel[1] = components > 1 ? source[1] : 255;
+            continue;
+        }
+
+        u8 rgba[4];
+        expandTexel(source, components, rgba);
+        memcpy(texel, rgba, target);
+    }
+}
+
+//***************************************************************************************************************
+// formats
+//***************************************************************************************************************
+
+bool TextureFormatIsCompressed(TextureFileFormat format)
+{
+    return format >= TEXTURE_FILE_BC1 && format <= TEXTURE_FILE_BC7;
+}
+
+int TextureFormatComponents(TextureFileFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_FILE_R8:
+    case TEXTURE_FILE_BC4:
+        return 1;
+    case TEXTURE_FILE_RG8:
+    case TEXTURE_FILE_BC5:
+        return 2;
+    case TEXTURE_FILE_RGB8:
+    case TEXTURE_FILE_BC1:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+u32 TextureFormatLevelSize(TextureFileFormat format, u32 width, u32 height)
+{
+    if (!TextureFormatIsCompressed(format))
+        return width * height * (u32)TextureFormatComponents(format);
+    const u32 blocks = ((width + 3) / 4) * ((height + 3) / 4);
+    return blocks * (format == TEXTURE_FILE_BC1 || format == TEXTURE_FILE_BC4 ? 8 : 16);
+}
+
+const char *TextureFormatName(TextureFileFormat format)
+{
+    static const char *names[TEXTURE_FILE_FORMAT_COUNT] = {"r8", "rg8", "rgb8", "rgba8", "bc1", "bc3", "bc4", "bc5", "bc7"};
+    return format < TEXTURE_FILE_FORMAT_COUNT ? names[format] : "unknown";
+}
+
+//***************************************************************************************************************
+// block encoders
+//***************************************************************************************************************
+
+// four colour mode, also the colour half of BC3
+void CompressBlockBC1(const u8 *rgba, u8 *block)
+{
+    float low[3];
+    float high[3];
+    fitEndpoints(rgba, 4, 3, low, high);
+
+    u16 c0 = packColor565(high);
+    u16 c1 = packColor565(low);
+    if (c0 < c1)
+    {
+        const u16 swap = c0;
+        c0 = c1;
+        c1 = swap;
+    }
+
+    block[0] = (u8)(c0 & 0xFF);
+    block[1] = (u8)(c0 >> 8);
+    block[2] = (u8)(c1 & 0xFF);
+    block[3] = (u8)(c1 >> 8);
+
+    u32 indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        unpackColor565(c0, palette[0]);
+        unpackColor565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            const u8 *texel = rgba + i * 4;
+            int best = 0;
+            int bestError = 0x7FFFFFFF;
+            for (int p = 0; p < 4; ++p)
+            {
+                const int dr = texel[0] - palette[p][0];
+                const int dg = texel[1] - palette[p][1];
+                const int db = texel[2] - palette[p][2];
+                const int error = dr * dr + dg * dg + db * db;
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (u32)best << (i * 2);
+        }
+    }
+    memcpy(block + 4, &indices, 4);
+}
+
+// eight value mode (a0 > a1)
+void CompressBlockBC4(const u8 *values, u8 *block)
+{
+    int lo = 255;
+    int hi = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        lo = Min(lo, (int)values[i]);
+        hi = Max(hi, (int)values[i]);
+    }
+
+    memset(block, 0, 8);
+    block[0] = (u8)hi;
+    block[1] = (u8)lo;
+    if (hi == lo)
+        return;
+
+    int palette[8];
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int p = 1; p < 7; ++p)
+        palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+
+    u64 indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        int bestError = 256;
+        for (int p = 0; p < 8; ++p)
+        {
+            const int error = abs(values[i] - palette[p]);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices |= (u64)best << (i * 3);
+    }
+    for (int b = 0; b < 6; ++b)
+        block[2 + b] = (u8)(indices >> (b * 8));
+}
+
+void CompressBlockBC3(const u8 *rgba, u8 *block)
+{
+    u8 alpha[16];
+    for (int i = 0; i < 16; ++i)
+        alpha[i] = rgba[i * 4 + 3];
+    CompressBlockBC4(alpha, block);
+    CompressBlockBC1(rgba, block + 8);
+}
+
+void CompressBlockBC5(const u8 *red, const u8 *green, u8 *block)
+{
+    CompressBlockBC4(red, block);
+    CompressBlockBC4(green, block + 8);
+}
+
+// Mode 6: one subset, RGBA endpoints of 7 bits plus a p bit each, 4 bit indices
+void CompressBlockBC7(const u8 *rgba, u8 *block)
+{
+    float endpoint[2][4];
+    fitEndpoints(rgba, 4, 4, endpoint[0], endpoint[1]);
+
+    // 7 bit values and the shared p bit with the lowest error
+    int quantized[2][4];
+    int pbit[2];
+    int expanded[2][4];
+    for (int e = 0; e < 2; ++e)
+    {
+        int bestError = 0x7FFFFFFF;
+        for (int p = 0; p < 2; ++p)
+        {
+            int values[4];
+            int error = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                values[c] = Clamp((int)((endpoint[e][c] - p) * 0.5f + 0.5f), 0, 127);
+                const int d = ((values[c] << 1) | p) - (int)(endpoint[e][c] + 0.5f);
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbit[e] = p;
+                memcpy(quantized[e], values, sizeof(values));
+            }
+        }
+        for (int c = 0; c < 4; ++c)
+            expanded[e][c] = (quantized[e][c] << 1) | pbit[e];
+    }
+
+    int palette[16][4];
+    for (int w = 0; w < 16; ++w)
+        for (int c = 0; c < 4; ++c)
+            palette[w][c] = ((64 - BC7_WEIGHTS[w]) * expanded[0][c] + BC7_WEIGHTS[w] * expanded[1][c] + 32) >> 6;
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        const u8 *texel = rgba + i * 4;
+        int best = 0;
+        int bestError = 0x7FFFFFFF;
+        for (int w = 0; w < 16; ++w)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                const int d = texel[c] - palette[w][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = w;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // the anchor index is stored without its top bit
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            const int swap = quantized[0][c];
+            quantized[0][c] = quantized[1][c];
+            quantized[1][c] = swap;
+        }
+        const int swap = pbit[0];
+        pbit[0] = pbit[1];
+        pbit[1] = swap;
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(block, 0, 16);
+    u32 position = 0;
+    writeBits(block, position, 1u << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        writeBits(block, position, (u32)quantized[0][c], 7);
+        writeBits(block, position, (u32)quantized[1][c], 7);
+    }
+    writeBits(block, position, (u32)pbit[0], 1);
+    writeBits(block, position, (u32)pbit[1], 1);
+    writeBits(block, position, (u32)indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        writeBits(block, position, (u32)indices[i], 4);
+}
+
+//***************************************************************************************************************
+// block decoders
+//***************************************************************************************************************
+
+static void decodeColorBlock(const u8 *block, u8 *rgba, bool threeColor)
+{
+    const u16 c0 = (u16)(block[0] | (block[1] << 8));
+    const u16 c1 = (u16)(block[2] | (block[3] << 8));
+    int palette[4][4];
+    unpackColor565(c0, palette[0]);
+    unpackColor565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    if (threeColor && c0 <= c1)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+        palette[3][3] = 0;
+    }
+    else
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    u32 indices;
+    memcpy(&indices, block + 4, 4);
+    for (int i = 0; i < 16; ++i)
+    {
+        const int *color = palette[(indices >> (i * 2)) & 3];
+        for (int c = 0; c < 4; ++c)
+            rgba[i * 4 + c] = (u8)color[c];
+    }
+}
+
+void DecompressBlockBC1(const u8 *block, u8 *rgba)
+{
+    decodeColorBlock(block, rgba, true);
+}
+
+void DecompressBlockBC4(const u8 *block, u8 *values)
+{
+    const int a0 = block[0];
+    const int a1 = block[1];
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int p = 1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+    }
+    else
+    {
+        for (int p = 1; p < 5; ++p)
+            palette[p + 1] = ((5 - p) * a0 + p * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    u64 indices = 0;
+    for (int b = 0; b < 6; ++b)
+        indices |= (u64)block[2 + b] << (b * 8);
+    for (int i = 0; i < 16; ++i)
+        values[i] = (u8)palette[(indices >> (i * 3)) & 7];
+}
+
+void DecompressBlockBC3(const u8 *block, u8 *rgba)
+{
+    u8 alpha[16];
+    DecompressBlockBC4(block, alpha);
+    decodeColorBlock(block + 8, rgba, false);
+    for (int i = 0; i < 16; ++i)
+        rgba[i * 4 + 3] = alpha[i];
+}
+
+//***************************************************************************************************************
+// images and files
+//***************************************************************************************************************
+
+bool CompressImage(TextureFileFormat format, const u8 *pixels, int width, int height, int components, std::vector<u8> &out)
+{
+    if (!pixels || width <= 0 || height <= 0 || components < 1 || components > 4 || format >= TEXTURE_FILE_FORMAT_COUNT)
+        return false;
+
+    out.resize(TextureFormatLevelSize(format, (u32)width, (u32)height));
+    if (!TextureFormatIsCompressed(format))
+    {
+        convertTexels(pixels, width, height, components, TextureFormatComponents(format), out.data());
+        return true;
+    }
+
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const u32 blockBytes = format == TEXTURE_FILE_BC1 || format == TEXTURE_FILE_BC4 ? 8 : 16;
+    u8 *block = out.data();
+    u8 rgba[64];
+    u8 red[16];
+    u8 green[16];
+    for (int by = 0; by < blocksY; ++by)
+        for (int bx = 0; bx < blocksX; ++bx, block += blockBytes)
+        {
+            switch (format)
+            {
+            case TEXTURE_FILE_BC1:
+                fetchBlock(pixels, width, height, components, bx, by, rgba);
+                CompressBlockBC1(rgba, block);
+                break;
+            case TEXTURE_FILE_BC3:
+                fetchBlock(pixels, width, height, components, bx, by, rgba);
+                CompressBlockBC3(rgba, block);
+                break;
+            case TEXTURE_FILE_BC4:
+                fetchChannel(pixels, width, height, components, 0, bx, by, red);
+                CompressBlockBC4(red, block);
+                break;
+            case TEXTURE_FILE_BC5:
+                fetchChannel(pixels, width, height, components, 0, bx, by, red);
+                fetchChannel(pixels, width, height, components, 1, bx, by, green);
+                CompressBlockBC5(red, green, block);
+                break;
+            default:
+                fetchBlock(pixels, width, height, components, bx, by, rgba);
+                CompressBlockBC7(rgba, block);
+                break;
+            }
+        }
+    return true;
+}
+
+bool CookTexture(const Pixmap &image, TextureFileFormat format, bool mipmaps, std::vector<u8> &out)
+{
+    if (!image.pixels || image.width <= 0 || image.height <= 0 || (u32)image.width > MAX_TEXTURE_SIZE || (u32)image.height > MAX_TEXTURE_SIZE)
+    {
+        Utils::LogError("CookTexture: invalid image");
+        return false;
+    }
+
+    const u32 levels = mipmaps ? fullChainLevels((u32)image.width, (u32)image.height) : 1;
+
+    TextureFileHeader header;
+    header.magic = TEXTURE_FILE_MAGIC;
+    header.version = TEXTURE_FILE_VERSION;
+    header.format = format;
+    header.width = (u32)image.width;
+    header.height = (u32)image.height;
+    header.levels = levels;
+
+    TextureFileLevel table[TEXTURE_FILE_MAX_LEVELS];
+    u32 offset = alignOffset((u32)(sizeof(header) + levels * sizeof(TextureFileLevel)));
+    for (u32 i = 0; i < levels; ++i)
+    {
+        table[i].width = Max(1u, header.width >> i);
+        table[i].height = Max(1u, header.height >> i);
+        table[i].size = TextureFormatLevelSize(format, table[i].width, table[i].height);
+        table[i].offset = offset;
+        offset = alignOffset(offset + table[i].size);
+    }
+
+    out.assign(offset, 0);
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), table, levels * sizeof(TextureFileLevel));
+
+    // every level is filtered from the previous uncompressed one
+    std::vector<u8> current(image.pixels, image.pixels + (size_t)image.width * image.height * image.components);
+    std::vector<u8> next;
+    std::vector<u8> encoded;
+    int width = image.width;
+    int height = image.height;
+    for (u32 i = 0; i < levels; ++i)
+    {
+        if (i > 0)
+        {
+            downsample(current.data(), width, height, image.components, next, width, height);
+            current.swap(next);
+        }
+        if (!CompressImage(format, current.data(), width, height, image.components, encoded))
+            return false;
+        memcpy(out.data() + table[i].offset, encoded.data(), encoded.size());
+    }
+    return true;
+}
+
+bool SaveTextureFile(const char *file_name, const std::vector<u8> &file)
+{
+    SDL_RWops *rw = SDL_RWFromFile(file_name, "wb");
+    if (!rw)
+    {
+        Utils::LogError("Failed to save file: %s", file_name);
+        return false;
+    }
+    const bool written = SDL_RWwrite(rw, file.data(), 1, file.size()) == file.size();
+    SDL_RWclose(rw);
+    if (!written)
+        Utils::LogError("Failed to write file: %s", file_name);
+    return written;
+}
+
+bool ParseTextureFile(const void *data, size_t size, TextureFileView &view)
+{
+    TextureFileHeader header;
+    if (!data || size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != TEXTURE_FILE_MAGIC || header.version != TEXTURE_FILE_VERSION || header.format >= TEXTURE_FILE_FORMAT_COUNT ||
+        header.width == 0 || header.height == 0 || header.width > MAX_TEXTURE_SIZE || header.height > MAX_TEXTURE_SIZE ||
+        header.levels == 0 || header.levels > TEXTURE_FILE_MAX_LEVELS || header.levels > fullChainLevels(header.width, header.height) ||
+        size < sizeof(header) + header.levels * sizeof(TextureFileLevel))
+        return false;
+
+    view.format = (TextureFileFormat)header.format;
+    view.width = header.width;
+    view.height = header.height;
+    view.levels = header.levels;
+    view.data = (const u8 *)data;
+    memcpy(view.level, view.data + sizeof(header), header.levels * sizeof(TextureFileLevel));
+
+    for (u32 i = 0; i < view.levels; ++i)
+    {
+        const TextureFileLevel &level = view.level[i];
+        if (level.width != Max(1u, header.width >> i) || level.height != Max(1u, header.height >> i) ||
+            level.size != TextureFormatLevelSize(view.format, level.width, level.height) ||
+            (u64)level.offset + level.size > size)
+            return false;
+    }
+    return true;
+}
+
+//***************************************************************************************************************
+// Texture2D
+//***************************************************************************************************************
+
+// S3TC is still an extension; RGTC (BC4 / BC5) and BPTC (BC7) are core
+static bool hasS3TC()
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+    return supported == 1;
+}
+
+static void decompressLevel(TextureFileFormat format, const u8 *blocks, u32 width, u32 height, std::vector<u8> &out)
+{
+    out.resize((size_t)width * height * 4);
+    const u32 blockBytes = format == TEXTURE_FILE_BC1 ? 8 : 16;
+    u8 rgba[64];
+    for (u32 by = 0; by < (height + 3) / 4; ++by)
+        for (u32 bx = 0; bx < (width + 3) / 4; ++bx, blocks += blockBytes)
+        {
+            if (format == TEXTURE_FILE_BC1)
+                DecompressBlockBC1(blocks, rgba);
+            else
+                DecompressBlockBC3(blocks, rgba);
+            for (u32 y = 0; y < 4 && by * 4 + y < height; ++y)
+                for (u32 x = 0; x < 4 && bx * 4 + x < width; ++x)
+                    memcpy(&out[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], rgba + (y * 4 + x) * 4, 4);
+        }
+}
+
+static const GLenum INTERNAL_FORMATS[TEXTURE_FILE_FORMAT_COUNT] = {
+    GL_R8, GL_RG8, GL_RGB8, GL_RGBA8,
+    GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    GL_COMPRESSED_RED_RGTC1, GL_COMPRESSED_RG_RGTC2, GL_COMPRESSED_RGBA_BPTC_UNORM};
+static const GLenum PIXEL_FORMATS[TEXTURE_FILE_FORMAT_COUNT] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+static bool decodedOnCPU(TextureFileFormat format)
+{
+    return (format == TEXTURE_FILE_BC1 || format == TEXTURE_FILE_BC3) && !hasS3TC();
+}
+
+u32 TextureFileInternalFormat(TextureFileFormat format)
+{
+    return decodedOnCPU(format) ? GL_RGBA8 : INTERNAL_FORMATS[format];
+}
+
+u32 TextureFileLevelBytes(const TextureFileView &view, u32 level)
+{
+    const TextureFileLevel &l = view.level[level];
+    return decodedOnCPU(view.format) ? l.width * l.height * 4 : l.size;
+}
+
+void UploadTextureLevel(const TextureFileView &view, u32 level, bool allocate, std::vector<u8> &scratch)
+{
+    const TextureFileLevel &l = view.level[level];
+    const GLenum internalFormat = TextureFileInternalFormat(view.format);
+    const u8 *data = view.GetLevelData(level);
+    GLenum format = PIXEL_FORMATS[view.format];
+    const bool decode = decodedOnCPU(view.format);
+    if (decode)
+    {
+        decompressLevel(view.format, data, l.width, l.height, scratch);
+        data = scratch.data();
+        format = GL_RGBA;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (TextureFormatIsCompressed(view.format) && !decode)
+    {
+        if (allocate)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, l.width, l.height, 0, l.size, data);
+        else
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height, internalFormat, l.size, data);
+    }
+    else
+    {
+        if (allocate)
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, l.width, l.height, 0, format, GL_UNSIGNED_BYTE, data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height, format, GL_UNSIGNED_BYTE, data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void ApplyTextureFileSwizzle(TextureFileFormat format)
+{
+    // gray and gray alpha like the decoded images, BC5 stays two channel data
+    if (format == TEXTURE_FILE_R8 || format == TEXTURE_FILE_BC4)
+    {
+        GLint swizzleMask[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
+    }
+    else if (format == TEXTURE_FILE_RG8)
+    {
+        GLint swizzleMask[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
+    }
+}
+
+bool Texture2D::LoadTextureFile(const char *file_name)
+{
+    size_t size = 0;
+    void *data = Utils::MapFile(file_name, &size);
+    if (!data)
+        return false;
+
+    TextureFileView view;
+    if (!ParseTextureFile(data, size, view))
+    {
+        Utils::UnmapFile(data, size);
+        Utils::LogError("Texture2D: Invalid texture file: %s", file_name);
+        return false;
+    }
+
+    width = (int)view.width;
+    height = (int)view.height;
+    components = TextureFormatComponents(view.format);
+
+    createTexture();
+    glTexStorage2D(GL_TEXTURE_2D, view.levels, TextureFileInternalFormat(view.format), width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, view.levels - 1);
+    std::vector<u8> scratch;
+    for (u32 i = 0; i < view.levels; ++i)
+        UploadTextureLevel(view, i, false, scratch);
+    ApplyTextureFileSwizzle(view.format);
+
+    Driver::Instance().SelectTexture(0);
+    Utils::UnmapFile(data, size);
+    Utils::LogInfo("TEXTURE2D: [ID %i] Load %s (%d,%d) %s, %u levels%s", id, file_name, width, height, TextureFormatName(view.format), view.levels, decodedOnCPU(view.format) ? ", decoded" : "");
+    return true;
+}
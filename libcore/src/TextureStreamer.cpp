@@ -0,0 +1,315 @@
+#include "TextureStreamer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+//***************************************************************************************************************
+// TextureStreamPolicy
+//***************************************************************************************************************
+
+TextureStreamPolicy::TextureStreamPolicy() : budget(0), uploadBudget(4 * 1024 * 1024), tailSize(64), graceFrames(60), mipBias(0.0f), frame(1), tailsOverBudget(false)
+{
+}
+
+void TextureStreamPolicy::Setup(StreamedTexture &texture, const TextureFileView &view) const
+{
+    texture.view = view;
+    texture.tail = view.levels - 1;
+    for (u32 level = 0; level < view.levels; ++level)
+        if (Max(view.level[level].width, view.level[level].height) <= tailSize)
+        {
+            texture.tail = level;
+            break;
+        }
+    texture.resident = texture.tail;
+    texture.target = texture.tail;
+    texture.pixels = 0.0f;
+    texture.lastTouched = 0;
+}
+
+void TextureStreamPolicy::Touch(StreamedTexture &texture, float pixels) const
+{
+    if (texture.lastTouched != frame || pixels > texture.pixels)
+        texture.pixels = pixels;
+    texture.lastTouched = frame;
+}
+
+bool TextureStreamPolicy::isVisible(const StreamedTexture &texture) const
+{
+    return texture.pixels > 0.0f && frame - texture.lastTouched <= graceFrames;
+}
+
+u32 TextureStreamPolicy::WantedLevel(const StreamedTexture &texture) const
+{
+    if (!isVisible(texture))
+        return texture.tail;
+    const float size = (float)Max(texture.view.width, texture.view.height);
+    const float level = log2f(size / texture.pixels) + mipBias;
+    if (level <= 0.0f)
+        return 0;
+    return Min((u32)level, texture.tail);
+}
+
+u64 TextureStreamPolicy::LevelBytes(const StreamedTexture &texture, u32 first)
+{
+    u64 bytes = 0;
+    for (u32 level = first; level < texture.view.levels; ++level)
+        bytes += TextureFileLevelBytes(texture.view, level);
+    return bytes;
+}
+
+u64 TextureStreamPolicy::FitBudget(std::vector<StreamedTexture> &textures)
+{
+    u64 total = 0;
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        textures[i].target = WantedLevel(textures[i]);
+        total += LevelBytes(textures[i], textures[i].target);
+    }
+    const u64 wanted = total;
+    if (total <= budget)
+    {
+        tailsOverBudget = false;
+        return wanted;
+    }
+
+    // give up the finest level of whichever texture has the fewest screen
+    // pixels per texel at its target, until the targets fit
+    typedef std::pair<float, u32> Candidate;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+    auto density = [this](const StreamedTexture &texture) {
+        const u32 texels = Max(1u, Max(texture.view.width, texture.view.height) >> texture.target);
+        return isVisible(texture) ? texture.pixels / (float)texels : 0.0f;
+    };
+    for (size_t i = 0; i < textures.size(); ++i)
+        if (textures[i].target < textures[i].tail)
+            candidates.push(Candidate(density(textures[i]), (u32)i));
+
+    while (total > budget && !candidates.empty())
+    {
+        const u32 index = candidates.top().second;
+        StreamedTexture &texture = textures[index];
+        candidates.pop();
+        total -= TextureFileLevelBytes(texture.view, texture.target);
+        texture.target++;
+        if (texture.target < texture.tail)
+            candidates.push(Candidate(density(texture), index));
+    }
+
+    if (total > budget && !tailsOverBudget)
+        Utils::LogWarning("TextureStreamer: mip tails alone need %u KB, over the budget", (u32)(total / 1024));
+    tailsOverBudget = total > budget;
+    return wanted;
+}
+
+void TextureStreamPolicy::PlanUploads(const std::vector<StreamedTexture> &textures, std::vector<u32> &uploads) const
+{
+    uploads.clear();
+    std::vector<u32> loads;
+    for (size_t i = 0; i < textures.size(); ++i)
+        if (textures[i].resident > textures[i].target)
+            loads.push_back((u32)i);
+
+    // largest on screen first, one level per texture and pass
+    std::sort(loads.begin(), loads.end(), [&textures](u32 a, u32 b) { return textures[a].pixels > textures[b].pixels; });
+    std::vector<u32> resident(loads.size());
+    for (size_t i = 0; i < loads.size(); ++i)
+        resident[i] = textures[loads[i]].resident;
+
+    u32 uploaded = 0;
+    bool progress = true;
+    while (progress && uploaded < uploadBudget)
+    {
+        progress = false;
+        for (size_t i = 0; i < loads.size() && uploaded < uploadBudget; ++i)
+        {
+            const StreamedTexture &texture = textures[loads[i]];
+            if (resident[i] <= texture.target)
+                continue;
+            resident[i]--;
+            uploaded += TextureFileLevelBytes(texture.view, resident[i]);
+            uploads.push_back(loads[i]);
+            progress = true;
+        }
+    }
+}
+
+//***************************************************************************************************************
+// TextureStreamer
+//***************************************************************************************************************
+
+TextureStreamer::TextureStreamer()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    Release();
+}
+
+bool TextureStreamer::Init(u64 budgetBytes, u32 uploadBytesPerFrame, u32 tailSize)
+{
+    policy.SetBudget(budgetBytes);
+    policy.SetUploadBudget(uploadBytesPerFrame);
+    policy.SetTailSize(tailSize);
+    Utils::LogInfo("TextureStreamer: budget %u KB, %u KB per frame", (u32)(budgetBytes / 1024), uploadBytesPerFrame / 1024);
+    return true;
+}
+
+void TextureStreamer::Release()
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[i].texture->Release();
+        delete entries[i].texture;
+        Utils::UnmapFile(entries[i].mapping, entries[i].mappedSize);
+    }
+    entries.clear();
+    streamed.clear();
+    lookup.clear();
+    memset(&stats, 0, sizeof(stats));
+}
+
+Texture2D *TextureStreamer::Load(const char *file_name)
+{
+    Entry entry;
+    entry.mapping = Utils::MapFile(file_name, &entry.mappedSize);
+    if (!entry.mapping)
+        return nullptr;
+    TextureFileView view;
+    if (!ParseTextureFile(entry.mapping, entry.mappedSize, view))
+    {
+        Utils::UnmapFile(entry.mapping, entry.mappedSize);
+        Utils::LogError("TextureStreamer: Invalid texture file: %s", file_name);
+        return nullptr;
+    }
+
+    StreamedTexture state;
+    policy.Setup(state, view);
+
+    Texture2D *texture = new Texture2D();
+    texture->width = (int)view.width;
+    texture->height = (int)view.height;
+    texture->components = TextureFormatComponents(view.format);
+
+    // mutable levels, so the ones above the base level can be given back
+    texture->createTexture();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, state.tail);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, view.levels - 1);
+    for (u32 level = state.tail; level < view.levels; ++level)
+        UploadTextureLevel(view, level, true, scratch);
+    ApplyTextureFileSwizzle(view.format);
+    Driver::Instance().SelectTexture(0);
+
+    entry.texture = texture;
+    entry.fileName = file_name;
+    lookup[texture] = (u32)entries.size();
+    entries.push_back(entry);
+    streamed.push_back(state);
+
+    Utils::LogInfo("TextureStreamer: %s (%u,%u) %s, %u levels, tail from %u", file_name, view.width, view.height, TextureFormatName(view.format), view.levels, state.tail);
+    return texture;
+}
+
+void TextureStreamer::Unload(Texture2D *texture)
+{
+    auto it = lookup.find(texture);
+    if (it == lookup.end())
+        return;
+
+    const u32 index = it->second;
+    Entry &entry = entries[index];
+    entry.texture->Release();
+    delete entry.texture;
+    Utils::UnmapFile(entry.mapping, entry.mappedSize);
+    lookup.erase(it);
+
+    if (index + 1 != entries.size())
+    {
+        entries[index] = entries.back();
+        streamed[index] = streamed.back();
+        lookup[entries[index].texture] = index;
+    }
+    entries.pop_back();
+    streamed.pop_back();
+}
+
+void TextureStreamer::Touch(Texture2D *texture, float pixels)
+{
+    auto it = lookup.find(texture);
+    if (it != lookup.end())
+        policy.Touch(streamed[it->second], pixels);
+}
+
+float TextureStreamer::ScreenSize(const Vec3 &center, float radius)
+{
+    const FrameConstants &constants = Driver::Instance().GetFrameConstants();
+    const Vec3 eye(constants.cameraPosition.x, constants.cameraPosition.y, constants.cameraPosition.z);
+    const float distance = (center - eye).length();
+    if (distance <= radius)
+        return Max(constants.viewport.x, constants.viewport.y);
+    // 2r / d of the view at unit focal length, over half the viewport height
+    return radius * constants.projection.m[5] * constants.viewport.y / distance;
+}
+
+u32 TextureStreamer::GetResidentLevel(Texture2D *texture) const
+{
+    auto it = lookup.find(texture);
+    return it == lookup.end() ? 0 : streamed[it->second].resident;
+}
+
+void TextureStreamer::evict(u32 index)
+{
+    StreamedTexture &state = streamed[index];
+    Driver::Instance().SelectTexture(entries[index].texture->id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, state.target);
+    // respecified as empty, the driver frees their storage
+    for (u32 level = state.resident; level < state.target; ++level)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    stats.evictedLevels += state.target - state.resident;
+    state.resident = state.target;
+}
+
+void TextureStreamer::uploadLevel(u32 index)
+{
+    StreamedTexture &state = streamed[index];
+    const u32 level = state.resident - 1;
+    Driver::Instance().SelectTexture(entries[index].texture->id);
+    UploadTextureLevel(state.view, level, true, scratch);
+    // only sampled once it is complete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    state.resident = level;
+    stats.uploadedLevels++;
+}
+
+void TextureStreamer::Update()
+{
+    stats.uploadedLevels = 0;
+    stats.evictedLevels = 0;
+    stats.wantedBytes = policy.FitBudget(streamed);
+
+    // drop first, so the uploads below never go over the budget
+    for (size_t i = 0; i < streamed.size(); ++i)
+        if (streamed[i].resident < streamed[i].target)
+            evict((u32)i);
+
+    policy.PlanUploads(streamed, uploads);
+    for (size_t i = 0; i < uploads.size(); ++i)
+        uploadLevel(uploads[i]);
+    if (stats.uploadedLevels > 0 || stats.evictedLevels > 0)
+        Driver::Instance().SelectTexture(0);
+
+    stats.residentBytes = 0;
+    stats.pendingLevels = 0;
+    for (size_t i = 0; i < streamed.size(); ++i)
+    {
+        stats.residentBytes += TextureStreamPolicy::LevelBytes(streamed[i], streamed[i].resident);
+        if (streamed[i].resident > streamed[i].target)
+            stats.pendingLevels += streamed[i].resident - streamed[i].target;
+    }
+    stats.budgetBytes = policy.GetBudget();
+    stats.textures = (u32)streamed.size();
+    policy.NextFrame();
+}
@@ -40,6 +40,45 @@ int main()
 
     BoundingBox box2;
 
+    // a field of small props drawn with one multi draw indirect call
+    const char *arenaVertexSrc = "#version 460 core\n" FRAME_BLOCK_GLSL DRAW_BLOCK_GLSL R"(
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec2 aTexCoord;
+    layout (location = 2) in vec3 aNormal;
+
+    out vec3 Normal;
+    out vec4 Color;
+
+    void main()
+    {
+        DrawConstants draw = draws[gl_DrawID];
+        Normal = mat3(draw.model) * aNormal;
+        Color = draw.color;
+        gl_Position = frame.viewProjection * draw.model * vec4(aPos, 1.0);
+    }
+    )";
+    const char *arenaFragmentSrc = R"(
+    #version 460 core
+    in vec3 Normal;
+    in vec4 Color;
+    out vec4 FragColor;
+
+    void main()
+    {
+        float light = max(dot(normalize(Normal), normalize(vec3(0.4, 1.0, 0.3))), 0.2);
+        FragColor = vec4(Color.rgb * light, Color.a);
+    }
+    )";
+    Shader arenaShader;
+    arenaShader.Create(arenaVertexSrc, arenaFragmentSrc);
+
+    MeshArena arena;
+    arena.Create(64 * 1024, 256 * 1024, 4096);
+    int props[3];
+    props[0] = arena.Add(MeshManager::Instance().CreateBox(0.5f, 0.5f, 0.5f));
+    props[1] = arena.Add(MeshManager::Instance().CreateSphere(0.5f, 8, 8));
+    props[2] = arena.Add(MeshManager::Instance().CreateCone(0.6f, 0.5f, 8));
+
 
     while (device.Running())
     {
@@ -108,8 +147,8 @@ int main()
         Driver::Instance().EnableDepthTest(true);
         Driver::Instance().EnableCullFace(true);
         Driver::Instance().UpdateFrustum();
-        glCullFace(GL_BACK);
-        glFrontFace(GL_CCW);
+        Driver::Instance().SetCullFace(GL_BACK);
+        Driver::Instance().SetFrontFace(GL_CCW);
 
           //  box2.expand(box);
 
@@ -129,6 +168,16 @@ int main()
 
         box.transform(box2,transform);
 
+        arena.Begin();
+        for (int z = 0; z < 40; ++z)
+            for (int x = 0; x < 40; ++x)
+            {
+                Mat4 prop = Mat4::Translate(Mat4::Identity(), Vec3(x - 20.0f, 0.25f, z - 20.0f));
+                arena.Draw(props[(x + z) % 3], prop, Vec4(0.3f + x / 60.0f, 0.5f, 0.3f + z / 60.0f, 1.0f));
+            }
+        arenaShader.Bind();
+        arena.Render();
+
         shader->Bind();
         shader->SetMatrix4("model", model.m);
         shader->SetMatrix4("view", view.m);
@@ -160,12 +209,15 @@ int main()
 
         font.Print(10, 20, " %d  %f", device.GetFPS(), device.GetFrameTime());
         font.Print(10, 40, "Cull: %d", cull);
+        font.Print(10, 60, "Arena draws %u  culled %u  draw calls %lu", arena.GetDrawCount(), arena.GetCulledCount(), Driver::Instance().GetTotalDrawCalls());
 
         batch.Render();
 
         device.Swap();
     }
 
+    arena.Release();
+    arenaShader.Release();
     batch.Release();
     font.Release();
     
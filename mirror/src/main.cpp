@@ -3,6 +3,7 @@
 #include "Batch.hpp"
 #include "Mesh.hpp"
 #include "Scene.hpp"
+#include "RenderQueue.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -216,6 +217,20 @@ int main()
     Shader *shader = Assets::Instance().GetShader("default");
     Texture2D *texture0 = Assets::Instance().LoadTexture("assets/align.jpg");
 
+    // uniforms resolved once, the render loop sets them by handle
+    UniformHandle renderProjection = renderShader.GetUniformHandle("projection");
+    UniformHandle renderView = renderShader.GetUniformHandle("view");
+    UniformHandle renderModel = renderShader.GetUniformHandle("model");
+    UniformHandle mirrorProjection = mirrorShader.GetUniformHandle("projection");
+    UniformHandle mirrorViewMatrix = mirrorShader.GetUniformHandle("view");
+    UniformHandle mirrorModel = mirrorShader.GetUniformHandle("model");
+    UniformHandle mirrorReflectFactor = mirrorShader.GetUniformHandle("reflectFactor");
+    UniformHandle mirrorTexture = mirrorShader.GetUniformHandle("Texture");
+    UniformHandle mirrorReflection = mirrorShader.GetUniformHandle("Reflection");
+    UniformHandle shaderProjection = shader->GetUniformHandle("projection");
+    UniformHandle shaderView = shader->GetUniformHandle("view");
+    UniformHandle shaderModel = shader->GetUniformHandle("model");
+
     Font font;
 
     font.LoadDefaultFont();
@@ -233,6 +248,7 @@ int main()
 
     Mesh *floor = MeshManager::Instance().CreatePlane(8, 8, 1, 1);
     Mesh *box = MeshManager::Instance().CreateBox(1.0f, 1.0f, 1.0f);
+    RenderQueue queue;
     Driver::Instance().SetClearColor(0.1f, 0.1f, 0.1f);
 
     RenderTexture rtt;
@@ -314,11 +330,11 @@ int main()
         Driver::Instance().SetClearColor(0.0f, 0.0f, 0.0f);
 
         renderShader.Bind();
-        renderShader.SetMatrix4("projection", projection.m);
-        renderShader.SetMatrix4("view", view.m);
+        renderShader.SetMatrix4(renderProjection, projection.m);
+        renderShader.SetMatrix4(renderView, view.m);
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
+        Driver::Instance().EnableCullFace(true);
+        Driver::Instance().SetCullFace(GL_FRONT);
 
         rtt.Begin();
 
@@ -337,9 +353,9 @@ int main()
 
         MirrorMatrix(cameraPos, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f), 100.0f,  mirrorProj, mirrorView);
 
-        renderShader.SetMatrix4("projection", mirrorProj.m);
-        renderShader.SetMatrix4("view", mirrorView.m);
-        renderShader.SetMatrix4("model", reflectedModel.m);
+        renderShader.SetMatrix4(renderProjection, mirrorProj.m);
+        renderShader.SetMatrix4(renderView, mirrorView.m);
+        renderShader.SetMatrix4(renderModel, reflectedModel.m);
 
         
         //Mat4 viewMIrror = Mat4::LookAt(Vec3(0.0f, 4.0f, 0.0f), Vec3(0.0f, 0.7f, 0.2f), Vec3(0.0f, 1.0f, 0.0f));
@@ -350,53 +366,48 @@ int main()
 
         rtt.End();
 
-        glCullFace(GL_BACK);
+        Driver::Instance().SetCullFace(GL_BACK);
 
         Driver::Instance().SetClearColor(0.1f, 0.1f, 0.1f);
         Driver::Instance().Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        renderShader.SetMatrix4("projection", projection.m);
-        renderShader.SetMatrix4("view", view.m);
+        renderShader.SetMatrix4(renderProjection, projection.m);
+        renderShader.SetMatrix4(renderView, view.m);
 
 
-        // render normal Second pass
-        texture0->Bind(0);
+        // render normal Second pass, sorted by the queue: opaque box first,
+        // then the blended mirror back to front
+        queue.Begin(cameraPos);
+
         model.identity();
         model = Mat4::Translate(model, Vec3(0.0f, 1.0f, 0.0f));
         model = Mat4::Rotate(model, device.GetTime(), Vec3(0.0f, 1.0f, 0.0f));
-        mirrorShader.SetMatrix4("model", model.m);
-       // renderShader.SetMatrix4("model", glm::value_ptr(obj));
-        box->Render(GL_TRIANGLES);
+        queue.Submit(RENDER_PASS_OPAQUE, &renderShader, box, model, texture0->GetID()).modelUniform = renderModel;
 
         // espelho
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, rtt.GetColorBuffer(0));
-        Driver::Instance().EnableBlend(true);
-        Driver::Instance().SetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        mirrorShader.SetMatrix4(mirrorProjection, projection.m);
+        mirrorShader.SetMatrix4(mirrorViewMatrix, view.m);
+        mirrorShader.SetFloat(mirrorReflectFactor, 0.5f);
+        mirrorShader.SetInt(mirrorTexture, 0);
+        mirrorShader.SetInt(mirrorReflection, 1);
 
         model.identity();
         model.scale(10.0f, 0.1f, 10.0f);
-        mirrorShader.Bind();
-        mirrorShader.SetMatrix4("model", model.m);
-        mirrorShader.SetMatrix4("projection", projection.m);
-        mirrorShader.SetMatrix4("view", view.m);
-        mirrorShader.SetFloat("reflectFactor", 0.5f);
-        mirrorShader.SetInt("Texture", 0);
-        mirrorShader.SetInt("Reflection", 1);
-        floor->Render(GL_TRIANGLES);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        RenderCommand &mirror = queue.Submit(RENDER_PASS_TRANSPARENT, &mirrorShader, floor, model, texture0->GetID());
+        mirror.textures[1] = rtt.GetColorBuffer(0);
+        mirror.modelUniform = mirrorModel;
+
+        queue.Flush();
 
+        Driver::Instance().BindTexture(1, 0);
         Driver::Instance().EnableBlend(false);
 
         // batch -----------------------------------------------------------------------------
         shader->Bind();
         model.identity();
-        shader->SetMatrix4("model", model.m);
-        shader->SetMatrix4("view", view.m);
-        shader->SetMatrix4("projection", projection.m);
+        shader->SetMatrix4(shaderModel, model.m);
+        shader->SetMatrix4(shaderView, view.m);
+        shader->SetMatrix4(shaderProjection, projection.m);
 
         batch.Grid(10, 0.1f, true);
         batch.Render();
@@ -406,9 +417,9 @@ int main()
         projection = Mat4::Orthographic(0.0f, (float)device.GetWidth(), (float)device.GetHeight(), 0.0f, -1.0f, 1.0f);
 
         shader->Bind();
-        shader->SetMatrix4("model", model.m);
-        shader->SetMatrix4("view", view.m);
-        shader->SetMatrix4("projection", projection.m);
+        shader->SetMatrix4(shaderModel, model.m);
+        shader->SetMatrix4(shaderView, view.m);
+        shader->SetMatrix4(shaderProjection, projection.m);
 
         Driver::Instance().EnableBlend(true);
         Driver::Instance().EnableDepthTest(false);
@@ -424,6 +435,7 @@ int main()
         font.Print(10, 40, "Triangles %ld  Vertices %ld", triangles, vertices);
 
         font.Print(10, 60, "Camera Pos: %f %f %f", cameraPos.x, cameraPos.y, cameraPos.z);
+        font.Print(10, 80, "State changes %u  elided %u", Driver::Instance().GetStateChanges(), Driver::Instance().GetStateChangesElided());
 
         batch.Render();
 
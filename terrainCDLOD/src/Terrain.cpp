@@ -0,0 +1,533 @@
+#include "Terrain.hpp"
+
+//
+// Continuous distance-dependent LOD (CDLOD) terrain.
+//
+// The heightmap is covered by a quadtree of nodes. Every node is drawn with
+// the same N x N grid (N = leaf size), the heights come from a float texture
+// sampled in the vertex shader, and vertices morph towards the next coarser
+// grid when they approach the end of their LOD range, so there are no cracks
+// and no popping. Each frame the selected nodes are written to an instance
+// buffer and drawn with at most 5 instanced calls: whole nodes plus one call
+// per node quadrant (used when only part of a node falls back to the parent).
+//
+
+static const char *terrainVertexSrc = "#version 460 core\n" FRAME_BLOCK_GLSL R"(
+    layout(location = 0) in vec2 aGrid;
+    layout(location = 1) in vec4 aNode;
+
+    out vec2 TexCoord0;
+    out vec2 TexCoord1;
+
+    uniform sampler2D HeightMap;
+    uniform vec2  HeightMapSize;
+    uniform float HeightScale;
+    uniform vec3  TerrainPosition;
+    uniform vec3  TerrainScale;
+    uniform vec3  CameraPosition;
+    uniform float GridDim;
+    uniform vec2  MorphConsts[12];
+    uniform float PaintScale;
+    uniform float DetailScale;
+
+    float sampleHeight(vec2 p)
+    {
+        return texture(HeightMap, (p + 0.5) / HeightMapSize).r * HeightScale;
+    }
+
+    vec3 toWorld(vec2 p)
+    {
+        return TerrainPosition + vec3(p.x, sampleHeight(p), p.y) * TerrainScale;
+    }
+
+    void main()
+    {
+        float cell = aNode.z / GridDim;
+        vec2 p = aNode.xy + aGrid * cell;
+
+        vec2 mc = MorphConsts[int(aNode.w)];
+        float k = 1.0 - clamp(mc.x - distance(toWorld(p), CameraPosition) * mc.y, 0.0, 1.0);
+
+        // odd grid vertices slide onto the coarser (parent) grid
+        p -= mod(aGrid, 2.0) * cell * k;
+        // nodes on the far edges can extend past the map when its size is not
+        // a multiple of the root size: their outer vertices fold onto the edge
+        p = min(p, HeightMapSize - 1.0);
+
+        gl_Position = frame.viewProjection * vec4(toWorld(p), 1.0);
+        TexCoord0 = p / PaintScale;
+        TexCoord1 = TexCoord0 * DetailScale;
+    }
+)";
+
+static const char *terrainFragmentSrc = R"(
+    #version 460 core
+
+    in vec2 TexCoord0;
+    in vec2 TexCoord1;
+
+    uniform sampler2D Texture0;
+    uniform sampler2D Texture1;
+
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = mix(texture(Texture0, TexCoord0), texture(Texture1, TexCoord1), 0.2);
+    }
+)";
+
+Terrain::Terrain(const Vec3 &position, const Vec3 &scale, s32 leafSize, s32 lodCount)
+    : vao(0), vbo(0), ebo(0), instanceVBO(0), heightTexture(0), instanceCapacity(0),
+      Width(0), Height(0), Position(position), Scale(scale), LeafSize(leafSize), LodCount(lodCount)
+{
+    if (LeafSize < 2)
+        LeafSize = 2;
+    LeafSize &= ~1;
+    if (LodCount < 1)
+        LodCount = 1;
+    if (LodCount > CDLOD_MAX_LODS)
+        LodCount = CDLOD_MAX_LODS;
+
+    QuadIndexCount = 0;
+    DetailDistance = LeafSize * Max(Scale.x, Scale.z) * 2.0f;
+    MorphRatio = 0.66f;
+    textureDetailScale = 16.0f;
+    texturePaintScale = 1.0f;
+    textureHeightScale = 1.0f;
+    calculateRanges();
+}
+
+Terrain::~Terrain()
+{
+}
+
+void Terrain::calculateRanges()
+{
+    float prev = 0.0f;
+    float range = DetailDistance;
+    for (s32 i = 0; i < LodCount; ++i)
+    {
+        lodRanges[i] = range;
+        morphEnd[i] = range;
+        morphStart[i] = prev + (range - prev) * MorphRatio;
+        prev = range;
+        range *= 2.0f;
+    }
+}
+
+void Terrain::createGrid()
+{
+    const u32 dim = (u32)LeafSize;
+    const u32 half = dim / 2;
+
+    std::vector<float> grid;
+    grid.reserve((dim + 1) * (dim + 1) * 2);
+    for (u32 z = 0; z <= dim; ++z)
+    {
+        for (u32 x = 0; x <= dim; ++x)
+        {
+            grid.push_back((float)x);
+            grid.push_back((float)z);
+        }
+    }
+
+    // indices are grouped by quadrant so a single quadrant can be drawn
+    // with an offset into the buffer
+    std::vector<u32> indices;
+    indices.reserve(dim * dim * 6);
+    for (u32 q = 0; q < 4; ++q)
+    {
+        const u32 x0 = (q & 1) * half;
+        const u32 z0 = (q >> 1) * half;
+        for (u32 z = z0; z < z0 + half; ++z)
+        {
+            for (u32 x = x0; x < x0 + half; ++x)
+            {
+                u32 i00 = z * (dim + 1) + x;
+                u32 i10 = i00 + 1;
+                u32 i01 = i00 + (dim + 1);
+                u32 i11 = i01 + 1;
+
+                indices.push_back(i00);
+                indices.push_back(i01);
+                indices.push_back(i10);
+
+                indices.push_back(i10);
+                indices.push_back(i01);
+                indices.push_back(i11);
+            }
+        }
+    }
+    QuadIndexCount = half * half * 6;
+
+    glGenVertexArrays(1, &vao);
+    Driver::Instance().BindVertexArray(vao);
+
+    glGenBuffers(1, &vbo);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(float), grid.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+
+    glGenBuffers(1, &instanceVBO);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance), (void *)0);
+    glVertexAttribDivisor(1, 1);
+
+    glGenBuffers(1, &ebo);
+    Driver::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u32), indices.data(), GL_STATIC_DRAW);
+
+    Driver::Instance().BindVertexArray(0);
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Terrain::createShader()
+{
+    shader.Create(terrainVertexSrc, terrainFragmentSrc);
+    shader.LoadDefaults();
+}
+
+s32 Terrain::buildNode(const TiledHeightmap &tiles, u32 x, u32 z, u32 level)
+{
+    TerrainNode node;
+    node.x = x;
+    node.z = z;
+    node.size = (u32)LeafSize << level;
+    node.level = level;
+    node.children[0] = node.children[1] = node.children[2] = node.children[3] = -1;
+    node.minHeight = 0.0f;
+    node.maxHeight = 0.0f;
+
+    const s32 index = (s32)nodes.size();
+    nodes.push_back(node);
+
+    if (level == 0)
+    {
+        // the node shares its last row and column with the neighbours, and
+        // stops at the map edge like its geometry
+        const u32 w = Min(node.size + 1, (u32)Width - x);
+        const u32 h = Min(node.size + 1, (u32)Height - z);
+        tiles.GetMinMax(x, z, w, h, nodes[index].minHeight, nodes[index].maxHeight);
+        return index;
+    }
+
+    const u32 half = node.size / 2;
+    bool first = true;
+    for (u32 q = 0; q < 4; ++q)
+    {
+        const u32 cx = x + (q & 1) * half;
+        const u32 cz = z + (q >> 1) * half;
+        if (cx >= (u32)Width - 1 || cz >= (u32)Height - 1)
+            continue;
+
+        s32 child = buildNode(tiles, cx, cz, level - 1);
+        nodes[index].children[q] = child;
+        if (first)
+        {
+            nodes[index].minHeight = nodes[child].minHeight;
+            nodes[index].maxHeight = nodes[child].maxHeight;
+            first = false;
+        }
+        else
+        {
+            nodes[index].minHeight = Min(nodes[index].minHeight, nodes[child].minHeight);
+            nodes[index].maxHeight = Max(nodes[index].maxHeight, nodes[child].maxHeight);
+        }
+    }
+    return index;
+}
+
+bool Terrain::LoadHeightmap(Heightmap &heightmap)
+{
+    TiledHeightmap tiles;
+    if (!tiles.Build(heightmap))
+        return false;
+    return LoadHeightmap(heightmap, tiles);
+}
+
+bool Terrain::LoadHeightmap(Heightmap &heightmap, const TiledHeightmap &tiles)
+{
+    u32 startTimer = SDL_GetTicks();
+
+    Width = heightmap.GetWidth();
+    Height = heightmap.GetHeight();
+    if (Width < 2 || Height < 2 || tiles.GetWidth() != Width || tiles.GetHeight() != Height)
+    {
+        Utils::LogError("TERRAIN: Invalid heightmap");
+        return false;
+    }
+    texturePaintScale = (float)(Max(Width, Height) - 1);
+
+    if (vao == 0)
+    {
+        createGrid();
+        createShader();
+    }
+
+    if (heightTexture == 0)
+        glGenTextures(1, &heightTexture);
+    Driver::Instance().SelectTexture(heightTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (heightmap.IsNative())
+    {
+        // keep 8/16 bit samples as normalized texels, the shader rescales them
+        const bool wide = heightmap.GetBitDepth() == 16;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, wide ? GL_R16 : GL_R8, Width, Height, 0, GL_RED, wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, heightmap.GetNativeData());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        textureHeightScale = heightmap.GetMaxHeight();
+    }
+    else
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, Width, Height, 0, GL_RED, GL_FLOAT, heightmap.GetData());
+        textureHeightScale = 1.0f;
+    }
+    Driver::Instance().SelectTexture(0);
+
+    nodes.clear();
+    roots.clear();
+
+    const u32 rootSize = (u32)LeafSize << (LodCount - 1);
+    const u32 rootsX = ((u32)Width - 1 + rootSize - 1) / rootSize;
+    const u32 rootsZ = ((u32)Height - 1 + rootSize - 1) / rootSize;
+    for (u32 z = 0; z < rootsZ; ++z)
+        for (u32 x = 0; x < rootsX; ++x)
+            roots.push_back(buildNode(tiles, x * rootSize, z * rootSize, LodCount - 1));
+
+    Box.reset(getNodeBox(nodes[roots[0]]).min);
+    for (size_t i = 0; i < roots.size(); ++i)
+        Box.expand(getNodeBox(nodes[roots[i]]));
+
+    Utils::LogInfo("TERRAIN: %d x %d samples, %d nodes, %d roots in %d ms", Width, Height, (int)nodes.size(), (int)roots.size(), SDL_GetTicks() - startTimer);
+    return true;
+}
+
+BoundingBox Terrain::getNodeBox(const TerrainNode &node) const
+{
+    const float xend = (float)Min(node.x + node.size, (u32)Width - 1);
+    const float zend = (float)Min(node.z + node.size, (u32)Height - 1);
+    Vec3 min(node.x * Scale.x + Position.x, node.minHeight * Scale.y + Position.y, node.z * Scale.z + Position.z);
+    Vec3 max(xend * Scale.x + Position.x, node.maxHeight * Scale.y + Position.y, zend * Scale.z + Position.z);
+    return BoundingBox(min, max);
+}
+
+static bool boxInSphere(const BoundingBox &box, const Vec3 &center, float radius)
+{
+    float d = 0.0f;
+    for (int i = 0; i < 3; ++i)
+    {
+        const float c = (&center.x)[i];
+        const float lo = (&box.min.x)[i];
+        const float hi = (&box.max.x)[i];
+        if (c < lo)
+            d += (lo - c) * (lo - c);
+        else if (c > hi)
+            d += (c - hi) * (c - hi);
+    }
+    return d <= radius * radius;
+}
+
+void Terrain::addInstance(s32 index, int list)
+{
+    const TerrainNode &node = nodes[index];
+    TerrainInstance instance;
+    instance.x = (float)node.x;
+    instance.z = (float)node.z;
+    instance.size = (float)node.size;
+    instance.level = (float)node.level;
+    selection[list].push_back(instance);
+    selectedNodes.push_back(index);
+}
+
+// Returns false when the node is out of its LOD range, so the parent has to
+// cover that area itself. Returns true when the node was handled (drawn or
+// frustum culled).
+bool Terrain::selectNode(s32 index)
+{
+    const TerrainNode &node = nodes[index];
+    const BoundingBox box = getNodeBox(node);
+    const s32 level = (s32)node.level;
+
+    if (level < LodCount - 1 && !boxInSphere(box, cameraPosition, lodRanges[level]))
+        return false;
+
+    if (!Driver::Instance().IsInFrustum(box))
+        return true;
+
+    if (level == 0 || !boxInSphere(box, cameraPosition, lodRanges[level - 1]))
+    {
+        addInstance(index, 0);
+        return true;
+    }
+
+    for (int q = 0; q < 4; ++q)
+    {
+        const s32 child = node.children[q];
+        if (child < 0)
+            continue;
+        if (!selectNode(child))
+            addInstance(index, 1 + q);
+    }
+    return true;
+}
+
+void Terrain::Update(const Vec3 &position)
+{
+    cameraPosition = position;
+    for (int i = 0; i < 5; ++i)
+        selection[i].clear();
+    selectedNodes.clear();
+
+    for (size_t i = 0; i < roots.size(); ++i)
+        selectNode(roots[i]);
+
+    instances.clear();
+    for (int i = 0; i < 5; ++i)
+        instances.insert(instances.end(), selection[i].begin(), selection[i].end());
+
+    if (instances.empty())
+        return;
+
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (instances.size() > instanceCapacity)
+        instanceCapacity = (u32)instances.size() * 2;
+    // orphan the previous frame storage so the driver does not stall
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(TerrainInstance), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(TerrainInstance), instances.data());
+    Driver::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Terrain::Render()
+{
+    if (vao == 0 || instances.empty())
+        return;
+
+    // the camera comes from the Driver's FrameData block
+    shader.Bind();
+    shader.SetInt("Texture0", 0);
+    shader.SetInt("Texture1", 1);
+    shader.SetInt("HeightMap", 2);
+    shader.SetFloat("HeightMapSize", (float)Width, (float)Height);
+    shader.SetFloat("HeightScale", textureHeightScale);
+    shader.SetFloat("TerrainPosition", Position.x, Position.y, Position.z);
+    shader.SetFloat("TerrainScale", Scale.x, Scale.y, Scale.z);
+    shader.SetFloat("CameraPosition", cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    shader.SetFloat("GridDim", (float)LeafSize);
+    shader.SetFloat("PaintScale", texturePaintScale);
+    shader.SetFloat("DetailScale", textureDetailScale);
+
+    char name[32];
+    for (s32 i = 0; i < LodCount; ++i)
+    {
+        snprintf(name, sizeof(name), "MorphConsts[%d]", i);
+        if (i == LodCount - 1)
+        {
+            // the top level never morphs
+            shader.SetFloat(name, 1.0f, 0.0f);
+        }
+        else
+        {
+            const float range = morphEnd[i] - morphStart[i];
+            shader.SetFloat(name, morphEnd[i] / range, 1.0f / range);
+        }
+    }
+
+    Driver::Instance().BindTexture(2, heightTexture);
+
+    Driver::Instance().BindVertexArray(vao);
+    int baseInstance = 0;
+    for (int i = 0; i < 5; ++i)
+    {
+        const int count = (int)selection[i].size();
+        if (count == 0)
+            continue;
+        if (i == 0)
+            Driver::Instance().DrawElementsInstanced(GL_TRIANGLES, QuadIndexCount * 4, GL_UNSIGNED_INT, (void *)0, count, baseInstance);
+        else
+            Driver::Instance().DrawElementsInstanced(GL_TRIANGLES, QuadIndexCount, GL_UNSIGNED_INT, (void *)(size_t)((i - 1) * QuadIndexCount * sizeof(u32)), count, baseInstance);
+        baseInstance += count;
+    }
+    Driver::Instance().BindVertexArray(0);
+
+    Driver::Instance().BindTexture(2, 0);
+}
+
+void Terrain::Debug(RenderBatch *batch)
+{
+    batch->SetColor(1.0f, 0.0f, 0.0f);
+    batch->Box(Box.min, Box.max);
+
+    for (size_t i = 0; i < selectedNodes.size(); ++i)
+    {
+        const TerrainNode &node = nodes[selectedNodes[i]];
+        switch (node.level % 6)
+        {
+        case 0:
+            batch->SetColor(0.0f, 1.0f, 0.0f);
+            break;
+        case 1:
+            batch->SetColor(1.0f, 0.0f, 0.0f);
+            break;
+        case 2:
+            batch->SetColor(0.0f, 0.0f, 1.0f);
+            break;
+        case 3:
+            batch->SetColor(1.0f, 1.0f, 0.0f);
+            break;
+        case 4:
+            batch->SetColor(1.0f, 0.0f, 1.0f);
+            break;
+        default:
+            batch->SetColor(0.0f, 1.0f, 1.0f);
+            break;
+        }
+        BoundingBox box = getNodeBox(node);
+        batch->Box(box.min, box.max);
+    }
+}
+
+void Terrain::Release()
+{
+    if (heightTexture != 0)
+        Driver::Instance().DeleteTexture(heightTexture);
+    if (instanceVBO != 0)
+        Driver::Instance().DeleteBuffer(instanceVBO);
+    if (ebo != 0)
+        Driver::Instance().DeleteBuffer(ebo);
+    if (vbo != 0)
+        Driver::Instance().DeleteBuffer(vbo);
+    if (vao != 0)
+        Driver::Instance().DeleteVertexArray(vao);
+    heightTexture = instanceVBO = ebo = vbo = vao = 0;
+    instanceCapacity = 0;
+    shader.Release();
+}
+
+void Terrain::SetDetailDistance(float distance)
+{
+    DetailDistance = distance;
+    calculateRanges();
+}
+
+void Terrain::SetMorphRatio(float ratio)
+{
+    MorphRatio = Clamp(ratio, 0.0f, 0.95f);
+    calculateRanges();
+}
+
+void Terrain::SetPaintScale(float scale)
+{
+    texturePaintScale = scale;
+}
+
+void Terrain::SetDetailScale(float scale)
+{
+    textureDetailScale = scale;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Core.hpp"
+#include "Math.hpp"
+#include "Batch.hpp"
+#include "Mesh.hpp"
+#include "Scene.hpp"
+
+
+const int CDLOD_MAX_LODS = 12;
+
+
+struct TerrainNode
+{
+    u32 x, z;           // first heightmap sample covered by the node
+    u32 size;           // samples per side (leafSize << level)
+    u32 level;          // 0 = leaf
+    s32 children[4];    // -1 = none, order: (0,0) (1,0) (0,1) (1,1)
+    float minHeight;
+    float maxHeight;
+};
+
+struct TerrainInstance
+{
+    float x, z;         // node origin in heightmap samples
+    float size;         // node size in heightmap samples
+    float level;
+};
+
+
+
+class Terrain
+{
+    private:
+
+        std::vector<TerrainNode> nodes;
+        std::vector<s32> roots;
+        std::vector<TerrainInstance> selection[5];   // full node + one list per quadrant
+        std::vector<TerrainInstance> instances;
+        std::vector<s32> selectedNodes;             // only for Debug
+
+        float lodRanges[CDLOD_MAX_LODS];
+        float morphStart[CDLOD_MAX_LODS];
+        float morphEnd[CDLOD_MAX_LODS];
+
+        GLuint vao;
+        GLuint vbo;
+        GLuint ebo;
+        GLuint instanceVBO;
+        GLuint heightTexture;
+        u32 instanceCapacity;
+
+        Shader shader;
+
+        s32 Width;
+        s32 Height;
+        Vec3 Position;
+        Vec3 Scale;
+        s32 LeafSize;
+        s32 LodCount;
+        u32 QuadIndexCount;
+        float DetailDistance;
+        float MorphRatio;
+        float textureDetailScale;
+        float texturePaintScale;
+        float textureHeightScale;
+        BoundingBox Box;
+        Vec3 cameraPosition;
+
+    private:
+        void createGrid();
+        void createShader();
+        void calculateRanges();
+        s32 buildNode(const TiledHeightmap &tiles, u32 x, u32 z, u32 level);
+        bool selectNode(s32 index);
+        BoundingBox getNodeBox(const TerrainNode &node) const;
+        void addInstance(s32 index, int list);
+
+    public:
+        Terrain(const Vec3 &position, const Vec3 &scale, s32 leafSize, s32 lodCount);
+        ~Terrain();
+
+        bool LoadHeightmap(Heightmap &heightmap);
+        bool LoadHeightmap(Heightmap &heightmap, const TiledHeightmap &tiles);
+
+        void Release();
+        void Update(const Vec3 &cameraPosition);
+        void Render();
+        void Debug(RenderBatch *batch);
+
+        void SetDetailDistance(float distance);
+        void SetMorphRatio(float ratio);
+        void SetPaintScale(float scale);
+        void SetDetailScale(float scale);
+
+        u32 GetNodeCount() const { return (u32)nodes.size(); }
+        u32 GetSelectedCount() const { return (u32)instances.size(); }
+        // world space, position plus the scaled heightmap extent
+        const BoundingBox &GetBounds() const { return Box; }
+};
@@ -0,0 +1,237 @@
+
+
+#include "Terrain.hpp"
+#include "RenderQueue.hpp"
+#include "TextureStreamer.hpp"
+
+static void renderTerrain(void *user)
+{
+    static_cast<Terrain *>(user)->Render();
+}
+
+int main()
+{
+
+    Device device;
+    device.Init("OpenGL Device", 800, 600, true);
+
+    RenderBatch batch;
+    batch.Init(1, 1024 * 8);
+    Assets::Instance().SetFlipTexture(false);
+    Shader *shader = Assets::Instance().GetShader("default");
+    // cooked versions (textureCooker assets/Texture.jpg assets/Texture.btex) when
+    // present, the colour map is then streamed by its size on screen
+    TextureStreamer streamer;
+    streamer.Init(16 * 1024 * 1024);
+    Texture2D *streamed = Utils::FileExists("assets/Texture.btex") ? streamer.Load("assets/Texture.btex") : nullptr;
+    Texture2D *texture0 = streamed ? streamed : Assets::Instance().LoadTexture("assets/Texture.jpg");
+    Texture2D *texture1 = Assets::Instance().LoadTexture(Utils::FileExists("assets/detail.btex") ? "assets/detail.btex" : "assets/detail.jpg");
+
+    RenderQueue queue;
+
+    Font font;
+
+    font.LoadDefaultFont();
+    font.SetBatch(&batch);
+    font.SetSize(12);
+
+    Vec3 cameraPos = Vec3(0.0f, 2.0f, 3.0f);
+    Vec3 cameraFront = Vec3(0.0f, 0.0f, -1.0f);
+    Vec3 cameraUp = Vec3(0.0f, 1.0f, 0.0f);
+
+    float yaw = -90.0f;
+    float pitch = 0.0f;
+    float lastX = Input::GetMouseX();
+    float lastY = Input::GetMouseY();
+
+    Heightmap heightmap(40.0f);
+    if (!heightmap.Map("assets/Terrain.raw", 8))
+    {
+        Utils::LogError("Error loading assets/Terrain.raw");
+        streamer.Release();
+        batch.Release();
+        font.Release();
+        device.Close();
+        return 1;
+    }
+
+    // bounds come from the tiled pyramid, baked next to the raw file and
+    // baked again when the raw file or the height scale changes
+    TiledHeightmap tiles;
+    const bool cached = Utils::FileExists("assets/Terrain.bhm") &&
+                        Utils::GetFileModTime("assets/Terrain.bhm") >= Utils::GetFileModTime("assets/Terrain.raw") &&
+                        tiles.Load("assets/Terrain.bhm");
+    if (!cached || tiles.GetWidth() != heightmap.GetWidth() || tiles.GetHeight() != heightmap.GetHeight() ||
+        tiles.GetMaxHeight() != heightmap.GetMaxHeight())
+    {
+        tiles.Build(heightmap);
+        tiles.Save("assets/Terrain.bhm");
+    }
+
+    Terrain terrain(Vec3(0.0f, -300.0f, 0.0f), Vec3(8.0f, 10.0f, 8.0f), 32, 5);
+    terrain.SetDetailDistance(400.0f);
+    terrain.SetDetailScale(16.0f);
+    if (!terrain.LoadHeightmap(heightmap, tiles))
+    {
+        Utils::LogError("Error building the terrain from assets/Terrain.raw");
+        terrain.Release();
+        streamer.Release();
+        batch.Release();
+        font.Release();
+        device.Close();
+        return 1;
+    }
+
+    bool debug = false;
+
+    Driver::Instance().SetClearColor(0.1f, 0.1f, 0.1f);
+
+
+    while (device.Running())
+    {
+        Driver::Instance().Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        Driver::Instance().SetViewport(0, 0, device.GetWidth(), device.GetHeight());
+
+
+        float cameraSpeed = 80.5f * device.GetFrameTime();
+
+        if (Input::IsMouseButtonDown(1))
+        {
+            float xpos = Input::GetMouseX();
+            float ypos = Input::GetMouseY();
+            float xoffset = xpos - lastX;
+            float yoffset = lastY - ypos;
+
+            float sensitivity = 0.1f;
+            xoffset *= sensitivity;
+            yoffset *= sensitivity;
+
+            yaw += xoffset;
+            pitch += yoffset;
+
+            if (pitch > 89.0f)
+                pitch = 89.0f;
+            if (pitch < -89.0f)
+                pitch = -89.0f;
+
+            Vec3 front;
+            front.x = Cos(yaw) * Cos(pitch);
+            front.y = Sin(pitch);
+            front.z = Sin(yaw) * Cos(pitch);
+            cameraFront = Vec3::Normalize(front);
+        }
+
+        lastX = Input::GetMouseX();
+        lastY = Input::GetMouseY();
+
+        if (Input::IsKeyDown(SDLK_w))
+        {
+            cameraPos += cameraSpeed * cameraFront;
+        }
+        if (Input::IsKeyDown(SDLK_s))
+        {
+            cameraPos -= cameraSpeed * cameraFront;
+        }
+        if (Input::IsKeyDown(SDLK_a))
+        {
+            cameraPos -= Vec3::Normalize(Vec3::Cross(cameraFront, cameraUp)) * cameraSpeed;
+        }
+        if (Input::IsKeyDown(SDLK_d))
+        {
+            cameraPos += Vec3::Normalize(Vec3::Cross(cameraFront, cameraUp)) * cameraSpeed;
+        }
+        if (Input::IsKeyPressed(SDLK_F1))
+        {
+            debug = !debug;
+        }
+
+
+
+        Mat4 model;
+        Mat4 view = Mat4::LookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        Mat4 projection = Mat4::Perspective(45.0f, (float)device.GetWidth() / (float)device.GetHeight(), 0.1f, 5000.0f);
+        Driver::Instance().SetTransform(VIEW_MATRIX, view);
+        Driver::Instance().SetTransform(PROJECTION_MATRIX, projection);
+        Driver::Instance().EnableBlend(false);
+        Driver::Instance().EnableDepthTest(true);
+        Driver::Instance().EnableCullFace(true);
+        Driver::Instance().UpdateFrustum();
+
+        terrain.Update(cameraPos);
+
+        if (streamed)
+        {
+            // the colour map spans the whole terrain, sphere around its bounds
+            const BoundingBox &bounds = terrain.GetBounds();
+            const Vec3 center = (bounds.min + bounds.max) * 0.5f;
+            streamer.Touch(streamed, TextureStreamer::ScreenSize(center, (bounds.max - bounds.min).length() * 0.5f));
+            streamer.Update();
+        }
+
+        // the terrain surrounds the eye, distance 0 puts it first among the opaque draws
+        queue.Begin(cameraPos);
+        RenderCommand &ground = queue.Submit(RENDER_PASS_OPAQUE, nullptr, renderTerrain, &terrain, 0.0f);
+        ground.textures[0] = texture0->GetID();
+        ground.textures[1] = texture1->GetID();
+        queue.Flush();
+
+
+
+        shader->Bind();
+        model.identity();
+        shader->SetMatrix4("model", model.m);
+        shader->SetMatrix4("view", view.m);
+        shader->SetMatrix4("projection", projection.m);
+
+        if (debug)
+            terrain.Debug(&batch);
+        batch.Grid(20, 0.1f, true);
+        batch.Render();
+
+        model = Mat4::Identity();
+        view  = Mat4::Identity();
+        projection = Mat4::Orthographic(0.0f, (float)device.GetWidth(), (float)device.GetHeight(), 0.0f, -1.0f, 1.0f);
+
+        shader->Bind();
+        shader->SetMatrix4("model", model.m);
+        shader->SetMatrix4("view", view.m);
+        shader->SetMatrix4("projection", projection.m);
+
+
+        Driver::Instance().EnableBlend(true);
+        Driver::Instance().EnableDepthTest(false);
+        Driver::Instance().EnableCullFace(false);
+        Driver::Instance().SetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        batch.SetColor(1, 1, 1);
+        font.SetSize(16);
+
+
+        u64 drawcalls = Driver::Instance().GetTotalDrawCalls();
+        font.Print(10, 20, " %d  %ld",device.GetFPS(),drawcalls);
+        u64 triangles = Driver::Instance().GetTotalTriangles();
+        u64 vertices = Driver::Instance().GetTotalVertices();
+        font.Print(10, 40, "Triangles %ld  Vertices %ld", triangles, vertices);
+        font.Print(10, 60, "Nodes %d / %d  (F1 debug)", terrain.GetSelectedCount(), terrain.GetNodeCount());
+        if (streamed)
+        {
+            const TextureStreamerStats &streaming = streamer.GetStats();
+            font.Print(10, 80, "Streaming %u KB / %u KB  level %u  pending %u", (u32)(streaming.residentBytes / 1024), (u32)(streaming.budgetBytes / 1024),
+                       streamer.GetResidentLevel(streamed), streaming.pendingLevels);
+        }
+
+
+        batch.Render();
+
+        device.Swap();
+    }
+
+    terrain.Release();
+    streamer.Release();
+    batch.Release();
+    font.Release();
+
+    device.Close();
+
+    return 0;
+}
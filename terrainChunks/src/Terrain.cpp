@@ -1,7 +1,9 @@
 #include "Terrain.hpp"
 
 TerrainChunk::TerrainChunk(int res, float chunkSize, int chunkX, int chunkZ)
-    : resolution(res), size(chunkSize), chunkX(chunkX), chunkZ(chunkZ)
+    : resolution(res), size(chunkSize), chunkX(chunkX), chunkZ(chunkZ),
+      position(0.0f, 0.0f, 0.0f), scale(1.0f, 1.0f, 1.0f), detailScale(16.0f), paintScale(1.0f),
+      dirtyStart(0), dirtyEnd(-1)
 {
 }
 
@@ -10,23 +12,45 @@ void TerrainChunk::Release()
     buffer.Release();
 }
 
-void TerrainChunk::GenerateMesh(Heightmap &heightmap, const Vec3 &position, const Vec3 &scale, float detailScale, float paintScale)
+void TerrainChunk::buildRows(Heightmap &heightmap, int rowStart, int rowEnd)
 {
-    float step = size / (resolution - 1);
-    vertices.clear();
-    indices.clear();
+    const float step = size / (resolution - 1);
+    const float baseX = chunkX * size;
+    const float baseZ = chunkZ * size;
+    const int rows = rowEnd - rowStart + 1;
+    const int pw = resolution + 2;
+
+    // heights for the rows plus a one vertex border, the border feeds the normals
+    std::vector<float> xs(pw * (rows + 2));
+    std::vector<float> zs(pw * (rows + 2));
+    std::vector<float> heights(pw * (rows + 2));
+    for (int r = 0; r < rows + 2; ++r)
+    {
+        for (int c = 0; c < pw; ++c)
+        {
+            xs[r * pw + c] = baseX + (c - 1) * step;
+            zs[r * pw + c] = baseZ + (rowStart + r - 1) * step;
+        }
+    }
+    heightmap.GetInterpolatedHeights(xs.data(), zs.data(), heights.data(), pw * (rows + 2));
 
-    for (int z = 0; z < resolution; ++z)
+    const float slopeX = scale.y / (2.0f * step * scale.x);
+    const float slopeZ = scale.y / (2.0f * step * scale.z);
+
+    for (int z = rowStart; z <= rowEnd; ++z)
     {
+        const float *down = heights.data() + (z - rowStart) * pw + 1;
+        const float *mid = down + pw;
+        const float *up = mid + pw;
+
         for (int x = 0; x < resolution; ++x)
         {
-            float worldX = chunkX * size + x * step;
-            float worldZ = chunkZ * size + z * step;
-            float height = heightmap.GetInterpolatedHeight(worldX, worldZ);
+            float worldX = baseX + x * step;
+            float worldZ = baseZ + z * step;
 
             Vertex v;
             v.x = position.x + worldX * scale.x;
-            v.y = position.y + height * scale.y;
+            v.y = position.y + mid[x] * scale.y;
             v.z = position.z + worldZ * scale.z;
 
             v.u1 = worldX / paintScale;
@@ -34,17 +58,37 @@ void TerrainChunk::GenerateMesh(Heightmap &heightmap, const Vec3 &position, cons
             v.u2 = v.u1 * detailScale;
             v.v2 = v.v1 * detailScale;
 
-            vertices.push_back(v.x);
-            vertices.push_back(v.y);
-            vertices.push_back(v.z);
-            vertices.push_back(v.u1);
-            vertices.push_back(v.v1);
-            vertices.push_back(v.u2);
-            vertices.push_back(v.v2);
+            Vec3 normal((mid[x - 1] - mid[x + 1]) * slopeX, 1.0f, (down[x] - up[x]) * slopeZ);
+            normal.normalize();
+            v.nx = normal.x;
+            v.ny = normal.y;
+            v.nz = normal.z;
 
-            boundingBox.expand(Vec3(v.x, v.y, v.z));
+            memcpy(&vertices[(z * resolution + x) * TERRAIN_VERTEX_STRIDE], &v, sizeof(Vertex));
         }
     }
+}
+
+void TerrainChunk::updateBounds()
+{
+    boundingBox.reset(Vec3(vertices[0], vertices[1], vertices[2]));
+    for (size_t i = TERRAIN_VERTEX_STRIDE; i < vertices.size(); i += TERRAIN_VERTEX_STRIDE)
+        boundingBox.expand(Vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+}
+
+void TerrainChunk::GenerateMesh(Heightmap &heightmap, const Vec3 &position, const Vec3 &scale, float detailScale, float paintScale)
+{
+    this->position = position;
+    this->scale = scale;
+    this->detailScale = detailScale;
+    this->paintScale = paintScale;
+
+    vertices.assign(resolution * resolution * TERRAIN_VERTEX_STRIDE, 0.0f);
+    indices.clear();
+
+    buildRows(heightmap, 0, resolution - 1);
+    updateBounds();
+
     for (int z = 0; z < resolution - 1; ++z)
     {
         for (int x = 0; x < resolution; ++x)
@@ -62,75 +106,61 @@ void TerrainChunk::GenerateMesh(Heightmap &heightmap, const Vec3 &position, cons
         }
     }
 
-    buffer.SetVertexData(vertices.data(), vertices.size(), {3, 2, 2}, true);
+    buffer.SetVertexData(vertices.data(), vertices.size(), {3, 2, 2, 3}, true);
     buffer.SetIndexData(indices.data(), indices.size(), false);
+
+    dirtyStart = 0;
+    dirtyEnd = -1;
 }
 
 void TerrainChunk::GenerateMesh(Heightmap &heightmap, float detailScale, float paintScale)
 {
-    float step = size / (resolution - 1);
-    vertices.clear();
-    indices.clear();
-
-    for (int z = 0; z < resolution; ++z)
-    {
-        for (int x = 0; x < resolution; ++x)
-        {
-            float worldX = chunkX * size + x * step;
-            float worldZ = chunkZ * size + z * step;
-
-            float height = heightmap.GetInterpolatedHeight(worldX, worldZ);
+    GenerateMesh(heightmap, Vec3(0.0f, 0.0f, 0.0f), Vec3(1.0f, 1.0f, 1.0f), detailScale, paintScale);
+}
 
-            Vertex v;
-            v.x = worldX;
-            v.y = height;
-            v.z = worldZ;
-            // v.u1 = (float)x / (resolution - 1);
-            // v.v1 = (float)z / (resolution - 1);
-            v.u1 = (float)worldX / paintScale;
-            v.v1 = (float)worldZ / paintScale;
-            v.u2 = v.u1 * detailScale;
-            v.v2 = v.v1 * detailScale;
+// z0..z1 is the edited sample range. Heights reach one sample through the
+// bilinear filter and normals one more vertex row.
+void TerrainChunk::MarkDirty(float z0, float z1)
+{
+    const float step = size / (resolution - 1);
+    const float baseZ = chunkZ * size;
+
+    int rowStart = (int)std::floor((z0 - 1.0f - baseZ) / step) - 1;
+    int rowEnd = (int)std::ceil((z1 + 1.0f - baseZ) / step) + 1;
+    rowStart = Max(rowStart, 0);
+    rowEnd = Min(rowEnd, resolution - 1);
+    if (rowStart > rowEnd)
+        return;
 
-            vertices.push_back(v.x);
-            vertices.push_back(v.y);
-            vertices.push_back(v.z);
-            vertices.push_back(v.u1);
-            vertices.push_back(v.v1);
-            vertices.push_back(v.u2);
-            vertices.push_back(v.v2);
-            boundingBox.expand((Vec3(v.x, v.y, v.z)));
-        }
+    if (IsDirty())
+    {
+        dirtyStart = Min(dirtyStart, rowStart);
+        dirtyEnd = Max(dirtyEnd, rowEnd);
     }
+    else
+    {
+        dirtyStart = rowStart;
+        dirtyEnd = rowEnd;
+    }
+}
 
+void TerrainChunk::Rebuild(Heightmap &heightmap)
+{
+    if (!IsDirty() || vertices.empty())
+        return;
 
-    for (int z = 0; z < resolution - 1; ++z)
-    {
-        for (int x = 0; x < resolution; ++x)
-        {
-            int top = z * resolution + x;
-            int bottom = (z + 1) * resolution + x;
-            indices.push_back(top);
-            indices.push_back(bottom);
-        }
+    buildRows(heightmap, dirtyStart, dirtyEnd);
+    updateBounds();
 
-        if (z < resolution - 2)
-        {
-            indices.push_back((z + 1) * resolution + (resolution - 1));
-            indices.push_back((z + 1) * resolution);
-        }
-    }
+    const u32 rowFloats = resolution * TERRAIN_VERTEX_STRIDE;
+    buffer.UpdateVertexData(vertices.data(), dirtyStart * rowFloats, (dirtyEnd - dirtyStart + 1) * rowFloats);
 
-    buffer.SetVertexData(vertices.data(), vertices.size(), {3, 2, 2}, true);
-    buffer.SetIndexData(indices.data(), indices.size(), false);
+    dirtyStart = 0;
+    dirtyEnd = -1;
 }
 
 void TerrainChunk::Render()
 {
-    if (!Driver::Instance().IsInFrustum(boundingBox))
-    {
-        return;
-    }
     buffer.Render(GL_TRIANGLE_STRIP);
 }
 
@@ -143,14 +173,16 @@ void TerrainChunk::Debug(RenderBatch *batch)
 Terrain::Terrain(int terrainSize, int chunkResolution, float chunkSize)
     : chunkResolution(chunkResolution), chunkSize(chunkSize), textureDetailScale(chunkSize)
 {
-    int numChunksPerSide = terrainSize / chunkSize;
+    chunksPerSide = terrainSize / chunkSize;
     texturePaintScale = terrainSize;
     m_position = Vec3(0.0f, 0.0f, 0.0f);
     m_scale = Vec3(1.0f, 1.0f, 1.0f);
+    m_world = false;
+    visibleCount = 0;
 
-    for (int z = 0; z < numChunksPerSide; ++z)
+    for (int z = 0; z < chunksPerSide; ++z)
     {
-        for (int x = 0; x < numChunksPerSide; ++x)
+        for (int x = 0; x < chunksPerSide; ++x)
         {
             chunks.push_back(new TerrainChunk(chunkResolution, chunkSize, x, z));
         }
@@ -162,12 +194,14 @@ Terrain::Terrain(int terrainSize, int chunkResolution, float chunkSize, const Ve
 {
     m_position = position;
     m_scale = scale;
-    int numChunksPerSide = terrainSize / chunkSize;
+    m_world = false;
+    visibleCount = 0;
+    chunksPerSide = terrainSize / chunkSize;
     texturePaintScale = terrainSize;
 
-    for (int z = 0; z < numChunksPerSide; ++z)
+    for (int z = 0; z < chunksPerSide; ++z)
     {
-        for (int x = 0; x < numChunksPerSide; ++x)
+        for (int x = 0; x < chunksPerSide; ++x)
         {
           //  Vec3 chunkPosition = position + Vec3(x * chunkSize * scale.x, 0.0f, z * chunkSize * scale.z);
             chunks.push_back(new TerrainChunk(chunkResolution, chunkSize, x, z));
@@ -201,14 +235,28 @@ void Terrain::Release()
         delete chunk;
     }
     chunks.clear();
+    bounds.clear();
+}
+
+void Terrain::updateBounds()
+{
+    bounds.resize(chunks.size());
+    for (u32 i = 0; i < chunks.size(); ++i)
+        bounds.set(i, chunks[i]->GetBoundingBox());
+    visible.resize((chunks.size() + 31) / 32);
+    planeCache.resize((chunks.size() + FRUSTUM_CULL_GROUP - 1) / FRUSTUM_CULL_GROUP, 0);
 }
 
 void Terrain::Render()
 {
-    for (const auto &chunk : chunks)
+    if (chunks.empty() || bounds.size() != chunks.size())
+        return;
+
+    visibleCount = Driver::Instance().CullBoxes(bounds, visible.data(), planeCache.data());
+    for (u32 i = 0; i < chunks.size(); ++i)
     {
-        
-        chunk->Render();
+        if (visible[i >> 5] & (1u << (i & 31)))
+            chunks[i]->Render();
     }
 }
 
@@ -222,17 +270,91 @@ void Terrain::Debug(RenderBatch *batch)
 
 void Terrain::GenerateMesh(Heightmap &heightmap)
 {
+    m_world = false;
     for (TerrainChunk *chunk : chunks)
     {
         chunk->GenerateMesh(heightmap, textureDetailScale, texturePaintScale);
     }
+    updateBounds();
 }
 
 void Terrain::GenerateMeshWorld(Heightmap &heightmap)
 {
+    m_world = true;
     for (TerrainChunk *chunk : chunks)
     {
         chunk->GenerateMesh(heightmap, m_position, m_scale, textureDetailScale, texturePaintScale);
     }
+    updateBounds();
 }
 
+void Terrain::MarkDirty(int x0, int z0, int x1, int z1)
+{
+    if (chunks.empty())
+        return;
+
+    // a vertex can read samples up to one step plus one sample away
+    const float margin = chunkSize / (chunkResolution - 1) + 1.0f;
+    const int cx0 = Max((int)std::floor((x0 - margin) / chunkSize), 0);
+    const int cz0 = Max((int)std::floor((z0 - margin) / chunkSize), 0);
+    const int cx1 = Min((int)std::floor((x1 + margin) / chunkSize), chunksPerSide - 1);
+    const int cz1 = Min((int)std::floor((z1 + margin) / chunkSize), chunksPerSide - 1);
+
+    for (int z = cz0; z <= cz1; ++z)
+        for (int x = cx0; x <= cx1; ++x)
+            chunks[z * chunksPerSide + x]->MarkDirty((float)z0, (float)z1);
+}
+
+SampleRect Terrain::Sculpt(Heightmap &heightmap, const Vec3 &worldPosition, float radius, float strength)
+{
+    const Vec3 position = m_world ? m_position : Vec3(0.0f, 0.0f, 0.0f);
+    const Vec3 scale = m_world ? m_scale : Vec3(1.0f, 1.0f, 1.0f);
+
+    const float cx = (worldPosition.x - position.x) / scale.x;
+    const float cz = (worldPosition.z - position.z) / scale.z;
+    const float rx = radius / scale.x;
+    const float rz = radius / scale.z;
+    const float amount = strength / scale.y;
+
+    const int x0 = Max((int)std::floor(cx - rx), 0);
+    const int z0 = Max((int)std::floor(cz - rz), 0);
+    const int x1 = Min((int)std::ceil(cx + rx), heightmap.GetWidth() - 1);
+    const int z1 = Min((int)std::ceil(cz + rz), heightmap.GetHeight() - 1);
+    const SampleRect edited = {x0, z0, x1, z1};
+    if (edited.IsEmpty())
+        return edited;
+
+    for (int z = z0; z <= z1; ++z)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            const float dx = (x - cx) / rx;
+            const float dz = (z - cz) / rz;
+            const float d = std::sqrt(dx * dx + dz * dz);
+            if (d >= 1.0f)
+                continue;
+            const float falloff = 1.0f - d;
+            const float weight = falloff * falloff * (3.0f - 2.0f * falloff);
+            heightmap.SetHeightValue(x, z, heightmap.GetHeight(x, z) + amount * weight);
+        }
+    }
+
+    MarkDirty(x0, z0, x1, z1);
+    return edited;
+}
+
+int Terrain::Update(Heightmap &heightmap)
+{
+    int rebuilt = 0;
+    for (u32 i = 0; i < chunks.size(); ++i)
+    {
+        if (chunks[i]->IsDirty())
+        {
+            chunks[i]->Rebuild(heightmap);
+            if (i < bounds.size())
+                bounds.set(i, chunks[i]->GetBoundingBox());
+            rebuilt++;
+        }
+    }
+    return rebuilt;
+}
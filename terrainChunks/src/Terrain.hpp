@@ -11,9 +11,20 @@ struct Vertex
     float x, y, z;      // Posição
     float u1, v1;       // Coordenadas para textura principal
     float u2, v2;       // Coordenadas para textura de detalhe
+    float nx, ny, nz;   // Normal
 
 };
 
+const int TERRAIN_VERTEX_STRIDE = sizeof(Vertex) / sizeof(float);
+
+// heightmap samples [x0, x1] x [z0, z1]
+struct SampleRect
+{
+    int x0, z0, x1, z1;
+
+    bool IsEmpty() const { return x0 > x1 || z0 > z1; }
+};
+
 class TerrainChunk
 {
 private:
@@ -22,9 +33,18 @@ private:
     std::vector<float> vertices;
     std::vector<u32> indices;
     BoundingBox boundingBox;
-    int chunkX, chunkZ;  
+    int chunkX, chunkZ;
     MeshBuffer buffer;
 
+    Vec3 position;
+    Vec3 scale;
+    float detailScale;
+    float paintScale;
+    int dirtyStart, dirtyEnd;   // dirty vertex rows, dirtyStart > dirtyEnd when clean
+
+    void buildRows(Heightmap &heightmap, int rowStart, int rowEnd);
+    void updateBounds();
+
 public:
     TerrainChunk(int res, float chunkSize,   int chunkX, int chunkZ);
 
@@ -34,21 +54,35 @@ public:
     void GenerateMesh(Heightmap &heightmap, const Vec3 &position, const Vec3 &scale, float detailScale, float paintScale);
     void Render();
     void Debug(RenderBatch *batch);
+    const BoundingBox &GetBoundingBox() const { return boundingBox; }
+
+    void MarkDirty(float z0, float z1);
+    bool IsDirty() const { return dirtyStart <= dirtyEnd; }
+    void Rebuild(Heightmap &heightmap);
 
 };
 
 
-class Terrain 
+class Terrain
 {
 private:
     std::vector<TerrainChunk*> chunks;
     int chunkResolution;
     float chunkSize;
+    int chunksPerSide;
     float textureDetailScale;
     float texturePaintScale;
     Vec3 m_position;
     Vec3 m_scale;
-    
+    bool m_world;
+
+    // chunk bounds for the batch frustum test, refreshed when a chunk is rebuilt
+    BoxList bounds;
+    std::vector<u32> visible;
+    std::vector<u8> planeCache;
+    u32 visibleCount;
+
+    void updateBounds();
 
 public:
     Terrain(int terrainSize, int chunkResolution, float chunkSize);
@@ -62,4 +96,11 @@ public:
     void Release();
     void Render();
     void Debug(RenderBatch *batch);
+    u32 GetVisibleCount() const { return visibleCount; }
+
+    // editing: changes go to the heightmap, only the touched chunk rows are rebuilt by Update
+    void MarkDirty(int x0, int z0, int x1, int z1);
+    // returns the samples it edited, empty when the brush is off the map
+    SampleRect Sculpt(Heightmap &heightmap, const Vec3 &worldPosition, float radius, float strength);
+    int Update(Heightmap &heightmap);
 };
@@ -14,12 +14,12 @@ int main()
         layout(location = 0) in vec3 aPos;
         layout(location = 1) in vec2 aTex0;
         layout(location = 2) in vec2 aTex1;
-        
- 
+        layout(location = 3) in vec3 aNormal;
         
         
         out vec2 TexCoord0;
         out vec2 TexCoord1;
+        out vec3 Normal;
 
             
         uniform mat4 model;
@@ -33,7 +33,7 @@ int main()
             gl_Position = projection * view * model * vec4( aPos, 1.0);
             TexCoord0 = aTex0;
             TexCoord1 = aTex1;
-            
+            Normal = mat3(model) * aNormal;
         }
     )";
 
@@ -42,7 +42,7 @@ int main()
         
         in vec2 TexCoord0;
         in vec2 TexCoord1;
-        
+        in vec3 Normal;
         
         uniform sampler2D Texture0;
         uniform sampler2D Texture1;
@@ -52,7 +52,9 @@ int main()
         void main()
          {
             
-            FragColor = mix(texture(Texture0, TexCoord0), texture(Texture1, TexCoord1), 0.2);
+            vec4 color = mix(texture(Texture0, TexCoord0), texture(Texture1, TexCoord1), 0.2);
+            float light = max(dot(normalize(Normal), normalize(vec3(0.3, 1.0, 0.2))), 0.0) * 0.7 + 0.3;
+            FragColor = vec4(color.rgb * light, color.a);
         }
     )";
 
@@ -101,8 +103,13 @@ int main()
 
     Terrain terrain(256, 64, 32,Vec3(0.0f, -100.0f, 0.0f),Vec3(5.0f, 8.0f, 5.0f));
     terrain.GenerateMeshWorld(heightmap);
+
+    HeightmapRaycaster raycaster;
+    raycaster.Build(heightmap, Vec3(0.0f, -100.0f, 0.0f), Vec3(5.0f, 8.0f, 5.0f));
     Driver::Instance().SetClearColor(0.1f, 0.1f, 0.1f);
 
+    int rebuiltChunks = 0;
+
      
 
     while (device.Running())
@@ -157,7 +164,20 @@ int main()
             cameraPos += Vec3::Normalize(Vec3::Cross(cameraFront, cameraUp)) * cameraSpeed;
         }
 
-        //  position.x -= 0.1f;
+        // sculpt the ground under the screen centre: R raises, F lowers
+        if (Input::IsKeyDown(SDLK_r) || Input::IsKeyDown(SDLK_f))
+        {
+            TerrainHit hit;
+            Vec3 brush = cameraPos + cameraFront * 60.0f;
+            if (raycaster.Raycast(Ray(cameraPos, cameraFront), hit, 2000.0f))
+                brush = hit.position;
+            float strength = (Input::IsKeyDown(SDLK_r) ? 40.0f : -40.0f) * device.GetFrameTime();
+            // the raycaster reads the same samples, refresh what the brush edited
+            const SampleRect edited = terrain.Sculpt(heightmap, brush, 25.0f, strength);
+            if (!edited.IsEmpty())
+                raycaster.Update(edited.x0, edited.z0, edited.x1, edited.z1);
+        }
+        rebuiltChunks = terrain.Update(heightmap);
 
       
 
@@ -234,6 +254,7 @@ int main()
         u64 triangles = Driver::Instance().GetTotalTriangles();
         u64 vertices = Driver::Instance().GetTotalVertices();
         font.Print(10, 40, "Triangles %ld  Vertices %ld", triangles, vertices);
+        font.Print(10, 60, "Sculpt R/F  rebuilt chunks %d  visible %d", rebuiltChunks, terrain.GetVisibleCount());
         
 
         batch.Render();
@@ -243,6 +264,7 @@ int main()
         device.Swap();
     }
 
+    raycaster.Release();
     terrain.Release();    
     renderShader.Release();
     batch.Release();
@@ -231,10 +231,9 @@ int main()
         Shader *screen = Assets::Instance().GetShader("screen");
         ScreenQuad quad = Driver::Instance().GetScreenQuad();
         screen->Bind();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, rtt.GetColorBuffer(0));
+        Driver::Instance().BindTexture(0, rtt.GetColorBuffer(0));
         quad.Render(0.0f, 0.0f, 1.0f, 1.0f);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().BindTexture(0, 0);
         
         device.Swap();
     }
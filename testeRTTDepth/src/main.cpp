@@ -185,10 +185,9 @@ int main()
         ScreenQuad quad = Driver::Instance().GetScreenQuad();
         screen->Bind();
         screen->SetInt("Depth", 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, rtt.GetDepthTexture());
+        Driver::Instance().BindTexture(0, rtt.GetDepthTexture());
         quad.Render(0.0f, 0.0f, 1.0f, 1.0f);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Driver::Instance().BindTexture(0, 0);
         
         device.Swap();
     }
@@ -129,12 +129,53 @@ int main()
     quadShader.Create(vertexSrc, fragmentSrc);
     quadShader.LoadDefaults();
 
+    // grass clumps are instanced: the wind is applied in world space after
+    // the per instance transform, height from the untransformed clump
+    const char *grassVertexSrc = "#version 330 core\n" INSTANCE_TRS_GLSL R"(
+        layout(location = 0) in vec3 aPos;
+        layout(location = 1) in vec2 aTex;
+        layout(location = 2) in vec3 aNormal;
+
+        out vec2 TexCoord;
+        out vec3 Normal;
+        out vec3 FragPos;
+
+        uniform mat4 view;
+        uniform mat4 projection;
+        uniform float time;
+        uniform vec2 windDirection = vec2(1.0, 0.3);
+        uniform float windStrength = 0.3;
+
+        void main()
+        {
+            vec3 pos = instanceTransform(aPos);
+            if (aPos.y > 0.0)
+            {
+                float windWave = sin(time * 2.0 + pos.x * 0.5 + pos.z * 0.5) * 0.5 + 0.5;
+                float heightFactor = aPos.y / 1.5;
+                pos.x += windDirection.x * windWave * windStrength * heightFactor;
+                pos.z += windDirection.y * windWave * windStrength * heightFactor;
+                pos.y += sin(time * 3.0 + pos.x * 0.5) * 0.05 * heightFactor;
+            }
+
+            FragPos = pos;
+            Normal = instanceRotate(aNormal);
+            TexCoord = aTex;
+            gl_Position = projection * view * vec4(FragPos, 1.0);
+        }
+    )";
+
+    Shader grassShader;
+    grassShader.Create(grassVertexSrc, fragmentSrc);
+    grassShader.LoadDefaults();
+
     RenderBatch batch;
     batch.Init(1, 1024);
     Assets::Instance().SetFlipTexture(false);
     Shader *shader = Assets::Instance().GetShader("default");
-    Texture2D *texture = Assets::Instance().LoadTexture("assets/grass_1024.jpg"); 
-    Texture2D *grasstexture =  Assets::Instance().LoadTexture("assets/grassWalpha.tga");
+    // decoded on the loader threads, bound as the default texture until uploaded
+    Texture2D *texture = Assets::Instance().LoadTextureAsync("assets/grass_1024.jpg"); 
+    Texture2D *grasstexture =  Assets::Instance().LoadTextureAsync("assets/grassWalpha.tga");
     Font font;
   
     font.LoadDefaultFont();
@@ -165,7 +206,6 @@ int main()
  //   Mesh *cube = MeshManager::Instance().CreateCapsule(0.5f, 20, 20, 1.0f);
 
     Mesh *grass = MeshManager::Instance().CreateMesh();
-    Mesh *GrassField = MeshManager::Instance().CreateMesh();
 
     const int GRASS_WIDTH = 1.5;
     const int GRASS_HEIGHT = 1.5;
@@ -219,19 +259,25 @@ int main()
             grass->indices.push_back(off + 0);
         }
 
-    	for (int x = -60; x < 60; x += GRASS_WIDTH)
-		{
-			for (int z = -60; z < 60; z += GRASS_WIDTH)
-			{
-                Quat q = Quat(Vec3(0.0f, 1.0f, 0.0f), RangeRandom(0.0f, 360.0f));
-                Mat4 rotation = q.toMat4();
-                Mat4 scale =Mat4::Scale(Vec3(1.0f, RangeRandom(0.45f, 1.15f), 1.0f));
-                Mat4 position = Mat4::Translate(Vec3(x + RangeRandom(-2,2), 0, z+ RangeRandom(-2,2)));
-                Mat4 transform = scale * rotation * position;
-                GrassField->AddMesh(grass, transform);
-            }
+    std::vector<InstanceTRS> grassField;
+    for (int x = -60; x < 60; x += GRASS_WIDTH)
+    {
+        for (int z = -60; z < 60; z += GRASS_WIDTH)
+        {
+            InstanceTRS clump;
+            clump.position = Vec3(x + RangeRandom(-2, 2), 0, z + RangeRandom(-2, 2));
+            clump.rotation = Quat(Vec3(0.0f, 1.0f, 0.0f), RangeRandom(0.0f, 360.0f));
+            clump.scale = Vec3(1.0f, RangeRandom(0.45f, 1.15f), 1.0f);
+            clump.color = Color::WHITE;
+            grassField.push_back(clump);
         }
- 
+    }
+
+    // the visible clumps are streamed every frame
+    InstanceBuffer grassInstances;
+    grassInstances.Create(INSTANCE_TRS, (u32)grassField.size());
+    grass->SetInstances(&grassInstances);
+
     // MeshManager::Instance().RotateMesh(cube, Vec3(0.0f, 0.0f, 1.0f), 90.0f);
 
     Vec3 lightPosition = Vec3(0.0f, 5.0f, 5.0f);
@@ -241,7 +287,7 @@ int main()
     {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glViewport(0, 0, device.GetWidth(), device.GetHeight());
+        Driver::Instance().SetViewport(0, 0, device.GetWidth(), device.GetHeight());
 
         float cameraSpeed = 5.5f * device.GetFrameTime();
 
@@ -297,15 +343,18 @@ int main()
 
         //  position.x -= 0.1f;
 
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-        glFrontFace(GL_CCW);
+        Driver::Instance().EnableDepthTest(true);
+        Driver::Instance().EnableBlend(false);
+        Driver::Instance().EnableCullFace(true);
+        Driver::Instance().SetCullFace(GL_BACK);
+        Driver::Instance().SetFrontFace(GL_CCW);
 
         Mat4 model;
         Mat4 view = Mat4::LookAt(cameraPos, cameraPos + cameraFront, cameraUp);
         Mat4 projection = Mat4::Perspective(45.0f, (float)device.GetWidth() / (float)device.GetHeight(), 0.1f, 1000.0f);
+        Driver::Instance().SetTransform(VIEW_MATRIX, view);
+        Driver::Instance().SetTransform(PROJECTION_MATRIX, projection);
+        Driver::Instance().UpdateFrustum();
 
         //GeoTerrain terrain(Vec3(1.0f, 1.0f, 1.0f), 5, TERRAIN_PATCH_SIZE::TPS_17, 0.5f);
 
@@ -330,10 +379,27 @@ int main()
         cube->Render(GL_TRIANGLES);
 
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        Driver::Instance().EnableBlend(true);
+        Driver::Instance().SetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        InstanceTRS *visible = (InstanceTRS *)grassInstances.Map((u32)grassField.size());
+        u32 visibleCount = 0;
+        if (visible)
+        {
+            const Vec3 extent(1.0f, 1.75f, 1.0f);
+            for (size_t i = 0; i < grassField.size(); ++i)
+                if (Driver::Instance().IsInFrustum(grassField[i].position - extent, grassField[i].position + extent))
+                    visible[visibleCount++] = grassField[i];
+            grassInstances.Unmap(visibleCount);
+        }
+
+        grassShader.Bind();
+        grassShader.SetMatrix4("view", view.m);
+        grassShader.SetMatrix4("projection", projection.m);
+        grassShader.SetInt("ourTexture", 0);
+        grassShader.SetFloat("lightPos", lightPosition.x, lightPosition.y, lightPosition.z);
+        grassShader.SetFloat("time", device.GetTime());
         grasstexture->Bind(0);
-        GrassField->Render(GL_TRIANGLES);
+        grass->RenderInstanced(GL_TRIANGLES);
 
        
         shader->Bind();
@@ -356,15 +422,18 @@ int main()
         shader->SetMatrix4("projection", projection.m);
         
 
-        glEnable(GL_BLEND);
-        glDisable(GL_CULL_FACE);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDisable(GL_DEPTH_TEST);
+        Driver::Instance().EnableBlend(true);
+        Driver::Instance().EnableCullFace(false);
+        Driver::Instance().SetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        Driver::Instance().EnableDepthTest(false);
 
         batch.SetColor(1, 1, 1);
         font.SetSize(16);
 
         font.Print(10, 20, " %d  %f",device.GetFPS(),device.GetFrameTime());
+        font.Print(10, 40, "Grass %u / %u", visibleCount, (u32)grassField.size());
+        if (texture->IsLoading() || grasstexture->IsLoading())
+            font.Print(10, 60, "Loading textures %u", Assets::Instance().GetTextureLoader().GetPendingCount());
 
         batch.Render();
 
@@ -372,6 +441,8 @@ int main()
     }
 
     
+    grassInstances.Release();
+    grassShader.Release();
     quadShader.Release();
     batch.Release();
     font.Release();
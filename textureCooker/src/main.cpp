@@ -0,0 +1,79 @@
+#include "Core.hpp"
+#include "TextureFile.hpp"
+#include <chrono>
+#include <cstring>
+
+//
+// Offline texture cooker: image in, .btex out, mip chain included.
+//
+//   textureCooker <input image> <output.btex> [format] [-nomips] [-flip]
+//
+// format: r8 rg8 rgb8 rgba8 bc1 bc3 bc4 bc5 bc7 (default bc1 for images
+// without alpha, bc3 with alpha)
+//
+
+static void usage()
+{
+    printf("usage: textureCooker <input image> <output.btex> [r8|rg8|rgb8|rgba8|bc1|bc3|bc4|bc5|bc7] [-nomips] [-flip]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    int format = -1;
+    bool mipmaps = true;
+    bool flip = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-nomips") == 0)
+        {
+            mipmaps = false;
+            continue;
+        }
+        if (strcmp(argv[i], "-flip") == 0)
+        {
+            flip = true;
+            continue;
+        }
+        bool matched = false;
+        for (int f = 0; f < TEXTURE_FILE_FORMAT_COUNT; ++f)
+            if (strcmp(argv[i], TextureFormatName((TextureFileFormat)f)) == 0)
+            {
+                format = f;
+                matched = true;
+            }
+        if (!matched)
+        {
+            printf("unknown option %s\n", argv[i]);
+            usage();
+            return 1;
+        }
+    }
+
+    Pixmap image;
+    if (!image.Load(argv[1]))
+        return 1;
+    if (flip)
+        image.FlipVertical();
+    if (format < 0)
+        format = image.components == 2 || image.components == 4 ? TEXTURE_FILE_BC3 : TEXTURE_FILE_BC1;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<u8> file;
+    if (!CookTexture(image, (TextureFileFormat)format, mipmaps, file))
+        return 1;
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!SaveTextureFile(argv[2], file))
+        return 1;
+
+    const size_t source = (size_t)image.width * image.height * image.components;
+    printf("%s -> %s  %dx%d %s  %u bytes (source level 0: %u bytes)  %.1f ms\n", argv[1], argv[2], image.width, image.height,
+           TextureFormatName((TextureFileFormat)format), (u32)file.size(), (u32)source, ms);
+    return 0;
+}